@@ -42,6 +42,7 @@ typedef struct _qt_blocking_queue_node_s {
     syscall_t                         op;
     uintptr_t                         args[5];
     ssize_t                           ret;
+    int                               err; /* errno, when ret < 0 */
 } qt_blocking_queue_node_t;
 
 typedef struct qthread_addrstat_s {
@@ -50,7 +51,7 @@ typedef struct qthread_addrstat_s {
     qthread_addrres_t    *FEQ;
     qthread_addrres_t    *FFQ;
 #ifdef QTHREAD_FEB_PROFILING
-    qtimer_t              empty_timer;
+    qtimer_local_t        empty_timer;
 #endif
     uint_fast8_t          full;
     uint_fast8_t          valid;
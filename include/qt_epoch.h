@@ -0,0 +1,67 @@
+#ifndef QT_EPOCH_H
+#define QT_EPOCH_H
+
+#include "qt_visibility.h"
+#include "qt_hazardptrs.h"      /* for hazardous_free_f */
+
+/*
+ * Epoch-based (quiescent-state) memory reclamation: an alternative to hazard
+ * pointers for the lock-free data structures, selected with
+ * --with-reclamation=epoch. Workers need not announce what they are reading;
+ * every time a worker goes back to qthread_master() to fetch its next task it
+ * holds no references into any of these structures, which is a quiescent
+ * state. Nodes retired in global epoch e are freed once the global epoch
+ * reaches e + 2, which can only happen after every worker has passed through
+ * a quiescent state (or been idle) since the node was retired.
+ *
+ * A qthread must therefore not block or yield between reading a pointer out
+ * of one of these structures and finishing with it. Threads that are not
+ * qthreads bracket their operations with qt_epoch_enter()/qt_epoch_exit().
+ */
+
+#define QT_EPOCH_BAGS 3         /* one per epoch that may still hold unsafe nodes */
+
+typedef struct {
+    hazardous_free_f freefunc;
+    void            *ptr;
+} qt_epoch_entry_t;
+
+typedef struct {
+    aligned_t         epoch;   /* the global epoch these nodes were retired in */
+    size_t            count;
+    size_t            size;
+    qt_epoch_entry_t *entries;
+} qt_epoch_bag_t;
+
+typedef struct {
+    /* 0 while offline (between tasks), otherwise the last global epoch seen */
+    volatile aligned_t epoch;
+    qt_epoch_bag_t     bags[QT_EPOCH_BAGS];
+} qt_epoch_worker_t;
+
+#ifdef QTHREAD_EPOCH_RECLAMATION
+struct qthread_worker_s;
+
+void INTERNAL initialize_epochs(void);
+void INTERNAL qt_epoch_offline(struct qthread_worker_s *w);
+void INTERNAL qt_epoch_online(struct qthread_worker_s *w);
+void INTERNAL qt_epoch_enter(void);
+void INTERNAL qt_epoch_exit(void);
+void INTERNAL qt_epoch_retire(hazardous_free_f freefunc,
+                              void            *ptr);
+
+/* Lock-free data structures protect and retire nodes through these, so that
+ * they follow the reclamation scheme chosen at configure time. */
+# define QT_SMR_ENTER()             qt_epoch_enter()
+# define QT_SMR_EXIT()              qt_epoch_exit()
+# define QT_SMR_PROTECT(which, ptr) do { } while (0)
+# define QT_SMR_RETIRE(func, ptr)   qt_epoch_retire((func), (ptr))
+#else
+# define QT_SMR_ENTER()             do { } while (0)
+# define QT_SMR_EXIT()              do { } while (0)
+# define QT_SMR_PROTECT(which, ptr) hazardous_ptr((which), (ptr))
+# define QT_SMR_RETIRE(func, ptr)   hazardous_release_node((func), (ptr))
+#endif /* ifdef QTHREAD_EPOCH_RECLAMATION */
+
+#endif // ifndef QT_EPOCH_H
+/* vim:set expandtab: */
@@ -3,6 +3,7 @@
 
 #include "qt_visibility.h"
 #include "qt_qthread_t.h"
+#include "qt_teams.h"
 
 /* Unexpected task destruction/cleanup */
 void INTERNAL qthread_internal_assassinate(qthread_t *t);
@@ -12,4 +13,9 @@ void INTERNAL qt_eureka_end_criticalsect_dead(qthread_t *self);
 void INTERNAL qt_eureka_check(int block);
 void INTERNAL qt_eureka_disable(void);
 
+/* Spawns a task into the given team, marked as a watcher */
+int INTERNAL qthread_internal_spawn_watcher(qthread_f  f,
+                                            void      *arg,
+                                            qt_team_t *team);
+
 #endif
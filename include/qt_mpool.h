@@ -2,6 +2,7 @@
 #define QT_MPOOL_H
 
 #include <stddef.h>                    /* for size_t (according to C89) */
+#include <qthread/qpool.h>             /* for qpool_stats_t */
 
 typedef struct qt_mpool_s *qt_mpool;
 
@@ -14,9 +15,24 @@ void qt_mpool_free(qt_mpool pool,
 
 qt_mpool qt_mpool_create_aligned(size_t       item_size,
                                  const size_t alignment);
+#ifdef QTHREAD_GUARD_PAGES
+qt_mpool qt_mpool_create_guarded(size_t item_size,
+                                 size_t guard_lo,
+                                 size_t guard_hi);
+#endif
 void qt_mpool_destroy(qt_mpool pool);
 
+size_t qt_mpool_num_nodes(qt_mpool pool);
+int    qt_mpool_stats(qt_mpool       pool,
+                      size_t         node,
+                      qpool_stats_t *stats);
+size_t qt_mpool_trim(qt_mpool pool);
+void   qt_mpool_set_soft_cap(qt_mpool pool,
+                             size_t   bytes);
+size_t qt_mpool_trim_all(void);
+
 void qt_mpool_subsystem_init(void);
+void qt_mpool_subsystem_nodes_init(void);
 
 #endif // ifndef QT_MPOOL_H
 /* vim:set expandtab: */
@@ -17,6 +17,17 @@
 #define ARGCOPY_DEFAULT   1024
 #define TASKLOCAL_DEFAULT 8
 
+/* Copied arguments are rounded up to a power-of-two size class, from 32
+ * bytes to 8KB, each with its own pool. Arguments up to ARGCOPY_SIZE are
+ * stored inside the qthread_t (QTHREAD_BIG_STRUCT), larger ones in a separate
+ * pooled buffer (QTHREAD_HAS_ARGCOPY); only arguments over 8KB are malloc'ed. */
+#define QTHREAD_ARGCOPY_MIN_SHIFT     5
+#define QTHREAD_ARGCOPY_MAX_SHIFT     13
+#define QTHREAD_ARGCOPY_CLASSES       (QTHREAD_ARGCOPY_MAX_SHIFT - QTHREAD_ARGCOPY_MIN_SHIFT + 1)
+#define QTHREAD_ARGCOPY_CLASS_SIZE(c) ((size_t)1 << ((c) + QTHREAD_ARGCOPY_MIN_SHIFT))
+#define QTHREAD_ARGCOPY_MAX           QTHREAD_ARGCOPY_CLASS_SIZE(QTHREAD_ARGCOPY_CLASSES - 1)
+#define QTHREAD_ARGCOPY_UNPOOLED      0xff
+
 /* flags (must be different bits) */
 #define QTHREAD_FUTURE           (1 << 0)
 #define QTHREAD_REAL_MCCOY       (1 << 1)
@@ -91,9 +102,15 @@ struct qthread_s {
     qthread_shepherd_id_t      target_shepherd; /* the shepherd we'd rather run on; set to NO_SHEPHERD unless the thread either migrated or was spawned to a specific destination (aka the programmer expressed a desire for this thread to be somewhere) */
     uint16_t                   flags;           /* may not need all bits */
     uint8_t                    thread_state : 4;
+    uint8_t                    argcopy_class;   /* size class of the argument copy, if any */
 
     Q_ALIGNED(8) uint8_t data[]; /* this is where we stick argcopy and tasklocal data */
 };
 
+/* The default task-local storage follows the inline argument copy, if any */
+#define QTHREAD_TASKLOCAL_DATA(t)                                                       \
+    ((void *)&(t)->data[((t)->flags & QTHREAD_BIG_STRUCT) ?                             \
+                        QTHREAD_ARGCOPY_CLASS_SIZE((t)->argcopy_class) : 0])
+
 #endif // ifndef QT_QTHREAD_STRUCT_H
 /* vim:set expandtab: */
@@ -9,6 +9,7 @@
 #include "qt_atomics.h"
 #include "qt_threadqueues.h"
 #include "qt_hazardptrs.h"
+#include "qt_epoch.h"
 #include "qt_macros.h"
 
 #ifdef QTHREAD_SHEPHERD_PROFILING
@@ -35,6 +36,9 @@ typedef struct qthread_shepherd_s qthread_shepherd_t;
 struct qthread_worker_s {
     uintptr_t                 hazard_ptrs[HAZARD_PTRS_PER_SHEP]; /* hazard pointers (see http://portal.acm.org/citation.cfm?id=987524.987595) */
     hazard_freelist_t         hazard_free_list;
+#ifdef QTHREAD_EPOCH_RECLAMATION
+    qt_epoch_worker_t         epoch; /* announced epoch and retired nodes */
+#endif
     pthread_t                 worker;
     qthread_shepherd_t       *shepherd;
     struct qthread_s        **nostealbuffer;
@@ -44,6 +48,10 @@ struct qthread_worker_s {
     qthread_worker_id_t       worker_id;
     qthread_worker_id_t       packed_worker_id;
     Q_ALIGNED(8) uint_fast8_t QTHREAD_CASLOCK(active);
+    /* qthread_random() state, padded onto a cache line of its own */
+    uint8_t                   rand_pad1[CACHELINE_WIDTH];
+    uint64_t                  rand_state;
+    uint8_t                   rand_pad2[CACHELINE_WIDTH];
 };
 typedef struct qthread_worker_s qthread_worker_t;
 
@@ -68,6 +76,8 @@ struct qthread_shepherd_s {
     unsigned int          *shep_dists;
     qthread_shepherd_id_t *sorted_sheplist;
     unsigned int           stealing; /* True when a worker is in the steal (attempt) process OR if stealing disabled*/
+    size_t                 steal_last_victim; /* index into sorted_sheplist of the last successful steal */
+    size_t                 spawn_domain; /* this shepherd plus the nearest tier of sorted_sheplist */
 #ifdef QTHREAD_OMP_AFFINITY
     unsigned int           stealing_mode; /* Specifies when a shepherd may steal */
 #endif
@@ -79,6 +89,14 @@ struct qthread_shepherd_s {
     size_t steal_elected;
     size_t steal_attempted;
     size_t steal_failed;
+    size_t steal_remote;        /* successful steals beyond the nearest distance tier */
+    size_t park_count;          /* times a worker gave up spinning and slept */
+    size_t wake_count;          /* times a parked worker was signalled awake */
+    double wake_latency;        /* total time from signal to wakeup */
+    double wake_maxlatency;     /* max time from signal to wakeup */
+    size_t spawn_placed;        /* unpinned tasks spawned onto this shepherd */
+    size_t spawn_remote;        /* ...of which were spawned from another shepherd */
+    size_t spawn_maxqueue;      /* longest queue seen when placing a task here */
 #endif
 #ifdef QTHREAD_SHEPHERD_PROFILING
     qtimer_t total_time;        /* how much time the shepherd spent running */
@@ -136,9 +154,17 @@ static QINLINE qthread_worker_t *qthread_internal_getworker(void)
     return (qthread_worker_t *)TLS_GET(shepherd_structs);
 }
 
+void INTERNAL                  qthread_internal_worker_seed(qthread_worker_t *w);
 unsigned int INTERNAL qthread_internal_shep_to_node(const qthread_shepherd_id_t shep);
 qthread_shepherd_t INTERNAL *qthread_find_active_shepherd(qthread_shepherd_id_t *l,
                                                           unsigned int          *d);
+void INTERNAL                  qthread_spawn_placement_init(void);
+qthread_shepherd_id_t INTERNAL qthread_spawn_place(qthread_shepherd_t *curr_shep,
+                                                   unsigned int        feature_flag,
+                                                   const void         *hint);
+#ifdef STEAL_PROFILE
+void INTERNAL qthread_spawn_placement_stat(void);
+#endif
 
 void qthread_back_to_master(qthread_t *t);
 void qthread_back_to_master2(qthread_t *t);
@@ -0,0 +1,20 @@
+#ifndef QT_SINC_POOL_H
+#define QT_SINC_POOL_H
+
+#include "qthread/sinc.h"
+#include "qt_visibility.h"
+
+/* Sincs are made and thrown away often (every team makes two), so the sinc
+ * implementations get their sincs, and whatever else they need, from pools
+ * rather than from malloc. Storage comes in whole cache lines, cache-line
+ * aligned, from one pool per number of lines; requests too big for any pool go
+ * to the aligned allocator. */
+void INTERNAL       qt_sinc_subsystem_init(void);
+qt_sinc_t INTERNAL *qt_sinc_internal_alloc(void);
+void INTERNAL       qt_sinc_internal_free(qt_sinc_t *sinc);
+void INTERNAL      *qt_sinc_internal_storage_alloc(size_t bytes);
+void INTERNAL       qt_sinc_internal_storage_free(void  *storage,
+                                                  size_t bytes);
+
+#endif // ifndef QT_SINC_POOL_H
+/* vim:set expandtab: */
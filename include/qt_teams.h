@@ -24,25 +24,32 @@
 
 #define QTHREAD_TEAM_RET_MASK (QTHREAD_TEAM_RET_IS_SYNCVAR | QTHREAD_TEAM_RET_IS_SINC)
 
-/* internal signalling macros */
-#define TEAM_SIGNAL_ISEXIT(team_id)   (((saligned_t)team_id) > 1)
-#define TEAM_SIGNAL_ISEUREKA(team_id) (((saligned_t)team_id) < 0)
-#define TEAM_SIGNAL_SENDERID(team_id) (labs(team_id))
-#define TEAM_SIGNAL_EXIT(team_id)     (team_id)
-#define TEAM_SIGNAL_EUREKA(team_id)   (-1 * (saligned_t)(team_id))
+#ifdef QTHREAD_USE_EUREKAS
+/* where a subteam stands with respect to eurekas from its parent */
+#define QT_TEAM_OPEN    0 /* a parent's eureka may still be delivered */
+#define QT_TEAM_EUREKA  1 /* a parent's eureka is on its way in */
+#define QT_TEAM_CLOSING 2 /* the leader is finishing; no more deliveries */
+#endif /* QTHREAD_USE_EUREKAS */
 
 typedef struct qt_team_s {
-    aligned_t    eureka;
-    aligned_t    eureka_lock;
-    aligned_t   *parent_eureka;
-    unsigned int team_id;
-    aligned_t    watcher_started;
-    qt_sinc_t   *sinc;
-    qt_sinc_t   *subteams_sinc;
-    unsigned int parent_id;
-    qt_sinc_t   *parent_subteams_sinc;
-    void        *return_loc;
-    uint_fast8_t flags;
+    aligned_t         eureka_lock;
+    unsigned int      team_id;
+    qt_sinc_t        *sinc;
+    qt_sinc_t        *subteams_sinc;
+    unsigned int      parent_id;
+    qt_sinc_t        *parent_subteams_sinc;
+#ifdef QTHREAD_USE_EUREKAS
+    /* Live subteams are kept on a list in their parent, so that a eureka in
+     * the parent can be handed on to them when (and only when) it happens */
+    struct qt_team_s *parent;
+    struct qt_team_s *subteams;
+    struct qt_team_s *next_subteam;
+    struct qt_team_s *prev_subteam;
+    aligned_t         subteams_lock;
+    aligned_t         eureka_state;
+#endif /* QTHREAD_USE_EUREKAS */
+    void             *return_loc;
+    uint_fast8_t      flags;
 } qt_team_t;
 
 void INTERNAL qt_internal_teams_init(void);
@@ -53,6 +60,8 @@ qt_team_t INTERNAL *qt_internal_team_new(void *restrict      ret,
                                          unsigned int        feature_flag,
                                          qt_team_t *restrict curr_team,
                                          unsigned int        parent_id);
-void INTERNAL qt_internal_subteam_leader(qthread_t *t);
+#ifdef QTHREAD_USE_EUREKAS
+void INTERNAL qt_internal_team_eureka_subteams(qt_team_t *team);
+#endif /* QTHREAD_USE_EUREKAS */
 #endif // ifndef QT_TEAMS_H
 /* vim:set expandtab: */
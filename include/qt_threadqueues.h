@@ -28,8 +28,23 @@ void INTERNAL qt_threadqueue_filter(qt_threadqueue_t       *q,
                                     qt_threadqueue_filter_f f);
 void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
                                      qthread_t *restrict        t);
+void INTERNAL qt_threadqueue_enqueue_many(qt_threadqueue_t *restrict q,
+                                          qthread_t *const          *t,
+                                          size_t                     n);
 void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                              qthread_t *restrict        t);
+
+/* qt_threadqueue_enqueue_many() for schedulers with no cheaper way to take a
+ * batch than one task at a time */
+static QINLINE void qt_threadqueue_enqueue_each(qt_threadqueue_t *restrict q,
+                                                qthread_t *const          *t,
+                                                size_t                     n)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_enqueue(q, t[i]);
+    }
+} /*}}}*/
+
 void INTERNAL qt_threadqueue_enqueue_cache(qt_threadqueue_t         *q,
                                            qt_threadqueue_private_t *cache);
 int INTERNAL qt_threadqueue_private_enqueue(qt_threadqueue_private_t *restrict pq,
@@ -16,8 +16,12 @@ struct tlrw_lock;
 typedef int (*qt_dict_key_equals_f)(void *,
                                     void *);
 typedef int (*qt_dict_hash_f)(void *);
+typedef uint64_t (*qt_dict_hash64_f)(void *);
 typedef void (*qt_dict_cleanup_f)(void *,
                                   void *);
+typedef void (*qt_dict_for_each_f)(void *key,
+                                   void *value,
+                                   void *arg);
 
 struct list_entry {
     void              *value;
@@ -46,6 +50,16 @@ qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
                                     qt_dict_hash_f       hash,
                                     qt_dict_cleanup_f    cleanup);
 
+/*
+ *      Same as qt_dictionary_create, but with a hashcode function that returns
+ * 64 bits, all of which are used:
+ *
+ * the signature of the qt_dict_hash64_f function is: uint64_t my_hashcode(void* key)
+ */
+qt_dictionary *qt_dictionary_create64(qt_dict_key_equals_f eq,
+                                      qt_dict_hash64_f     hash,
+                                      qt_dict_cleanup_f    cleanup);
+
 /*
  *      Destroys the dictionary d
  *      d must be empty (keys and values must have been cleaned up already (or else, leaks)
@@ -98,11 +112,52 @@ void *qt_dictionary_get(qt_dictionary *dict,
 void *qt_dictionary_delete(qt_dictionary *dict,
                            void          *key);
 
+/*
+ *      Looks up n keys at once; values[i] is set to the value for keys[i], or
+ *      to NULL if it was not present. The keys are hashed up front, so that
+ *      their buckets can be prefetched and, where the dictionary uses locks,
+ *      keys that share a lock are looked up under one acquisition.
+ *      returns:
+ *                      the number of keys that were found
+ */
+size_t qt_dictionary_get_many(qt_dictionary *dict,
+                              size_t         n,
+                              void *const   *keys,
+                              void         **values);
+
+/*
+ *      Inserts n key, value pairs, as qt_dictionary_put would, batching the
+ *      work the same way as qt_dictionary_get_many. If results is not NULL,
+ *      results[i] is set to what qt_dictionary_put would have returned for
+ *      keys[i].
+ *      returns:
+ *                      the number of pairs that were stored (i.e. did not fail)
+ */
+size_t qt_dictionary_put_many(qt_dictionary *dict,
+                              size_t         n,
+                              void *const   *keys,
+                              void *const   *values,
+                              void         **results);
+
+/*
+ *      Calls f(key, value, arg) once for every entry in the dictionary. The
+ *      buckets are divided among the shepherds with qt_loop_balance, so f may
+ *      run concurrently with itself and must not insert into or delete from
+ *      dict. Entries inserted or deleted concurrently by other tasks may or
+ *      may not be visited.
+ */
+void qt_dictionary_for_each(qt_dictionary     *dict,
+                            qt_dict_for_each_f f,
+                            void              *arg);
+
 /*
  *      Creates a new iterator on the dictionary dict
  *      returns:
  *                      addr - address of new iterator if creation was successful
  *                      ERROR - if an error occurred
+ *      Note: The default (simple) dictionary does not grow while any iterator
+ *                on it is alive, so that no entry is returned twice; destroy
+ *                iterators promptly.
  *
  */
 qt_dictionary_iterator *qt_dictionary_iterator_create(qt_dictionary *dict);
@@ -15,6 +15,8 @@ typedef void (*qt_loopr_f)(const size_t   startat,
                            void *restrict ret);
 typedef void (*qt_accum_f)(void *restrict       a,
                            const void *restrict b);
+typedef int (*qt_filter_f)(const void *elem,
+                           void       *arg);
 
 typedef struct qqloop_handle_s qqloop_handle_t;
 typedef struct qqloop_step_handle_s qqloop_step_handle_t;
@@ -100,6 +102,40 @@ void qt_loopaccum_balance_dc(const size_t     start,
                              const qt_loopr_f func,
                              void *restrict   argptr,
                              const qt_accum_f acc);
+void qt_loop_lbs(const size_t    start,
+                 const size_t    stop,
+                 const qt_loop_f func,
+                 void           *argptr);
+void qt_loopaccum_lbs(const size_t     start,
+                      const size_t     stop,
+                      const size_t     size,
+                      void *restrict   out,
+                      const qt_loopr_f func,
+                      void *restrict   argptr,
+                      const qt_accum_f acc);
+
+typedef enum {QT_SCAN_INCLUSIVE, QT_SCAN_EXCLUSIVE} qt_scan_type;
+void qt_loop_scan(const void *restrict in,
+                  void *restrict       out,
+                  const size_t         length,
+                  const size_t         size,
+                  const qt_accum_f     acc,
+                  const void *restrict identity,
+                  const qt_scan_type   type);
+void qt_loop_reduce_by_key(const size_t *restrict keys,
+                           const void *restrict   values,
+                           const size_t           length,
+                           const size_t           size,
+                           void *restrict         out,
+                           const size_t           nkeys,
+                           const qt_accum_f       acc,
+                           const void *restrict   identity);
+size_t qt_loop_filter(const void *restrict in,
+                      void *restrict       out,
+                      const size_t         length,
+                      const size_t         size,
+                      const qt_filter_f    pred,
+                      void *restrict       argptr);
 
 typedef enum {CHUNK, GUIDED, FACTORED, TIMED} qt_loop_queue_type;
 qqloop_handle_t *qt_loop_queue_create(const qt_loop_queue_type type,
@@ -177,6 +213,35 @@ aligned_t qt_uint_min(aligned_t *array,
                       size_t     length,
                       int        checkfeb);
 
+void qt_double_prefix_sum(const double *in,
+                          double       *out,
+                          size_t        length,
+                          qt_scan_type  type);
+void qt_int_prefix_sum(const saligned_t *in,
+                       saligned_t       *out,
+                       size_t            length,
+                       qt_scan_type      type);
+void qt_uint_prefix_sum(const aligned_t *in,
+                        aligned_t       *out,
+                        size_t           length,
+                        qt_scan_type     type);
+
+void qt_double_sum_by_key(const size_t *keys,
+                          const double *values,
+                          size_t        length,
+                          double       *out,
+                          size_t        nkeys);
+void qt_int_sum_by_key(const size_t     *keys,
+                       const saligned_t *values,
+                       size_t            length,
+                       saligned_t       *out,
+                       size_t            nkeys);
+void qt_uint_sum_by_key(const size_t    *keys,
+                        const aligned_t *values,
+                        size_t           length,
+                        aligned_t       *out,
+                        size_t           nkeys);
+
 /* These are some utility accumulator functions */
 static Q_UNUSED void qt_dbl_add_acc(void *restrict       a,
                                     const void *restrict b)
@@ -20,6 +20,26 @@ qpool *qpool_create_aligned(const size_t item_size,
 
 void qpool_destroy(qpool *pool);
 
+/* Counters for one memory domain (NUMA node) of a pool; see qpool_stats(3) */
+typedef struct qpool_stats_s {
+    size_t hits;         /* allocations served from a thread's own cache */
+    size_t refills;      /* batches taken from the domain's shared free list */
+    size_t spills;       /* batches of local frees put on that list */
+    size_t remote_frees; /* items freed in other domains and sent back here */
+    size_t blocks;       /* blocks of items this domain holds now */
+    size_t bytes;        /* bytes allocated in this domain */
+    size_t trimmed;      /* blocks given back to the system */
+} qpool_stats_t;
+
+size_t qpool_num_nodes(qpool *pool);
+int    qpool_stats(qpool         *pool,
+                   size_t         node,
+                   qpool_stats_t *stats);
+
+size_t qpool_trim(qpool *pool);
+void   qpool_set_soft_cap(qpool *pool,
+                          size_t bytes);
+
 Q_ENDCXX /* */
 
 #endif // ifndef QPOOL_H
@@ -284,7 +284,10 @@ enum _qthread_features {
     SPAWN_PC_SYNCVAR_T,
     SPAWN_AGGREGABLE,
     SPAWN_COUNT,
-    SPAWN_LOCAL_PRIORITY
+    SPAWN_LOCAL_PRIORITY,
+    SPAWN_PLACE_P2C,
+    SPAWN_PLACE_DOMAIN,
+    SPAWN_PLACE_OWNER
 };
 
 #define QTHREAD_SPAWN_PARENT        (1 << SPAWN_PARENT)
@@ -297,6 +300,9 @@ enum _qthread_features {
 #define QTHREAD_SPAWN_PC_SYNCVAR_T  (1 << SPAWN_PC_SYNCVAR_T)
 #define QTHREAD_SPAWN_AGGREGABLE    (1 << SPAWN_AGGREGABLE)
 #define QTHREAD_SPAWN_LOCAL_PRIORITY (1 << SPAWN_LOCAL_PRIORITY)
+#define QTHREAD_SPAWN_PLACE_P2C     (1 << SPAWN_PLACE_P2C)
+#define QTHREAD_SPAWN_PLACE_DOMAIN  (1 << SPAWN_PLACE_DOMAIN)
+#define QTHREAD_SPAWN_PLACE_OWNER   (1 << SPAWN_PLACE_OWNER)
 
 int qthread_spawn(qthread_f             f,
                   const void           *arg,
@@ -306,6 +312,13 @@ int qthread_spawn(qthread_f             f,
                   void                 *preconds,
                   qthread_shepherd_id_t target_shep,
                   unsigned int          feature_flag);
+int qthread_spawn_many(size_t                n,
+                       const qthread_f      *f,
+                       void *const          *args,
+                       size_t                arg_size,
+                       void *const          *rets,
+                       qthread_shepherd_id_t target_shep,
+                       unsigned int          feature_flag);
 
 /* This is a function to move a thread from one shepherd to another. */
 int qthread_migrate_to(const qthread_shepherd_id_t shepherd);
@@ -325,6 +338,7 @@ qthread_shepherd_id_t qthread_shep(void);
 qthread_worker_id_t   qthread_worker(qthread_shepherd_id_t *s);
 qthread_worker_id_t   qthread_worker_unique(qthread_shepherd_id_t *s);
 qthread_worker_id_t   qthread_worker_local(qthread_shepherd_id_t *s);
+unsigned long         qthread_random(void);
 #ifdef QTHREAD_USE_ROSE_EXTENSIONS
 unsigned                          qthread_barrier_id(void);
 struct qthread_parallel_region_s *qt_parallel_region(void);
@@ -340,6 +354,7 @@ void *   qthread_get_tasklocal(unsigned int);
 unsigned qthread_size_tasklocal(void);
 
 size_t     qthread_stackleft(void);
+size_t     qthread_trim_memory(void);
 aligned_t *qthread_retloc(void);
 int        qthread_shep_ok(void);
 void       qthread_shep_next(qthread_shepherd_id_t *shep);
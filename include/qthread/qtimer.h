@@ -2,11 +2,20 @@
 #define QTHREAD_TIMER
 
 #include <qthread/macros.h>
+#include <qthread/qthread-int.h> /* for uint64_t */
 
 Q_STARTCXX /* */
 
 typedef struct qtimer_s *qtimer_t;
 
+/* A timer that needs no qtimer_create() or qtimer_destroy(): it can live on
+ * the stack or inside another structure. It holds raw ticks of the underlying
+ * clock, which qtimer_ticks_secs() turns into seconds. */
+typedef struct qtimer_local_s {
+    uint64_t start;
+    uint64_t stop;
+} qtimer_local_t;
+
 unsigned long qtimer_fastrand(void);
 double        qtimer_wtime(void);
 double        qtimer_res(void);
@@ -17,6 +26,13 @@ void     qtimer_start(qtimer_t);
 void     qtimer_stop(qtimer_t);
 double   qtimer_secs(qtimer_t);
 
+uint64_t qtimer_ticks(void);
+double   qtimer_ticks_secs(uint64_t ticks);
+
+#define qtimer_local_start(t) ((t)->start = qtimer_ticks())
+#define qtimer_local_stop(t)  ((t)->stop = qtimer_ticks())
+#define qtimer_local_secs(t)  qtimer_ticks_secs((t)->stop - (t)->start)
+
 Q_ENDCXX /* */
 
 #endif // ifndef QTHREAD_TIMER
@@ -46,6 +46,36 @@ saligned_t qutil_int_min(const saligned_t *array,
                          size_t            length,
                          int               checkfeb);
 
+/* These compute the sum of the squares of the entries of an array */
+double qutil_double_sumsq(const double *array,
+                          size_t        length,
+                          int           checkfeb);
+aligned_t qutil_uint_sumsq(const aligned_t *array,
+                           size_t           length,
+                           int              checkfeb);
+saligned_t qutil_int_sumsq(const saligned_t *array,
+                           size_t            length,
+                           int               checkfeb);
+/* These return the index of the first largest/smallest entry of an array */
+size_t qutil_double_argmax(const double *array,
+                           size_t        length,
+                           int           checkfeb);
+size_t qutil_double_argmin(const double *array,
+                           size_t        length,
+                           int           checkfeb);
+size_t qutil_uint_argmax(const aligned_t *array,
+                         size_t           length,
+                         int              checkfeb);
+size_t qutil_uint_argmin(const aligned_t *array,
+                         size_t           length,
+                         int              checkfeb);
+size_t qutil_int_argmax(const saligned_t *array,
+                        size_t            length,
+                        int               checkfeb);
+size_t qutil_int_argmin(const saligned_t *array,
+                        size_t            length,
+                        int               checkfeb);
+
 void qutil_mergesort(double *array,
                      size_t  length);
 void qutil_qsort(double *array,
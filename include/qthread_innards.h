@@ -24,6 +24,12 @@
 #include "qt_threadqueues.h"
 #include "qt_hash.h"
 
+/* a lock alone on its cacheline(s), for arrays of contended locks */
+typedef struct qt_padded_lock_s {
+    QTHREAD_FASTLOCK_TYPE lock;
+    char                  pad[CACHELINE_WIDTH - (sizeof(QTHREAD_FASTLOCK_TYPE) % CACHELINE_WIDTH)];
+} qt_padded_lock_t;
+
 #ifdef CAS_STEAL_PROFILE
 // stripe this array across a cache line
 # define CAS_STEAL_PROFILE_LENGTH (CACHELINE_WIDTH / sizeof(uint64_t))
@@ -109,7 +115,7 @@ typedef struct qlib_s {
 #if defined(QTHREAD_MUTEX_INCREMENT) ||             \
     (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32) || \
     (QTHREAD_ASSEMBLY_ARCH == QTHREAD_SPARCV9_32)
-    QTHREAD_FASTLOCK_TYPE *atomic_locks;
+    qt_padded_lock_t      *atomic_locks;
 # ifdef QTHREAD_COUNT_THREADS
     aligned_t             *atomic_stripes;
     QTHREAD_FASTLOCK_TYPE *atomic_stripes_locks;
@@ -128,6 +134,20 @@ typedef struct qlib_s {
 
 extern qlib_t qlib;
 
+/* The FEB, syncvar, and emulated-atomic tables are split into this many
+ * stripes (a power of two), chosen in qthread_initialize(). */
+extern unsigned int QTHREAD_LOCKING_STRIPES;
+
+/* Fibonacci hashing of the word address; unlike taking its low bits, this
+ * spreads strided arrays across all of the stripes. */
+static QINLINE unsigned int qt_choose_stripe(const void *addr)
+{   /*{{{*/
+    const uint64_t h = ((uint64_t)(uintptr_t)addr / sizeof(aligned_t)) * UINT64_C(0x9E3779B97F4A7C15);
+
+    return (unsigned int)(h >> 32) & (QTHREAD_LOCKING_STRIPES - 1);
+} /*}}}*/
+#define QTHREAD_CHOOSE_STRIPE(addr) qt_choose_stripe((const void *)(addr))
+
 void INTERNAL qthread_exec(qthread_t    *t,
                            qt_context_t *c);
 
@@ -20,9 +20,11 @@ my %config = (
     mutexfifo     => '--with-scheduler=mutexfifo',
     mtsfifo       => '--with-scheduler=mtsfifo',
     nottingham    => '--with-scheduler=nottingham',
+    chaselev      => '--with-scheduler=chaselev',
     rose          => '--enable-interfaces=rose --enable-timer-progs --enable-rose-extensions --enable-hpctoolkit-support --with-scheduler=sherwood --with-topology=hwloc --disable-lf-febs',
     slowcontext   => '--disable-fastcontext',
     shavit        => '--with-dict=shavit',
+    epoch         => '--with-reclamation=epoch',
     shep_profile  => '--enable-profiling=shepherd',
     lock_profile  => '--enable-profiling=feb',
     steal_profile => '--enable-profiling=steal',
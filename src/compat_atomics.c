@@ -8,9 +8,6 @@
 #include "qthread_innards.h"
 #include "qt_profiling.h"
 
-extern unsigned int QTHREAD_LOCKING_STRIPES;
-#define QTHREAD_CHOOSE_STRIPE(addr) (((size_t)addr >> 4) & (QTHREAD_LOCKING_STRIPES - 1))
-
 #if defined(QTHREAD_MUTEX_INCREMENT) ||             \
     (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32) || \
     (QTHREAD_ASSEMBLY_ARCH == QTHREAD_SPARCV9_32)
@@ -27,10 +24,10 @@ uint32_t qthread_incr32_(uint32_t     *op,
     QTHREAD_COUNT_THREADS_BINCOUNTER(atomic, stripe);
     QTHREAD_FEB_UNIQUERECORD(incr, op, qthread_internal_self());
     QTHREAD_FEB_TIMER_START(incr);
-    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe].lock));
     retval = *op;
     *op   += incr;
-    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe].lock));
     QTHREAD_FEB_TIMER_STOP(incr, qthread_internal_self());
     return retval;
 }                      /*}}} */
@@ -48,10 +45,10 @@ uint64_t qthread_incr64_(uint64_t     *op,
     QTHREAD_COUNT_THREADS_BINCOUNTER(atomic, stripe);
     QTHREAD_FEB_UNIQUERECORD(incr, op, qthread_internal_self());
     QTHREAD_FEB_TIMER_START(incr);
-    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe].lock));
     retval = *op;
     *op   += incr;
-    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe].lock));
     QTHREAD_FEB_TIMER_STOP(incr, qthread_internal_self());
     return retval;
 }                      /*}}} */
@@ -64,10 +61,10 @@ double qthread_dincr_(double      *op,
 
     assert(qthread_library_initialized);
 
-    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe].lock));
     retval = *op;
     *op   += incr;
-    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe].lock));
     return retval;
 }                      /*}}} */
 
@@ -79,10 +76,10 @@ float qthread_fincr_(float      *op,
 
     assert(qthread_library_initialized);
 
-    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe].lock));
     retval = *op;
     *op   += incr;
-    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe].lock));
     return retval;
 }                      /*}}} */
 
@@ -95,12 +92,12 @@ uint32_t qthread_cas32_(uint32_t      *operand,
 
     assert(qthread_library_initialized);
 
-    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe].lock));
     retval = *operand;
     if (retval == oldval) {
         *operand = newval;
     }
-    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe].lock));
     return retval;
 }                      /*}}} */
 
@@ -113,12 +110,12 @@ uint64_t qthread_cas64_(uint64_t      *operand,
 
     assert(qthread_library_initialized);
 
-    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_LOCK(&(qlib->atomic_locks[stripe].lock));
     retval = *operand;
     if (retval == oldval) {
         *operand = newval;
     }
-    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe]));
+    QTHREAD_FASTLOCK_UNLOCK(&(qlib->atomic_locks[stripe].lock));
     return retval;
 }                      /*}}} */
 
@@ -11,12 +11,15 @@
 #include <qthread/qthread.h> /* for qthread_incr() and qthread_cas() */
 #include <qthread/qpool.h>
 #include <qthread/dictionary.h>
+#include <qthread/qloop.h>
 
 /* Internal Headers */
 #include "qt_asserts.h"
 #include "qt_debug.h"
 #include "qt_atomics.h"
 #include "qt_aligned_alloc.h"
+#include "qt_prefetch.h"
+#include "qt_epoch.h"
 
 /*
  * The hash table in this file is based on the work by Ori Shalev and Nir Shavit
@@ -31,6 +34,7 @@
  */
 
 #define MAX_LOAD 4
+#define BATCH    32 /* keys hashed and prefetched at a time by the _many calls */
 // #define USE_HASHWORD 1
 
 #ifdef USE_HASHWORD
@@ -64,6 +68,20 @@ static size_t hard_max_buckets = NO_BUCKETS;
 /* ... pools */
 static qpool *hash_entry_pool = NULL;
 
+/* Entries unlinked from a list may still be in use by a concurrent find
+ * unless epoch-based reclamation is configured, in which case they are only
+ * returned to the pool once no operation can still be looking at them. */
+#ifdef QTHREAD_EPOCH_RECLAMATION
+static void hash_entry_free(void *e)
+{
+    qpool_free(hash_entry_pool, e);
+}
+
+# define RETIRE_ENTRY(e) qt_epoch_retire(hash_entry_free, (e))
+#else
+# define RETIRE_ENTRY(e) qpool_free(hash_entry_pool, (e))
+#endif
+
 typedef struct list_entry hash_entry;
 // So: list_entry* = hash_entry*
 // (other typedef found in dictionary.h)
@@ -74,6 +92,7 @@ struct qt_dictionary {
     size_t               size;   // Crt number of buckets (doubling if load per bucket too much)
     qt_dict_key_equals_f op_equals;
     qt_dict_hash_f       op_hash;
+    qt_dict_hash64_f     op_hash64; // used instead of op_hash if not NULL
     qt_dict_cleanup_f    op_cleanup;
 };
 // So: qt_dictionary* = qt_hash
@@ -198,7 +217,7 @@ static int qt_lf_list_delete(marked_ptr_t        *head,
             if (cleanup != NULL) {
                 cleanup(PTR_OF(lcur)->key, NULL);
             }
-            qpool_free(hash_entry_pool, PTR_OF(lcur));
+            RETIRE_ENTRY(PTR_OF(lcur));
         } else {
             qt_lf_list_find(head, hashed_key, key, NULL, NULL, NULL, op_equals);                                   // needs to set cur/prev/next
         }
@@ -264,7 +283,7 @@ static void *qt_lf_list_find(marked_ptr_t        *head,
                 prev = (marked_ptr_t *)&(PTR_OF(cur)->next);
             } else {
                 if (qthread_cas(prev, CONSTRUCT(0, cur), CONSTRUCT(0, next)) == CONSTRUCT(0, cur)) {
-                    qpool_free(hash_entry_pool, PTR_OF(cur));
+                    RETIRE_ENTRY(PTR_OF(cur));
                 } else {
                     break;
                 }
@@ -274,6 +293,20 @@ static void *qt_lf_list_find(marked_ptr_t        *head,
     }
 }
 
+static inline key_t qt_hash_key(qt_hash        h,
+                                const qt_key_t key)
+{
+    key_t lkey;
+
+    if (h->op_hash64 != NULL) {
+        lkey = h->op_hash64(key);
+    } else {
+        lkey = (uint64_t)(uintptr_t)(h->op_hash(key));
+    }
+    HASH_KEY(lkey);
+    return lkey;
+}
+
 static inline so_key_t so_regularkey(const key_t key)
 {
     return REVERSE(key | MSB);
@@ -287,18 +320,31 @@ static inline so_key_t so_dummykey(const key_t key)
 #define PUT_ALWAYS    0
 #define PUT_IF_ABSENT 1
 
-// old public method; added last param to distinguish between put and put if absent
-static inline hash_entry *qt_hash_put(qt_hash  h,
-                                      qt_key_t key,
-                                      void    *value,
-                                      int      put_choice)
+/* Counts n new entries, growing the table if they overloaded it. */
+static inline void qt_hash_count_added(qt_hash h,
+                                       size_t  n)
+{
+    size_t csize = h->size;
+
+    if ((qthread_incr(&h->count, n) + n - 1) / csize > MAX_LOAD) {
+        if (2 * csize <= hard_max_buckets) { // this caps the size of the hash
+            qthread_cas(&h->size, csize, 2 * csize);
+        }
+    }
+}
+
+/* Inserts without counting; *added is set if the entry must be counted. */
+static inline void *qt_hash_put_uncounted(qt_hash  h,
+                                          qt_key_t key,
+                                          void    *value,
+                                          int      put_choice,
+                                          uint64_t lkey,
+                                          int     *added)
 {
     hash_entry *node = qpool_alloc(hash_entry_pool);
     hash_entry *ret  = node;
     size_t      bucket;
-    uint64_t    lkey = (uint64_t)(uintptr_t)(h->op_hash(key));
 
-    HASH_KEY(lkey);
     bucket = lkey % h->size;
 
     assert(node);
@@ -315,33 +361,53 @@ static inline hash_entry *qt_hash_put(qt_hash  h,
     if(put_choice == PUT_IF_ABSENT) {
         if (!qt_lf_list_insert(&(h->B[bucket]), node, NULL, &ret, h->op_equals)) {
             qpool_free(hash_entry_pool, node);
+            *added = 0;
             return ret->value;
         }
     } else {
         qt_lf_force_list_insert(&(h->B[bucket]), node, h->op_equals);
     }
+    *added = 1;
+    return ret->value;
+}
 
-    size_t csize = h->size;
-    if (qthread_incr(&h->count, 1) / csize > MAX_LOAD) {
-        if (2 * csize <= hard_max_buckets) { // this caps the size of the hash
-            qthread_cas(&h->size, csize, 2 * csize);
-        }
+// old public method; added last param to distinguish between put and put if absent
+static inline void *qt_hash_put(qt_hash  h,
+                                qt_key_t key,
+                                void    *value,
+                                int      put_choice)
+{
+    int   added;
+    void *ret = qt_hash_put_uncounted(h, key, value, put_choice, qt_hash_key(h, key), &added);
+
+    if (added) {
+        qt_hash_count_added(h, 1);
     }
-    return ret->value;
+    return ret;
 }
 
 void *qt_dictionary_put(qt_dictionary *dict,
                         void          *key,
                         void          *value)
 {
-    return qt_hash_put(dict, key, value, PUT_ALWAYS);
+    void *ret;
+
+    QT_SMR_ENTER();
+    ret = qt_hash_put(dict, key, value, PUT_ALWAYS);
+    QT_SMR_EXIT();
+    return ret;
 }
 
 void *qt_dictionary_put_if_absent(qt_dictionary *dict,
                                   void          *key,
                                   void          *value)
 {
-    return qt_hash_put(dict, key, value, PUT_IF_ABSENT);
+    void *ret;
+
+    QT_SMR_ENTER();
+    ret = qt_hash_put(dict, key, value, PUT_IF_ABSENT);
+    QT_SMR_EXIT();
+    return ret;
 }
 
 // old public method
@@ -349,9 +415,8 @@ static inline void *qt_hash_get(qt_hash        h,
                                 const qt_key_t key)
 {
     size_t   bucket;
-    uint64_t lkey = (uint64_t)(uintptr_t)(h->op_hash(key));
+    uint64_t lkey = qt_hash_key(h, key);
 
-    HASH_KEY(lkey);
     bucket = lkey % h->size;
 
     if (h->B[bucket] == UNINITIALIZED) {
@@ -366,7 +431,96 @@ static inline void *qt_hash_get(qt_hash        h,
 void *qt_dictionary_get(qt_dictionary *dict,
                         void          *key)
 {
-    return qt_hash_get(dict, key);
+    void *ret;
+
+    QT_SMR_ENTER();
+    ret = qt_hash_get(dict, key);
+    QT_SMR_EXIT();
+    return ret;
+}
+
+/* Hashes a batch of keys and touches the start of each key's bucket (for a
+ * table of csize buckets), so that the list walks that follow overlap their
+ * cache misses. */
+static void qt_hash_batch_prepare(qt_hash      h,
+                                  void *const *keys,
+                                  size_t       n,
+                                  size_t       csize,
+                                  uint64_t    *lkeys)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        size_t bucket;
+
+        lkeys[i] = qt_hash_key(h, keys[i]);
+        bucket   = lkeys[i] % csize;
+        if (h->B[bucket] == UNINITIALIZED) {
+            initialize_bucket(h, bucket);
+        }
+        Q_PREFETCH(PTR_OF(h->B[bucket]));
+    }
+    for (i = 0; i < n; i++) {
+        Q_PREFETCH(PTR_OF((marked_ptr_t)PTR_OF(h->B[lkeys[i] % csize])->next));
+    }
+}
+
+size_t qt_dictionary_get_many(qt_dictionary *dict,
+                              size_t         n,
+                              void *const   *keys,
+                              void         **values)
+{
+    uint64_t lkeys[BATCH];
+    size_t   found = 0;
+
+    QT_SMR_ENTER();
+    for (size_t base = 0; base < n; base += BATCH) {
+        size_t const bn    = (n - base < BATCH) ? (n - base) : BATCH;
+        size_t const csize = dict->size;
+
+        qt_hash_batch_prepare(dict, keys + base, bn, csize, lkeys);
+        for (size_t i = 0; i < bn; i++) {
+            // a bucket index computed from an older size is still valid
+            values[base + i] = qt_lf_list_find(&(dict->B[lkeys[i] % csize]), so_regularkey(lkeys[i]),
+                                               keys[base + i], NULL, NULL, NULL, dict->op_equals);
+            if (values[base + i] != NULL) { found++; }
+        }
+    }
+    QT_SMR_EXIT();
+    return found;
+}
+
+size_t qt_dictionary_put_many(qt_dictionary *dict,
+                              size_t         n,
+                              void *const   *keys,
+                              void *const   *values,
+                              void         **results)
+{
+    uint64_t lkeys[BATCH];
+    size_t   stored = 0;
+
+    QT_SMR_ENTER();
+    for (size_t base = 0; base < n; base += BATCH) {
+        size_t const bn    = (n - base < BATCH) ? (n - base) : BATCH;
+        size_t       added = 0;
+
+        qt_hash_batch_prepare(dict, keys + base, bn, dict->size, lkeys);
+        for (size_t i = 0; i < bn; i++) {
+            int   a;
+            void *ret = qt_hash_put_uncounted(dict, keys[base + i], values[base + i],
+                                              PUT_ALWAYS, lkeys[i], &a);
+
+            if (results != NULL) { results[base + i] = ret; }
+            if (ret != NULL) { stored++; }
+            added += a;
+        }
+        // one update of the shared element count per batch
+        if (added) {
+            qt_hash_count_added(dict, added);
+        }
+    }
+    QT_SMR_EXIT();
+    return stored;
 }
 
 // old public method
@@ -374,9 +528,8 @@ static inline int qt_hash_remove(qt_hash        h,
                                  const qt_key_t key)
 {
     size_t   bucket;
-    uint64_t lkey = (uint64_t)(uintptr_t)(h->op_hash(key));
+    uint64_t lkey = qt_hash_key(h, key);
 
-    HASH_KEY(lkey);
     bucket = lkey % h->size;
 
     if (h->B[bucket] == UNINITIALIZED) {
@@ -392,8 +545,13 @@ static inline int qt_hash_remove(qt_hash        h,
 void *qt_dictionary_delete(qt_dictionary *dict,
                            void          *key)
 {
-    void *val = qt_hash_get(dict, key);     // TODO : this is inefficient!
-    int   ret = qt_hash_remove(dict, key);
+    void *val;
+    int   ret;
+
+    QT_SMR_ENTER();
+    val = qt_hash_get(dict, key);     // TODO : this is inefficient!
+    ret = qt_hash_remove(dict, key);
+    QT_SMR_EXIT();
 
     if(ret) { return val; } else { return NULL; }
 }
@@ -454,6 +612,7 @@ static inline qt_hash qt_hash_create(qt_dict_key_equals_f eq,
     assert(tmp);
     tmp->op_equals  = eq;
     tmp->op_hash    = hash;
+    tmp->op_hash64  = NULL;
     tmp->op_cleanup = cleanup;
 
     assert(tmp);
@@ -480,6 +639,16 @@ qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
     return qt_hash_create(eq, hash, cleanup);
 }
 
+qt_dictionary *qt_dictionary_create64(qt_dict_key_equals_f eq,
+                                      qt_dict_hash64_f     hash,
+                                      qt_dict_cleanup_f    cleanup)
+{
+    qt_hash tmp = qt_hash_create(eq, NULL, cleanup);
+
+    tmp->op_hash64 = hash;
+    return tmp;
+}
+
 // old public method
 static inline void qt_hash_destroy(qt_hash h)
 {
@@ -556,6 +725,56 @@ void qt_dictionary_destroy(qt_dictionary *d)
  * }
  */
 
+typedef struct for_each_args_s {
+    qt_hash            h;
+    qt_dict_for_each_f f;
+    void              *arg;
+} for_each_args_t;
+
+/* The dummy node of every initialized bucket starts the run of entries that
+ * belong to it (and to any uninitialized buckets that split from it), which
+ * ends at the next dummy; regular keys are the ones with the low bit set.
+ * Racing initialize_bucket() calls can leave more than one dummy for the same
+ * bucket next to each other, so only a dummy of another bucket ends the run. */
+static void qt_hash_for_each_range(const size_t startat,
+                                   const size_t stopat,
+                                   void        *arg_)
+{
+    for_each_args_t *arg = (for_each_args_t *)arg_;
+    qt_hash          h   = arg->h;
+
+    QT_SMR_ENTER();
+    for (size_t bucket = startat; bucket < stopat; bucket++) {
+        marked_ptr_t cursor = h->B[bucket];
+        so_key_t     dummy_key;
+
+        if (cursor == UNINITIALIZED) { continue; }
+        dummy_key = PTR_OF(cursor)->hashed_key;
+        cursor    = (marked_ptr_t)(PTR_OF(cursor)->next);
+        while (PTR_OF(cursor) != NULL) {
+            hash_entry  *e    = PTR_OF(cursor);
+            marked_ptr_t next = (marked_ptr_t)(e->next);
+
+            if ((e->hashed_key & 1) == 0) {
+                if (e->hashed_key != dummy_key) { break; }
+            } else if (!MARK_OF(next)) { // skip entries that are being deleted
+                arg->f(e->key, e->value, arg->arg);
+            }
+            cursor = next;
+        }
+    }
+    QT_SMR_EXIT();
+}
+
+void qt_dictionary_for_each(qt_dictionary     *dict,
+                            qt_dict_for_each_f f,
+                            void              *arg)
+{
+    for_each_args_t fe = { dict, f, arg };
+
+    qt_loop_balance(0, dict->size, qt_hash_for_each_range, &fe);
+}
+
 struct qt_dictionary_iterator {
     qt_dictionary *dict;
     list_entry    *crt; // =NULL if iterator is newly created or reached the end; =crt elem otherwise.
@@ -1,27 +1,95 @@
-#include <qthread/dictionary.h>
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
 #include <assert.h>
 #include <stdio.h>
-#include <limits.h>          // using CHAR_BIT
-#include <qthread/qthread.h> // using CAS_ptr, qthread_worker_unique and qthread_num_workers
-#include <56reader-rwlock.h> // using rwlock_*
+#include <string.h>          /* for memset() */
+
+/* Qthreads Headers */
+#include <qthread/qthread.h> /* for qthread_incr(), qthread_cas() and qthread_num_workers() */
+#include <qthread/dictionary.h>
+#include <qthread/qloop.h>
 
+/* Internal Headers */
 #include "qt_asserts.h"
+#include "qt_atomics.h"
 #include "qt_debug.h"
+#include "qt_aligned_alloc.h"
+#include "qt_expect.h"
+#include "qt_prefetch.h"
+
+/*
+ * A chained hash table that starts small and doubles as it fills.
+ *
+ * Buckets are protected by an array of stripe locks; bucket b of any table is
+ * covered by stripe (b & smask). Tables are never smaller than the number of
+ * stripes, so when a table doubles, old bucket b and the two new buckets it
+ * splits into (b and b + oldsize) are all covered by the same stripe. That
+ * lets each old bucket be migrated on its own, under one stripe lock, the
+ * first time an operation touches it or when a writer is asked to help; there
+ * is never a stop-the-world rehash. The only operations that take every stripe
+ * lock are installing a new table and retiring the old one once it is empty,
+ * which happens twice per doubling and does no rehashing.
+ *
+ * Growth is decided per stripe: a stripe that holds more than its share of
+ * DICT_MAX_LOAD entries per bucket triggers a resize, so there is no shared
+ * element counter for writers to fight over.
+ *
+ * A doubling that started in the middle of an iteration would move entries
+ * the iterator has already returned into buckets it has yet to visit, so no
+ * new doubling starts while an iterator is alive; chains just get longer
+ * until the last one is destroyed. A resize that was already under way is
+ * finished as usual, since migration only ever moves entries forward.
+ */
+
+#define DICT_MAX_LOAD    1    /* average chain length before the table doubles */
+#define DICT_MIN_BUCKETS 16
+#define DICT_MAX_STRIPES 128
+#define DICT_HELP_CHUNK  8    /* old buckets migrated by each writer during a resize */
+#define DICT_BATCH       32   /* keys hashed and grouped by stripe at a time by the _many calls */
+
+/* marks an old bucket whose entries have been moved to the new table */
+#define DICT_MIGRATED ((list_entry *)(uintptr_t)1)
+
+#define DICT_ITER_START ((size_t)-1)
+#define DICT_ITER_END   ((size_t)-2)
+
+typedef struct dict_table_s {
+    size_t      mask;      /* buckets - 1 */
+    list_entry *buckets[];
+} dict_table;
+
+#define DICT_TABLE_SIZE(n) (sizeof(dict_table) + (n) * sizeof(list_entry *))
+
+typedef struct dict_stripe_s {
+    QTHREAD_TRYLOCK_TYPE lock;
+    size_t               count; /* entries in this stripe's buckets */
+    char                 pad[CACHELINE_WIDTH - ((sizeof(QTHREAD_TRYLOCK_TYPE) + sizeof(size_t)) % CACHELINE_WIDTH)];
+} dict_stripe;
 
 struct qt_dictionary {
     qt_dict_key_equals_f op_equals;
     qt_dict_hash_f       op_hash;
+    qt_dict_hash64_f     op_hash64; /* used instead of op_hash if not NULL */
     qt_dict_cleanup_f    op_cleanup;
-    list_entry         **content;
-#ifdef DELETE_SUPPORT
-    struct tlrw_lock    *lock;
-#endif
+    /* cur and old only change while every stripe lock is held */
+    dict_table *volatile cur;
+    dict_table *volatile old;      /* being migrated into cur, or NULL */
+    volatile size_t      old_size; /* buckets in old, 0 when not resizing */
+    aligned_t            cursor;   /* next old bucket to hand to a helper */
+    aligned_t            migrated; /* old buckets moved so far */
+    aligned_t            resizing; /* set from the decision to grow until old is retired */
+    aligned_t            iterators; /* live iterators; no doubling starts while nonzero */
+    size_t               smask;    /* stripes - 1 */
+    dict_stripe         *stripes;
 };
 
 struct qt_dictionary_iterator {
     qt_dictionary *dict;
     list_entry    *crt;
-    int            bkt;
+    size_t         bkt;
 };
 
 /* Prototype should NOT go in header, we don't want it public*/
@@ -30,107 +98,249 @@ void *qt_dictionary_put_helper(qt_dictionary *dict,
                                void          *value,
                                char           put_type);
 
-#ifdef DELETE_SUPPORT
-
-// Handle the case when variable does not exist;
-// Locks become nops when qthread is no longer initialized
-# ifdef QTHREAD_NO_ASSERTS
-static int qthread_library_initialized = 1;
-# endif
-
-# define rlock(a)                                                                       \
-    {                                                                                   \
-        if(qthread_library_initialized == 1) {                                          \
-            int id = qthread_worker_unique(NULL);                                       \
-            /* this if protects against crash when using after qthreads was finalized*/ \
-            /* if qthreads is finalized, use sequential semantics */                    \
-            if (id < MAX_READERS) {                                                     \
-                rwlock_rdlock(a, id); }                                                 \
-        }                                                                               \
-    }
-
-# define runlock(a)                               \
-    {                                             \
-        if(qthread_library_initialized == 1) {    \
-            int id = qthread_worker_unique(NULL); \
-            if (id < MAX_READERS) {               \
-                rwlock_rdunlock(a, id); }         \
-        }                                         \
-    }
-# define wlock(a)                                 \
-    {                                             \
-        if(qthread_library_initialized == 1) {    \
-            int id = qthread_worker_unique(NULL); \
-            if (id < MAX_READERS) {               \
-                rwlock_wrlock(a, id); }           \
-        }                                         \
-    }
-
-# define wunlock(a)                               \
-    {                                             \
-        if(qthread_library_initialized == 1) {    \
-            int id = qthread_worker_unique(NULL); \
-            if (id < MAX_READERS) {               \
-                rwlock_wrunlock(a); }             \
-        }                                         \
-    }
-# define rwlinit(a)                                                                  \
-    {                                                                                \
-        /* fail instead of silently accepting more readers than we can handle*/      \
-        /* setting the number of workers dynamically to be larger than MAX_READERS*/ \
-        /* is not checked, so don't do it! */                                        \
-        assert(qthread_num_workers() < MAX_READERS);                                 \
-        a = (rwlock_t *)MALLOC(sizeof(rwlock_t));                                    \
-        rwlock_init(a);                                                              \
-    }
-# define rwlfree(a)                \
-    {                              \
-        FREE(a, sizeof(rwlock_t)); \
-    }
-#else /* ifdef DELETE_SUPPORT */
-# define rlock(a)
-# define runlock(a)
-# define wlock(a)
-# define wunlock(a)
-# define rwlinit(a)
-# define rwlfree(a)
-#endif /* ifdef DELETE_SUPPORT */
-
-// #define DICT_ABS(v) ((+1 | (v>>(sizeof(int)*CHAR_BIT-1)))*v)
-#define DICT_ABS(v) ((v > 0) ? v : (-v))
-
-#define GET_BUCKET(hash) ((DICT_ABS(hash)) & ((1 << BKT_POW) - 1))
-
 #ifndef QTHREAD_NO_ASSERTS
 extern int qthread_library_initialized;
 #endif
 
-qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
-                                    qt_dict_hash_f       hash,
-                                    qt_dict_cleanup_f    cleanup)
-{
+/* User hash functions often have poor low bits, so the result is mixed before
+ * it is masked; every step is invertible, so distinct 64-bit hashes stay
+ * distinct. */
+static QINLINE uint64_t dict_hash(const qt_dictionary *dict,
+                                  void                *key)
+{   /*{{{*/
+    uint64_t h;
+
+    if (dict->op_hash64 != NULL) {
+        h  = dict->op_hash64(key);
+        h ^= h >> 32;
+    } else {
+        h = (uint64_t)(unsigned int)dict->op_hash(key);
+    }
+    h *= 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+} /*}}}*/
+
+static dict_table *dict_table_new(size_t nbuckets)
+{   /*{{{*/
+    dict_table *t = MALLOC(DICT_TABLE_SIZE(nbuckets));
+
+    if (t != NULL) {
+        t->mask = nbuckets - 1;
+        memset(t->buckets, 0, nbuckets * sizeof(list_entry *));
+    }
+    return t;
+} /*}}}*/
+
+/* Stripe locks are taken by spinning on trylock rather than by queueing: a
+ * fair (ticket) lock hands itself to the next waiter even when that waiter's
+ * worker is not running, and a task that touches the same stripe twice in a
+ * row then waits out the other worker's whole timeslice. */
+static QINLINE void dict_stripe_lock(dict_stripe *s)
+{   /*{{{*/
+    while (!QTHREAD_TRYLOCK_TRY(&s->lock)) {
+        SPINLOCK_BODY();
+    }
+} /*}}}*/
+
+static void dict_lock_all(qt_dictionary *dict)
+{   /*{{{*/
+    for (size_t i = 0; i <= dict->smask; i++) {
+        dict_stripe_lock(&dict->stripes[i]);
+    }
+} /*}}}*/
+
+static void dict_unlock_all(qt_dictionary *dict)
+{   /*{{{*/
+    for (size_t i = dict->smask + 1; i > 0; i--) {
+        QTHREAD_TRYLOCK_UNLOCK(&dict->stripes[i - 1].lock);
+    }
+} /*}}}*/
+
+/* Moves old bucket b into the current table. The stripe lock covering b must
+ * be held. Returns 1 if the bucket had not been migrated yet. */
+static int dict_migrate_bucket(qt_dictionary *dict,
+                               size_t         b)
+{   /*{{{*/
+    dict_table *old  = dict->old;
+    dict_table *cur  = dict->cur;
+    list_entry *walk = old->buckets[b];
+
+    if (walk == DICT_MIGRATED) { return 0; }
+    while (walk != NULL) {
+        list_entry  *next = walk->next;
+        list_entry **dst  = &cur->buckets[walk->hashed_key & cur->mask];
+
+        walk->next = *dst;
+        *dst       = walk;
+        walk       = next;
+    }
+    old->buckets[b] = DICT_MIGRATED;
+    return 1;
+} /*}}}*/
+
+/* Frees the old table once every bucket has left it. */
+static void dict_retire(qt_dictionary *dict)
+{   /*{{{*/
+    dict_table *old;
+
+    dict_lock_all(dict);
+    old            = dict->old;
+    dict->old      = NULL;
+    dict->old_size = 0;
+    dict_unlock_all(dict);
+    FREE(old, DICT_TABLE_SIZE(old->mask + 1));
+    dict->resizing = 0;
+} /*}}}*/
+
+/* Records migrations made while a stripe lock was held; must be called after
+ * releasing it. */
+static QINLINE void dict_account(qt_dictionary *dict,
+                                 size_t         moved,
+                                 size_t         old_size)
+{   /*{{{*/
+    if (moved && (qthread_incr(&dict->migrated, moved) + moved == old_size)) {
+        dict_retire(dict);
+    }
+} /*}}}*/
+
+static void dict_grow(qt_dictionary *dict)
+{   /*{{{*/
+    /* only the thread that set dict->resizing gets here, so cur is stable */
+    size_t const nbuckets = (dict->cur->mask + 1) * 2;
+    dict_table  *t        = dict_table_new(nbuckets);
+
+    if (t == NULL) {
+        /* keep working with longer chains */
+        dict->resizing = 0;
+        return;
+    }
+    dict_lock_all(dict);
+    if (dict->iterators != 0) {
+        /* an iterator was created since the decision to grow */
+        dict_unlock_all(dict);
+        FREE(t, DICT_TABLE_SIZE(nbuckets));
+        dict->resizing = 0;
+        return;
+    }
+    dict->cursor   = 0;
+    dict->migrated = 0;
+    dict->old      = dict->cur;
+    dict->old_size = nbuckets / 2;
+    dict->cur      = t;
+    dict_unlock_all(dict);
+} /*}}}*/
+
+/* Migrates a few more old buckets, so a resize finishes even if most old
+ * buckets are never touched again. */
+static void dict_help_resize(qt_dictionary *dict)
+{   /*{{{*/
+    size_t const hint = dict->old_size;
+    size_t       first, moved = 0, old_size = 0;
+
+    if ((hint == 0) || (dict->cursor >= hint)) { return; }
+    first = qthread_incr(&dict->cursor, DICT_HELP_CHUNK);
+    for (size_t b = first; b < first + DICT_HELP_CHUNK; b++) {
+        dict_stripe *s = &dict->stripes[b & dict->smask];
+
+        dict_stripe_lock(s);
+        if ((dict->old != NULL) && (b <= dict->old->mask)) {
+            old_size = dict->old_size;
+            moved   += dict_migrate_bucket(dict, b);
+        }
+        QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+    }
+    dict_account(dict, moved, old_size);
+} /*}}}*/
+
+/* Locks the stripe for hash h and makes sure h's bucket in the current table
+ * holds everything that hashes there. If that required migrating an old
+ * bucket, *old_size is set to the old table's size for dict_unlock_hash(). */
+static QINLINE dict_stripe *dict_lock_hash(qt_dictionary *dict,
+                                           uint64_t       h,
+                                           dict_table   **cur,
+                                           size_t        *old_size)
+{   /*{{{*/
+    dict_stripe *s = &dict->stripes[h & dict->smask];
+
+    dict_stripe_lock(s);
+    *old_size = 0;
+    if (QTHREAD_UNLIKELY(dict->old != NULL)) {
+        if (dict_migrate_bucket(dict, h & dict->old->mask)) {
+            *old_size = dict->old_size;
+        }
+    }
+    *cur = dict->cur;
+    return s;
+} /*}}}*/
+
+static QINLINE void dict_unlock_hash(qt_dictionary *dict,
+                                     dict_stripe   *s,
+                                     size_t         old_size)
+{   /*{{{*/
+    QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+    dict_account(dict, (old_size != 0), old_size);
+} /*}}}*/
+
+static qt_dictionary *dict_create(qt_dict_key_equals_f eq,
+                                  qt_dict_hash_f       hash,
+                                  qt_dict_hash64_f     hash64,
+                                  qt_dict_cleanup_f    cleanup)
+{   /*{{{*/
     assert(qthread_library_initialized && "Need to initialize qthreads before using the dictionary");
     qt_dictionary *ret = (qt_dictionary *)MALLOC(sizeof(qt_dictionary));
+    size_t         nstripes = 1;
+
+    if (ret == NULL) { return NULL; }
+    while (nstripes < 2 * (size_t)qthread_num_workers() && nstripes < DICT_MAX_STRIPES) {
+        nstripes <<= 1;
+    }
     ret->op_equals  = eq;
     ret->op_hash    = hash;
+    ret->op_hash64  = hash64;
     ret->op_cleanup = cleanup;
-    ret->content    = (list_entry **)MALLOC(NO_BUCKETS * sizeof(list_entry *));
-
-    int i;
-    for (i = 0; i < NO_BUCKETS; i++) {
-        ret->content[i] = NULL;
+    ret->old        = NULL;
+    ret->old_size   = 0;
+    ret->cursor     = 0;
+    ret->migrated   = 0;
+    ret->resizing   = 0;
+    ret->iterators  = 0;
+    ret->smask      = nstripes - 1;
+    ret->cur        = dict_table_new((nstripes > DICT_MIN_BUCKETS) ? nstripes : DICT_MIN_BUCKETS);
+    ret->stripes    = qthread_internal_aligned_alloc(nstripes * sizeof(dict_stripe), CACHELINE_WIDTH);
+    if ((ret->cur == NULL) || (ret->stripes == NULL)) {
+        if (ret->cur) { FREE(ret->cur, DICT_TABLE_SIZE(ret->cur->mask + 1)); }
+        if (ret->stripes) { qthread_internal_aligned_free(ret->stripes, CACHELINE_WIDTH); }
+        FREE(ret, sizeof(qt_dictionary));
+        return NULL;
+    }
+    for (size_t i = 0; i < nstripes; i++) {
+        QTHREAD_TRYLOCK_INIT(ret->stripes[i].lock);
+        ret->stripes[i].count = 0;
     }
-
-    rwlinit(ret->lock);
     return ret;
+} /*}}}*/
+
+qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
+                                    qt_dict_hash_f       hash,
+                                    qt_dict_cleanup_f    cleanup)
+{
+    return dict_create(eq, hash, NULL, cleanup);
 }
 
-void qt_dictionary_destroy(qt_dictionary *d)
+qt_dictionary *qt_dictionary_create64(qt_dict_key_equals_f eq,
+                                      qt_dict_hash64_f     hash,
+                                      qt_dict_cleanup_f    cleanup)
 {
-    int i;
+    return dict_create(eq, NULL, hash, cleanup);
+}
+
+static void dict_table_destroy(qt_dictionary *d,
+                               dict_table    *t)
+{   /*{{{*/
+    for (size_t i = 0; i <= t->mask; i++) {
+        list_entry *tmp, *top = t->buckets[i];
 
-    for (i = 0; i < NO_BUCKETS; i++) {
-        list_entry *tmp, *top = d->content[i];
+        if (top == DICT_MIGRATED) { continue; }
         while (top != NULL) {
             tmp = top;
             top = top->next;
@@ -140,133 +350,95 @@ void qt_dictionary_destroy(qt_dictionary *d)
             FREE(tmp, sizeof(list_entry));
         }
     }
-    FREE(d->content, NO_BUCKETS * sizeof(list_entry *));
-    rwlfree(d->lock);
+    FREE(t, DICT_TABLE_SIZE(t->mask + 1));
+} /*}}}*/
+
+void qt_dictionary_destroy(qt_dictionary *d)
+{
+    dict_table_destroy(d, d->cur);
+    if (d->old) {
+        dict_table_destroy(d, d->old);
+    }
+    for (size_t i = 0; i <= d->smask; i++) {
+        QTHREAD_TRYLOCK_DESTROY(d->stripes[i].lock);
+    }
+    qthread_internal_aligned_free(d->stripes, CACHELINE_WIDTH);
     FREE(d, sizeof(qt_dictionary));
 }
 
 #define PUT_ALWAYS    0
 #define PUT_IF_ABSENT 1
 
-#define DICTIONARY_ADD_TO_HEAD
-
-#ifdef DICTIONARY_ADD_TO_HEAD
-void *qt_dictionary_put_helper(qt_dictionary *dict,
-                               void          *key,
-                               void          *value,
-                               char           put_type)
-{
-    int hash = dict->op_hash(key);
-
-    int bucket = GET_BUCKET(hash);
-
-    rlock(dict->lock);
-    list_entry **const crt = &(dict->content[bucket]);
-    assert(!(crt == NULL || dict->content == NULL));
-    list_entry *walk = *crt, *toadd = NULL;
-    list_entry *head = walk, *stop = NULL;
-    while(1) {
-        while(walk != stop && walk != NULL) {
-            if((walk->hashed_key == hash) && (dict->op_equals(walk->key, key))) {
-                if(toadd != NULL) { FREE(toadd, sizeof(list_entry)); }
-
-                if(put_type == PUT_ALWAYS) {
-                    void **crt_val_adr = &(walk->value);
-                    void  *crt_val     = walk->value;
-                    while((qthread_cas_ptr(crt_val_adr, \
-                                           crt_val, value)) != crt_val ) {
-                        // try until succeeding to add
-                        crt_val = walk->value;
-                    }
-                }
-                runlock(dict->lock);
-                return walk->value;
-            }
-            walk = walk->next;
-        }
-        // if new entry not found and not created, create it.
-        if(toadd == NULL) {
-            toadd = (list_entry *)MALLOC(sizeof(list_entry));
-            if(toadd == NULL) {
-                runlock(dict->lock);
-                return NULL;
+/* The stripe lock s covering hash must be held. Sets *grow if the stripe has
+ * become too full. */
+static void *dict_put_locked(qt_dictionary *dict,
+                             dict_stripe   *s,
+                             dict_table    *cur,
+                             uint64_t       hash,
+                             void          *key,
+                             void          *value,
+                             char           put_type,
+                             int           *grow)
+{   /*{{{*/
+    list_entry **const head = &cur->buckets[hash & cur->mask];
+    list_entry        *walk = *head;
+
+    while (walk != NULL) {
+        if ((walk->hashed_key == hash) && (dict->op_equals(walk->key, key))) {
+            if (put_type == PUT_ALWAYS) {
+                walk->value = value;
             }
-            toadd->key        = key;
-            toadd->value      = value;
-            toadd->next       = head;
-            toadd->hashed_key = hash;
-        }
-        void *code = qthread_cas_ptr(crt, head, toadd);
-        if(code == head) {        // succeeded adding
-            runlock(dict->lock);
-            return value;
+            return walk->value;
         }
-        stop        = head;
-        head        = *crt;
-        walk        = head;
-        toadd->next = head;
+        walk = walk->next;
     }
+    walk = (list_entry *)MALLOC(sizeof(list_entry));
+    if (walk == NULL) {
+        return NULL;
+    }
+    walk->key        = key;
+    walk->value      = value;
+    walk->hashed_key = hash;
+    walk->next       = *head;
+    *head            = walk;
+    s->count++;
+    /* this stripe covers 1/(smask+1) of the buckets */
+    if ((dict->old == NULL) &&
+        (s->count * (dict->smask + 1) > DICT_MAX_LOAD * (cur->mask + 1))) {
+        *grow = 1;
+    }
+    return value;
+} /*}}}*/
+
+/* Called after a put, with no stripe lock held. */
+static QINLINE void dict_after_put(qt_dictionary *dict,
+                                   int            grow)
+{   /*{{{*/
+    if (grow && !dict->iterators && !dict->resizing &&
+        (qthread_cas(&dict->resizing, 0, 1) == 0)) {
+        dict_grow(dict);
+    }
+    dict_help_resize(dict);
+} /*}}}*/
 
-    runlock(dict->lock);
-    return NULL;
-}
-
-#else /* ifdef DICTIONARY_ADD_TO_HEAD */
 void *qt_dictionary_put_helper(qt_dictionary *dict,
                                void          *key,
                                void          *value,
                                char           put_type)
 {
-    int hash = dict->op_hash(key);
-
-    int bucket = GET_BUCKET(hash);
-
-    rlock(dict->lock);
-    list_entry **crt = &(dict->content[bucket]);
-    assert(!(crt == NULL || dict->content == NULL));
-    list_entry *walk = *crt, *toadd = NULL;
-    while(1) {
-        while(walk != NULL) {
-            if((walk->hashed_key == hash) && (dict->op_equals(walk->key, key))) {
-                if(toadd != NULL) { FREE(toadd, sizeof(list_entry)); }
-
-                if(put_type == PUT_ALWAYS) {
-                    void **crt_val_adr = &(walk->value);
-                    void  *crt_val     = walk->value;
-                    while((qthread_cas_ptr(crt_val_adr, \
-                                           crt_val, value)) != crt_val ) {
-                        crt_val = walk->value;
-                    }
-                }
-                runlock(dict->lock);
-                return walk->value;
-            }
-            crt  = &(walk->next);
-            walk = walk->next;
-        }
-        if(toadd == NULL) {
-            toadd = (list_entry *)MALLOC(sizeof(list_entry));
-            if(toadd == NULL) {
-                runlock(dict->lock);
-                return NULL;
-            }
-            toadd->key        = key;
-            toadd->value      = value;
-            toadd->next       = NULL;
-            toadd->hashed_key = hash;
-        }
-        void *code = qthread_cas_ptr(crt, NULL, toadd);
-        if(code == NULL) {
-            runlock(dict->lock);
-            return value;
-        }
-        walk = *crt;
-    }
+    uint64_t const hash = dict_hash(dict, key);
+    dict_table    *cur;
+    size_t         old_size;
+    int            grow = 0;
+    void          *ret;
 
-    runlock(dict->lock);
-    return NULL;
+    dict_stripe *const s = dict_lock_hash(dict, hash, &cur, &old_size);
+
+    ret = dict_put_locked(dict, s, cur, hash, key, value, put_type, &grow);
+    dict_unlock_hash(dict, s, old_size);
+    dict_after_put(dict, grow);
+    return ret;
 }
-#endif /* ifdef DICTIONARY_ADD_TO_HEAD */
 
 void *qt_dictionary_put(qt_dictionary *dict,
                         void          *key,
@@ -282,92 +454,271 @@ void *qt_dictionary_put_if_absent(qt_dictionary *dict,
     return qt_dictionary_put_helper(dict, key, value, PUT_IF_ABSENT);
 }
 
+/* The stripe lock covering hash must be held. */
+static QINLINE void *dict_get_locked(qt_dictionary *dict,
+                                     dict_table    *cur,
+                                     uint64_t       hash,
+                                     void          *key)
+{   /*{{{*/
+    list_entry *walk = cur->buckets[hash & cur->mask];
+
+    while (walk != NULL) {
+        if ((walk->hashed_key == hash) && (dict->op_equals(walk->key, key))) {
+            return walk->value;
+        }
+        walk = walk->next;
+    }
+    return NULL;
+} /*}}}*/
+
 void *qt_dictionary_get(qt_dictionary *dict,
                         void          *key)
 {
-    int hash   = dict->op_hash(key);
-    int bucket = GET_BUCKET(hash);
+    uint64_t const hash = dict_hash(dict, key);
+    dict_table    *cur;
+    size_t         old_size;
+    void          *ret;
 
-    rlock(dict->lock);
+    dict_stripe *const s = dict_lock_hash(dict, hash, &cur, &old_size);
 
-    list_entry *walk = dict->content[bucket];
-    while(walk != NULL) {
-        if ((walk->hashed_key == hash) && (dict->op_equals(walk->key, key))) {
-            runlock(dict->lock);
-            return walk->value;
+    ret = dict_get_locked(dict, cur, hash, key);
+    dict_unlock_hash(dict, s, old_size);
+    return ret;
+}
+
+/* Hashes up to DICT_BATCH keys and sorts their indices by stripe, so that the
+ * keys sharing a stripe can be handled under one acquisition of its lock.
+ * Insertion sort is fine for a batch this small. */
+static void dict_batch_prepare(qt_dictionary *dict,
+                               void *const   *keys,
+                               size_t         n,
+                               uint64_t      *hashes,
+                               unsigned      *order)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        size_t   j;
+        unsigned stripe;
+
+        hashes[i] = dict_hash(dict, keys[i]);
+        stripe    = hashes[i] & dict->smask;
+        for (j = i; j > 0 && (hashes[order[j - 1]] & dict->smask) > stripe; j--) {
+            order[j] = order[j - 1];
         }
-        walk = walk->next;
+        order[j] = i;
+    }
+} /*}}}*/
+
+/* Locks the stripe shared by order[first..*last) and migrates any old buckets
+ * they need, prefetching their buckets in the current table. */
+static dict_stripe *dict_batch_lock(qt_dictionary  *dict,
+                                    const uint64_t *hashes,
+                                    const unsigned *order,
+                                    size_t          first,
+                                    size_t          n,
+                                    size_t         *last,
+                                    dict_table    **cur,
+                                    size_t         *moved,
+                                    size_t         *old_size)
+{   /*{{{*/
+    size_t const stripe = hashes[order[first]] & dict->smask;
+    dict_stripe *s      = &dict->stripes[stripe];
+    size_t       i;
+
+    dict_stripe_lock(s);
+    *cur = dict->cur;
+    for (i = first; i < n && (hashes[order[i]] & dict->smask) == stripe; i++) {
+        uint64_t const h = hashes[order[i]];
+
+        if (QTHREAD_UNLIKELY(dict->old != NULL)) {
+            *old_size = dict->old_size;
+            *moved   += dict_migrate_bucket(dict, h & dict->old->mask);
+        }
+        Q_PREFETCH(&(*cur)->buckets[h & (*cur)->mask]);
+    }
+    *last = i;
+    return s;
+} /*}}}*/
+
+size_t qt_dictionary_get_many(qt_dictionary *dict,
+                              size_t         n,
+                              void *const   *keys,
+                              void         **values)
+{
+    uint64_t hashes[DICT_BATCH];
+    unsigned order[DICT_BATCH];
+    size_t   found = 0;
+
+    for (size_t base = 0; base < n; base += DICT_BATCH) {
+        size_t const bn       = (n - base < DICT_BATCH) ? (n - base) : DICT_BATCH;
+        size_t       moved    = 0, old_size = 0;
+        size_t       i, last;
+
+        dict_batch_prepare(dict, keys + base, bn, hashes, order);
+        for (i = 0; i < bn; i = last) {
+            dict_table        *cur;
+            dict_stripe *const s = dict_batch_lock(dict, hashes, order, i, bn, &last,
+                                                   &cur, &moved, &old_size);
+
+            for (size_t j = i; j < last; j++) {
+                size_t const k = order[j];
+
+                values[base + k] = dict_get_locked(dict, cur, hashes[k], keys[base + k]);
+                if (values[base + k] != NULL) { found++; }
+            }
+            QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+        }
+        dict_account(dict, moved, old_size);
     }
+    return found;
+}
 
-    runlock(dict->lock);
-    return NULL;
+size_t qt_dictionary_put_many(qt_dictionary *dict,
+                              size_t         n,
+                              void *const   *keys,
+                              void *const   *values,
+                              void         **results)
+{
+    uint64_t hashes[DICT_BATCH];
+    unsigned order[DICT_BATCH];
+    size_t   stored = 0;
+
+    for (size_t base = 0; base < n; base += DICT_BATCH) {
+        size_t const bn       = (n - base < DICT_BATCH) ? (n - base) : DICT_BATCH;
+        size_t       moved    = 0, old_size = 0;
+        size_t       i, last;
+        int          grow = 0;
+
+        dict_batch_prepare(dict, keys + base, bn, hashes, order);
+        for (i = 0; i < bn; i = last) {
+            dict_table        *cur;
+            dict_stripe *const s = dict_batch_lock(dict, hashes, order, i, bn, &last,
+                                                   &cur, &moved, &old_size);
+
+            for (size_t j = i; j < last; j++) {
+                size_t const k   = order[j];
+                void        *ret = dict_put_locked(dict, s, cur, hashes[k], keys[base + k],
+                                                   values[base + k], PUT_ALWAYS, &grow);
+
+                if (results != NULL) { results[base + k] = ret; }
+                if (ret != NULL) { stored++; }
+            }
+            QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+        }
+        dict_account(dict, moved, old_size);
+        dict_after_put(dict, grow);
+    }
+    return stored;
 }
 
 void *qt_dictionary_delete(qt_dictionary *dict,
                            void          *key)
 {
-    void       *to_ret  = NULL;
-    list_entry *to_free = NULL;
-    int         hash    = dict->op_hash(key);
-    int         bucket  = GET_BUCKET(hash);
-
-    wlock(dict->lock);
-
-    list_entry *walk = dict->content[bucket];
-    list_entry *head = walk;
-    /*
-     * if(walk == NULL) assert(0);//cannot remove an element not present in hash
-     * else if((walk -> hashed_key == hash) && (dict -> op_equals(walk -> key, key))) {
-     *      //remove list head
-     *      to_free = walk;
-     *      to_ret = walk -> value;
-     *      dict -> content[bucket] = walk -> next;
-     *      if (dict->op_cleanup != NULL)
-     *              dict->op_cleanup(to_free->key);
-     *      free(to_free);
-     * }
-     * else while(walk -> next != NULL){
-     *      if ((walk -> hashed_key == hash) && (dict -> op_equals(walk -> next -> key, key))) {
-     *              to_free = walk -> next;
-     *              to_ret = walk -> next -> value;
-     *              walk -> next = walk -> next -> next;
-     *              if (dict->op_cleanup != NULL)
-     *                      dict->op_cleanup(to_free->key);
-     *              free(to_free);
-     *              break;
-     *      }
-     *      walk = walk -> next;
-     * }
-     *
-     */
-    list_entry *prev = NULL;
-    while(walk != NULL) {
+    uint64_t const hash    = dict_hash(dict, key);
+    list_entry    *to_free = NULL;
+    void          *to_ret  = NULL;
+    dict_table    *cur;
+    size_t         old_size;
+
+    dict_stripe *const s    = dict_lock_hash(dict, hash, &cur, &old_size);
+    list_entry       **prev = &cur->buckets[hash & cur->mask];
+
+    while (*prev != NULL) {
+        list_entry *walk = *prev;
+
         if ((walk->hashed_key == hash) && (dict->op_equals(walk->key, key))) {
-            if (walk == head) {
-                dict->content[bucket] = walk->next;
-            } else {
-                prev->next = walk->next;
-            }
+            *prev   = walk->next;
             to_free = walk;
             to_ret  = walk->value;
-            if (dict->op_cleanup != NULL) {
-                dict->op_cleanup(to_free->key, NULL);
-            }
-            FREE(to_free, sizeof(list_entry));
-
+            s->count--;
             break;
         }
-        prev = walk;
-        walk = walk->next;
+        prev = &walk->next;
     }
+    dict_unlock_hash(dict, s, old_size);
 
-    wunlock(dict->lock);
+    if (to_free != NULL) {
+        if (dict->op_cleanup != NULL) {
+            dict->op_cleanup(to_free->key, NULL);
+        }
+        FREE(to_free, sizeof(list_entry));
+    }
+    dict_help_resize(dict);
     return to_ret;
 }
 
+typedef struct dict_for_each_s {
+    qt_dictionary     *dict;
+    qt_dict_for_each_f f;
+    void              *arg;
+    size_t             nbuckets; /* size of the current table when the walk began */
+} dict_for_each_t;
+
+/* Visits the entries of current-table buckets b, b + nbuckets, b + 2*nbuckets
+ * and so on for each b in [startat, stopat): if the table has doubled since
+ * the walk began, those are exactly the buckets that bucket b split into, and
+ * they share b's stripe. Each bucket's entries are copied out under the lock,
+ * so f is called with no lock held. */
+static void dict_for_each_range(const size_t startat,
+                                const size_t stopat,
+                                void        *arg_)
+{   /*{{{*/
+    dict_for_each_t *const arg  = arg_;
+    qt_dictionary *const   dict = arg->dict;
+    list_entry             local[DICT_BATCH];
+
+    for (size_t b = startat; b < stopat; b++) {
+        dict_stripe *s     = &dict->stripes[b & dict->smask];
+        list_entry  *copy  = local;
+        size_t       ncopy = 0, nalloc = DICT_BATCH;
+        size_t       moved = 0, old_size = 0;
+
+        dict_stripe_lock(s);
+        for (size_t cb = b; cb <= dict->cur->mask; cb += arg->nbuckets) {
+            list_entry *walk;
+
+            if (dict->old != NULL) {
+                old_size = dict->old_size;
+                moved   += dict_migrate_bucket(dict, cb & dict->old->mask);
+            }
+            for (walk = dict->cur->buckets[cb]; walk != NULL; walk = walk->next) {
+                if (ncopy == nalloc) {
+                    list_entry *bigger = MALLOC(2 * nalloc * sizeof(list_entry));
+
+                    assert(bigger);
+                    memcpy(bigger, copy, ncopy * sizeof(list_entry));
+                    if (copy != local) { FREE(copy, nalloc * sizeof(list_entry)); }
+                    copy    = bigger;
+                    nalloc *= 2;
+                }
+                copy[ncopy++] = *walk;
+            }
+        }
+        QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+        dict_account(dict, moved, old_size);
+        for (size_t i = 0; i < ncopy; i++) {
+            arg->f(copy[i].key, copy[i].value, arg->arg);
+        }
+        if (copy != local) { FREE(copy, nalloc * sizeof(list_entry)); }
+    }
+} /*}}}*/
+
+void qt_dictionary_for_each(qt_dictionary     *dict,
+                            qt_dict_for_each_f f,
+                            void              *arg)
+{
+    dict_for_each_t fe = { dict, f, arg, 0 };
+    dict_stripe    *s  = &dict->stripes[0];
+
+    /* cur only changes under every stripe lock */
+    dict_stripe_lock(s);
+    fe.nbuckets = dict->cur->mask + 1;
+    QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+    qt_loop_balance(0, fe.nbuckets, dict_for_each_range, &fe);
+}
+
 qt_dictionary_iterator *qt_dictionary_iterator_create(qt_dictionary *dict)
 {
-    if((dict == NULL) || (dict->content == NULL)) {
+    if((dict == NULL) || (dict->cur == NULL)) {
         return ERROR;
     }
     qt_dictionary_iterator *it = (qt_dictionary_iterator *)MALLOC(sizeof(qt_dictionary_iterator));
@@ -375,64 +726,92 @@ qt_dictionary_iterator *qt_dictionary_iterator_create(qt_dictionary *dict)
         return ERROR;         // out of memory
     }
     it->dict = dict;
-    it->bkt  = -1;
+    it->bkt  = DICT_ITER_START;
     it->crt  = NULL;
+    /* dict_grow() checks the count with every stripe lock held */
+    dict_stripe_lock(&dict->stripes[0]);
+    qthread_incr(&dict->iterators, 1);
+    QTHREAD_TRYLOCK_UNLOCK(&dict->stripes[0].lock);
     return it;
 }
 
 void qt_dictionary_iterator_destroy(qt_dictionary_iterator *it)
 {
     if(it == NULL) { return; }
+    qthread_incr(&it->dict->iterators, -1);
     FREE(it, sizeof(qt_dictionary_iterator));
 }
 
+/* Finds the first non-empty bucket at or after b, migrating old buckets on
+ * the way so that entries still in the old table are not skipped. */
+static list_entry *dict_iterator_scan(qt_dictionary_iterator *it,
+                                      size_t                  b)
+{   /*{{{*/
+    qt_dictionary *dict = it->dict;
+
+    for (;; b++) {
+        dict_stripe *s = &dict->stripes[b & dict->smask];
+        list_entry  *head;
+        size_t       moved = 0, old_size = 0;
+
+        dict_stripe_lock(s);
+        if (b > dict->cur->mask) {
+            QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+            break;
+        }
+        if (dict->old != NULL) {
+            old_size = dict->old_size;
+            moved    = dict_migrate_bucket(dict, b & dict->old->mask);
+        }
+        head = dict->cur->buckets[b];
+        QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+        dict_account(dict, moved, old_size);
+        if (head != NULL) {
+            it->bkt = b;
+            it->crt = head;
+            return head;
+        }
+    }
+    it->bkt = DICT_ITER_END;
+    it->crt = NULL;
+    return NULL;
+} /*}}}*/
+
 list_entry *qt_dictionary_iterator_next(qt_dictionary_iterator *it)
 {
-    if((it == NULL) || (it->dict == NULL) || (it->dict->content == NULL)) {
+    if((it == NULL) || (it->dict == NULL) || (it->dict->cur == NULL)) {
         return ERROR;
     }
     // First call to next: search for the first non-empty bucket
-    if(it->bkt == -1) {
-        int i;
-        for(i = 0; i < NO_BUCKETS; i++)
-            if(it->dict->content[i] != NULL) {
-                it->bkt = i;
-                it->crt = it->dict->content[i];
-                return it->crt;
-            }
-    } else {
-        // start searching for next element starting with the last returned element
-        list_entry *walk = it->crt;
-        // if item was deleted or there are no more elements in the list, return NULL
-        if(walk == NULL) {
-            it->bkt = -1;
-            return ERROR;
-        }
-
-        walk = walk->next;
-
-        // search all buckets in dictionary
-        while (it->bkt < NO_BUCKETS) {
-            if(walk != NULL) {
-                it->crt = walk;
-                return it->crt;
-            }
-            it->bkt++;
-            if(it->bkt < NO_BUCKETS) {
-                walk = it->dict->content[it->bkt];
-            }
-        }
-        // if dictionary has no more elements return NULL
-        it->crt = NULL;
+    if(it->bkt == DICT_ITER_START) {
+        return dict_iterator_scan(it, 0);
+    }
+    if(it->bkt == DICT_ITER_END) {
         return NULL;
     }
-    assert(0);
-    return NULL;
+    // if item was deleted or there are no more elements in the list, return NULL
+    if(it->crt == NULL) {
+        it->bkt = DICT_ITER_START;
+        return ERROR;
+    }
+    {
+        dict_stripe *s = &it->dict->stripes[it->bkt & it->dict->smask];
+        list_entry  *next;
+
+        dict_stripe_lock(s);
+        next = it->crt->next;
+        QTHREAD_TRYLOCK_UNLOCK(&s->lock);
+        if(next != NULL) {
+            it->crt = next;
+            return next;
+        }
+    }
+    return dict_iterator_scan(it, it->bkt + 1);
 }
 
 list_entry *qt_dictionary_iterator_get(const qt_dictionary_iterator *it)
 {
-    if((it == NULL) || (it->dict == NULL) || (it->dict->content == NULL)) {
+    if((it == NULL) || (it->dict == NULL) || (it->dict->cur == NULL)) {
         printf(" Inside dictionary get, found NULL, will return ERROR\n");
         return ERROR;
     }
@@ -442,13 +821,15 @@ list_entry *qt_dictionary_iterator_get(const qt_dictionary_iterator *it)
 
 qt_dictionary_iterator *qt_dictionary_end(qt_dictionary *dict)
 {
-    if((dict == NULL) || (dict->content == NULL)) {
+    if((dict == NULL) || (dict->cur == NULL)) {
         return NULL;
     }
     qt_dictionary_iterator *it = qt_dictionary_iterator_create(dict);
-    it->crt  = NULL;
-    it->bkt  = NO_BUCKETS;
-    it->dict = dict;
+    if((it == NULL) || (it == ERROR)) {
+        return NULL;
+    }
+    it->crt = NULL;
+    it->bkt = DICT_ITER_END;
     return it;
 }
 
@@ -475,31 +856,39 @@ qt_dictionary_iterator *qt_dictionary_iterator_copy(qt_dictionary_iterator *b)
     return ret;
 }
 
+static void dict_table_printbuckets(dict_table *t,
+                                    int        *total,
+                                    int        *used_buckets)
+{   /*{{{*/
+    for (size_t bucket = 0; bucket <= t->mask; bucket++) {
+        int         no_el = 0;
+        list_entry *walk  = t->buckets[bucket];
+
+        if (walk == DICT_MIGRATED) { continue; }
+        while (walk != NULL) {
+            no_el++;
+            walk = walk->next;
+        }
+        if (no_el > 0) {
+            printf("Bucket %d has %d elements.\n", (int)bucket, no_el);
+            (*used_buckets)++;
+        }
+        *total += no_el;
+    }
+} /*}}}*/
+
 void qt_dictionary_printbuckets(qt_dictionary *dict)
 {
     int total        = 0;
     int used_buckets = 0;
 
-    for(int bucket = 0; bucket < NO_BUCKETS; bucket++) {
-        int          no_el = 0;
-        list_entry **crt   = &(dict->content[bucket]);
-        if ((crt != NULL) && (dict->content != NULL)) {
-            list_entry *walk = *crt;
-            while(walk != NULL) {
-                no_el++;
-                crt  = &(walk->next);
-                walk = walk->next;
-            }
-            if (no_el > 0) {
-                printf("Bucket %d has %d elements.\n", bucket, no_el);
-                used_buckets++;
-            }
-            total += no_el;
-
-            // assert(no_el < 2);
-        }
+    dict_table_printbuckets(dict->cur, &total, &used_buckets);
+    if (dict->old != NULL) {
+        printf("Resize in progress; unmigrated buckets of the old table:\n");
+        dict_table_printbuckets(dict->old, &total, &used_buckets);
     }
-    printf("used_buckets = %d; total elements = %d;\n", used_buckets, total);
+    printf("buckets = %d; used_buckets = %d; total elements = %d;\n",
+           (int)(dict->cur->mask + 1), used_buckets, total);
 }
 
 /* vim:set expandtab: */
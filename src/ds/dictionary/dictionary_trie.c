@@ -12,10 +12,13 @@
 /* Installed Headers */
 #include <qthread/dictionary.h>
 #include <qthread/qthread.h>
+#include <qthread/qloop.h>
 
 /* Internal Headers */
 #include "qt_asserts.h"
+#include "qt_atomics.h"
 #include "qt_debug.h"
+#include "qt_prefetch.h"
 #ifdef EBUG
 # define DEBUG(x) x
 #else
@@ -51,6 +54,7 @@ typedef void (*qt_hash_callback_fn)(const qt_key_t,
 #define SPINE_BUCKET_WIDTH 5
 #define BASE_SPINE_LENGTH  64
 #define BASE_BUCKET_WIDTH  6
+#define BATCH              32 /* keys hashed and prefetched at a time by the _many calls */
 /*
  * typedef struct hash_entry_s {
  *  qt_key_t key;
@@ -75,15 +79,23 @@ typedef struct _spine_s {
     spine_element_t  elements[SPINE_LENGTH];
 } spine_t;
 
+/* Spine ids are handed out and the id->spine index is grown under
+ * spine_lock, so a doubling cannot miss an id that is being installed at the
+ * same time. Walks read the index without the lock; an index that has been
+ * outgrown is chained from the last slot of its successor and only freed
+ * when the dictionary is destroyed, since a walk may still be reading it. */
 struct qt_dictionary {
     spine_element_t      base[BASE_SPINE_LENGTH];
-    spine_t            **spines;
+    spine_t **volatile   spines;
     size_t               count;
-    size_t               maxspines;
+    volatile size_t      maxspines;
     size_t               numspines;
+    size_t               freespine; /* every id below this is in use */
+    QTHREAD_TRYLOCK_TYPE spine_lock;
 
     qt_dict_key_equals_f op_equals;
     qt_dict_hash_f       op_hash;
+    qt_dict_hash64_f     op_hash64; // used instead of op_hash if not NULL
     qt_dict_cleanup_f    op_cleanup;
 };
 
@@ -99,13 +111,18 @@ static inline qt_hash qt_hash_create(qt_dict_key_equals_f eq,
 {
     qt_hash tmp = MALLOC(sizeof(qt_dictionary));
 
+    assert(tmp);
+    memset(tmp, 0, sizeof(qt_dictionary)); // the base spine starts empty
     tmp->op_equals  = eq;
     tmp->op_hash    = hash;
+    tmp->op_hash64  = NULL;
     tmp->op_cleanup = cleanup;
 
     assert(tmp);
     tmp->maxspines = getpagesize() / sizeof(spine_element_t *);
-    tmp->spines    = (spine_t **)calloc(tmp->maxspines, sizeof(spine_element_t *));
+    tmp->spines    = (spine_t **)calloc(tmp->maxspines + 1, sizeof(spine_element_t *));
+    tmp->freespine = 0;
+    QTHREAD_TRYLOCK_INIT(tmp->spine_lock);
 
     return tmp;
 }
@@ -117,6 +134,16 @@ qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
     return qt_hash_create(eq, hash, cleanup);
 }
 
+qt_dictionary *qt_dictionary_create64(qt_dict_key_equals_f eq,
+                                      qt_dict_hash64_f     hash,
+                                      qt_dict_cleanup_f    cleanup)
+{
+    qt_hash tmp = qt_hash_create(eq, NULL, cleanup);
+
+    tmp->op_hash64 = hash;
+    return tmp;
+}
+
 #define SPINE_PTR_TEST(x)            ((x).u & 1)
 #define SPINE_PTR_COUNT(x)           ((x).s.ctr >> 1)
 #define SPINE_PTR_ID(x)              ((x).s.id)
@@ -164,48 +191,57 @@ qt_dictionary *qt_dictionary_create(qt_dict_key_equals_f eq,
 }
 #define DECREMENT_COUNT(bkt)            DECREMENT_COUNT_BY(bkt, 1)
 
+/* Not a fair lock: when there are more workers than cores, a ticket lock
+ * hands itself to waiters that are not running, and every spine allocation
+ * then waits out somebody else's timeslice. */
+static inline void lock_spines(qt_hash h)
+{
+    while (!QTHREAD_TRYLOCK_TRY(&h->spine_lock)) {
+        SPINLOCK_BODY();
+    }
+}
+
 static void deallocate_spine(qt_hash h,
                              size_t  id)
 {
+    lock_spines(h);
     free((void *)(h->spines[id])); // XXX should be to a memory pool
     h->spines[id] = NULL;
-    INCR(&h->numspines, -1);
+    h->numspines--;
+    if (id < h->freespine) {
+        h->freespine = id;
+    }
+    QTHREAD_TRYLOCK_UNLOCK(&h->spine_lock);
 }
 
 static size_t allocate_spine(qt_hash   h,
                              spine_t **realspine)
 {
-    size_t   newspine_ct = INCR(&h->numspines, 1) + 1;
-    size_t   maxspines   = h->maxspines;
-    spine_t *newspine;
+    spine_t *newspine = calloc(1, sizeof(spine_t)); // XXX should be from a memory pool
     size_t   id;
 
-    if (newspine_ct >= maxspines) {
+    assert(newspine);
+    lock_spines(h);
+    id = h->freespine;
+    while (id < h->maxspines && h->spines[id] != NULL) {
+        ++id;
+    }
+    if (id == h->maxspines) {
         // Need to make more room in the spine-idx array
-        spine_t **spines    = calloc(maxspines * 2, sizeof(spine_t *));
-        spine_t **oldspines = h->spines;
-        spine_t **tmp;
+        size_t    maxspines = h->maxspines;
+        spine_t **spines    = calloc(maxspines * 2 + 1, sizeof(spine_t *));
+
         assert(spines);
         memcpy(spines, h->spines, sizeof(spine_t *) * maxspines);
-        tmp = CAS(&h->spines, oldspines, spines);
-        if (tmp != oldspines) { // someone else added more spines
-            FREE(spines, maxspines * 2 * sizeof(spine_t *));
-        } else {
-            INCR(&h->maxspines, maxspines);
-        }
-        maxspines *= 2;
-    }
-    newspine = calloc(1, sizeof(spine_t)); // XXX should be from a memory pool
-    assert(newspine);
-    for(id = 0; id < maxspines; ++id) {
-        if (h->spines[id] == NULL) {
-            spine_t *tmp = CAS(&h->spines[id], NULL, newspine);
-            if (tmp == NULL) {
-                break; // success!
-            }
-        }
+        spines[maxspines * 2] = (spine_t *)h->spines;
+        h->spines             = spines;
+        MACHINE_FENCE; // iterators read maxspines before spines
+        h->maxspines = maxspines * 2;
     }
-    assert(id < maxspines);
+    h->spines[id] = newspine;
+    h->freespine  = id + 1;
+    h->numspines++;
+    QTHREAD_TRYLOCK_UNLOCK(&h->spine_lock);
     if (realspine != NULL) {
         *realspine = (spine_t *)newspine;
     }
@@ -261,7 +297,13 @@ void qt_dictionary_destroy(qt_hash h)
             }
         }
     }
-    FREE(h->spines, h->maxspines * sizeof(spine_element_t *));
+    for (size_t max = h->maxspines; h->spines != NULL; max /= 2) {
+        spine_t **outgrown = (spine_t **)h->spines[max];
+
+        FREE(h->spines, (max + 1) * sizeof(spine_element_t *));
+        h->spines = outgrown;
+    }
+    QTHREAD_TRYLOCK_DESTROY(h->spine_lock);
     FREE(h, sizeof(qt_dictionary));
 }
 
@@ -294,19 +336,36 @@ void qt_dictionary_destroy(qt_hash h)
 # define HASH_KEY(key)
 #endif  /* ifdef USE_HASHWORD */
 
+/* The deepest spine consumes bit 60, so 64-bit hashes have their top three
+ * bits folded into the low ones; sign-extended int hashes are unaffected. */
+#define TRIE_KEY_BITS 61
+
+static inline uint64_t qt_hash_key(qt_dictionary *h,
+                                   const qt_key_t key)
+{
+    uint64_t lkey;
+
+    if (h->op_hash64 != NULL) {
+        lkey = h->op_hash64(key);
+        lkey = (lkey ^ (lkey >> TRIE_KEY_BITS)) & ((UINT64_C(1) << TRIE_KEY_BITS) - 1);
+    } else {
+        lkey = (uint64_t)(uintptr_t)(h->op_hash(key));
+    }
+    HASH_KEY(lkey);
+    return lkey;
+}
+
 void *qt_hash_put_helper(qt_dictionary *h,
                          qt_key_t       key,
                          void          *value,
                          int            put_choice);
 
-void *qt_hash_put_helper(qt_dictionary *h,
-                         qt_key_t       key,
-                         void          *value,
-                         int            put_choice)
+static void *qt_hash_put_hashed(qt_dictionary *h,
+                                qt_key_t       key,
+                                void          *value,
+                                int            put_choice,
+                                uint64_t       lkey)
 {
-    uint64_t lkey = (uint64_t)(uintptr_t)(h->op_hash(key));
-
-    HASH_KEY(lkey);
     assert(h);
 
     unsigned         bucket    = BASE_SPINE_BUCKET(lkey);
@@ -382,41 +441,50 @@ void *qt_hash_put_helper(qt_dictionary *h,
         } else {
             // use the real user-equals operation to differentiate subcases
             // it is possible that the element is there or it may not be there
-            hash_entry *head;
-            do {
-                head    = child_id->e;
-                e->next = head;
-                crt     = head;
-                // find the entry, if it is in the list
-                while (crt) {
-                    if (h->op_equals(crt->key, key)) {
-                        // already exists
-
-                        if (put_choice != PUT_IF_ABSENT) {
-                            void **crt_val_adr = &(crt->value);
-                            void  *crt_val     = crt->value;
-                            while((qthread_cas_ptr(crt_val_adr, \
-                                                   crt_val, value)) != crt_val ) {
-                                crt_val = crt->value;
-                            }
+            hash_entry     *head = child_val.e;
+            spine_element_t cur;
+
+            e->next = head;
+            crt     = head;
+            // find the entry, if it is in the list
+            while (crt) {
+                if (h->op_equals(crt->key, key)) {
+                    // already exists
+
+                    if (put_choice != PUT_IF_ABSENT) {
+                        void **crt_val_adr = &(crt->value);
+                        void  *crt_val     = crt->value;
+                        while((qthread_cas_ptr(crt_val_adr, \
+                                               crt_val, value)) != crt_val ) {
+                            crt_val = crt->value;
                         }
-
-                        if (cur_id) { DECREMENT_COUNT(cur_id); }
-                        return crt->value;
                     }
-                    crt = crt->next;
+
+                    if (cur_id) { DECREMENT_COUNT(cur_id); }
+                    free(e); // never published
+                    return crt->value;
                 }
-                // and try to insert it at the head of the list;
-                // if the list changed, redu the work
-            } while (qthread_cas_ptr(&(child_id->e), head, e) != head);
-            // printf("IN put: (%s-%s)\n", child_id->e->key, child_id->e->value);
-            // if (e->next !=NULL)
-            //	printf("next key is %s and value %s\n", e->next->key, e->next->value);
-            return e->value;
+                crt = crt->next;
+            }
+            // and try to insert it at the head of the list
+            if ((cur.e = CAS(&(child_id->e), head, e)) == head) {
+                return e->value;
+            }
+            // the slot changed under us; it may have grown a longer list,
+            // been emptied, or been upgraded to a spine, so look again
+            child_val = cur;
         }
     } while (1);
 }
 
+void *qt_hash_put_helper(qt_dictionary *h,
+                         qt_key_t       key,
+                         void          *value,
+                         int            put_choice)
+{
+    return qt_hash_put_hashed(h, key, value, put_choice, qt_hash_key(h, key));
+}
+
 void *qt_dictionary_put(qt_dictionary *dict,
                         void          *key,
                         void          *value)
@@ -437,10 +505,8 @@ int qt_dictionary_remove(qt_dictionary *h,
 int qt_dictionary_remove(qt_dictionary *h,
                          const qt_key_t key)
 {
-    uint64_t lkey = (uint64_t)(uintptr_t)(h->op_hash(key));
+    uint64_t lkey = qt_hash_key(h, key);
 
-    HASH_KEY(lkey);
-    HASH_KEY(lkey);
     assert(h);
 
     unsigned         bucket    = BASE_SPINE_BUCKET(lkey);
@@ -471,9 +537,9 @@ int qt_dictionary_remove(qt_dictionary *h,
                     spine_element_t cur;
                     if ((cur.e = CAS(prev, e, e->next)) == e) {
                         if (h->op_cleanup != NULL) {
-                            h->op_cleanup(child_val.e->key, NULL);
+                            h->op_cleanup(e->key, NULL);
                         }
-                        free(child_val.e);                         // XXX should be into a mempool
+                        free(e);                                   // XXX should be into a mempool
                         // Second, walk back up the parent pointers, removing empty spines (if any)
                         // cur_id is the current spine pointer's location (if its null, we're in the base spine)
                         while (cur_id) {
@@ -525,12 +591,10 @@ void *qt_dictionary_delete(qt_dictionary *dict,
     if(ret) { return val; } else { return NULL; }
 }
 
-void *qt_dictionary_get(qt_dictionary *h,
-                        const qt_key_t key)
+static void *qt_hash_get_hashed(qt_dictionary *h,
+                                const qt_key_t key,
+                                uint64_t       lkey)
 {
-    uint64_t lkey = (uint64_t)(uintptr_t)(h->op_hash(key));
-
-    HASH_KEY(lkey);
     assert(h);
 
     unsigned bucket = BASE_SPINE_BUCKET(lkey);
@@ -570,6 +634,124 @@ void *qt_dictionary_get(qt_dictionary *h,
     } while (1);
 }
 
+void *qt_dictionary_get(qt_dictionary *h,
+                        const qt_key_t key)
+{
+    return qt_hash_get_hashed(h, key, qt_hash_key(h, key));
+}
+
+/* Hashes a batch of keys and touches each key's base spine slot and what it
+ * points to, so that the walks that follow overlap their cache misses. */
+static void qt_hash_batch_prepare(qt_dictionary *h,
+                                  void *const   *keys,
+                                  size_t         n,
+                                  uint64_t      *lkeys)
+{
+    for (size_t i = 0; i < n; i++) {
+        lkeys[i] = qt_hash_key(h, keys[i]);
+        Q_PREFETCH(&h->base[BASE_SPINE_BUCKET(lkeys[i])]);
+    }
+    for (size_t i = 0; i < n; i++) {
+        spine_element_t child_val = h->base[BASE_SPINE_BUCKET(lkeys[i])];
+
+        if (child_val.e == NULL) { continue; }
+        if (SPINE_PTR_TEST(child_val)) {
+            Q_PREFETCH(SPINE_PTR(h, child_val));
+        } else {
+            Q_PREFETCH(child_val.e);
+        }
+    }
+}
+
+size_t qt_dictionary_get_many(qt_dictionary *dict,
+                              size_t         n,
+                              void *const   *keys,
+                              void         **values)
+{
+    uint64_t lkeys[BATCH];
+    size_t   found = 0;
+
+    for (size_t base = 0; base < n; base += BATCH) {
+        size_t const bn = (n - base < BATCH) ? (n - base) : BATCH;
+
+        qt_hash_batch_prepare(dict, keys + base, bn, lkeys);
+        for (size_t i = 0; i < bn; i++) {
+            values[base + i] = qt_hash_get_hashed(dict, keys[base + i], lkeys[i]);
+            if (values[base + i] != NULL) { found++; }
+        }
+    }
+    return found;
+}
+
+size_t qt_dictionary_put_many(qt_dictionary *dict,
+                              size_t         n,
+                              void *const   *keys,
+                              void *const   *values,
+                              void         **results)
+{
+    uint64_t lkeys[BATCH];
+    size_t   stored = 0;
+
+    for (size_t base = 0; base < n; base += BATCH) {
+        size_t const bn = (n - base < BATCH) ? (n - base) : BATCH;
+
+        qt_hash_batch_prepare(dict, keys + base, bn, lkeys);
+        for (size_t i = 0; i < bn; i++) {
+            void *ret = qt_hash_put_hashed(dict, keys[base + i], values[base + i],
+                                           PUT_ALWAYS, lkeys[i]);
+
+            if (results != NULL) { results[base + i] = ret; }
+            if (ret != NULL) { stored++; }
+        }
+    }
+    return stored;
+}
+
+typedef struct for_each_args_s {
+    qt_dictionary     *h;
+    qt_dict_for_each_f f;
+    void              *arg;
+} for_each_args_t;
+
+static void spine_for_each(qt_dictionary   *h,
+                           spine_element_t  child_val,
+                           for_each_args_t *arg)
+{
+    if (child_val.e == NULL) {
+        return;
+    } else if (SPINE_PTR_TEST(child_val)) {
+        spine_t *spine = SPINE_PTR(h, child_val);
+
+        for (size_t i = 0; i < SPINE_LENGTH; ++i) {
+            spine_for_each(h, spine->elements[i], arg);
+        }
+    } else {
+        for (hash_entry *e = child_val.e; e != NULL; e = e->next) {
+            arg->f(e->key, e->value, arg->arg);
+        }
+    }
+}
+
+static void qt_hash_for_each_range(const size_t startat,
+                                   const size_t stopat,
+                                   void        *arg_)
+{
+    for_each_args_t *arg = (for_each_args_t *)arg_;
+
+    for (size_t bucket = startat; bucket < stopat; ++bucket) {
+        spine_for_each(arg->h, arg->h->base[bucket], arg);
+    }
+}
+
+void qt_dictionary_for_each(qt_dictionary     *dict,
+                            qt_dict_for_each_f f,
+                            void              *arg)
+{
+    for_each_args_t fe = { dict, f, arg };
+
+    qt_loop_balance(0, BASE_SPINE_LENGTH, qt_hash_for_each_range, &fe);
+}
+
 size_t qt_dictionary_count(qt_dictionary *h);
 
 size_t qt_dictionary_count(qt_dictionary *h)
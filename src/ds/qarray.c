@@ -290,7 +290,7 @@ static qarray *qarray_create_internal(const size_t         count,
                          [ret->dist_specific.dist_shep], segment_count);
             break;
         case ALL_RAND:
-            ret->dist_specific.dist_shep  = (qthread_shepherd_id_t)random();
+            ret->dist_specific.dist_shep  = (qthread_shepherd_id_t)qthread_random();
             ret->dist_specific.dist_shep %=
                 (qthread_shepherd_id_t)qthread_num_shepherds();
             qthread_incr(&chunk_distribution_tracker
@@ -380,7 +380,7 @@ static qarray *qarray_create_internal(const size_t         count,
                     break;
                 case DIST:             /* assumed equivalent to DIST_RAND */
                 case DIST_RAND:
-                    target_shep = random() % max_sheps;
+                    target_shep = qthread_random() % max_sheps;
                     break;
                 case DIST_FIELDS:
                 {                      /* roughly copied from FIXED_FIELDS logic */
@@ -210,7 +210,7 @@ static void qdqueue_internal_sortedsheps(qthread_shepherd_id_t shep,
         assert(k == count);
         /* and now randomly append them to the all array */
         for (j = 0; j < count; j++) {
-            size_t randpick = random() % (count - j);
+            size_t randpick = qthread_random() % (count - j);
 
             all[i++] = &(Qs[thisdist[randpick]]);
             for (k = randpick; k < (count - j - 1); k++) {
@@ -279,7 +279,7 @@ static struct qdsubqueue_s **qdqueue_internal_getneighbors(qthread_shepherd_id_t
     ret = MALLOC(numN * sizeof(struct qdsubqueue_s *));
     assert(ret);
     for (i = 0; i < numN; i++) {
-        size_t k, randpick = random() % (numN - i);
+        size_t k, randpick = qthread_random() % (numN - i);
 
         ret[i] = &(Qs[temp[randpick]]);
         for (k = randpick; k < (numN - i - 1); k++) {
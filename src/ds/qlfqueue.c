@@ -6,7 +6,7 @@
 #include <qthread/qlfqueue.h>
 
 #include <qthread/qpool.h>
-#include "qt_hazardptrs.h"
+#include "qt_epoch.h"                  /* for QT_SMR_*() */
 #include "qt_atomics.h"
 #include "qt_asserts.h"
 #include "qt_debug.h"                  /* for malloc debug wrappers */
@@ -36,6 +36,7 @@ static void qlfqueue_internal_cleanup(void)
  * http://www.research.ibm.com/people/m/michael/podc-1996.pdf
  * ... and modified to use hazard ptrs according to
  * http://www.research.ibm.com/people/m/michael/ieeetpds-2004.pdf
+ * (or epoch-based reclamation, when configured --with-reclamation=epoch)
  */
 
 qlfqueue_t *qlfqueue_create(void)
@@ -101,10 +102,11 @@ int qlfqueue_enqueue(qlfqueue_t *q,
     memset((void *)node, 0, sizeof(qlfqueue_node_t));
     node->value = elem;
 
+    QT_SMR_ENTER();
     while (1) {
         tail = q->tail;
 
-        hazardous_ptr(0, tail);
+        QT_SMR_PROTECT(0, tail);
         if (tail != q->tail) { continue; }
 
         next = tail->next;
@@ -118,7 +120,8 @@ int qlfqueue_enqueue(qlfqueue_t *q,
         }
     }
     (void)qthread_cas_ptr((void **)&(q->tail), (void *)tail, node);
-    hazardous_ptr(0, NULL); // release the ptr (avoid hazardptr resource exhaustion)
+    QT_SMR_PROTECT(0, NULL); // release the ptr (avoid hazardptr resource exhaustion)
+    QT_SMR_EXIT();
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
@@ -135,18 +138,22 @@ void *qlfqueue_dequeue(qlfqueue_t *q)
     qlfqueue_node_t *next_ptr;
 
     qassert_ret((q != NULL), NULL);
+    QT_SMR_ENTER();
     while (1) {
         head = q->head;
 
-        hazardous_ptr(0, head);
+        QT_SMR_PROTECT(0, head);
         if (head != q->head) { continue; }
 
         tail     = q->tail;
         next_ptr = head->next;
 
-        hazardous_ptr(1, next_ptr);
+        QT_SMR_PROTECT(1, next_ptr);
 
-        if (next_ptr == NULL) { return NULL; } /* queue is empty */
+        if (next_ptr == NULL) { /* queue is empty */
+            QT_SMR_EXIT();
+            return NULL;
+        }
         if (head == tail) { /* tail is falling behind! */
             /* advance tail ptr... */
             (void)qthread_cas_ptr((void **)&(q->tail), (void *)tail, next_ptr);
@@ -158,7 +165,8 @@ void *qlfqueue_dequeue(qlfqueue_t *q)
             break;             /* success! */
         }
     }
-    hazardous_release_node(qlfqueue_pool_free_wrapper, head);
+    QT_SMR_RETIRE(qlfqueue_pool_free_wrapper, head);
+    QT_SMR_EXIT();
     return p;
 }                                      /*}}} */
 
@@ -3,10 +3,12 @@
 #endif
 
 /* Internal Headers */
+#include "qthread/qthread.h" /* for QTHREAD_BADARGS */
 #include "qthread/qpool.h"
 #include "qt_mpool.h"
 #include "qt_asserts.h"
 #ifdef UNPOOLED
+#include <string.h> /* for memset() */
 #include "qt_debug.h" /* for malloc() debug wrappers */
 #endif
 
@@ -66,4 +68,47 @@ void qpool_destroy(qpool *pool)
 #endif
 }
 
+size_t qpool_num_nodes(qpool *pool)
+{                                      /*{{{ */
+#ifdef UNPOOLED
+    return 1;
+#else
+    return qt_mpool_num_nodes(pool);
+#endif
+}                                      /*}}} */
+
+int qpool_stats(qpool         *pool,
+                size_t         node,
+                qpool_stats_t *stats)
+{                                      /*{{{ */
+    qassert_ret((pool != NULL), QTHREAD_BADARGS);
+    qassert_ret((stats != NULL), QTHREAD_BADARGS);
+#ifdef UNPOOLED
+    if (node != 0) { return QTHREAD_BADARGS; }
+    memset(stats, 0, sizeof(qpool_stats_t));
+    return QTHREAD_SUCCESS;
+#else
+    return qt_mpool_stats(pool, node, stats);
+#endif
+}                                      /*}}} */
+
+size_t qpool_trim(qpool *pool)
+{                                      /*{{{ */
+    qassert_ret((pool != NULL), 0);
+#ifdef UNPOOLED
+    return 0;
+#else
+    return qt_mpool_trim(pool);
+#endif
+}                                      /*}}} */
+
+void qpool_set_soft_cap(qpool *pool,
+                        size_t bytes)
+{                                      /*{{{ */
+    qassert_retvoid((pool != NULL));
+#ifndef UNPOOLED
+    qt_mpool_set_soft_cap(pool, bytes);
+#endif
+}                                      /*}}} */
+
 /* vim:set expandtab: */
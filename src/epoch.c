@@ -0,0 +1,263 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef QTHREAD_EPOCH_RECLAMATION
+
+/* The API */
+#include "qthread/qthread.h"
+
+/* System Headers */
+#include <stdlib.h>            /* for realloc() */
+
+/* Internal Headers */
+#include "qt_epoch.h"
+#include "qt_shepherd_innards.h"
+#include "qthread_innards.h"
+#include "qt_atomics.h"
+#include "qt_expect.h"
+#include "qt_debug.h" /* for malloc debug headers */
+#include "qt_asserts.h"
+#include "qt_subsystems.h"
+
+/* Starts at 2 so that a bag's epoch tag is never mistaken for "not yet
+ * safe" just because it is still zero. */
+static struct {
+    volatile aligned_t epoch;
+    uint8_t            pad[CACHELINE_WIDTH - sizeof(aligned_t)];
+} Q_ALIGNED(CACHELINE_WIDTH) global = { 2 };
+
+/* Threads that are not workers (external pthreads) announce their epoch
+ * through one of these, kept in a push-only list like the hazard pointers of
+ * such threads. */
+typedef struct qt_epoch_record_s {
+    volatile aligned_t         epoch;
+    unsigned int               depth;
+    struct qt_epoch_record_s  *next;
+} qt_epoch_record_t;
+
+static TLS_DECL_INIT(qt_epoch_record_t *, ts_epoch_record);
+static qt_epoch_record_t *volatile records = NULL;
+
+/* ... and what they retire goes here, to be freed by whichever worker next
+ * notices it is safe. */
+static QTHREAD_FASTLOCK_TYPE orphan_lock;
+static qt_epoch_bag_t        orphans[QT_EPOCH_BAGS];
+static volatile size_t       orphan_count = 0;
+
+static void epoch_bag_free(qt_epoch_bag_t *bag)
+{   /*{{{*/
+    for (size_t i = 0; i < bag->count; ++i) {
+        bag->entries[i].freefunc(bag->entries[i].ptr);
+    }
+    bag->count = 0;
+} /*}}}*/
+
+static void epoch_bag_add(qt_epoch_bag_t  *bag,
+                          aligned_t        e,
+                          hazardous_free_f freefunc,
+                          void            *ptr)
+{   /*{{{*/
+    if (bag->epoch != e) {
+        /* the bag last held an epoch at least QT_EPOCH_BAGS behind, which is
+         * long past being unreachable */
+        epoch_bag_free(bag);
+        bag->epoch = e;
+    }
+    if (QTHREAD_UNLIKELY(bag->count == bag->size)) {
+        bag->size    = bag->size ? (bag->size * 2) : 64;
+        bag->entries = realloc(bag->entries, bag->size * sizeof(qt_epoch_entry_t));
+        assert(bag->entries);
+    }
+    bag->entries[bag->count].freefunc = freefunc;
+    bag->entries[bag->count].ptr      = ptr;
+    bag->count++;
+} /*}}}*/
+
+/* Frees every bag retired two or more epochs before e; returns how many
+ * entries are still waiting. */
+static size_t epoch_bags_collect(qt_epoch_bag_t *bags,
+                                 aligned_t       e)
+{   /*{{{*/
+    size_t pending = 0;
+
+    for (int i = 0; i < QT_EPOCH_BAGS; ++i) {
+        if (bags[i].count == 0) { continue; }
+        if (bags[i].epoch + 2 <= e) {
+            epoch_bag_free(&bags[i]);
+        } else {
+            pending += bags[i].count;
+        }
+    }
+    return pending;
+} /*}}}*/
+
+static void epoch_bags_destroy(qt_epoch_bag_t *bags)
+{   /*{{{*/
+    for (int i = 0; i < QT_EPOCH_BAGS; ++i) {
+        epoch_bag_free(&bags[i]);
+        if (bags[i].entries) {
+            free(bags[i].entries);
+        }
+        bags[i].entries = NULL;
+        bags[i].size    = 0;
+    }
+} /*}}}*/
+
+/* Publishes the current global epoch in *slot. The re-check makes sure the
+ * announcement was visible before the global epoch could move on without
+ * us; otherwise a stale announcement could let nodes we are about to read be
+ * freed underneath us. */
+static QINLINE aligned_t epoch_announce(volatile aligned_t *slot)
+{   /*{{{*/
+    aligned_t e;
+
+    do {
+        e     = global.epoch;
+        *slot = e;
+        MACHINE_FENCE;
+    } while (e != global.epoch);
+    return e;
+} /*}}}*/
+
+/* Moves the global epoch from e to e + 1 if every thread that is currently
+ * inside a critical section has already seen e. */
+static void epoch_try_advance(aligned_t e)
+{   /*{{{*/
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
+            aligned_t const we = qlib->shepherds[i].workers[j].epoch.epoch;
+            if ((we != 0) && (we != e)) { return; }
+        }
+    }
+    for (qt_epoch_record_t *r = records; r != NULL; r = r->next) {
+        aligned_t const re = r->epoch;
+        if ((re != 0) && (re != e)) { return; }
+    }
+    (void)qthread_cas(&global.epoch, e, e + 1);
+} /*}}}*/
+
+static void epoch_collect_orphans(aligned_t e)
+{   /*{{{*/
+    QTHREAD_FASTLOCK_LOCK(&orphan_lock);
+    orphan_count = epoch_bags_collect(orphans, e);
+    QTHREAD_FASTLOCK_UNLOCK(&orphan_lock);
+} /*}}}*/
+
+void INTERNAL qt_epoch_offline(qthread_worker_t *w)
+{   /*{{{*/
+    /* make sure everything this worker's last task read was read before it
+     * stops holding back the epoch */
+    MACHINE_FENCE;
+    w->epoch.epoch = 0;
+} /*}}}*/
+
+void INTERNAL qt_epoch_online(qthread_worker_t *w)
+{   /*{{{*/
+    aligned_t const e       = epoch_announce(&w->epoch.epoch);
+    size_t          pending = epoch_bags_collect(w->epoch.bags, e);
+
+    if (orphan_count) {
+        epoch_collect_orphans(e);
+        pending += orphan_count;
+    }
+    /* only nodes waiting to be freed are a reason to look at everyone else */
+    if (pending) {
+        epoch_try_advance(e);
+    }
+} /*}}}*/
+
+void INTERNAL qt_epoch_enter(void)
+{   /*{{{*/
+    qt_epoch_record_t *r;
+
+    /* workers are always inside a critical section while running a task */
+    if (qthread_internal_getworker() != NULL) { return; }
+
+    r = TLS_GET(ts_epoch_record);
+    if (r == NULL) {
+        r = calloc(1, sizeof(qt_epoch_record_t));
+        assert(r);
+        do {
+            r->next = records;
+        } while (qthread_cas_ptr((void **)&records, r->next, r) != r->next);
+        TLS_SET(ts_epoch_record, r);
+    }
+    if (r->depth++ == 0) {
+        (void)epoch_announce(&r->epoch);
+    }
+} /*}}}*/
+
+void INTERNAL qt_epoch_exit(void)
+{   /*{{{*/
+    qt_epoch_record_t *r;
+
+    if (qthread_internal_getworker() != NULL) { return; }
+
+    r = TLS_GET(ts_epoch_record);
+    assert(r && r->depth > 0);
+    if (--r->depth == 0) {
+        MACHINE_FENCE;
+        r->epoch = 0;
+    }
+} /*}}}*/
+
+void INTERNAL qt_epoch_retire(hazardous_free_f freefunc,
+                              void            *ptr)
+{   /*{{{*/
+    qthread_worker_t *w;
+    aligned_t         e;
+
+    assert(ptr != NULL);
+    assert(freefunc != NULL);
+    /* read after the node was unlinked, so that a thread that has seen a
+     * later epoch cannot have found it */
+    MACHINE_FENCE;
+    e = global.epoch;
+    w = qthread_internal_getworker();
+    if (w != NULL) {
+        epoch_bag_add(&w->epoch.bags[e % QT_EPOCH_BAGS], e, freefunc, ptr);
+    } else {
+        QTHREAD_FASTLOCK_LOCK(&orphan_lock);
+        epoch_bag_add(&orphans[e % QT_EPOCH_BAGS], e, freefunc, ptr);
+        orphan_count++;
+        QTHREAD_FASTLOCK_UNLOCK(&orphan_lock);
+    }
+} /*}}}*/
+
+static void epoch_internal_teardown(void)
+{   /*{{{*/
+    /* the workers are gone, so everything retired is now unreachable */
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
+            epoch_bags_destroy(qlib->shepherds[i].workers[j].epoch.bags);
+        }
+    }
+    epoch_bags_destroy(orphans);
+    orphan_count = 0;
+    QTHREAD_FASTLOCK_DESTROY(orphan_lock);
+    TLS_DELETE(ts_epoch_record);
+    while (records != NULL) {
+        qt_epoch_record_t *r = records;
+        records = r->next;
+        free(r);
+    }
+} /*}}}*/
+
+void INTERNAL initialize_epochs(void)
+{   /*{{{*/
+    global.epoch = 2;
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; ++i) {
+        for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
+            memset(&qlib->shepherds[i].workers[j].epoch, 0, sizeof(qt_epoch_worker_t));
+        }
+    }
+    memset(orphans, 0, sizeof(orphans));
+    QTHREAD_FASTLOCK_INIT(orphan_lock);
+    TLS_INIT(ts_epoch_record);
+    qthread_internal_cleanup(epoch_internal_teardown);
+}   /*}}}*/
+
+#endif /* ifdef QTHREAD_EPOCH_RECLAMATION */
+
+/* vim:set expandtab: */
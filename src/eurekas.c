@@ -28,9 +28,11 @@ static qt_team_t *eureka_ptr         = NULL;
 static aligned_t  eureka_in_barrier  = 0;
 static aligned_t  eureka_out_barrier = 0;
 
+/* Tasks delivering a eureka from a parent team are spared: they take over
+ * as the team's leader once they run. */
 static filter_code eureka_filter(qthread_t *t)
 {   /*{{{*/
-    if (t->team == eureka_ptr) {
+    if ((t->team == eureka_ptr) && !(t->flags & QTHREAD_TEAM_WATCHER)) {
         tassert((t->flags & QTHREAD_REAL_MCCOY) == 0);
         return REMOVE_AND_CONTINUE; // remove, keep going
     } else {
@@ -45,7 +47,7 @@ static void eureka(void)
     qthread_t          *t = w->current;
 
     if (t) {
-        if (t->team == eureka_ptr) {
+        if ((t->team == eureka_ptr) && !(t->flags & QTHREAD_TEAM_WATCHER)) {
             tassert((t->flags & QTHREAD_REAL_MCCOY) == 0);
             t->thread_state = QTHREAD_STATE_ASSASSINATED;
         }
@@ -239,9 +241,7 @@ void API_FUNC qt_team_eureka(void)
     MACHINE_FENCE;
     eureka_ptr = my_team;
     MACHINE_FENCE;
-    /* 2: writeEF my team's Eureka, to signal all the waiters */
-    qthread_debug(TEAM_DETAILS, "setting my team's (%u) eureka batsignal (%p) to %u\n", my_team->team_id, &my_team->eureka, TEAM_SIGNAL_EUREKA(my_team->team_id));
-    qthread_writeEF_const(&my_team->eureka, TEAM_SIGNAL_EUREKA(my_team->team_id));
+    /* 2: (subteams are told in step 9, once this team's tasks are gone) */
     /* 3: broadcast signal to all the other workers */
     /* NOTE: From here until the end of barrier 2, printfs are STRICTLY
      *    FORBIDDEN. Printf, on many platforms, uses a mutex for one reason or
@@ -313,17 +313,16 @@ void API_FUNC qt_team_eureka(void)
     /* 9-step1: assume team-leader position */
     self->flags |= QTHREAD_TEAM_LEADER;
     /* 9-step2: reset team data */
-    if ((my_team->parent_id != QTHREAD_DEFAULT_TEAM_ID) &&
-        (my_team->parent_id != QTHREAD_NON_TEAM_ID)) {
-        qt_sinc_reset(my_team->sinc, 2);              // I, and the waiter, are the only remaining members
-    } else {
-        qt_sinc_reset(my_team->sinc, 1);              // I am the only remaining member
-    }
+    qt_sinc_reset(my_team->sinc, 1);              // I am the only remaining member
+    /* 9-step3: hand the eureka on to the subteams */
+    qt_eureka_disable();
+    qt_internal_team_eureka_subteams(my_team);
+    qt_eureka_check(0);
     qt_sinc_submit(my_team->subteams_sinc, NULL); // wait for subteams to die (if any)
     qthread_debug(TEAM_DETAILS, "wait for subteams to die... %p\n", &my_team->subteams_sinc);
     qt_sinc_wait(my_team->subteams_sinc, NULL);
     qt_sinc_reset(my_team->subteams_sinc, 1); // reset the subteams sinc
-    /* 9-step3: change my retloc */
+    /* 9-step4: change my retloc */
     assert(self->ret == NULL || self->ret == my_team->return_loc); // XXX: what should we do if this is not true?
     self->ret    = my_team->return_loc;
     self->flags |= QTHREAD_RET_MASK;
@@ -31,10 +31,36 @@
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_output_macros.h"
 
+/* The slot fast path relies on the hash lock to serialize against the
+ * hashed path, so it is unavailable with the lock-free hash; it is also
+ * unavailable when profiling, which measures per-addrstat empty times. */
+#if !defined(LOCK_FREE_FEBS) && !defined(QTHREAD_FEB_PROFILING)
+# define QTHREAD_FEB_FASTPATH
+# define QTHREAD_FEB_SLOTS_PER_STRIPE 64
+# define QTHREAD_FEB_MIN_SLOTS        (1 << 14)
+/* slot values; see qt_feb_fastpath() */
+# define FEB_SLOT_FULL   ((void *)(uintptr_t)0)
+# define FEB_SLOT_HASHED ((void *)(uintptr_t)1)
+# define FEB_SLOT_EMPTY  ((uintptr_t)1)
+# define FEB_SLOT_BUSY   ((uintptr_t)2)
+/* orders the data copy against the slot update; x86 does not reorder loads
+ * with loads or stores with stores */
+# if ((QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA32))
+#  define FEB_SLOT_FENCE COMPILER_FENCE
+# else
+#  define FEB_SLOT_FENCE MACHINE_FENCE
+# endif
+#endif
+
 /********************************************************************
  * Local Variables
  *********************************************************************/
 static qt_hash *FEBs;
+#ifdef QTHREAD_FEB_FASTPATH
+static void *volatile *FEBslots;
+static unsigned int   *FEBslots_hashed; /* protected by the stripe's hash lock */
+static unsigned int    FEBslots_mask;
+#endif
 #ifdef QTHREAD_COUNT_THREADS
 aligned_t *febs_stripes;
 # ifdef QTHREAD_MUTEX_INCREMENT
@@ -94,8 +120,8 @@ qt_mpool generic_addrstat_pool = NULL;
 qt_mpool generic_addrres_pool = NULL;
 #endif
 
-/* guaranteed to be between 0 and 128, using the first parts of addr that are
- * significant */
+/* sized from the number of workers (or QT_LOCKING_STRIPES) in
+ * qthread_initialize(); always a power of two */
 unsigned int QTHREAD_LOCKING_STRIPES = 128;
 
 /********************************************************************
@@ -118,6 +144,10 @@ static void qt_feb_subsystem_shutdown(void)
 #endif
     }
     FREE(FEBs, sizeof(qt_hash) * QTHREAD_LOCKING_STRIPES);
+#ifdef QTHREAD_FEB_FASTPATH
+    FREE((void *)FEBslots, sizeof(void *) * (FEBslots_mask + 1));
+    FREE(FEBslots_hashed, sizeof(unsigned int) * (FEBslots_mask + 1));
+#endif
 #ifdef QTHREAD_COUNT_THREADS
     FREE(febs_stripes, sizeof(aligned_t) * QTHREAD_LOCKING_STRIPES);
 # ifdef QTHREAD_MUTEX_INCREMENT
@@ -146,6 +176,20 @@ void INTERNAL qt_feb_subsystem_init(uint_fast8_t need_sync)
 #endif
     FEBs = MALLOC(sizeof(qt_hash) * QTHREAD_LOCKING_STRIPES);
     assert(FEBs);
+#ifdef QTHREAD_FEB_FASTPATH
+    FEBslots_mask = QTHREAD_LOCKING_STRIPES * QTHREAD_FEB_SLOTS_PER_STRIPE;
+    if (FEBslots_mask < QTHREAD_FEB_MIN_SLOTS) {
+        FEBslots_mask = QTHREAD_FEB_MIN_SLOTS;
+    }
+    FEBslots_mask--;
+    FEBslots        = MALLOC(sizeof(void *) * (FEBslots_mask + 1));
+    FEBslots_hashed = MALLOC(sizeof(unsigned int) * (FEBslots_mask + 1));
+    assert(FEBslots && FEBslots_hashed);
+    for (unsigned i = 0; i <= FEBslots_mask; i++) {
+        FEBslots[i]        = FEB_SLOT_FULL;
+        FEBslots_hashed[i] = 0;
+    }
+#endif
 #ifdef QTHREAD_COUNT_THREADS
     febs_stripes = MALLOC(sizeof(aligned_t) * QTHREAD_LOCKING_STRIPES);
     assert(febs_stripes);
@@ -238,14 +282,190 @@ static int qthread_feb_blocker_func(void        *dest,
     return args.retval;
 } /*}}}*/
 
-#define QTHREAD_CHOOSE_STRIPE2(addr) (qt_hash64((uint64_t)(uintptr_t)addr) & (QTHREAD_LOCKING_STRIPES - 1))
-// #define QTHREAD_CHOOSE_STRIPE2(addr) QTHREAD_CHOOSE_STRIPE(addr)
 /* The lock ordering in these functions is very particular, and is designed to
  * reduce the impact of having only one hashtable. Don't monkey with it unless
  * you REALLY know what you're doing! If one hashtable becomes a problem, we
  * may need to move to a new mechanism.
  */
 
+#ifdef QTHREAD_FEB_FASTPATH
+/* Every address also maps to a slot in FEBslots; the slots are nested inside
+ * the stripes, so all of a slot's addresses share a hash table. A slot holds
+ * one of:
+ *
+ *   FEB_SLOT_FULL          - every address in the slot is full
+ *   addr|FEB_SLOT_EMPTY    - addr is empty, every other address is full
+ *   FEB_SLOT_HASHED        - the state of the slot's addresses is kept in the
+ *                            hash table as addrstats, exactly as without slots
+ *
+ * The first two are owned by the fast path, which flips them with a CAS on
+ * the slot word (holding FEB_SLOT_BUSY while it copies data), so uncontended
+ * transitions never touch the hash table or allocate an addrstat. When an
+ * operation needs to wait, or a second address in the slot needs to be
+ * emptied, the slot is converted to FEB_SLOT_HASHED while both the slot and
+ * the stripe's hash lock are held. It reverts to FEB_SLOT_FULL when
+ * qthread_FEB_remove() deletes the last addrstat that belongs to it, which
+ * also happens under the hash lock; hence anything that takes the hash lock
+ * must check that the slot is still hashed before trusting the table. */
+# define QTHREAD_FEB_SLOT(addr, lockbin) \
+    ((((uintptr_t)(addr) / sizeof(aligned_t)) * QTHREAD_LOCKING_STRIPES + (lockbin)) & FEBslots_mask)
+
+static QINLINE void qt_feb_hash_put_locked(const int           lockbin,
+                                           const aligned_t    *addr,
+                                           qthread_addrstat_t *m)
+{   /*{{{*/
+    qassertnot(qt_hash_put_locked(FEBs[lockbin], (void *)addr, m), 0);
+    FEBslots_hashed[QTHREAD_FEB_SLOT(addr, lockbin)]++;
+} /*}}}*/
+
+static QINLINE void qt_feb_hash_remove_locked(const int        lockbin,
+                                              const aligned_t *addr)
+{   /*{{{*/
+    const unsigned int slot = QTHREAD_FEB_SLOT(addr, lockbin);
+
+    qassertnot(qt_hash_remove_locked(FEBs[lockbin], (void *)addr), 0);
+    assert(FEBslots_hashed[slot] > 0);
+    if (--FEBslots_hashed[slot] == 0) {
+        assert(FEBslots[slot] == FEB_SLOT_HASHED);
+        MACHINE_FENCE;
+        FEBslots[slot] = FEB_SLOT_FULL;
+    }
+} /*}}}*/
+
+/* Performs op on addr if its slot is not hashed and op does not need to wait,
+ * returning 1 and storing the result in *ret. Otherwise returns 0 with the
+ * stripe's hash lock held and the slot hashed. The data copy, if any, is
+ * *dest = *src. */
+static int qt_feb_fastpath(const blocker_type       op,
+                           const int                lockbin,
+                           const aligned_t         *addr,
+                           aligned_t *restrict       dest,
+                           const aligned_t *restrict src,
+                           int                     *ret)
+{   /*{{{*/
+    const unsigned int   slotidx = QTHREAD_FEB_SLOT(addr, lockbin);
+    void *volatile      *slot    = &FEBslots[slotidx];
+    void *const          mine    = (void *)((uintptr_t)addr | FEB_SLOT_EMPTY);
+    void                *cur, *next;
+    qthread_addrstat_t  *m;
+
+    if ((op == READFF) || (op == READFF_NB)) {
+        /* reading a full address changes nothing, so it is enough to see
+         * that the slot did not change around the copy */
+        while (1) {
+            cur = *slot;
+            if ((cur == FEB_SLOT_HASHED) || (cur == mine) ||
+                ((uintptr_t)cur & FEB_SLOT_BUSY)) {
+                break;
+            }
+            if (dest && (dest != src)) {
+                *dest = *src;
+            }
+            FEB_SLOT_FENCE;
+            if (*slot == cur) {
+                *ret = QTHREAD_SUCCESS;
+                return 1;
+            }
+        }
+    }
+    while (1) {
+        cur = *slot;
+        if (cur == FEB_SLOT_HASHED) {
+            qt_hash_lock(FEBs[lockbin]);
+            if (*slot == FEB_SLOT_HASHED) { return 0; }
+            qt_hash_unlock(FEBs[lockbin]);
+        } else if ((uintptr_t)cur & FEB_SLOT_BUSY) {
+            SPINLOCK_BODY();
+        } else if (qthread_cas_ptr(slot, cur, (void *)((uintptr_t)cur | FEB_SLOT_BUSY)) == cur) {
+            break;
+        }
+    }
+    /* the slot is ours until it is stored again */
+    next = cur;
+    *ret = QTHREAD_SUCCESS;
+    if (cur == mine) {
+        /* addr is empty */
+        switch (op) {
+            case WRITEEF:
+            case WRITEEF_NB:
+            case WRITEF:
+                if (dest && (dest != src)) {
+                    *dest = *src;
+                }
+                next = FEB_SLOT_FULL;
+                break;
+            case FILL:
+                next = FEB_SLOT_FULL;
+                break;
+            case EMPTY:
+                break;
+            case READFF_NB:
+            case READFE_NB:
+                *ret = QTHREAD_OPFAIL;
+                break;
+            default:
+                goto hashed; /* has to wait */
+        }
+    } else {
+        /* addr is full */
+        switch (op) {
+            case READFE:
+            case READFE_NB:
+            case EMPTY:
+                if (cur != FEB_SLOT_FULL) {
+                    goto hashed; /* another address in the slot is empty */
+                }
+                next = mine;
+            /* fall through */
+            case READFF:
+            case READFF_NB:
+            case WRITEF:
+                if (dest && (dest != src)) {
+                    *dest = *src;
+                }
+                break;
+            case FILL:
+                break;
+            case WRITEEF_NB:
+                *ret = QTHREAD_OPFAIL;
+                break;
+            case WRITEEF:
+                goto hashed; /* has to wait */
+        }
+    }
+    FEB_SLOT_FENCE;
+    *slot = next;
+    return 1;
+
+hashed:
+    qt_hash_lock(FEBs[lockbin]);
+    if (cur != FEB_SLOT_FULL) {
+        /* move the empty address into the table */
+        m = qthread_addrstat_new();
+        if (!m) {
+            qt_hash_unlock(FEBs[lockbin]);
+            *slot = cur;
+            *ret  = QTHREAD_MALLOC_ERROR;
+            return 1;
+        }
+        m->full = 0;
+        qt_feb_hash_put_locked(lockbin, (aligned_t *)((uintptr_t)cur & ~FEB_SLOT_EMPTY), m);
+    }
+    qthread_debug(FEB_DETAILS, "addr=%p: slot %u is now hashed\n", addr, slotidx);
+    MACHINE_FENCE;
+    *slot = FEB_SLOT_HASHED;
+    return 0;
+} /*}}}*/
+
+#else /* ifdef QTHREAD_FEB_FASTPATH */
+# define qt_feb_hash_put_locked(lockbin, addr, m) \
+    qassertnot(qt_hash_put_locked(FEBs[lockbin], (void *)(addr), (m)), 0)
+# define qt_feb_hash_remove_locked(lockbin, addr) \
+    qassertnot(qt_hash_remove_locked(FEBs[lockbin], (void *)(addr)), 0)
+# define qt_feb_fastpath(op, lockbin, addr, dest, src, ret) \
+    (qt_hash_lock(FEBs[lockbin]), 0)
+#endif /* ifdef QTHREAD_FEB_FASTPATH */
+
 /* This is just a little function that should help in debugging */
 int API_FUNC qthread_feb_status(const aligned_t *addr)
 {                      /*{{{ */
@@ -257,7 +477,7 @@ int API_FUNC qthread_feb_status(const aligned_t *addr)
     }
     qthread_addrstat_t *m;
     int                 status  = 1; /* full */
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(addr);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(addr);
 
     QALIGN(addr, alignedaddr);
     QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
@@ -278,7 +498,12 @@ int API_FUNC qthread_feb_status(const aligned_t *addr)
         break;
     } while (1);
 #else  /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]); {
+    if (qt_feb_fastpath(READFF_NB, lockbin, alignedaddr, NULL, NULL, &status)) {
+        status = (status == QTHREAD_SUCCESS);
+        qthread_debug(FEB_BEHAVIOR, "addr %p is %i\n", addr, status);
+        return status;
+    }
+    {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin],
                                                      (void *)alignedaddr);
         if (m) {
@@ -298,7 +523,7 @@ int API_FUNC qthread_feb_status(const aligned_t *addr)
 static QINLINE void qthread_FEB_remove(void *maddr)
 {                      /*{{{ */
     qthread_addrstat_t *m;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(maddr);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(maddr);
 
     // qthread_debug(ALWAYS_OUTPUT, "Attempting removal of addr %p\n", maddr);
     qthread_debug(FEB_BEHAVIOR, "maddr=%p: attempting removal\n", maddr);
@@ -346,7 +571,7 @@ got_m:
             if ((m->FEQ == NULL) && (m->EFQ == NULL) && (m->FFQ == NULL) &&
                 (m->full == 1)) {
                 qthread_debug(FEB_DETAILS, "maddr=%p: lists are empty, status is full; invalidating and removing\n", maddr);
-                qassertnot(qt_hash_remove_locked(FEBs[lockbin], maddr), 0);
+                qt_feb_hash_remove_locked(lockbin, maddr);
             } else {
                 QTHREAD_FASTLOCK_UNLOCK(&(m->lock));
                 qthread_debug(FEB_DETAILS, "maddr=%p: addrstat cannot be removed; in use\n", maddr);
@@ -547,6 +772,7 @@ int API_FUNC qthread_empty(const aligned_t *dest)
 
     qthread_addrstat_t *m;
     qt_hash             FEBbin;
+    int                 lockbin;
     qthread_shepherd_t *shep = qthread_internal_getshep();
 
     assert(qthread_library_initialized);
@@ -555,13 +781,10 @@ int API_FUNC qthread_empty(const aligned_t *dest)
         return qthread_feb_blocker_func((void *)dest, NULL, EMPTY);
     }
     QALIGN(dest, alignedaddr);
-    {
-        const int lockbin = QTHREAD_CHOOSE_STRIPE2(alignedaddr);
-        FEBbin = FEBs[lockbin];
-        qthread_debug(FEB_CALLS, "dest=%p (tid=%i lockbin=%u)\n", dest, qthread_id(), lockbin);
-
-        QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
-    }
+    lockbin = QTHREAD_CHOOSE_STRIPE(alignedaddr);
+    FEBbin  = FEBs[lockbin];
+    qthread_debug(FEB_CALLS, "dest=%p (tid=%i lockbin=%u)\n", dest, qthread_id(), lockbin);
+    QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 #ifdef LOCK_FREE_FEBS
     do {
         m = qt_hash_get(FEBbin, (void *)alignedaddr);
@@ -596,7 +819,13 @@ int API_FUNC qthread_empty(const aligned_t *dest)
         }
     } while (1);
 #else  /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBbin);
+    {
+        int ret;
+        if (qt_feb_fastpath(EMPTY, lockbin, alignedaddr, NULL, NULL, &ret)) {
+            qthread_debug(FEB_BEHAVIOR, "dest=%p (tid=%i): fast path returned %i\n", dest, qthread_id(), ret);
+            return ret;
+        }
+    }
     {                      /* BEGIN CRITICAL SECTION */
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBbin, (void *)alignedaddr);
         if (!m) {
@@ -609,7 +838,7 @@ int API_FUNC qthread_empty(const aligned_t *dest)
             m->full = 0;
             QTHREAD_EMPTY_TIMER_START(m);
             COMPILER_FENCE;
-            qassertnot(qt_hash_put_locked(FEBbin, (void *)alignedaddr, m), 0);
+            qt_feb_hash_put_locked(lockbin, alignedaddr, m);
             qthread_debug(FEB_DETAILS, "dest=%p (tid=%i): inserted m=%p\n", dest, qthread_id(), m);
             m = NULL;
         } else {
@@ -636,7 +865,7 @@ int API_FUNC qthread_fill(const aligned_t *dest)
         return QTHREAD_SUCCESS;
     }
     qthread_addrstat_t *m;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(dest);
     qthread_shepherd_t *shep    = qthread_internal_getshep();
 
     assert(qthread_library_initialized);
@@ -666,7 +895,13 @@ int API_FUNC qthread_fill(const aligned_t *dest)
         break;
     } while (1);
 #else  /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]);
+    {
+        int ret;
+        if (qt_feb_fastpath(FILL, lockbin, alignedaddr, NULL, NULL, &ret)) {
+            qthread_debug(FEB_DETAILS, "dest=%p (tid=%i): fast path returned %i\n", dest, qthread_id(), ret);
+            return ret;
+        }
+    }
     {                      /* BEGIN CRITICAL SECTION */
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -697,7 +932,7 @@ int API_FUNC qthread_writeF(aligned_t *restrict       dest,
 
     qthread_debug(FEB_CALLS, "dest=%p, src=%p\n", dest, src);
     qthread_addrstat_t *m;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(dest);
     qthread_shepherd_t *shep    = qthread_internal_getshep();
 
     assert(qthread_library_initialized);
@@ -729,7 +964,14 @@ got_m:
         break;
     } while (1);
 #else  /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]); {    /* lock hash */
+    {
+        int ret;
+        if (qt_feb_fastpath(WRITEF, lockbin, alignedaddr, dest, src, &ret)) {
+            qthread_debug(FEB_BEHAVIOR, "tid %u fast path returned %i on %p=%p\n", (shep->current) ? (shep->current->thread_id) : UINT_MAX, ret, dest, src);
+            return ret;
+        }
+    }
+    {    /* hash is locked */
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
             QTHREAD_FASTLOCK_LOCK(&m->lock);
@@ -767,7 +1009,7 @@ int API_FUNC qthread_writeEF(aligned_t *restrict       dest,
 
     qthread_addrstat_t *m;
     qthread_addrres_t  *X       = NULL;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(dest);
     qthread_t          *me      = qthread_internal_self();
 
     QTHREAD_FEB_TIMER_DECLARATION(febblock);
@@ -825,7 +1067,13 @@ got_m:
         }
     } while(1);
 #else  /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]);
+    {
+        int ret;
+        if (qt_feb_fastpath(WRITEEF, lockbin, alignedaddr, dest, src, &ret)) {
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return ret;
+        }
+    }
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (!m) {
@@ -834,7 +1082,7 @@ got_m:
                 qt_hash_unlock(FEBs[lockbin]);
                 return QTHREAD_MALLOC_ERROR;
             }
-            qassertnot(qt_hash_put_locked(FEBs[lockbin], alignedaddr, m), 0);
+            qt_feb_hash_put_locked(lockbin, alignedaddr, m);
         }
         QTHREAD_FASTLOCK_LOCK(&(m->lock));
     }
@@ -890,7 +1138,7 @@ int INTERNAL qthread_writeEF_nb(aligned_t *restrict       dest,
 
     qthread_debug(FEB_CALLS, "dest=%p, src=%p\n", dest, src);
     qthread_addrstat_t *m;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(dest);
     qthread_t          *me      = qthread_internal_self();
 
     if (!me) {
@@ -917,7 +1165,12 @@ int INTERNAL qthread_writeEF_nb(aligned_t *restrict       dest,
         }
     } while (1);
 # else /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]);
+    {
+        int ret;
+        if (qt_feb_fastpath(WRITEEF_NB, lockbin, alignedaddr, dest, src, &ret)) {
+            return ret;
+        }
+    }
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -962,7 +1215,7 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
 
     qthread_addrstat_t *m       = NULL;
     qthread_addrres_t  *X       = NULL;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(src);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(src);
     qthread_t          *me      = qthread_internal_self();
 
     QTHREAD_FEB_TIMER_DECLARATION(febblock);
@@ -992,7 +1245,13 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
         break;
     } while(1);
 # else /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]);
+    {
+        int ret;
+        if (qt_feb_fastpath(READFF, lockbin, alignedaddr, dest, src, &ret)) {
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return ret;
+        }
+    }
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -1049,7 +1308,7 @@ int INTERNAL qthread_readFF_nb(aligned_t *restrict       dest,
 
     qthread_debug(FEB_CALLS, "dest=%p, src=%p\n", dest, src);
     qthread_addrstat_t *m       = NULL;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(src);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(src);
     qthread_t          *me      = qthread_internal_self();
 
     if (!me) {
@@ -1079,7 +1338,12 @@ got_m:
         break;
     } while(1);
 # else /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]);
+    {
+        int ret;
+        if (qt_feb_fastpath(READFF_NB, lockbin, alignedaddr, dest, src, &ret)) {
+            return ret;
+        }
+    }
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -1123,7 +1387,7 @@ int API_FUNC qthread_readFE(aligned_t *restrict       dest,
     const aligned_t *alignedaddr;
 
     qthread_addrstat_t *m;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(src);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(src);
     qthread_t          *me      = qthread_internal_self();
 
     QTHREAD_FEB_TIMER_DECLARATION(febblock);
@@ -1172,7 +1436,13 @@ got_m:
         }
     } while (1);
 # else /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]);
+    {
+        int ret;
+        if (qt_feb_fastpath(READFE, lockbin, alignedaddr, dest, src, &ret)) {
+            QTHREAD_FEB_TIMER_STOP(febblock, me);
+            return ret;
+        }
+    }
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], alignedaddr);
         if (!m) {
@@ -1181,7 +1451,7 @@ got_m:
                 qt_hash_unlock(FEBs[lockbin]);
                 return QTHREAD_MALLOC_ERROR;
             }
-            qassertnot(qt_hash_put_locked(FEBs[lockbin], alignedaddr, m), 0);
+            qt_feb_hash_put_locked(lockbin, alignedaddr, m);
         }
         QTHREAD_FASTLOCK_LOCK(&(m->lock));
     }
@@ -1233,7 +1503,7 @@ int INTERNAL qthread_readFE_nb(aligned_t *restrict       dest,
 
     qthread_debug(FEB_CALLS, "dest=%p, src=%p\n", dest, src);
     qthread_addrstat_t *m;
-    const int           lockbin = QTHREAD_CHOOSE_STRIPE2(src);
+    const int           lockbin = QTHREAD_CHOOSE_STRIPE(src);
     qthread_t          *me      = qthread_internal_self();
 
     if (!me) {
@@ -1271,7 +1541,12 @@ int INTERNAL qthread_readFE_nb(aligned_t *restrict       dest,
         }
     } while (1);
 # else /* ifdef LOCK_FREE_FEBS */
-    qt_hash_lock(FEBs[lockbin]);
+    {
+        int ret;
+        if (qt_feb_fastpath(READFE_NB, lockbin, alignedaddr, dest, src, &ret)) {
+            return ret;
+        }
+    }
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], alignedaddr);
         if (!m) {
@@ -1280,7 +1555,7 @@ int INTERNAL qthread_readFE_nb(aligned_t *restrict       dest,
                 qt_hash_unlock(FEBs[lockbin]);
                 return QTHREAD_MALLOC_ERROR;
             }
-            qassertnot(qt_hash_put_locked(FEBs[lockbin], alignedaddr, m), 0);
+            qt_feb_hash_put_locked(lockbin, alignedaddr, m);
         }
         QTHREAD_FASTLOCK_LOCK(&(m->lock));
     }
@@ -1337,7 +1612,7 @@ int INTERNAL qthread_check_feb_preconds(qthread_t *t)
     // Process input preconds
     while (these_preconds && (these_preconds[0] != NULL)) {
         aligned_t          *this_sync = these_preconds[(uintptr_t)these_preconds[0]];
-        const int           lockbin   = QTHREAD_CHOOSE_STRIPE2(this_sync);
+        const int           lockbin   = QTHREAD_CHOOSE_STRIPE(this_sync);
         const aligned_t    *alignedaddr;
         qthread_addrstat_t *m = NULL;
 
@@ -1360,7 +1635,16 @@ int INTERNAL qthread_check_feb_preconds(qthread_t *t)
             break;
         } while(1);
 #else   /* ifdef LOCK_FREE_FEBS */
-        qt_hash_lock(FEBs[lockbin]);
+        {
+            int ret;
+            if (qt_feb_fastpath(READFF, lockbin, alignedaddr, NULL, NULL, &ret)) {
+                if (ret != QTHREAD_SUCCESS) {
+                    return ret;
+                }
+                these_preconds[0] = (aligned_t *)(((uintptr_t)these_preconds[0]) - 1);
+                continue;
+            }
+        }
         {
             m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
             if (m) {
@@ -1426,17 +1710,9 @@ static filter_code qt_feb_tf_call_cb(const qt_key_t            addr,
     void             *tls;
 
     if (waiter->rdata->tasklocal_size <= qlib->qthread_tasklocal_size) {
-        if (waiter->flags & QTHREAD_BIG_STRUCT) {
-            tls = &waiter->data[qlib->qthread_argcopy_size];
-        } else {
-            tls = waiter->data;
-        }
+        tls = QTHREAD_TASKLOCAL_DATA(waiter);
     } else {
-        if (waiter->flags & QTHREAD_BIG_STRUCT) {
-            tls = *(void **)&waiter->data[qlib->qthread_argcopy_size];
-        } else {
-            tls = *(void **)&waiter->data[0];
-        }
+        tls = *(void **)QTHREAD_TASKLOCAL_DATA(waiter);
     }
     f((void *)addr, waiter->f, waiter->arg, waiter->ret, waiter->thread_id, tls, f_arg);
     return IGNORE_AND_CONTINUE;
@@ -41,6 +41,7 @@ struct qt_hash_s {
 static uint_fast8_t linesize = 0;
 static uint_fast8_t bucketsize;
 static size_t bucketmask;
+#define QT_HASH_LOCK_SIZE (((sizeof(QTHREAD_FASTLOCK_TYPE) + linesize - 1) / linesize) * linesize)
 #define KEY_NULL    ((qt_key_t)0)
 #define KEY_DELETED ((qt_key_t)1)
 
@@ -143,7 +144,9 @@ qt_hash INTERNAL qt_hash_create(int needSync)
     ret = calloc(1, sizeof(struct qt_hash_s));
     if (ret) {
         if (needSync) {
-            ret->lock = MALLOC(sizeof(QTHREAD_FASTLOCK_TYPE));
+            /* a whole cacheline, so that neighboring tables' locks don't
+             * false-share */
+            ret->lock = qthread_internal_aligned_alloc(QT_HASH_LOCK_SIZE, linesize);
             QTHREAD_FASTLOCK_INIT_PTR(ret->lock);
         } else {
             ret->lock = NULL;
@@ -158,7 +161,7 @@ void INTERNAL qt_hash_destroy(qt_hash h)
     assert(h);
     if (h->lock) {
         QTHREAD_FASTLOCK_DESTROY_PTR(h->lock);
-        FREE((void *)h->lock, sizeof(QTHREAD_FASTLOCK_TYPE));
+        qthread_internal_aligned_free((void *)h->lock, linesize);
     }
     assert(h->entries);
     qthread_internal_aligned_free(h->entries, linesize);
@@ -29,6 +29,13 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
+#include <errno.h>
+#ifdef QTHREAD_USE_IO_URING
+# include <string.h>                   /* for memset() */
+# include <strings.h>                  /* for strncasecmp() */
+# include <sys/mman.h>                 /* for mmap() */
+# include <linux/io_uring.h>
+#endif
 
 /* Internal Headers */
 #include "qt_io.h"
@@ -58,8 +65,403 @@ static unsigned long timeout    = 100; // in microseconds
 static int           proxy_exit = 0;
 TLS_DECL_INIT(qthread_t *, IO_task_struct);
 
+#ifdef QTHREAD_USE_IO_URING
+/* The io_uring engine gives each shepherd its own ring. Workers submit SQEs
+ * straight from qthread_master(), once the blocked qthread has been switched
+ * out, and a single reaper pthread per ring turns completions back into
+ * runnable qthreads, so the number of outstanding I/O operations is not
+ * limited by the number of OS threads. Anything the ring can't express (or
+ * anything submitted while the ring is full) goes to the proxy pool below. */
+typedef struct {
+    int                   fd;
+    QTHREAD_FASTLOCK_TYPE sq_lock;
+    unsigned             *sq_tail;
+    unsigned             *sq_mask;
+    unsigned             *sq_array;
+    struct io_uring_sqe  *sqes;
+    unsigned             *cq_head;
+    unsigned             *cq_tail;
+    unsigned             *cq_mask;
+    struct io_uring_cqe  *cqes;
+    unsigned              cq_entries;
+    saligned_t            inflight;     /* CQEs not yet reaped */
+    void                 *ring_mem;
+    size_t                ring_size;
+    size_t                sqes_size;
+    pthread_t             reaper;
+} qt_io_ring_t;
+
+static qt_io_ring_t *io_rings      = NULL; /* one per shepherd; NULL means proxy only */
+static size_t        io_ring_count = 0;
+static uint_fast8_t  io_ring_ops[USER_DEFINED + 1];
+
+# define IO_RING_IGNORE ((uint64_t)0)  /* user_data of linked timeouts */
+# define IO_RING_EXIT   ((uint64_t)1)  /* user_data of the reaper's exit NOP */
+
+static int qt_io_ring_enter(qt_io_ring_t *ring,
+                            unsigned      to_submit,
+                            unsigned      min_complete,
+                            unsigned      flags)
+{   /*{{{*/
+    long r;
+
+    do {
+        r = syscall(SYS_io_uring_enter, ring->fd, to_submit, min_complete, flags, NULL, 0);
+    } while (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+    if (r < 0) {
+        perror("qt_io_ring_enter: io_uring_enter() failed");
+        abort();
+    }
+    return (int)r;
+} /*}}}*/
+
+/* must be called with ring->sq_lock held; the SQ is always drained by the
+ * time the lock is released, so slot <tail> is free */
+static struct io_uring_sqe *qt_io_ring_next_sqe(qt_io_ring_t *ring,
+                                                unsigned     *tail)
+{   /*{{{*/
+    unsigned             idx = *tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[idx] = idx;
+    (*tail)++;
+    return sqe;
+} /*}}}*/
+
+static void qt_io_ring_flush(qt_io_ring_t *ring,
+                             unsigned      tail,
+                             unsigned      nsqe)
+{   /*{{{*/
+    (void)qthread_incr(&ring->inflight, nsqe);
+    MACHINE_FENCE;
+    *(volatile unsigned *)ring->sq_tail = tail;
+    while (nsqe > 0) {
+        nsqe -= qt_io_ring_enter(ring, nsqe, 0, 0);
+    }
+} /*}}}*/
+
+/* Returns 1 if the job was handed to the ring, 0 if the proxy pool must
+ * handle it */
+static int qt_io_ring_submit(qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    qt_io_ring_t            *ring;
+    struct io_uring_sqe     *sqe;
+    struct __kernel_timespec ts;
+    unsigned                 tail;
+    unsigned                 nsqe    = 1;
+    int                      fd      = 0;
+    int                      timeout = -1;
+
+    if (!io_ring_ops[job->op]) { return 0; }
+    switch(job->op) {
+        case READ: case PREAD: case WRITE: case PWRITE:
+            if ((size_t)job->args[2] > UINT32_MAX) { return 0; }
+            break;
+        case POLL:
+        {
+            nfds_t nfds;
+            memcpy(&nfds, &job->args[1], sizeof(nfds_t));
+            memcpy(&timeout, &job->args[2], sizeof(int));
+            if ((nfds != 1) || (timeout == 0)) { return 0; }
+            if (timeout > 0) { nsqe = 2; }
+            break;
+        }
+        default:
+            break;
+    }
+    if (job->op == POLL) {
+        fd = ((struct pollfd *)job->args[0])->fd;
+    } else {
+        memcpy(&fd, &job->args[0], sizeof(int));
+    }
+
+    ring = &io_rings[job->thread->rdata->shepherd_ptr->shepherd_id];
+    QTHREAD_FASTLOCK_LOCK(&ring->sq_lock);
+    if ((size_t)ring->inflight + nsqe > ring->cq_entries) {
+        QTHREAD_FASTLOCK_UNLOCK(&ring->sq_lock);
+        qthread_debug(IO_BEHAVIOR, "ring %p is full, using the proxy pool\n", ring);
+        return 0;
+    }
+    tail           = *ring->sq_tail;
+    sqe            = qt_io_ring_next_sqe(ring, &tail);
+    sqe->fd        = fd;
+    sqe->user_data = (uint64_t)(uintptr_t)job;
+    switch(job->op) {
+        case READ:
+        case PREAD:
+            sqe->opcode = IORING_OP_READ;
+            sqe->addr   = (uint64_t)job->args[1];
+            sqe->len    = (uint32_t)job->args[2];
+            sqe->off    = (job->op == READ) ? (uint64_t)-1 : (uint64_t)(off_t)job->args[3];
+            break;
+        case WRITE:
+        case PWRITE:
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->addr   = (uint64_t)job->args[1];
+            sqe->len    = (uint32_t)job->args[2];
+            sqe->off    = (job->op == WRITE) ? (uint64_t)-1 : (uint64_t)(off_t)job->args[3];
+            break;
+        case ACCEPT:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->addr   = (uint64_t)job->args[1];
+            sqe->addr2  = (uint64_t)job->args[2];
+            break;
+        case CONNECT:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr   = (uint64_t)job->args[1];
+            sqe->off    = (uint64_t)(socklen_t)job->args[2];
+            break;
+        case POLL:
+            sqe->opcode      = IORING_OP_POLL_ADD;
+            sqe->poll_events = ((struct pollfd *)job->args[0])->events;
+            if (nsqe == 2) {
+                /* the timeout is copied by the kernel during submission, so
+                 * it may live on this stack */
+                sqe->flags    |= IOSQE_IO_LINK;
+                ts.tv_sec      = timeout / 1000;
+                ts.tv_nsec     = (timeout % 1000) * 1000000;
+                sqe            = qt_io_ring_next_sqe(ring, &tail);
+                sqe->opcode    = IORING_OP_LINK_TIMEOUT;
+                sqe->fd        = -1;
+                sqe->addr      = (uint64_t)(uintptr_t)&ts;
+                sqe->len       = 1;
+                sqe->user_data = IO_RING_IGNORE;
+            }
+            break;
+        default:
+            abort();
+    }
+    qt_io_ring_flush(ring, tail, nsqe);
+    QTHREAD_FASTLOCK_UNLOCK(&ring->sq_lock);
+    qthread_debug(IO_DETAILS, "job %p (op %u) submitted to ring %p\n", job, (unsigned)job->op, ring);
+    return 1;
+} /*}}}*/
+
+static void qt_io_ring_complete(qt_blocking_queue_node_t *job,
+                                int                       res)
+{   /*{{{*/
+    if (job->op == POLL) {
+        struct pollfd *fds = (struct pollfd *)job->args[0];
+
+        if (res == -ECANCELED) {
+            /* the linked timeout fired */
+            fds[0].revents = 0;
+            res            = 0;
+        } else if (res >= 0) {
+            fds[0].revents = (short)res;
+            res            = 1;
+        }
+    }
+    if (res < 0) {
+        job->ret = -1;
+        job->err = -res;
+    } else {
+        job->ret = res;
+        job->err = 0;
+    }
+    qt_threadqueue_enqueue(job->thread->rdata->shepherd_ptr->ready, job->thread);
+} /*}}}*/
+
+static void *qt_io_ring_reaper(void *arg)
+{   /*{{{*/
+    qt_io_ring_t *ring    = (qt_io_ring_t *)arg;
+    int           exiting = 0;
+
+    while (!exiting) {
+        unsigned head = *ring->cq_head;
+        unsigned tail = *(volatile unsigned *)ring->cq_tail;
+        unsigned reaped;
+
+        MACHINE_FENCE;
+        if (head == tail) {
+            qt_io_ring_enter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+            continue;
+        }
+        reaped = tail - head;
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+            if (cqe->user_data == IO_RING_EXIT) {
+                exiting = 1;
+            } else if (cqe->user_data != IO_RING_IGNORE) {
+                qt_io_ring_complete((qt_blocking_queue_node_t *)(uintptr_t)cqe->user_data, cqe->res);
+            }
+        }
+        MACHINE_FENCE;
+        *(volatile unsigned *)ring->cq_head = head;
+        (void)qthread_incr(&ring->inflight, -(saligned_t)reaped);
+    }
+    qthread_debug(IO_DETAILS, "ring %p reaper exiting\n", ring);
+    return NULL;
+} /*}}}*/
+
+static int qt_io_ring_setup(qt_io_ring_t *ring,
+                            unsigned      entries,
+                            uint32_t     *features)
+{   /*{{{*/
+    struct io_uring_params p;
+    char                  *base;
+    void                  *sqes;
+    size_t                 cq_size;
+
+    memset(&p, 0, sizeof(struct io_uring_params));
+    ring->fd = (int)syscall(SYS_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        qthread_debug(IO_BEHAVIOR, "io_uring_setup() failed (%i)\n", errno);
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(ring->fd);
+        return -1;
+    }
+    ring->ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size         = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > ring->ring_size) { ring->ring_size = cq_size; }
+    ring->ring_mem = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->ring_mem == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes            = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(ring->ring_mem, ring->ring_size);
+        close(ring->fd);
+        return -1;
+    }
+    base             = (char *)ring->ring_mem;
+    ring->sq_tail    = (unsigned *)(base + p.sq_off.tail);
+    ring->sq_mask    = (unsigned *)(base + p.sq_off.ring_mask);
+    ring->sq_array   = (unsigned *)(base + p.sq_off.array);
+    ring->sqes       = (struct io_uring_sqe *)sqes;
+    ring->cq_head    = (unsigned *)(base + p.cq_off.head);
+    ring->cq_tail    = (unsigned *)(base + p.cq_off.tail);
+    ring->cq_mask    = (unsigned *)(base + p.cq_off.ring_mask);
+    ring->cqes       = (struct io_uring_cqe *)(base + p.cq_off.cqes);
+    ring->cq_entries = p.cq_entries;
+    ring->inflight   = 0;
+    QTHREAD_FASTLOCK_INIT(ring->sq_lock);
+    *features = p.features;
+    return 0;
+} /*}}}*/
+
+static void qt_io_ring_teardown(qt_io_ring_t *ring)
+{   /*{{{*/
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring_mem, ring->ring_size);
+    close(ring->fd);
+    QTHREAD_FASTLOCK_DESTROY(ring->sq_lock);
+} /*}}}*/
+
+/* Decides which operations go to the rings, based on what the kernel says it
+ * supports */
+static void qt_io_ring_probe(qt_io_ring_t *ring,
+                             uint32_t      features)
+{   /*{{{*/
+    size_t                 len   = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+
+    assert(probe);
+    if (syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+        qthread_debug(IO_BEHAVIOR, "io_uring probe failed (%i)\n", errno);
+        free(probe);
+        return;
+    }
+# define OP_SUPPORTED(o) ((o) < probe->ops_len && (probe->ops[o].flags & IO_URING_OP_SUPPORTED))
+    io_ring_ops[PREAD]   = OP_SUPPORTED(IORING_OP_READ);
+    io_ring_ops[PWRITE]  = OP_SUPPORTED(IORING_OP_WRITE);
+    /* plain read/write need the kernel to honor the file position */
+    io_ring_ops[READ]    = io_ring_ops[PREAD] && (features & IORING_FEAT_RW_CUR_POS);
+    io_ring_ops[WRITE]   = io_ring_ops[PWRITE] && (features & IORING_FEAT_RW_CUR_POS);
+    io_ring_ops[ACCEPT]  = OP_SUPPORTED(IORING_OP_ACCEPT);
+    io_ring_ops[CONNECT] = OP_SUPPORTED(IORING_OP_CONNECT);
+    io_ring_ops[POLL]    = OP_SUPPORTED(IORING_OP_POLL_ADD) && OP_SUPPORTED(IORING_OP_LINK_TIMEOUT);
+# undef OP_SUPPORTED
+    free(probe);
+} /*}}}*/
+
+static void qt_io_ring_init(void)
+{   /*{{{*/
+    const char *engine = qt_internal_get_env_str("IO_ENGINE", "uring");
+    unsigned    entries;
+    uint32_t    features = 0;
+    size_t      i;
+
+    if (engine) {
+        if (!strncasecmp("proxy", engine, 5)) {
+            return;
+        } else if (strncasecmp("uring", engine, 5)) {
+            fprintf(stderr, "unparsable I/O engine (%s)\n", engine);
+            exit(EXIT_FAILURE);
+        }
+    }
+    entries       = qt_internal_get_env_num("IO_URING_ENTRIES", 256, 256);
+    io_ring_count = qlib->nshepherds;
+    io_rings      = calloc(io_ring_count, sizeof(qt_io_ring_t));
+    assert(io_rings);
+    for (i = 0; i < io_ring_count; i++) {
+        if (qt_io_ring_setup(&io_rings[i], entries, &features) != 0) {
+            qthread_debug(IO_BEHAVIOR, "could not set up ring %u, using the proxy pool\n", (unsigned)i);
+            while (i > 0) qt_io_ring_teardown(&io_rings[--i]);
+            free(io_rings);
+            io_rings = NULL;
+            return;
+        }
+    }
+    qt_io_ring_probe(&io_rings[0], features);
+    for (i = 0; i < io_ring_count; i++) {
+        int r;
+
+        if ((r = pthread_create(&io_rings[i].reaper, NULL, qt_io_ring_reaper, &io_rings[i])) != 0) {
+            fprintf(stderr, "qt_blocking_subsystem_init: pthread_create() failed (%d)\n", r);
+            perror("qt_blocking_subsystem_init spawning ring reaper");
+            abort();
+        }
+    }
+} /*}}}*/
+
+static void qt_io_ring_stopwork(void)
+{   /*{{{*/
+    size_t i;
+
+    for (i = 0; i < io_ring_count; i++) {
+        qt_io_ring_t        *ring = &io_rings[i];
+        struct io_uring_sqe *sqe;
+        unsigned             tail;
+
+        QTHREAD_FASTLOCK_LOCK(&ring->sq_lock);
+        tail           = *ring->sq_tail;
+        sqe            = qt_io_ring_next_sqe(ring, &tail);
+        sqe->opcode    = IORING_OP_NOP;
+        sqe->user_data = IO_RING_EXIT;
+        qt_io_ring_flush(ring, tail, 1);
+        QTHREAD_FASTLOCK_UNLOCK(&ring->sq_lock);
+        pthread_join(ring->reaper, NULL);
+    }
+} /*}}}*/
+
+static void qt_io_ring_freemem(void)
+{   /*{{{*/
+    size_t i;
+
+    /* closing the ring cancels anything still outstanding */
+    for (i = 0; i < io_ring_count; i++) {
+        qt_io_ring_teardown(&io_rings[i]);
+    }
+    free(io_rings);
+    io_rings      = NULL;
+    io_ring_count = 0;
+} /*}}}*/
+#endif /* ifdef QTHREAD_USE_IO_URING */
+
 static void qt_blocking_subsystem_internal_stopwork(void)
 {   /*{{{*/
+#ifdef QTHREAD_USE_IO_URING
+    qt_io_ring_stopwork();
+#endif
     proxy_exit = 1;
     MACHINE_FENCE;
     while (io_worker_count != 0) SPINLOCK_BODY();
@@ -74,6 +476,9 @@ static void qt_blocking_subsystem_internal_freemem(void)
 #endif
     QTHREAD_DESTROYLOCK(&theQueue.lock);
     QTHREAD_DESTROYCOND(&theQueue.notempty);
+#ifdef QTHREAD_USE_IO_URING
+    qt_io_ring_freemem();
+#endif
 } /*}}}*/
 
 static void *qt_blocking_subsystem_proxy_thread(void *QUNUSED(arg))
@@ -116,6 +521,9 @@ void INTERNAL qt_blocking_subsystem_init(void)
     TLS_INIT(IO_task_struct);
     qassert(pthread_mutex_init(&theQueue.lock, NULL), 0);
     qassert(pthread_cond_init(&theQueue.notempty, NULL), 0);
+#ifdef QTHREAD_USE_IO_URING
+    qt_io_ring_init();
+#endif
     /* thread(s) must be stopped *before* shepherds die, to keep them from
      * trying to push orphan threads into shepherd queues */
     qthread_internal_cleanup_early(qt_blocking_subsystem_internal_stopwork);
@@ -331,6 +739,7 @@ int INTERNAL qt_process_blocking_call(void)
                               (const void *)item->args[1],
                               (size_t)item->args[2]);
 #endif
+            break;
         case PWRITE:
 #if HAVE_SYSCALL && HAVE_DECL_SYS_PWRITE
             item->ret = syscall(SYS_pwrite,
@@ -357,9 +766,17 @@ int INTERNAL qt_process_blocking_call(void)
             break;
         }
     }
-    /* and now, re-queue */
-    qt_threadqueue_enqueue(item->thread->rdata->shepherd_ptr->ready, item->thread);
-    FREE_SYSCALLJOB(item);
+    /* and now, re-queue; the woken thread frees its own job, except for
+     * user-defined actions, whose job nobody else is waiting on */
+    if (item->op == USER_DEFINED) {
+        qthread_t *t = item->thread;
+
+        FREE_SYSCALLJOB(item);
+        qt_threadqueue_enqueue(t->rdata->shepherd_ptr->ready, t);
+    } else {
+        item->err = (item->ret < 0) ? errno : 0;
+        qt_threadqueue_enqueue(item->thread->rdata->shepherd_ptr->ready, item->thread);
+    }
     return 0;
 } /*}}}*/
 
@@ -370,6 +787,11 @@ void INTERNAL qt_blocking_subsystem_enqueue(qt_blocking_queue_node_t *job)
     qthread_debug(IO_FUNCTIONS, "entering, job = %p, thread:%p, rdata:%p\n", job, job->thread, job->thread->rdata);
     assert(job->next == NULL);
     assert(job->thread->rdata);
+#ifdef QTHREAD_USE_IO_URING
+    if (io_rings && qt_io_ring_submit(job)) {
+        return;
+    }
+#endif
     QTHREAD_LOCK(&theQueue.lock);
     qthread_debug(IO_DETAILS, "1) theQueue.head = %p, .tail = %p, job = %p\n", theQueue.head, theQueue.tail, job);
     prev          = theQueue.tail;
@@ -14,6 +14,7 @@
 #include "qt_mpool.h"
 #include "qt_debug.h"
 #include "qt_subsystems.h"
+#include "qt_epoch.h"
 
 /* The Internal API */
 #include "qt_hash.h"
@@ -66,6 +67,19 @@ struct qt_hash_s {
 # define FREE_HASH_ENTRY(t) FREE(t, sizeof(hash_entry))
 #endif /* ifndef UNPOOLED */
 
+/* Entries unlinked from a list may still be in use by a concurrent find
+ * unless epoch-based reclamation is configured. */
+#ifdef QTHREAD_EPOCH_RECLAMATION
+static void hash_entry_free(void *t)
+{
+    FREE_HASH_ENTRY(t);
+}
+
+# define RETIRE_HASH_ENTRY(t) qt_epoch_retire(hash_entry_free, (t))
+#else
+# define RETIRE_HASH_ENTRY(t) FREE_HASH_ENTRY(t)
+#endif
+
 /* prototypes */
 static void *qt_lf_list_find(marked_ptr_t  *head,
                              so_key_t       key,
@@ -133,7 +147,7 @@ static int qt_lf_list_delete(marked_ptr_t *head,
         if (qt_lf_list_find(head, key, &lprev, &lcur, &lnext) == NULL) { return 0; }
         if (qthread_cas_ptr(&PTR_OF(lcur)->next, CONSTRUCT(0, lnext), CONSTRUCT(1, lnext)) != (void *)CONSTRUCT(0, lnext)) { continue; }
         if (qthread_cas(lprev, CONSTRUCT(0, lcur), CONSTRUCT(0, lnext)) == CONSTRUCT(0, lcur)) {
-            FREE_HASH_ENTRY(PTR_OF(lcur));
+            RETIRE_HASH_ENTRY(PTR_OF(lcur));
         } else {
             qt_lf_list_find(head, key, NULL, NULL, NULL);                       // needs to set cur/prev/next
         }
@@ -180,7 +194,7 @@ static void *qt_lf_list_find(marked_ptr_t  *head,
                 prev = &(PTR_OF(cur)->next);
             } else {
                 if (qthread_cas(prev, CONSTRUCT(0, cur), CONSTRUCT(0, next)) == CONSTRUCT(0, cur)) {
-                    FREE_HASH_ENTRY(PTR_OF(cur));
+                    RETIRE_HASH_ENTRY(PTR_OF(cur));
                 } else {
                     break;
                 }
@@ -241,13 +255,16 @@ int INTERNAL qt_hash_put(qt_hash  h,
     node->value = value;
     node->next  = UNINITIALIZED;
 
+    QT_SMR_ENTER();
     if (h->B[bucket] == UNINITIALIZED) {
         initialize_bucket(h, bucket);
     }
     if (!qt_lf_list_insert(&(h->B[bucket]), node, NULL)) {
+        QT_SMR_EXIT();
         FREE_HASH_ENTRY(node);
         return 0;
     }
+    QT_SMR_EXIT();
     size_t csize = h->size;
     if (qthread_incr(&h->count, 1) / csize > MAX_LOAD) {
         if (2 * csize <= hard_max_buckets) { // this caps the size of the hash
@@ -262,17 +279,21 @@ void INTERNAL *qt_hash_get(qt_hash        h,
 {
     size_t bucket;
     lkey_t lkey = (uint64_t)(uintptr_t)key;
+    void  *ret;
 
     HASH_KEY(lkey);
     bucket = lkey % h->size;
 
+    QT_SMR_ENTER();
     if (h->B[bucket] == UNINITIALIZED) {
         // You'd think returning NULL at this point would be a good idea; but
         // if we do that, we risk losing key/value pairs (incorrectly reporting
         // them as absent) when the hash table resizes
         initialize_bucket(h, bucket);
     }
-    return qt_lf_list_find(&(h->B[bucket]), so_regularkey(lkey), NULL, NULL, NULL);
+    ret = qt_lf_list_find(&(h->B[bucket]), so_regularkey(lkey), NULL, NULL, NULL);
+    QT_SMR_EXIT();
+    return ret;
 }
 
 int INTERNAL qt_hash_remove(qt_hash        h,
@@ -284,12 +305,15 @@ int INTERNAL qt_hash_remove(qt_hash        h,
     HASH_KEY(lkey);
     bucket = lkey % h->size;
 
+    QT_SMR_ENTER();
     if (h->B[bucket] == UNINITIALIZED) {
         initialize_bucket(h, bucket);
     }
     if (!qt_lf_list_delete(&(h->B[bucket]), so_regularkey(lkey))) {
+        QT_SMR_EXIT();
         return 0;
     }
+    QT_SMR_EXIT();
     qthread_incr(&h->count, -1);
     return 1;
 }
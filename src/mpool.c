@@ -8,6 +8,13 @@
 #include <stddef.h>                    /* for size_t (according to C89) */
 #include <stdlib.h>                    /* for calloc() and malloc() */
 #include <string.h>
+#ifdef QTHREAD_GUARD_PAGES
+# include <stdio.h>                    /* for perror() */
+#endif
+#if defined(QTHREAD_GUARD_PAGES) || defined(HAVE_MADVISE)
+# include <sys/types.h>
+# include <sys/mman.h>                 /* for mmap(), mprotect() and madvise() */
+#endif
 
 /* External Headers */
 #ifdef QTHREAD_USE_VALGRIND
@@ -35,6 +42,8 @@
 #include "qt_visibility.h"
 #include "qt_aligned_alloc.h"
 #include "qt_subsystems.h"
+#include "qt_shepherd_innards.h"       /* for qthread_internal_getshep() */
+#include "qt_affinity.h"               /* for qt_affinity_mem_tonode() */
 
 /* Seems SLIGHTLY faster without TLS, and a whole lot safer and cleaner */
 #ifdef TLS
@@ -43,6 +52,52 @@
 
 typedef struct threadlocal_cache_s qt_mpool_threadlocal_cache_t;
 
+/*
+ * Pools are hierarchical: each thread has its own cache of free items, each
+ * memory domain (NUMA node, as the shepherds' locality reports it) has a
+ * shared list of batches of free items, and new blocks of items are allocated
+ * in (and bound to) the domain of the thread that needs them. An item freed
+ * by a thread in another domain is not kept by that thread; it is collected
+ * with others from the same domain and sent home a batch at a time.
+ *
+ * A domain's shared list only ever holds items of that domain's blocks, so a
+ * block all of whose items are on it is unused and can be given back to the
+ * system (see qt_mpool_trim()).
+ */
+typedef struct qt_mpool_block_s {
+    uint8_t                 *base;
+    struct qt_mpool_block_s *next;
+    unsigned int             node;
+    size_t                   nfree; /* only used while trimming */
+} qt_mpool_block_t;
+
+typedef struct qt_mpool_node_s {
+    QTHREAD_FASTLOCK_TYPE reuse_lock;
+    void                 *reuse_pool;  /* batches of items_per_alloc items */
+    aligned_t             refills;
+    aligned_t             spills;
+    aligned_t             remote_frees;
+    aligned_t             blocks;
+    aligned_t             trimmed;
+} Q_ALIGNED(CACHELINE_WIDTH) qt_mpool_node_t;
+
+/* a thread's not-yet-full batch of items that belong to another domain */
+typedef struct qt_mpool_remote_s {
+    struct qt_mpool_cache_entry_s *head;
+    size_t                         count;
+} qt_mpool_remote_t;
+
+/* Memory domains, numbered densely, for each shepherd; set up once the
+ * shepherds know where they are. */
+static unsigned int  mpool_nnodes     = 1;
+static unsigned int *mpool_shep_nodes = NULL;
+static unsigned int *mpool_node_ids   = NULL; /* topology node of each domain */
+static size_t        mpool_nsheps     = 0;
+
+/* every pool, so that qt_mpool_trim_all() can find them */
+static pthread_mutex_t   all_pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct qt_mpool_s *all_pools     = NULL;
+
 #ifdef TLS
 static TLS_DECL_INIT(qt_mpool_threadlocal_cache_t *, pool_caches);
 static TLS_DECL_INIT(uintptr_t, pool_cache_count);
@@ -55,6 +110,8 @@ struct qt_mpool_s {
     size_t alloc_size;
     size_t items_per_alloc;
     size_t alignment;
+    size_t guard_lo;        /* offsets of an item's two PROT_NONE pages; */
+    size_t guard_hi;        /* both are zero unless the pool is guarded */
 
 #ifdef TLS
     size_t                        offset;
@@ -63,12 +120,16 @@ struct qt_mpool_s {
 #endif
     qt_mpool_threadlocal_cache_t *caches;  // for cleanup
 
-    QTHREAD_FASTLOCK_TYPE         reuse_lock;
-    void                         *reuse_pool;
+    size_t                        block_alignment;
+    unsigned int                  nnodes;
+    qt_mpool_node_t              *nodes;
 
     QTHREAD_FASTLOCK_TYPE         pool_lock;
-    void                        **alloc_list;
-    size_t                        alloc_list_pos;
+    qt_mpool_block_t             *blocks;
+
+    QTHREAD_TRYLOCK_TYPE          trim_lock;
+    size_t                        soft_cap; /* in bytes; 0 means none */
+    struct qt_mpool_s            *next;     /* in all_pools */
 };
 
 typedef struct qt_mpool_cache_entry_s {
@@ -82,9 +143,79 @@ struct threadlocal_cache_s {
     uint_fast16_t                 count;
     uint8_t                      *block;
     uint_fast32_t                 i;
-    qt_mpool_threadlocal_cache_t *next;  // for cleanup
+    unsigned int                  node;
+    size_t                        hits;
+    qt_mpool_remote_t            *remote; // one per domain, once needed
+    qt_mpool_threadlocal_cache_t *next;   // for cleanup
 };
 
+/*
+ * The page map finds the block (and so the home domain) of any pooled item:
+ * blocks are page-aligned and a whole number of pages long, so every page
+ * belongs to at most one block. It is a three-level radix tree over page
+ * numbers; interior levels are installed with CAS and never freed, and an
+ * entry is only read by a thread freeing an item, after the block was
+ * registered by the thread that allocated it.
+ */
+#define PAGEMAP_BITS 12
+#define PAGEMAP_SIZE (1 << PAGEMAP_BITS)
+#define PAGEMAP_MASK (PAGEMAP_SIZE - 1)
+
+typedef qt_mpool_block_t *pagemap_leaf_t[PAGEMAP_SIZE];
+typedef pagemap_leaf_t   *pagemap_mid_t[PAGEMAP_SIZE];
+
+static pagemap_mid_t *pagemap[PAGEMAP_SIZE];
+static unsigned int   pagemap_shift = 0;
+
+static qt_mpool_block_t **qt_mpool_internal_pagemap_slot(uintptr_t addr,
+                                                         int       create)
+{                                      /*{{{ */
+    uintptr_t const page = addr >> pagemap_shift;
+    pagemap_mid_t  *mid;
+    pagemap_leaf_t *leaf;
+
+    if ((page >> (3 * PAGEMAP_BITS)) != 0) { return NULL; }
+    mid = pagemap[page >> (2 * PAGEMAP_BITS)];
+    if (mid == NULL) {
+        if (!create) { return NULL; }
+        mid = calloc(1, sizeof(pagemap_mid_t));
+        assert(mid);
+        if (qthread_cas_ptr(&pagemap[page >> (2 * PAGEMAP_BITS)], NULL, mid) != NULL) {
+            free(mid);
+            mid = pagemap[page >> (2 * PAGEMAP_BITS)];
+        }
+    }
+    leaf = (*mid)[(page >> PAGEMAP_BITS) & PAGEMAP_MASK];
+    if (leaf == NULL) {
+        if (!create) { return NULL; }
+        leaf = calloc(1, sizeof(pagemap_leaf_t));
+        assert(leaf);
+        if (qthread_cas_ptr(&(*mid)[(page >> PAGEMAP_BITS) & PAGEMAP_MASK], NULL, leaf) != NULL) {
+            free(leaf);
+            leaf = (*mid)[(page >> PAGEMAP_BITS) & PAGEMAP_MASK];
+        }
+    }
+    return &(*leaf)[page & PAGEMAP_MASK];
+}                                      /*}}} */
+
+static void qt_mpool_internal_pagemap_set(qt_mpool          pool,
+                                          qt_mpool_block_t *blk,
+                                          qt_mpool_block_t *val)
+{                                      /*{{{ */
+    for (size_t off = 0; off < pool->alloc_size; off += ((size_t)1 << pagemap_shift)) {
+        qt_mpool_block_t **slot = qt_mpool_internal_pagemap_slot((uintptr_t)blk->base + off, val != NULL);
+
+        if (slot) { *slot = val; }
+    }
+}                                      /*}}} */
+
+static QINLINE qt_mpool_block_t *qt_mpool_internal_block_of(void *mem)
+{                                      /*{{{ */
+    qt_mpool_block_t **slot = qt_mpool_internal_pagemap_slot((uintptr_t)mem, 0);
+
+    return slot ? *slot : NULL;
+}                                      /*}}} */
+
 #ifdef TLS
 static void qt_mpool_subsystem_shutdown(void)
 {
@@ -102,6 +233,11 @@ static void qt_mpool_subsystem_shutdown(void)
 
 void INTERNAL qt_mpool_subsystem_init(void)
 {
+    if (pagemap_shift == 0) {
+        while (((size_t)1 << pagemap_shift) < pagesize) {
+            pagemap_shift++;
+        }
+    }
 #ifdef TLS
     assert(TLS_GET(pool_caches) == NULL);
     assert(TLS_GET(pool_cache_count) == 0);
@@ -110,6 +246,65 @@ void INTERNAL qt_mpool_subsystem_init(void)
 #endif
 }
 
+static void qt_mpool_subsystem_nodes_shutdown(void)
+{                                      /*{{{ */
+    FREE(mpool_shep_nodes, mpool_nsheps * sizeof(unsigned int));
+    FREE(mpool_node_ids, mpool_nsheps * sizeof(unsigned int));
+    mpool_shep_nodes = NULL;
+    mpool_node_ids   = NULL;
+    mpool_nsheps     = 0;
+    mpool_nnodes     = 1;
+}                                      /*}}} */
+
+/* Groups the shepherds into memory domains by the node their affinity
+ * puts them on (all of them form one domain when that is unknown), or
+ * round-robin into QT_MPOOL_NODES domains if that is set. Pools created
+ * before this (or while it is not in effect) have a single domain. */
+void INTERNAL qt_mpool_subsystem_nodes_init(void)
+{                                      /*{{{ */
+    size_t const nsheps = qthread_num_shepherds();
+    size_t const forced = qt_internal_get_env_num("MPOOL_NODES", 0, 0);
+    unsigned int nnodes = 0;
+
+    mpool_shep_nodes = MALLOC(nsheps * sizeof(unsigned int));
+    mpool_node_ids   = MALLOC(nsheps * sizeof(unsigned int));
+    assert(mpool_shep_nodes && mpool_node_ids);
+    for (size_t i = 0; i < nsheps; ++i) {
+        unsigned int const node = qthread_internal_shep_to_node(i);
+        unsigned int       d;
+
+        if (forced) {
+            d = i % forced;
+            if (d >= nnodes) {
+                mpool_node_ids[d] = node;
+                nnodes            = d + 1;
+            }
+        } else {
+            for (d = 0; d < nnodes && mpool_node_ids[d] != node; ++d) ;
+            if (d == nnodes) {
+                mpool_node_ids[nnodes++] = node;
+            }
+        }
+        mpool_shep_nodes[i] = d;
+    }
+    mpool_nsheps = nsheps;
+    mpool_nnodes = nnodes ? nnodes : 1;
+    qthread_internal_cleanup_late(qt_mpool_subsystem_nodes_shutdown);
+}                                      /*}}} */
+
+/* the calling thread's domain, as far as this pool is concerned */
+static unsigned int qt_mpool_internal_mynode(qt_mpool pool)
+{                                      /*{{{ */
+    qthread_shepherd_t *shep;
+    unsigned int        node;
+
+    if (pool->nnodes == 1) { return 0; }
+    shep = qthread_internal_getshep();
+    if ((shep == NULL) || (shep->shepherd_id >= mpool_nsheps)) { return 0; }
+    node = mpool_shep_nodes[shep->shepherd_id];
+    return (node < pool->nnodes) ? node : 0;
+}                                      /*}}} */
+
 /* local funcs */
 static QINLINE void *qt_mpool_internal_aligned_alloc(size_t alloc_size,
                                                      size_t alignment)
@@ -126,6 +321,67 @@ static QINLINE void qt_mpool_internal_aligned_free(void  *freeme,
     qthread_internal_aligned_free(freeme, alignment);
 }                                      /*}}} */
 
+/* Blocks for guarded pools come straight from mmap(), and every item's guard
+ * pages are protected once, here, for the life of the pool. Blocks are bound
+ * to the domain that will use them before anything touches them. */
+static void *qt_mpool_internal_block_alloc(qt_mpool     pool,
+                                           unsigned int node)
+{                                      /*{{{ */
+    uint8_t *block;
+
+#ifdef QTHREAD_GUARD_PAGES
+    if (pool->guard_lo) {
+        block = mmap(NULL, pool->alloc_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (block == MAP_FAILED) {
+            return NULL;
+        }
+    } else
+#endif
+    {
+        block = qt_mpool_internal_aligned_alloc(pool->alloc_size, pool->block_alignment);
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+#ifdef QTHREAD_HAVE_MEM_AFFINITY
+    if ((pool->nnodes > 1) && (node < mpool_nnodes) &&
+        (mpool_node_ids[node] != (unsigned int)-1)) {
+        qt_affinity_mem_tonode(block, pool->alloc_size, mpool_node_ids[node]);
+    }
+#endif
+#ifdef QTHREAD_GUARD_PAGES
+    if (pool->guard_lo) {
+        size_t i;
+
+        for (i = 0; i < pool->items_per_alloc; i++) {
+            uint8_t *item = block + (i * pool->item_size);
+            if ((mprotect(item + pool->guard_lo, pagesize, PROT_NONE) != 0) ||
+                (mprotect(item + pool->guard_hi, pagesize, PROT_NONE) != 0)) {
+                perror("mprotect in qt_mpool_alloc");
+            }
+        }
+    }
+#endif
+    return block;
+}                                      /*}}} */
+
+static void qt_mpool_internal_block_free(qt_mpool pool,
+                                         void    *block)
+{                                      /*{{{ */
+#ifdef QTHREAD_GUARD_PAGES
+    if (pool->guard_lo) {
+        munmap(block, pool->alloc_size);
+        return;
+    }
+#endif
+    qt_mpool_internal_aligned_free(block, pool->block_alignment);
+}                                      /*}}} */
+
+/* The part of an item that may be scribbled on: everything below the first
+ * guard page. */
+#define SCRIBBLE_SIZE(pool) ((pool)->guard_lo ? (pool)->guard_lo : (pool)->item_size)
+
 // sync means lock-protected
 // item_size is how many bytes to return
 // ...memory is always allocated in multiples of getpagesize()
@@ -167,6 +423,8 @@ qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
 
     pool->item_size = item_size;
     pool->alignment = alignment;
+    pool->guard_lo  = 0;
+    pool->guard_hi  = 0;
     /* next, we find the least-common-multiple in sizes between item_size and
      * pagesize. If this is less than 128 items (an arbitrary number), we
      * increase the alloc_size until it is at least that big. This guarantees
@@ -196,24 +454,34 @@ qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
             alloc_size *= 2;
         }
     }
+    /* whole pages, so that the page map can tell blocks apart */
+    if (alloc_size % pagesize) {
+        alloc_size += pagesize - (alloc_size % pagesize);
+    }
     pool->alloc_size      = alloc_size;
     pool->items_per_alloc = alloc_size / item_size;
-    pool->reuse_pool      = NULL;
-    QTHREAD_FASTLOCK_INIT(pool->reuse_lock);
+    pool->block_alignment = (alignment > pagesize) ? alignment : pagesize;
+    pool->blocks          = NULL;
+    pool->nnodes          = mpool_nnodes;
+    pool->nodes           = qthread_internal_aligned_alloc(pool->nnodes * sizeof(qt_mpool_node_t), CACHELINE_WIDTH);
+    qassert_goto((pool->nodes != NULL), errexit);
+    memset(pool->nodes, 0, pool->nnodes * sizeof(qt_mpool_node_t));
+    for (unsigned int n = 0; n < pool->nnodes; ++n) {
+        QTHREAD_FASTLOCK_INIT(pool->nodes[n].reuse_lock);
+    }
     QTHREAD_FASTLOCK_INIT(pool->pool_lock);
+    QTHREAD_TRYLOCK_INIT(pool->trim_lock);
+    pool->soft_cap = 0;
 #ifdef TLS
     pool->offset = qthread_incr(&pool_cache_global_max, 1);
 #else
     pthread_key_create(&pool->threadlocal_cache, NULL);
 #endif
-    /* this assumes that pagesize is a multiple of sizeof(void*) */
-    assert(pagesize % sizeof(void *) == 0);
-    pool->alloc_list = qthread_internal_aligned_alloc(pagesize, pagesize);
-    qassert_goto((pool->alloc_list != NULL), errexit);
-    memset(pool->alloc_list, 0, pagesize);
-    pool->alloc_list_pos = 0;
-
     pool->caches = NULL;
+    pthread_mutex_lock(&all_pools_lock);
+    pool->next = all_pools;
+    all_pools  = pool;
+    pthread_mutex_unlock(&all_pools_lock);
     return pool;
 
     qgoto(errexit);
@@ -223,6 +491,32 @@ qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
     return NULL;
 }                                      /*}}} */
 
+#ifdef QTHREAD_GUARD_PAGES
+/* A pool of page-aligned items, each of which has two single-page guards
+ * (at guard_lo and guard_hi bytes into the item) that stay PROT_NONE the
+ * whole time the item is pooled, so recycling an item costs no syscalls.
+ * The first page of each item must be left unguarded; the free-list link
+ * lives there. */
+qt_mpool INTERNAL qt_mpool_create_guarded(size_t item_size,
+                                          size_t guard_lo,
+                                          size_t guard_hi)
+{                                      /*{{{ */
+    qt_mpool pool;
+
+    assert(item_size % pagesize == 0);
+    assert(guard_lo % pagesize == 0 && guard_hi % pagesize == 0);
+    assert(guard_lo >= pagesize && guard_lo < guard_hi);
+    assert(guard_hi + pagesize <= item_size);
+
+    pool = qt_mpool_create_aligned(item_size, pagesize);
+    qassert_ret((pool != NULL), NULL);
+    assert(pool->item_size == item_size);
+    pool->guard_lo = guard_lo;
+    pool->guard_hi = guard_hi;
+    return pool;
+}                                      /*}}} */
+#endif /* ifdef QTHREAD_GUARD_PAGES */
+
 static qt_mpool_threadlocal_cache_t *qt_mpool_internal_getcache(qt_mpool pool)
 {
     qt_mpool_threadlocal_cache_t *tc;
@@ -292,10 +586,13 @@ static qt_mpool_threadlocal_cache_t *qt_mpool_internal_getcache(qt_mpool pool)
     if (NULL == tc) {
         tc = qthread_internal_aligned_alloc(sizeof(qt_mpool_threadlocal_cache_t), CACHELINE_WIDTH);
         assert(tc);
-        tc->cache = NULL;
-        tc->count = 0;
-        tc->block = NULL;
-        tc->i     = 0;
+        tc->cache  = NULL;
+        tc->count  = 0;
+        tc->block  = NULL;
+        tc->i      = 0;
+        tc->node   = qt_mpool_internal_mynode(pool);
+        tc->hits   = 0;
+        tc->remote = NULL;
         do {
             tc->next = pool->caches;
         } while (qthread_cas_ptr(&pool->caches, tc->next, tc) != tc->next);
@@ -321,7 +618,8 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
         qthread_debug(MPOOL_DETAILS, "->...cached count:%zu\n", (size_t)tc->count - 1);
         tc->cache = cache->next;
         --tc->count;
-        ALLOC_SCRIBBLE(cache, pool->item_size);
+        tc->hits++;
+        ALLOC_SCRIBBLE(cache, SCRIBBLE_SIZE(pool));
         return cache;
     } else if (tc->block) {
         void *ret = &(tc->block[tc->i * pool->item_size]);
@@ -329,52 +627,53 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
         if (++tc->i == pool->items_per_alloc) {
             tc->block = NULL;
         }
-        ALLOC_SCRIBBLE(ret, pool->item_size);
+        tc->hits++;
+        ALLOC_SCRIBBLE(ret, SCRIBBLE_SIZE(pool));
         return ret;
     } else {
         const size_t      items_per_alloc = pool->items_per_alloc;
+        qt_mpool_node_t  *node            = &pool->nodes[tc->node];
         qt_mpool_cache_t *cache           = NULL;
 
         cnt = 0;
         /* cache is empty; need to fill it */
-        if (pool->reuse_pool) { // global cache
+        if (node->reuse_pool) { // this domain's cache
             qthread_debug(MPOOL_BEHAVIOR, "->...pull from reuse\n");
-            QTHREAD_FASTLOCK_LOCK(&pool->reuse_lock);
-            if (pool->reuse_pool) {
-                cache                   = pool->reuse_pool;
-                pool->reuse_pool        = cache->block_tail->next;
+            QTHREAD_FASTLOCK_LOCK(&node->reuse_lock);
+            if (node->reuse_pool) {
+                cache                   = node->reuse_pool;
+                node->reuse_pool        = cache->block_tail->next;
                 cache->block_tail->next = NULL;
                 cnt                     = items_per_alloc;
+                node->refills++;
             }
-            QTHREAD_FASTLOCK_UNLOCK(&pool->reuse_lock);
+            QTHREAD_FASTLOCK_UNLOCK(&node->reuse_lock);
         }
         if (NULL == cache) {
-            uint8_t *p;
-            // const size_t item_size = pool->item_size;
+            uint8_t          *p;
+            qt_mpool_block_t *blk;
 
             /* need to allocate a new block and record that I did so in the central pool */
             qthread_debug(MPOOL_BEHAVIOR, "->...allocating new block\n");
-            p = qt_mpool_internal_aligned_alloc(pool->alloc_size,
-                                                pool->alignment);
+            p = qt_mpool_internal_block_alloc(pool, tc->node);
             qassert_ret((p != NULL), NULL);
             assert(pool->alignment == 0 ||
                    (((uintptr_t)p) & (pool->alignment - 1)) == 0);
+            blk = MALLOC(sizeof(qt_mpool_block_t));
+            qassert_ret((blk != NULL), NULL);
+            blk->base  = p;
+            blk->node  = tc->node;
+            blk->nfree = 0;
+            qt_mpool_internal_pagemap_set(pool, blk, blk);
             QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
-            if (pool->alloc_list_pos == (pagesize / sizeof(void *) - 1)) {
-                void **tmp = qthread_internal_aligned_alloc(pagesize, pagesize);
-                qassert_ret((tmp != NULL), NULL);
-                memset(tmp, 0, pagesize);
-                tmp[pagesize / sizeof(void *) - 1] = pool->alloc_list;
-                pool->alloc_list                   = tmp;
-                pool->alloc_list_pos               = 0;
-            }
-            pool->alloc_list[pool->alloc_list_pos] = p;
-            pool->alloc_list_pos++;
+            blk->next    = pool->blocks;
+            pool->blocks = blk;
             QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
+            qthread_incr(&node->blocks, 1);
             /* store the block for later allocation */
             tc->block = p;
             tc->i     = 1;
-            ALLOC_SCRIBBLE(p, pool->item_size);
+            ALLOC_SCRIBBLE(p, SCRIBBLE_SIZE(pool));
             return p;
         } else {
             qthread_debug(MPOOL_BEHAVIOR, "->...from_global_pool count:%zu\n", (size_t)(cnt - 1));
@@ -382,12 +681,189 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
             tc->count = cnt - 1;
             // cache->next       = NULL; // unnecessary
             // cache->block_tail = NULL; // unnecessary
-            ALLOC_SCRIBBLE(cache, pool->item_size);
+            ALLOC_SCRIBBLE(cache, SCRIBBLE_SIZE(pool));
             return cache;
         }
     }
 } /*}}}*/
 
+static size_t qt_mpool_internal_bytes(qt_mpool pool)
+{                                      /*{{{ */
+    size_t blocks = 0;
+
+    for (unsigned int n = 0; n < pool->nnodes; ++n) {
+        blocks += pool->nodes[n].blocks;
+    }
+    return blocks * pool->alloc_size;
+}                                      /*}}} */
+
+/* Gives a block's memory back to the system. Guarded blocks are unmapped;
+ * other blocks have their pages dropped first, since the allocator may well
+ * keep them around for reuse. */
+static void qt_mpool_internal_block_release(qt_mpool          pool,
+                                            qt_mpool_block_t *blk)
+{                                      /*{{{ */
+    qt_mpool_internal_pagemap_set(pool, blk, NULL);
+#if defined(HAVE_MADVISE) && defined(MADV_DONTNEED)
+    if (!pool->guard_lo) {
+        madvise(blk->base, pool->alloc_size, MADV_DONTNEED);
+    }
+#endif
+    qt_mpool_internal_block_free(pool, blk->base);
+    FREE(blk, sizeof(qt_mpool_block_t));
+}                                      /*}}} */
+
+/* Releases the blocks of domain n all of whose items are on the domain's
+ * shared list, for as long as the pool holds more than target bytes. The list
+ * is taken while the blocks are counted, so allocations in the domain may
+ * make new blocks in the meantime; items in threads' caches, and blocks a
+ * thread is still handing out, keep their blocks. Whole blocks' worth of
+ * items are removed, so what goes back on the list still makes full
+ * batches. Returns the number of bytes released. */
+static size_t qt_mpool_internal_trim_node(qt_mpool     pool,
+                                          unsigned int n,
+                                          size_t       target)
+{                                      /*{{{ */
+    qt_mpool_node_t  *node            = &pool->nodes[n];
+    const size_t      items_per_alloc = pool->items_per_alloc;
+    qt_mpool_cache_t *items, *it, *next;
+    qt_mpool_cache_t *kept = NULL, *kept_tail = NULL, *batch = NULL;
+    qt_mpool_block_t *blk, **prev, *freeme = NULL;
+    size_t            bytes, count = 0, released = 0;
+
+    QTHREAD_FASTLOCK_LOCK(&node->reuse_lock);
+    items            = node->reuse_pool;
+    node->reuse_pool = NULL;
+    QTHREAD_FASTLOCK_UNLOCK(&node->reuse_lock);
+    if (items == NULL) { return 0; }
+
+    for (it = items; it; it = it->next) {
+        if ((blk = qt_mpool_internal_block_of(it)) != NULL) {
+            blk->nfree++;
+        }
+    }
+    QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
+    bytes = qt_mpool_internal_bytes(pool);
+    for (prev = &pool->blocks; (blk = *prev) != NULL;) {
+        if ((blk->node == n) && (blk->nfree == items_per_alloc) && (bytes > target)) {
+            *prev      = blk->next;
+            blk->next  = freeme;
+            blk->nfree = SIZE_MAX;
+            freeme     = blk;
+            bytes     -= pool->alloc_size;
+        } else {
+            prev = &blk->next;
+        }
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
+
+    /* rebuild the batches out of what is left */
+    for (it = items; it; it = next) {
+        next = it->next;
+        blk  = qt_mpool_internal_block_of(it);
+        if (blk) {
+            if (blk->nfree == SIZE_MAX) { continue; }
+            blk->nfree = 0;
+        }
+        it->next = NULL;
+        if (kept_tail) {
+            kept_tail->next = it;
+        } else {
+            kept = it;
+        }
+        kept_tail = it;
+        if (count++ % items_per_alloc == 0) {
+            batch = it;
+        }
+        batch->block_tail = it;
+    }
+    assert(count % items_per_alloc == 0);
+    if (kept) {
+        QTHREAD_FASTLOCK_LOCK(&node->reuse_lock);
+        kept_tail->next  = node->reuse_pool;
+        node->reuse_pool = kept;
+        QTHREAD_FASTLOCK_UNLOCK(&node->reuse_lock);
+    }
+
+    while (freeme) {
+        blk    = freeme;
+        freeme = blk->next;
+        qt_mpool_internal_block_release(pool, blk);
+        qthread_incr(&node->blocks, -1);
+        qthread_incr(&node->trimmed, 1);
+        released += pool->alloc_size;
+    }
+    return released;
+}                                      /*}}} */
+
+/* Only one thread trims a pool at a time; if block is false and someone else
+ * already is, this does nothing. */
+static size_t qt_mpool_internal_trim(qt_mpool pool,
+                                     size_t   target,
+                                     int      block)
+{                                      /*{{{ */
+    size_t released = 0;
+
+    if (block) {
+        QTHREAD_TRYLOCK_LOCK(&pool->trim_lock);
+    } else if (!QTHREAD_TRYLOCK_TRY(&pool->trim_lock)) {
+        return 0;
+    }
+    for (unsigned int n = 0; n < pool->nnodes; ++n) {
+        released += qt_mpool_internal_trim_node(pool, n, target);
+    }
+    QTHREAD_TRYLOCK_UNLOCK(&pool->trim_lock);
+    qthread_debug(MPOOL_BEHAVIOR, "pool:%p released %zu bytes\n", pool, released);
+    return released;
+}                                      /*}}} */
+
+/* Called after a batch went onto a shared list: every so often, if the pool
+ * has grown past its soft cap, give back what is unused. */
+static QINLINE void qt_mpool_internal_check_cap(qt_mpool         pool,
+                                                qt_mpool_node_t *node)
+{                                      /*{{{ */
+    if (QTHREAD_UNLIKELY(pool->soft_cap != 0) &&
+        (((node->spills + node->remote_frees / pool->items_per_alloc) & 7) == 0) &&
+        (qt_mpool_internal_bytes(pool) > pool->soft_cap)) {
+        qt_mpool_internal_trim(pool, pool->soft_cap, 0);
+    }
+}                                      /*}}} */
+
+/* Items that belong to another domain are chained up per domain, and each
+ * chain goes home as soon as it is a full batch. */
+static void qt_mpool_internal_free_remote(qt_mpool                      pool,
+                                          qt_mpool_threadlocal_cache_t *tc,
+                                          qt_mpool_cache_t             *n,
+                                          unsigned int                  home)
+{   /*{{{*/
+    qt_mpool_remote_t *remote;
+
+    if (QTHREAD_UNLIKELY(tc->remote == NULL)) {
+        tc->remote = calloc(pool->nnodes, sizeof(qt_mpool_remote_t));
+        assert(tc->remote);
+    }
+    remote = &tc->remote[home];
+    if (remote->head) {
+        n->next       = remote->head;
+        n->block_tail = remote->head->block_tail;
+    } else {
+        n->next       = NULL;
+        n->block_tail = n;
+    }
+    remote->head = n;
+    if (++remote->count == pool->items_per_alloc) {
+        qthread_debug(MPOOL_BEHAVIOR, "->send batch home to domain %u\n", home);
+        QTHREAD_FASTLOCK_LOCK(&pool->nodes[home].reuse_lock);
+        n->block_tail->next          = pool->nodes[home].reuse_pool;
+        pool->nodes[home].reuse_pool = n;
+        pool->nodes[home].remote_frees += pool->items_per_alloc;
+        QTHREAD_FASTLOCK_UNLOCK(&pool->nodes[home].reuse_lock);
+        remote->head  = NULL;
+        remote->count = 0;
+        qt_mpool_internal_check_cap(pool, &pool->nodes[home]);
+    }
+} /*}}}*/
+
 void INTERNAL qt_mpool_free(qt_mpool pool,
                             void    *mem)
 {   /*{{{*/
@@ -400,8 +876,17 @@ void INTERNAL qt_mpool_free(qt_mpool pool,
     qthread_debug(MPOOL_CALLS, "pool=%p mem=%p\n", pool, mem);
     qassert_retvoid((mem != NULL));
     qassert_retvoid((pool != NULL));
-    FREE_SCRIBBLE(mem, pool->item_size);
-    tc    = qt_mpool_internal_getcache(pool);
+    FREE_SCRIBBLE(mem, SCRIBBLE_SIZE(pool));
+    tc = qt_mpool_internal_getcache(pool);
+    if (pool->nnodes > 1) {
+        qt_mpool_block_t *blk = qt_mpool_internal_block_of(mem);
+
+        if (blk && (blk->node != tc->node)) {
+            qt_mpool_internal_free_remote(pool, tc, n, blk->node);
+            VALGRIND_MEMPOOL_FREE(pool, mem);
+            return;
+        }
+    }
     cache = tc->cache;
     cnt   = tc->count;
     qthread_debug(MPOOL_DETAILS, "->cache:%p (bt:%p) cnt:%u\n", cache, cache ? cache->block_tail : NULL, (unsigned int)cnt);
@@ -417,7 +902,8 @@ void INTERNAL qt_mpool_free(qt_mpool pool,
     cnt++;
     if (cnt >= (items_per_alloc * 2)) {
         qt_mpool_cache_t *toglobal;
-        /* push to global */
+        qt_mpool_node_t  *node;
+        /* push to this domain's cache */
         qthread_debug(MPOOL_BEHAVIOR, "->push to global! cnt:%u\n", (unsigned)cnt);
         assert(n);
         assert(n->block_tail);
@@ -425,11 +911,14 @@ void INTERNAL qt_mpool_free(qt_mpool pool,
         n->block_tail->next = NULL;
         assert(toglobal);
         assert(toglobal->block_tail);
-        QTHREAD_FASTLOCK_LOCK(&pool->reuse_lock);
-        toglobal->block_tail->next = pool->reuse_pool;
-        pool->reuse_pool           = toglobal;
-        QTHREAD_FASTLOCK_UNLOCK(&pool->reuse_lock);
+        node = &pool->nodes[tc->node];
+        QTHREAD_FASTLOCK_LOCK(&node->reuse_lock);
+        toglobal->block_tail->next = node->reuse_pool;
+        node->reuse_pool           = toglobal;
+        node->spills++;
+        QTHREAD_FASTLOCK_UNLOCK(&node->reuse_lock);
         cnt -= items_per_alloc;
+        qt_mpool_internal_check_cap(pool, node);
     } else if (cnt == items_per_alloc + 1) {
         qthread_debug(MPOOL_BEHAVIOR, "->chop_block\n");
         n->block_tail = n;
@@ -444,26 +933,29 @@ void INTERNAL qt_mpool_destroy(qt_mpool pool)
 {                                      /*{{{ */
     qthread_debug(MPOOL_CALLS, "pool:%p\n", pool);
     qassert_retvoid((pool != NULL));
-    while (pool->alloc_list) {
-        unsigned int i = 0;
-
-        void *p = pool->alloc_list[0];
-
-        while (p && i < (pagesize / sizeof(void *) - 1)) {
-            qt_mpool_internal_aligned_free(p,
-                                           pool->alignment);
-            i++;
-            p = pool->alloc_list[i];
+    pthread_mutex_lock(&all_pools_lock);
+    for (qt_mpool *p = &all_pools; *p; p = &(*p)->next) {
+        if (*p == pool) {
+            *p = pool->next;
+            break;
         }
-        p                = pool->alloc_list;
-        pool->alloc_list = pool->alloc_list[pagesize / sizeof(void *) - 1];
-        FREE_SCRIBBLE(p, pagesize);
-        qthread_internal_aligned_free(p, pagesize);
+    }
+    pthread_mutex_unlock(&all_pools_lock);
+    while (pool->blocks) {
+        qt_mpool_block_t *blk = pool->blocks;
+
+        pool->blocks = blk->next;
+        qt_mpool_internal_pagemap_set(pool, blk, NULL);
+        qt_mpool_internal_block_free(pool, blk->base);
+        FREE(blk, sizeof(qt_mpool_block_t));
     }
     qthread_debug(MPOOL_DETAILS, "begin free TLS caches\n");
     while (pool->caches) {
         qt_mpool_threadlocal_cache_t *freeme = pool->caches;
         pool->caches = freeme->next;
+        if (freeme->remote) {
+            free(freeme->remote);
+        }
         qthread_internal_aligned_free(freeme, CACHELINE_WIDTH);
     }
     qthread_debug(MPOOL_DETAILS, "done freeing TLS caches\n");
@@ -471,9 +963,72 @@ void INTERNAL qt_mpool_destroy(qt_mpool pool)
     pthread_key_delete(pool->threadlocal_cache);
 #endif
     QTHREAD_FASTLOCK_DESTROY(pool->pool_lock);
-    QTHREAD_FASTLOCK_DESTROY(pool->reuse_lock);
+    QTHREAD_TRYLOCK_DESTROY(pool->trim_lock);
+    for (unsigned int n = 0; n < pool->nnodes; ++n) {
+        QTHREAD_FASTLOCK_DESTROY(pool->nodes[n].reuse_lock);
+    }
+    qthread_internal_aligned_free(pool->nodes, CACHELINE_WIDTH);
     VALGRIND_DESTROY_MEMPOOL(pool);
     FREE(pool, sizeof(struct qt_mpool_s));
 }                                      /*}}} */
 
+size_t INTERNAL qt_mpool_num_nodes(qt_mpool pool)
+{                                      /*{{{ */
+    return pool->nnodes;
+}                                      /*}}} */
+
+/* The counters are read without stopping anyone, so they are only a
+ * snapshot while the pool is in use. */
+int INTERNAL qt_mpool_stats(qt_mpool       pool,
+                            size_t         node,
+                            qpool_stats_t *stats)
+{                                      /*{{{ */
+    qt_mpool_node_t const *n;
+
+    if (node >= pool->nnodes) { return QTHREAD_BADARGS; }
+    n                   = &pool->nodes[node];
+    stats->hits         = 0;
+    for (qt_mpool_threadlocal_cache_t *tc = pool->caches; tc; tc = tc->next) {
+        if (tc->node == node) {
+            stats->hits += tc->hits;
+        }
+    }
+    stats->refills      = n->refills;
+    stats->spills       = n->spills;
+    stats->remote_frees = n->remote_frees;
+    stats->blocks       = n->blocks;
+    stats->bytes        = n->blocks * pool->alloc_size;
+    stats->trimmed      = n->trimmed;
+    return QTHREAD_SUCCESS;
+}                                      /*}}} */
+
+/* Gives every block the pool is not using back to the system; returns how
+ * many bytes that was. */
+size_t INTERNAL qt_mpool_trim(qt_mpool pool)
+{                                      /*{{{ */
+    qassert_ret((pool != NULL), 0);
+    return qt_mpool_internal_trim(pool, 0, 1);
+}                                      /*}}} */
+
+/* Once the pool holds more than bytes, frees trim it back down (as far as
+ * unused blocks allow). Zero turns this off. */
+void INTERNAL qt_mpool_set_soft_cap(qt_mpool pool,
+                                    size_t   bytes)
+{                                      /*{{{ */
+    qassert_retvoid((pool != NULL));
+    pool->soft_cap = bytes;
+}                                      /*}}} */
+
+size_t INTERNAL qt_mpool_trim_all(void)
+{                                      /*{{{ */
+    size_t released = 0;
+
+    pthread_mutex_lock(&all_pools_lock);
+    for (qt_mpool p = all_pools; p; p = p->next) {
+        released += qt_mpool_trim(p);
+    }
+    pthread_mutex_unlock(&all_pools_lock);
+    return released;
+}                                      /*}}} */
+
 /* vim:set expandtab: */
@@ -167,11 +167,11 @@ static void qt_ap_genwork2(const size_t           startat,
         qdqueue_enqueue_there(gargs->wq, workunit, 0);
 #elif 0
         /* option 2: random, probably bad */
-        qdqueue_enqueue_there(gargs->wq, workunit, random() % maxsheps);
+        qdqueue_enqueue_there(gargs->wq, workunit, qthread_random() % maxsheps);
 #elif 1
         /* option 3: random selection of the two, maybe good */
         qthread_shepherd_id_t s;
-        if (random() % 2) {
+        if (qthread_random() % 2) {
             s = shep;
         } else {
             s = qthread_shep();
@@ -273,7 +273,7 @@ static void qt_allpairs_internal(const qarray             *array1,
                         equivs[equiv_cnt++] = h;
                     }
                 }
-                halfway[s][d] = equivs[random() % equiv_cnt];
+                halfway[s][d] = equivs[qthread_random() % equiv_cnt];
                 // halfway_dist[s][d] = dist;
                 // printf("optimal [%i][%i]:%i from %i\n", (int)s, (int)d, (int)dist, equiv_cnt);
             }
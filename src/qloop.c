@@ -4,6 +4,7 @@
 
 /* System Headers */
 #include <stdlib.h>
+#include <string.h>            /* for memcpy() */
 
 /* Installed Headers */
 #include <qthread/qthread.h>
@@ -20,11 +21,12 @@
 #include "qt_debug.h"
 #include "qt_aligned_alloc.h"
 #include "qt_barrier.h"
+#include "qt_shepherd_innards.h" // for qthread_internal_getshep()
+#include "qt_threadqueues.h"     // for qt_threadqueue_advisory_queuelen() and qthread_steal_disable
 
 #ifdef QTHREAD_USE_ROSE_EXTENSIONS
 # include <stdio.h>
 # include "qt_atomics.h"
-# include "qt_threadqueues.h" // for qthread_steal_disable
 #endif
 
 #ifdef QTHREAD_RCRTOOL
@@ -259,15 +261,19 @@ static aligned_t qt_loop_wrapper(struct qt_loop_wrapper_args *const restrict arg
 } /*}}}*/
 
 #define QT_LOOP_SPAWNER_SIMPLE (1 << 0)
+#define QT_LOOP_SPAWN_BATCH    64
 
 static void qt_loop_spawner(const size_t start,
                             const size_t stop,
                             void        *args_)
 {   /*{{{*/
-    size_t                      i, threadct;
-    size_t                      steps     = stop - start;
-    struct qt_loop_wrapper_args qwa;
-    unsigned int                flags     = 0;
+    size_t                       i, threadct;
+    size_t                       steps     = stop - start;
+    size_t const                 batch     = (steps < QT_LOOP_SPAWN_BATCH) ? steps : QT_LOOP_SPAWN_BATCH;
+    struct qt_loop_wrapper_args *qwa;
+    qthread_f                   *funcs;
+    void                       **qwas, **rets;
+    unsigned int                 flags     = 0;
     const synctype_t            sync_type = ((struct qt_loop_spawner_arg *)args_)->sync_type;
     const qt_loop_f             func      = ((struct qt_loop_spawner_arg *)args_)->func;
     void *const                 argptr    = ((struct qt_loop_spawner_arg *)args_)->argptr;
@@ -316,26 +322,46 @@ static void qt_loop_spawner(const size_t start,
             yieldarg = 0;
             break;
     }
-    for (i = start, threadct = 0; i < stop; ++i, ++threadct) {
-        qwa.func      = func;
-        qwa.startat   = i;
-        qwa.stopat    = i + 1;
-        qwa.arg       = argptr;
-        qwa.id        = threadct;
-        qwa.sync_type = sync_type;
-        if (sync_type == DONECOUNT) {
-            qwa.sync = &dc;
-            qassert_aligned(dc, QTHREAD_ALIGNMENT_ALIGNED_T);
-        } else {
-            qwa.sync = sync.syncvar;
+    /* spawn the iterations a batch at a time; the wrapper args are copied
+     * into each task, so the batch buffers can be reused */
+    qwa   = MALLOC(batch * sizeof(struct qt_loop_wrapper_args));
+    funcs = MALLOC(batch * sizeof(qthread_f));
+    qwas  = MALLOC(batch * 2 * sizeof(void *));
+    assert(qwa && funcs && qwas);
+    rets = retptr ? (qwas + batch) : NULL;
+    for (i = 0; i < batch; i++) {
+        funcs[i] = (qthread_f)qt_loop_wrapper;
+        qwas[i]  = &qwa[i];
+    }
+    for (i = start, threadct = 0; i < stop;) {
+        size_t const chunk = ((stop - i) < batch) ? (stop - i) : batch;
+
+        for (size_t j = 0; j < chunk; ++j, ++i, ++threadct) {
+            qwa[j].func      = func;
+            qwa[j].startat   = i;
+            qwa[j].stopat    = i + 1;
+            qwa[j].arg       = argptr;
+            qwa[j].id        = threadct;
+            qwa[j].sync_type = sync_type;
+            if (sync_type == DONECOUNT) {
+                qwa[j].sync = &dc;
+                qassert_aligned(dc, QTHREAD_ALIGNMENT_ALIGNED_T);
+            } else {
+                qwa[j].sync = sync.syncvar;
+            }
+            if (rets) {
+                rets[j] = (sync_type == SYNCVAR_T) ? (void *)(sync.syncvar + threadct) :
+                          (void *)(sync.aligned + threadct);
+            }
         }
-        qassert(qthread_spawn((qthread_f)qt_loop_wrapper,
-                              &qwa, sizeof(struct qt_loop_wrapper_args),
-                              retptr,
-                              0, NULL,
-                              NO_SHEPHERD, flags), QTHREAD_SUCCESS);
+        qassert(qthread_spawn_many(chunk, funcs, qwas,
+                                   sizeof(struct qt_loop_wrapper_args),
+                                   rets, NO_SHEPHERD, flags), QTHREAD_SUCCESS);
         qthread_yield_(yieldarg);
     }
+    FREE(qwas, batch * 2 * sizeof(void *));
+    FREE(funcs, batch * sizeof(qthread_f));
+    FREE(qwa, batch * sizeof(struct qt_loop_wrapper_args));
     switch (sync_type) {
         case SYNCVAR_T:
             for (i = 0; i < steps; i++) {
@@ -575,6 +601,8 @@ static QINLINE void qt_loop_balance_inner(const size_t       start,
                 break;
             case ALIGNED:
                 qthread_empty(&sync.aligned[i]);
+                qwa[i].sync = sync.aligned;
+                break;
             case DONECOUNT:
                 qwa[i].sync = &sync.dc;
                 break;
@@ -947,6 +975,630 @@ void API_FUNC qt_loopaccum_balance_dc(const size_t     start,
     qt_loopaccum_balance_inner(start, stop, size, out, func, argptr, acc, 0, DONECOUNT);
 }                                      /*}}} */
 
+/* Lazy binary splitting: the whole range starts out in one task, which works
+ * through it a grain at a time. Between grains, if its shepherd has nothing
+ * else queued up (so that an idle worker there, or a thief from elsewhere,
+ * would find nothing to do), it hands the upper half of what it has left to
+ * a new task. Tasks are only made when someone might run them, so irregular
+ * iterations get balanced without cutting the range up in advance.
+ *
+ * Each task waits for the tasks it split off before it finishes, and folds
+ * their results into its own. A task's own range comes first, and each task
+ * split off covers the range just past that of the one split off after it,
+ * so the results are combined in iteration order: acc need only be
+ * associative. */
+#define QLOOP_LBS_GRAINS_PER_WORKER 32
+
+struct qloop_lbs_args {
+    qt_loop_f      func;
+    qt_loopr_f     rfunc; // set instead of func for accumulating loops
+    void *restrict arg;
+    void *restrict ret;   // where this task's result goes
+    size_t         size;
+    qt_accum_f     acc;
+    size_t         startat, stopat, grain;
+    aligned_t      done;
+    struct qloop_lbs_args *next; // the child split off before this one
+};
+
+static QINLINE int qloop_lbs_hungry(void)
+{                                      /*{{{ */
+    qthread_shepherd_t *shep = qthread_internal_getshep();
+
+    return (shep == NULL) || (qt_threadqueue_advisory_queuelen(shep->ready) <= 0);
+}                                      /*}}} */
+
+static aligned_t qloop_lbs_wrapper(struct qloop_lbs_args *const restrict arg);
+
+static void qloop_lbs_run(struct qloop_lbs_args *const restrict arg)
+{                                      /*{{{ */
+    /* kept as a list rather than an array: qthread stacks are small */
+    struct qloop_lbs_args *children = NULL;
+    size_t                 i        = arg->startat;
+    size_t                 stop     = arg->stopat;
+    uint8_t               *tmp      = NULL;
+
+    while (i < stop) {
+        size_t end;
+
+        if ((stop - i > arg->grain) && qloop_lbs_hungry()) {
+            size_t const           mid   = i + (stop - i) / 2;
+            struct qloop_lbs_args *child = MALLOC(sizeof(struct qloop_lbs_args) + arg->size);
+
+            assert(child);
+            *child         = *arg;
+            child->startat = mid;
+            child->stopat  = stop;
+            child->ret     = arg->size ? (child + 1) : NULL;
+            qassert(qthread_fork((qthread_f)qloop_lbs_wrapper, child, &child->done), QTHREAD_SUCCESS);
+            /* a thief can't take it out of the spawn cache */
+            qthread_flushsc();
+            child->next = children;
+            children    = child;
+            stop        = mid;
+            continue;
+        }
+        end = (stop - i > arg->grain) ? (i + arg->grain) : stop;
+        if (arg->rfunc == NULL) {
+            arg->func(i, end, arg->arg);
+        } else if (i == arg->startat) {
+            arg->rfunc(i, end, arg->arg, arg->ret);
+        } else {
+            if (tmp == NULL) {
+                tmp = MALLOC(arg->size);
+                assert(tmp);
+            }
+            arg->rfunc(i, end, arg->arg, tmp);
+            arg->acc(arg->ret, tmp);
+        }
+        i = end;
+    }
+    if (tmp) {
+        FREE(tmp, arg->size);
+    }
+    /* the newest child holds the range right after ours */
+    while (children != NULL) {
+        struct qloop_lbs_args *const child = children;
+
+        children = child->next;
+        qthread_readFF(NULL, &child->done);
+        if (arg->rfunc) {
+            arg->acc(arg->ret, child->ret);
+        }
+        FREE(child, sizeof(struct qloop_lbs_args) + arg->size);
+    }
+}                                      /*}}} */
+
+static aligned_t qloop_lbs_wrapper(struct qloop_lbs_args *const restrict arg)
+{                                      /*{{{ */
+    qloop_lbs_run(arg);
+    return 0;
+}                                      /*}}} */
+
+static void qt_loop_lbs_inner(const size_t     start,
+                              const size_t     stop,
+                              const size_t     size,
+                              void *restrict   out,
+                              const qt_loop_f  func,
+                              const qt_loopr_f rfunc,
+                              void *restrict   argptr,
+                              const qt_accum_f acc)
+{                                      /*{{{ */
+    const size_t          workers = qthread_num_workers();
+    struct qloop_lbs_args root;
+
+    assert(qthread_library_initialized);
+    if (start >= stop) { return; }
+    root.func    = func;
+    root.rfunc   = rfunc;
+    root.arg     = argptr;
+    root.ret     = out;
+    root.size    = size;
+    root.acc     = acc;
+    root.startat = start;
+    root.stopat  = stop;
+    root.grain   = (stop - start) / (workers * QLOOP_LBS_GRAINS_PER_WORKER);
+    if (root.grain == 0) {
+        root.grain = 1;
+    }
+    if (workers == 1) {
+        /* nobody to split for */
+        root.grain = stop - start;
+    }
+    qloop_lbs_run(&root);
+}                                      /*}}} */
+
+void API_FUNC qt_loop_lbs(const size_t    start,
+                          const size_t    stop,
+                          const qt_loop_f func,
+                          void           *argptr)
+{                                      /*{{{ */
+    assert(func);
+    qt_loop_lbs_inner(start, stop, 0, NULL, func, NULL, argptr, NULL);
+}                                      /*}}} */
+
+void API_FUNC qt_loopaccum_lbs(const size_t     start,
+                               const size_t     stop,
+                               const size_t     size,
+                               void *restrict   out,
+                               const qt_loopr_f func,
+                               void *restrict   argptr,
+                               const qt_accum_f acc)
+{                                      /*{{{ */
+    assert(func);
+    assert(acc);
+    assert(size > 0 && out != NULL);
+    qt_loop_lbs_inner(start, stop, size, out, NULL, func, argptr, acc);
+}                                      /*}}} */
+
+/* Scans, reductions by key and filters over arrays. These all work in two
+ * passes over the same blocks of the array, one block per worker (fewer, if
+ * the array is small); qt_loop_balance_inner() hands the blocks out and waits
+ * on a sinc for each pass. In between, the per-block results are combined in
+ * block order by the calling thread, so that, as for qt_loopaccum_lbs(), acc
+ * need only be associative. */
+#define QLOOP_BLOCK_MIN_ITERS 1024
+
+static size_t qloop_nblocks(const size_t length)
+{                                      /*{{{ */
+    size_t nblocks = length / QLOOP_BLOCK_MIN_ITERS;
+
+    if (nblocks > qthread_num_workers()) {
+        nblocks = qthread_num_workers();
+    }
+    return (nblocks > 0) ? nblocks : 1;
+}                                      /*}}} */
+
+/* the first index of block b; blocks differ in size by at most one */
+static QINLINE size_t qloop_block_start(const size_t length,
+                                        const size_t nblocks,
+                                        const size_t b)
+{                                      /*{{{ */
+    const size_t extra = length % nblocks;
+
+    return (length / nblocks) * b + ((b < extra) ? b : extra);
+}                                      /*}}} */
+
+static void qloop_for_blocks(const size_t    nblocks,
+                             const qt_loop_f func,
+                             void           *arg)
+{                                      /*{{{ */
+    if (nblocks == 1) {
+        /* not worth a qthread */
+        func(0, 1, arg);
+    } else {
+        qt_loop_balance_inner(0, nblocks, func, arg, 0, SINC_T);
+    }
+}                                      /*}}} */
+
+struct qloop_scan_args {
+    const uint8_t *restrict in;
+    uint8_t                *out;
+    size_t                  length, size, nblocks;
+    qt_accum_f              acc;
+    const void             *identity;
+    qt_scan_type            kind;
+    uint8_t                *sums; // block b's total, later the total through block b
+};
+
+/* pass 1: the total of each block but the last */
+static void qloop_scan_reduce(const size_t startat,
+                              const size_t stopat,
+                              void        *arg_)
+{                                      /*{{{ */
+    struct qloop_scan_args *const arg  = (struct qloop_scan_args *)arg_;
+    const size_t                  size = arg->size;
+
+    for (size_t b = startat; b < stopat; b++) {
+        const size_t   lo  = qloop_block_start(arg->length, arg->nblocks, b);
+        const size_t   hi  = qloop_block_start(arg->length, arg->nblocks, b + 1);
+        uint8_t *const sum = arg->sums + b * size;
+
+        memcpy(sum, arg->in + lo * size, size);
+        for (size_t i = lo + 1; i < hi; i++) {
+            arg->acc(sum, arg->in + i * size);
+        }
+    }
+}                                      /*}}} */
+
+/* pass 2: scan each block, starting from the total of the blocks before it */
+static void qloop_scan_apply(const size_t startat,
+                             const size_t stopat,
+                             void        *arg_)
+{                                      /*{{{ */
+    struct qloop_scan_args *const arg  = (struct qloop_scan_args *)arg_;
+    const size_t                  size = arg->size;
+    uint8_t                      *run  = MALLOC(2 * size);
+    uint8_t                      *next = run + size;
+
+    assert(run);
+    for (size_t b = startat; b < stopat; b++) {
+        size_t i  = qloop_block_start(arg->length, arg->nblocks, b);
+        size_t hi = qloop_block_start(arg->length, arg->nblocks, b + 1);
+
+        if (b > 0) {
+            memcpy(run, arg->sums + (b - 1) * size, size);
+        } else if (arg->kind == QT_SCAN_EXCLUSIVE) {
+            memcpy(run, arg->identity, size);
+        } else {
+            memcpy(run, arg->in + i * size, size);
+            memcpy(arg->out + i * size, run, size);
+            i++;
+        }
+        if (arg->kind == QT_SCAN_EXCLUSIVE) {
+            for (; i < hi; i++) {
+                uint8_t *const tmp = run;
+
+                memcpy(next, run, size);
+                arg->acc(next, arg->in + i * size);
+                memcpy(arg->out + i * size, run, size);
+                run  = next;
+                next = tmp;
+            }
+        } else {
+            for (; i < hi; i++) {
+                arg->acc(run, arg->in + i * size);
+                memcpy(arg->out + i * size, run, size);
+            }
+        }
+    }
+    FREE((run < next) ? run : next, 2 * size);
+}                                      /*}}} */
+
+static void qloop_scan_run(struct qloop_scan_args *const restrict arg,
+                           const qt_loop_f                        reduce,
+                           const qt_loop_f                        apply)
+{                                      /*{{{ */
+    const size_t nblocks = qloop_nblocks(arg->length);
+
+    assert(qthread_library_initialized);
+    if (arg->length == 0) { return; }
+    arg->nblocks = nblocks;
+    arg->sums    = NULL;
+    if (nblocks > 1) {
+        uint8_t *tmp;
+
+        /* the last block's total is never needed, so its slot is scratch */
+        arg->sums = MALLOC(nblocks * arg->size);
+        assert(arg->sums);
+        tmp = arg->sums + (nblocks - 1) * arg->size;
+        qloop_for_blocks(nblocks - 1, reduce, arg);
+        for (size_t b = 1; b < nblocks - 1; b++) {
+            memcpy(tmp, arg->sums + (b - 1) * arg->size, arg->size);
+            arg->acc(tmp, arg->sums + b * arg->size);
+            memcpy(arg->sums + b * arg->size, tmp, arg->size);
+        }
+    }
+    qloop_for_blocks(nblocks, apply, arg);
+    if (arg->sums) {
+        FREE(arg->sums, nblocks * arg->size);
+    }
+}                                      /*}}} */
+
+void API_FUNC qt_loop_scan(const void *restrict in,
+                           void *restrict       out,
+                           const size_t         length,
+                           const size_t         size,
+                           const qt_accum_f     acc,
+                           const void *restrict identity,
+                           const qt_scan_type   type)
+{                                      /*{{{ */
+    struct qloop_scan_args arg;
+
+    assert(in && out && acc && size);
+    assert(type == QT_SCAN_INCLUSIVE || identity != NULL);
+    arg.in       = in;
+    arg.out      = out;
+    arg.length   = length;
+    arg.size     = size;
+    arg.acc      = acc;
+    arg.identity = identity;
+    arg.kind     = type;
+    qloop_scan_run(&arg, qloop_scan_reduce, qloop_scan_apply);
+}                                      /*}}} */
+
+struct qloop_rbk_args {
+    const size_t *restrict  keys;
+    const uint8_t *restrict values;
+    uint8_t                *out;
+    size_t                  length, size, nkeys, nblocks;
+    qt_accum_f              acc;
+    const void             *identity;
+    uint8_t                *tables; // one per block after the first, which uses out
+};
+
+static QINLINE uint8_t *qloop_rbk_table(const struct qloop_rbk_args *const arg,
+                                        const size_t                       b)
+{                                      /*{{{ */
+    return b ? (arg->tables + (b - 1) * arg->nkeys * arg->size) : arg->out;
+}                                      /*}}} */
+
+/* pass 1: reduce each block into its own table */
+static void qloop_rbk_reduce(const size_t startat,
+                             const size_t stopat,
+                             void        *arg_)
+{                                      /*{{{ */
+    struct qloop_rbk_args *const arg  = (struct qloop_rbk_args *)arg_;
+    const size_t                 size = arg->size;
+
+    for (size_t b = startat; b < stopat; b++) {
+        const size_t   hi    = qloop_block_start(arg->length, arg->nblocks, b + 1);
+        uint8_t *const table = qloop_rbk_table(arg, b);
+
+        for (size_t k = 0; k < arg->nkeys; k++) {
+            memcpy(table + k * size, arg->identity, size);
+        }
+        for (size_t i = qloop_block_start(arg->length, arg->nblocks, b); i < hi; i++) {
+            assert(arg->keys[i] < arg->nkeys);
+            arg->acc(table + arg->keys[i] * size, arg->values + i * size);
+        }
+    }
+}                                      /*}}} */
+
+/* pass 2: fold the other blocks' tables into out, a range of keys at a time */
+static void qloop_rbk_combine(const size_t startat,
+                              const size_t stopat,
+                              void        *arg_)
+{                                      /*{{{ */
+    struct qloop_rbk_args *const arg  = (struct qloop_rbk_args *)arg_;
+    const size_t                 size = arg->size;
+
+    for (size_t b = 1; b < arg->nblocks; b++) {
+        const uint8_t *const table = qloop_rbk_table(arg, b);
+
+        for (size_t k = startat; k < stopat; k++) {
+            arg->acc(arg->out + k * size, table + k * size);
+        }
+    }
+}                                      /*}}} */
+
+static void qloop_rbk_run(struct qloop_rbk_args *const restrict arg,
+                          const qt_loop_f                       reduce,
+                          const qt_loop_f                       combine)
+{                                      /*{{{ */
+    size_t nblocks = qloop_nblocks(arg->length);
+
+    assert(qthread_library_initialized);
+    if (arg->nkeys == 0) { return; }
+    /* every block has a whole table to set up and fold in */
+    if (nblocks > 1 + arg->length / arg->nkeys) {
+        nblocks = 1 + arg->length / arg->nkeys;
+    }
+    arg->nblocks = nblocks;
+    arg->tables  = NULL;
+    if (nblocks > 1) {
+        arg->tables = MALLOC((nblocks - 1) * arg->nkeys * arg->size);
+        assert(arg->tables);
+    }
+    qloop_for_blocks(nblocks, reduce, arg);
+    if (nblocks > 1) {
+        qt_loop_balance_inner(0, arg->nkeys, combine, arg, 0, SINC_T);
+        FREE(arg->tables, (nblocks - 1) * arg->nkeys * arg->size);
+    }
+}                                      /*}}} */
+
+void API_FUNC qt_loop_reduce_by_key(const size_t *restrict keys,
+                                    const void *restrict   values,
+                                    const size_t           length,
+                                    const size_t           size,
+                                    void *restrict         out,
+                                    const size_t           nkeys,
+                                    const qt_accum_f       acc,
+                                    const void *restrict   identity)
+{                                      /*{{{ */
+    struct qloop_rbk_args arg;
+
+    assert(keys && values && out && acc && identity && size);
+    arg.keys     = keys;
+    arg.values   = values;
+    arg.out      = out;
+    arg.length   = length;
+    arg.size     = size;
+    arg.nkeys    = nkeys;
+    arg.acc      = acc;
+    arg.identity = identity;
+    qloop_rbk_run(&arg, qloop_rbk_reduce, qloop_rbk_combine);
+}                                      /*}}} */
+
+#define SCAN_FUNCS(initials, type, shorttype)                                                \
+    static void qt ## initials ## _scan_reduce(const size_t startat, const size_t stopat,    \
+                                                void *arg_)                                  \
+    {                                                                                        \
+        struct qloop_scan_args *const arg = (struct qloop_scan_args *)arg_;                  \
+        const type *const             in  = (const type *)arg->in;                           \
+        for (size_t b = startat; b < stopat; b++) {                                          \
+            const size_t hi  = qloop_block_start(arg->length, arg->nblocks, b + 1);          \
+            type         sum = 0;                                                            \
+            for (size_t i = qloop_block_start(arg->length, arg->nblocks, b); i < hi; i++) {  \
+                sum += in[i];                                                                \
+            }                                                                                \
+            ((type *)arg->sums)[b] = sum;                                                    \
+        }                                                                                    \
+    }                                                                                        \
+    static void qt ## initials ## _scan_apply(const size_t startat, const size_t stopat,     \
+                                               void *arg_)                                   \
+    {                                                                                        \
+        struct qloop_scan_args *const arg = (struct qloop_scan_args *)arg_;                  \
+        const type *const             in  = (const type *)arg->in;                           \
+        type *const                   out = (type *)arg->out;                                \
+        for (size_t b = startat; b < stopat; b++) {                                          \
+            const size_t hi  = qloop_block_start(arg->length, arg->nblocks, b + 1);          \
+            type         run = b ? ((type *)arg->sums)[b - 1] : 0;                           \
+            size_t       i   = qloop_block_start(arg->length, arg->nblocks, b);              \
+            if (arg->kind == QT_SCAN_EXCLUSIVE) {                                            \
+                for (; i < hi; i++) {                                                        \
+                    const type v = in[i];                                                    \
+                    out[i] = run;                                                            \
+                    run   += v;                                                              \
+                }                                                                            \
+            } else {                                                                         \
+                for (; i < hi; i++) {                                                        \
+                    run   += in[i];                                                          \
+                    out[i] = run;                                                            \
+                }                                                                            \
+            }                                                                                \
+        }                                                                                    \
+    }                                                                                        \
+    void API_FUNC qt_ ## shorttype ## _prefix_sum(const type *in, type *out, size_t length,  \
+                                                  qt_scan_type scantype)                     \
+    {                                                                                        \
+        struct qloop_scan_args arg;                                                          \
+        assert(in && out);                                                                   \
+        arg.in       = (const uint8_t *)in;                                                  \
+        arg.out      = (uint8_t *)out;                                                       \
+        arg.length   = length;                                                               \
+        arg.size     = sizeof(type);                                                         \
+        arg.acc      = qt_ ## initials ## _add_acc;                                          \
+        arg.identity = NULL;                                                                 \
+        arg.kind     = scantype;                                                             \
+        qloop_scan_run(&arg, qt ## initials ## _scan_reduce, qt ## initials ## _scan_apply); \
+    }                                                                                        \
+    static void qt ## initials ## _rbk_reduce(const size_t startat, const size_t stopat,     \
+                                               void *arg_)                                   \
+    {                                                                                        \
+        struct qloop_rbk_args *const arg    = (struct qloop_rbk_args *)arg_;                 \
+        const type *const            values = (const type *)arg->values;                     \
+        for (size_t b = startat; b < stopat; b++) {                                          \
+            const size_t hi    = qloop_block_start(arg->length, arg->nblocks, b + 1);        \
+            type *const  table = (type *)qloop_rbk_table(arg, b);                            \
+            for (size_t k = 0; k < arg->nkeys; k++) {                                        \
+                table[k] = 0;                                                                \
+            }                                                                                \
+            for (size_t i = qloop_block_start(arg->length, arg->nblocks, b); i < hi; i++) {  \
+                assert(arg->keys[i] < arg->nkeys);                                           \
+                table[arg->keys[i]] += values ? values[i] : 1;                               \
+            }                                                                                \
+        }                                                                                    \
+    }                                                                                        \
+    static void qt ## initials ## _rbk_combine(const size_t startat, const size_t stopat,    \
+                                                void *arg_)                                  \
+    {                                                                                        \
+        struct qloop_rbk_args *const arg = (struct qloop_rbk_args *)arg_;                    \
+        type *const                  out = (type *)arg->out;                                 \
+        for (size_t b = 1; b < arg->nblocks; b++) {                                          \
+            const type *const table = (const type *)qloop_rbk_table(arg, b);                 \
+            for (size_t k = startat; k < stopat; k++) {                                      \
+                out[k] += table[k];                                                          \
+            }                                                                                \
+        }                                                                                    \
+    }                                                                                        \
+    void API_FUNC qt_ ## shorttype ## _sum_by_key(const size_t *keys, const type *values,    \
+                                                  size_t length, type *out, size_t nkeys)    \
+    {                                                                                        \
+        struct qloop_rbk_args arg;                                                           \
+        assert(keys && out);                                                                 \
+        arg.keys     = keys;                                                                 \
+        arg.values   = (const uint8_t *)values;                                              \
+        arg.out      = (uint8_t *)out;                                                       \
+        arg.length   = length;                                                               \
+        arg.size     = sizeof(type);                                                         \
+        arg.nkeys    = nkeys;                                                                \
+        arg.acc      = qt_ ## initials ## _add_acc;                                          \
+        arg.identity = NULL;                                                                 \
+        qloop_rbk_run(&arg, qt ## initials ## _rbk_reduce, qt ## initials ## _rbk_combine);  \
+    }
+
+SCAN_FUNCS(uint, aligned_t, uint)
+SCAN_FUNCS(int, saligned_t, int)
+SCAN_FUNCS(dbl, double, double)
+
+struct qloop_filter_args {
+    const uint8_t *restrict in;
+    uint8_t *restrict       out;
+    size_t                  length, size, nblocks;
+    qt_filter_f             pred;
+    void                   *arg;
+    uint8_t                *keep;    // what pred said about each element
+    size_t                 *offsets; // where each block's survivors go
+};
+
+/* pass 1: ask pred about every element, and count each block's survivors */
+static void qloop_filter_count(const size_t startat,
+                               const size_t stopat,
+                               void        *arg_)
+{                                      /*{{{ */
+    struct qloop_filter_args *const arg = (struct qloop_filter_args *)arg_;
+
+    for (size_t b = startat; b < stopat; b++) {
+        const size_t hi    = qloop_block_start(arg->length, arg->nblocks, b + 1);
+        size_t       count = 0;
+
+        for (size_t i = qloop_block_start(arg->length, arg->nblocks, b); i < hi; i++) {
+            arg->keep[i] = (arg->pred(arg->in + i * arg->size, arg->arg) != 0);
+            count       += arg->keep[i];
+        }
+        arg->offsets[b] = count;
+    }
+}                                      /*}}} */
+
+/* pass 2: copy the survivors; the common element sizes get a fixed-size copy
+ * the compiler can inline */
+static void qloop_filter_copy(const size_t startat,
+                              const size_t stopat,
+                              void        *arg_)
+{                                      /*{{{ */
+    struct qloop_filter_args *const arg  = (struct qloop_filter_args *)arg_;
+    const size_t                    size = arg->size;
+
+    for (size_t b = startat; b < stopat; b++) {
+        const size_t hi = qloop_block_start(arg->length, arg->nblocks, b + 1);
+        size_t       j  = arg->offsets[b];
+        size_t       i  = qloop_block_start(arg->length, arg->nblocks, b);
+
+        if (size == sizeof(aligned_t)) {
+            for (; i < hi; i++) {
+                if (arg->keep[i]) {
+                    memcpy(arg->out + j * sizeof(aligned_t), arg->in + i * sizeof(aligned_t), sizeof(aligned_t));
+                    j++;
+                }
+            }
+        } else {
+            for (; i < hi; i++) {
+                if (arg->keep[i]) {
+                    memcpy(arg->out + j * size, arg->in + i * size, size);
+                    j++;
+                }
+            }
+        }
+    }
+}                                      /*}}} */
+
+size_t API_FUNC qt_loop_filter(const void *restrict in,
+                               void *restrict       out,
+                               const size_t         length,
+                               const size_t         size,
+                               const qt_filter_f    pred,
+                               void *restrict       argptr)
+{                                      /*{{{ */
+    struct qloop_filter_args arg;
+    size_t                   total = 0;
+
+    assert(qthread_library_initialized);
+    assert(in && out && pred && size);
+    if (length == 0) { return 0; }
+    arg.in      = in;
+    arg.out     = out;
+    arg.length  = length;
+    arg.size    = size;
+    arg.nblocks = qloop_nblocks(length);
+    arg.pred    = pred;
+    arg.arg     = argptr;
+    arg.keep    = MALLOC(length);
+    arg.offsets = MALLOC(arg.nblocks * sizeof(size_t));
+    assert(arg.keep && arg.offsets);
+    qloop_for_blocks(arg.nblocks, qloop_filter_count, &arg);
+    for (size_t b = 0; b < arg.nblocks; b++) {
+        const size_t count = arg.offsets[b];
+
+        arg.offsets[b] = total;
+        total         += count;
+    }
+    qloop_for_blocks(arg.nblocks, qloop_filter_copy, &arg);
+    FREE(arg.offsets, arg.nblocks * sizeof(size_t));
+    FREE(arg.keep, length);
+    return total;
+}                                      /*}}} */
+
 /* Now, the easy option for qt_loop_balance() is... effective, but has a major
  * drawback: if some iterations take longer than others, we will have a laggard
  * thread holding everyone up. Even worse, imagine if a shepherd is disabled
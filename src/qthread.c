@@ -76,6 +76,7 @@
 #include "qt_feb.h"
 #include "qt_syncvar.h"
 #include "qt_spawncache.h"
+#include "qt_sinc_pool.h"
 #ifdef QTHREAD_MULTINODE
 # include "qt_multinode_innards.h"
 #endif
@@ -167,20 +168,37 @@ void qthread_thread_free(qthread_t *t);
 extern int adaptiveSetHigh;
 #endif
 
+#define BIG_QTHREAD_SIZE(c) (sizeof(qthread_t) + QTHREAD_ARGCOPY_CLASS_SIZE(c) + qlib->qthread_tasklocal_size)
 #if defined(UNPOOLED_QTHREAD_T) || defined(UNPOOLED)
-# define ALLOC_QTHREAD()     (qthread_t *)MALLOC(sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size)
-# define ALLOC_BIG_QTHREAD() (qthread_t *)MALLOC(sizeof(qthread_t) + qlib->qthread_argcopy_size + qlib->qthread_tasklocal_size)
-# define FREE_QTHREAD(t)     FREE(t, sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size)
-# define FREE_BIG_QTHREAD(t) FREE(t, sizeof(qthread_t) + qlib->qthread_argcopy_size + qlib->qthread_tasklocal_size)
+# define ALLOC_QTHREAD()      (qthread_t *)MALLOC(sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size)
+# define ALLOC_BIG_QTHREAD(c) (qthread_t *)MALLOC(BIG_QTHREAD_SIZE(c))
+# define FREE_QTHREAD(t)      FREE(t, sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size)
+# define FREE_BIG_QTHREAD(t)  FREE(t, BIG_QTHREAD_SIZE((t)->argcopy_class))
+# define ALLOC_ARGCOPY(c)     MALLOC(QTHREAD_ARGCOPY_CLASS_SIZE(c))
+# define FREE_ARGCOPY(a, c)   FREE(a, QTHREAD_ARGCOPY_CLASS_SIZE(c))
 #else /* if defined(UNPOOLED_QTHREAD_T) || defined(UNPOOLED) */
-qt_mpool generic_qthread_pool     = NULL;
-qt_mpool generic_big_qthread_pool = NULL;
-# define ALLOC_QTHREAD()     (qthread_t *)qt_mpool_alloc(generic_qthread_pool)
-# define ALLOC_BIG_QTHREAD() (qthread_t *)qt_mpool_alloc(generic_big_qthread_pool)
-# define FREE_QTHREAD(t)     qt_mpool_free(generic_qthread_pool, t)
-# define FREE_BIG_QTHREAD(t) qt_mpool_free(generic_big_qthread_pool, t)
+qt_mpool        generic_qthread_pool = NULL;
+static qt_mpool generic_big_qthread_pools[QTHREAD_ARGCOPY_CLASSES];
+static qt_mpool generic_argcopy_pools[QTHREAD_ARGCOPY_CLASSES];
+# define ALLOC_QTHREAD()      (qthread_t *)qt_mpool_alloc(generic_qthread_pool)
+# define ALLOC_BIG_QTHREAD(c) (qthread_t *)qt_mpool_alloc(generic_big_qthread_pools[c])
+# define FREE_QTHREAD(t)      qt_mpool_free(generic_qthread_pool, t)
+# define FREE_BIG_QTHREAD(t)  qt_mpool_free(generic_big_qthread_pools[(t)->argcopy_class], t)
+# define ALLOC_ARGCOPY(c)     qt_mpool_alloc(generic_argcopy_pools[c])
+# define FREE_ARGCOPY(a, c)   qt_mpool_free(generic_argcopy_pools[c], a)
 #endif /* if defined(UNPOOLED_QTHREAD_T) || defined(UNPOOLED) */
 
+/* the smallest argument-copy size class that holds size bytes */
+static QINLINE uint8_t qthread_argcopy_class(size_t size)
+{                      /*{{{ */
+    uint8_t c = 0;
+
+    while (QTHREAD_ARGCOPY_CLASS_SIZE(c) < size) {
+        c++;
+    }
+    return c;
+}                      /*}}} */
+
 #if defined(UNPOOLED_STACKS) || defined(UNPOOLED)
 # ifdef QTHREAD_GUARD_PAGES
 static QINLINE void *ALLOC_STACK(void)
@@ -226,13 +244,22 @@ static QINLINE void FREE_STACK(void *t)
     }
 }                      /*}}} */
 
+#  define STACK_RDATA(s) ((struct qthread_runtime_data_s *)((uint8_t *)(s) + qlib->qthread_stack_size + \
+                                                            (GUARD_PAGES ? getpagesize() : 0)))
 # else /* ifdef QTHREAD_GUARD_PAGES */
 #  define ALLOC_STACK() MALLOC(qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s))
 #  define FREE_STACK(t) FREE(t, qlib->qthread_stack_size) /* XXX: this size seems wrong */
+#  define STACK_RDATA(s) ((struct qthread_runtime_data_s *)((uint8_t *)(s) + qlib->qthread_stack_size))
 # endif /* ifdef QTHREAD_GUARD_PAGES */
 #else /* if defined(UNPOOLED_STACKS) || defined(UNPOOLED) */
 static qt_mpool generic_stack_pool = NULL;
 # ifdef QTHREAD_GUARD_PAGES
+/* Guarded pool entries are laid out as
+ *     [ rdata (stack_head_size) | guard | stack | guard ]
+ * and keep their guard pages for as long as the pool exists (see
+ * qt_mpool_create_guarded()), so allocating and freeing are syscall-free. */
+static size_t stack_head_size = 0;
+
 static QINLINE void *ALLOC_STACK(void)
 {                      /*{{{ */
     if (GUARD_PAGES) {
@@ -242,15 +269,7 @@ static QINLINE void *ALLOC_STACK(void)
         if (tmp == NULL) {
             return NULL;
         }
-        if (mprotect(tmp, getpagesize(), PROT_NONE) != 0) {
-            perror("mprotect in ALLOC_STACK (1)");
-        }
-        if (mprotect(tmp + qlib->qthread_stack_size + getpagesize(),
-                    getpagesize(),
-                    PROT_NONE) != 0) {
-            perror("mprotect in ALLOC_STACK (2)");
-        }
-        return tmp + getpagesize();
+        return tmp + stack_head_size + getpagesize();
     } else {
         return qt_mpool_alloc(generic_stack_pool);
     }
@@ -260,22 +279,24 @@ static QINLINE void FREE_STACK(void *t)
 {                      /*{{{ */
     if (GUARD_PAGES) {
         assert(t);
-        t = (uint8_t*)t - getpagesize();
-        if (mprotect(t, getpagesize(), PROT_READ | PROT_WRITE) != 0) {
-            perror("mprotect in FREE_STACK (1)");
-        }
-        if (mprotect(((uint8_t*)t) + qlib->qthread_stack_size + getpagesize(),
-                    getpagesize(),
-                    PROT_READ | PROT_WRITE) != 0) {
-            perror("mprotect in FREE_STACK (2)");
-        }
+        t = (uint8_t *)t - getpagesize() - stack_head_size;
     }
     qt_mpool_free(generic_stack_pool, t);
 }                      /*}}} */
 
+static QINLINE struct qthread_runtime_data_s *STACK_RDATA(void *s)
+{                      /*{{{ */
+    if (GUARD_PAGES) {
+        return (struct qthread_runtime_data_s *)((uint8_t *)s - getpagesize() - stack_head_size);
+    } else {
+        return (struct qthread_runtime_data_s *)((uint8_t *)s + qlib->qthread_stack_size);
+    }
+}                      /*}}} */
+
 # else /* ifdef QTHREAD_GUARD_PAGES */
 #  define ALLOC_STACK() qt_mpool_alloc(generic_stack_pool)
 #  define FREE_STACK(t) qt_mpool_free(generic_stack_pool, t)
+#  define STACK_RDATA(s) ((struct qthread_runtime_data_s *)((uint8_t *)(s) + qlib->qthread_stack_size))
 # endif /* ifdef QTHREAD_GUARD_PAGES */
 #endif  /* if defined(UNPOOLED_STACKS) || defined(UNPOOLED) */
 
@@ -356,11 +377,7 @@ static QINLINE void alloc_rdata(qthread_shepherd_t *me,
     } else {
         stack = ALLOC_STACK();
         assert(stack);
-        if (GUARD_PAGES) {
-            rdata = t->rdata = (struct qthread_runtime_data_s *)(((uint8_t *)stack) + getpagesize() + qlib->qthread_stack_size);
-        } else {
-            rdata = t->rdata = (struct qthread_runtime_data_s *)(((uint8_t *)stack) + qlib->qthread_stack_size);
-        }
+        rdata = t->rdata = STACK_RDATA(stack);
     }
     rdata->tasklocal_size = 0;
     rdata->criticalsect   = 0;
@@ -527,6 +544,11 @@ static void *qthread_master(void *arg)
             }
         }
 #endif  /* ifdef QTHREAD_RCRTOOL */
+#ifdef QTHREAD_EPOCH_RECLAMATION
+        /* between tasks, this worker holds no lock-free data structure
+         * references, so it need not hold back reclamation while idle */
+        qt_epoch_offline(me_worker);
+#endif
         while (!QTHREAD_CASLOCK_READ_UI(me_worker->active)) {
             SPINLOCK_BODY();
         }
@@ -536,6 +558,9 @@ static void *qthread_master(void *arg)
         t = qt_scheduler_get_thread(threadqueue, localqueue, QTHREAD_CASLOCK_READ_UI(me->active));
 #endif /* ifdef QTHREAD_LOCAL_PRIORITY */
         assert(t);
+#ifdef QTHREAD_EPOCH_RECLAMATION
+        qt_epoch_online(me_worker);
+#endif
 #ifdef QTHREAD_SHEPHERD_PROFILING
         qtimer_stop(idle);
         me->idle_count++;
@@ -566,6 +591,9 @@ qt_run:
             }
 #endif
             done = 1;
+#ifdef QTHREAD_EPOCH_RECLAMATION
+            qt_epoch_offline(me_worker);
+#endif
 #ifdef QTHREAD_RCRTOOL
             if (rcrtoollevel > 0) {
                 qthread_incr(&qlib->shepherds[my_id].active_workers, -1); // not working spinning
@@ -877,7 +905,6 @@ int API_FUNC qthread_initialize(void)
     qthread_shepherd_id_t nshepherds      = 0;
     qthread_worker_id_t   nworkerspershep = 0;
     size_t                hw_par          = 0;
-    extern unsigned int QTHREAD_LOCKING_STRIPES;
 
     print_info = qt_internal_get_env_num("INFO", 0, 1);
 
@@ -898,14 +925,6 @@ int API_FUNC qthread_initialize(void)
     qlib = (qlib_t)MALLOC(sizeof(struct qlib_s));
     qassert_ret(qlib, QTHREAD_MALLOC_ERROR);
 
-#if defined(QTHREAD_MUTEX_INCREMENT) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32)
-    qlib->atomic_locks = MALLOC(sizeof(QTHREAD_FASTLOCK_TYPE) * QTHREAD_LOCKING_STRIPES);
-    qassert_ret(qlib->atomic_locks, QTHREAD_MALLOC_ERROR);
-    for (i = 0; i < QTHREAD_LOCKING_STRIPES; i++) {
-        QTHREAD_FASTLOCK_INIT(qlib->atomic_locks[i]);
-    }
-#endif
-
     qthread_internal_alignment_init();
     qt_hash_initialize_subsystem();
 
@@ -916,7 +935,23 @@ int API_FUNC qthread_initialize(void)
     if ((nshepherds == 1) && (nworkerspershep == 1)) {
         need_sync = 0;
     }
-    QTHREAD_LOCKING_STRIPES = 2 << (QT_INT_LOG(nshepherds * nworkerspershep) + 1);
+    {
+        size_t stripes = 2 << (QT_INT_LOG(nshepherds * nworkerspershep) + 1);
+
+        stripes = qt_internal_get_env_num("LOCKING_STRIPES", stripes, stripes);
+        QTHREAD_LOCKING_STRIPES = 1;
+        while (QTHREAD_LOCKING_STRIPES < stripes && QTHREAD_LOCKING_STRIPES < (1u << 24)) {
+            QTHREAD_LOCKING_STRIPES <<= 1;
+        }
+        qthread_debug(CORE_DETAILS, "using %u locking stripes\n", QTHREAD_LOCKING_STRIPES);
+    }
+#if defined(QTHREAD_MUTEX_INCREMENT) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32)
+    qlib->atomic_locks = qthread_internal_aligned_alloc(sizeof(qt_padded_lock_t) * QTHREAD_LOCKING_STRIPES, CACHELINE_WIDTH);
+    qassert_ret(qlib->atomic_locks, QTHREAD_MALLOC_ERROR);
+    for (i = 0; i < QTHREAD_LOCKING_STRIPES; i++) {
+        QTHREAD_FASTLOCK_INIT(qlib->atomic_locks[i].lock);
+    }
+#endif
     qthread_debug(CORE_BEHAVIOR, "there will be %u shepherd(s)\n", (unsigned)nshepherds);
 
 #ifdef QTHREAD_COUNT_THREADS
@@ -1032,9 +1067,15 @@ int API_FUNC qthread_initialize(void)
         assert(qlib->shepherds[0].sorted_sheplist);
         assert(qlib->shepherds[0].shep_dists);
     }
+    /* pools created from here on know which shepherds share memory */
+    qt_mpool_subsystem_nodes_init();
+    qthread_spawn_placement_init();
 
     // Set task argument buffer size
     qlib->qthread_argcopy_size = qt_internal_get_env_num("ARGCOPY_SIZE", ARGCOPY_DEFAULT, 0);
+    if (qlib->qthread_argcopy_size > QTHREAD_ARGCOPY_MAX) {
+        qlib->qthread_argcopy_size = QTHREAD_ARGCOPY_MAX;
+    }
     qthread_debug(CORE_DETAILS, "qthread task argcopy size: %u\n", (unsigned)qlib->qthread_argcopy_size);
 
     // Set task-local data size
@@ -1045,17 +1086,46 @@ int API_FUNC qthread_initialize(void)
 
 #ifndef UNPOOLED
     generic_qthread_pool     = qt_mpool_create_aligned(sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size, qthread_cacheline());
-    generic_big_qthread_pool = qt_mpool_create(sizeof(qthread_t) + qlib->qthread_argcopy_size + qlib->qthread_tasklocal_size);
+    {
+        /* classes up to ARGCOPY_SIZE are copied inline, the rest out of line */
+        uint8_t const last_inline = qlib->qthread_argcopy_size ?
+                                    qthread_argcopy_class(qlib->qthread_argcopy_size) : 0;
+        uint8_t const first_outer = qthread_argcopy_class(qlib->qthread_argcopy_size + 1);
+
+        for (uint8_t c = 0; c < QTHREAD_ARGCOPY_CLASSES; c++) {
+            generic_big_qthread_pools[c] = NULL;
+            generic_argcopy_pools[c]     = NULL;
+            if (qlib->qthread_argcopy_size && (c <= last_inline)) {
+                generic_big_qthread_pools[c] = qt_mpool_create(BIG_QTHREAD_SIZE(c));
+            }
+            if (c >= first_outer) {
+                generic_argcopy_pools[c] = qt_mpool_create(QTHREAD_ARGCOPY_CLASS_SIZE(c));
+            }
+        }
+    }
+#ifdef QTHREAD_GUARD_PAGES
     if (GUARD_PAGES) {
+        stack_head_size = sizeof(struct qthread_runtime_data_s);
+        if (stack_head_size % pagesize) {
+            stack_head_size += pagesize - (stack_head_size % pagesize);
+        }
         generic_stack_pool =
-            qt_mpool_create_aligned(qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s) +
-                                    (2 * getpagesize()), getpagesize());
-    } else {
+            qt_mpool_create_guarded(stack_head_size + qlib->qthread_stack_size + (2 * pagesize),
+                                    stack_head_size,
+                                    stack_head_size + pagesize + qlib->qthread_stack_size);
+    } else
+#endif
+    {
         generic_stack_pool = qt_mpool_create_aligned(qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s), QTHREAD_STACK_ALIGNMENT);     // stacks on most platforms must be 16-byte aligned (or less)
     }
+    qt_mpool_set_soft_cap(generic_stack_pool, qt_internal_get_env_num("STACK_POOL_CAP", 0, 0));
     generic_rdata_pool = qt_mpool_create(sizeof(struct qthread_runtime_data_s));
 #endif /* ifndef UNPOOLED */
     initialize_hazardptrs();
+#ifdef QTHREAD_EPOCH_RECLAMATION
+    initialize_epochs();
+#endif
+    qt_sinc_subsystem_init();
     qt_internal_teams_init();
     qthread_queue_subsystem_init();
     qt_feb_subsystem_init(need_sync);
@@ -1144,6 +1214,7 @@ int API_FUNC qthread_initialize(void)
     qlib->shepherds[0].workers[0].worker_id = 0;
     qlib->shepherds[0].workers[0].unique_id = qthread_internal_incr(&(qlib->max_unique_id),
                                                                     &qlib->max_unique_id_lock, 1);
+    qthread_internal_worker_seed(&qlib->shepherds[0].workers[0]);
     qthread_makecontext(&(qlib->master_context), qlib->master_stack,
                         qlib->master_stack_size,
 #ifdef QTHREAD_MAKECONTEXT_SPLIT
@@ -1208,6 +1279,7 @@ int API_FUNC qthread_initialize(void)
             qlib->shepherds[i].workers[j].worker_id = j;
             qlib->shepherds[i].workers[j].unique_id = qthread_internal_incr(&(qlib->max_unique_id),
                                                                             &qlib->max_unique_id_lock, 1);
+            qthread_internal_worker_seed(&qlib->shepherds[i].workers[j]);
             qlib->shepherds[i].workers[j].packed_worker_id = j + (i * nworkerspershep);
 
             if ((j * nshepherds) + i + 1 > hw_par) {
@@ -1478,6 +1550,7 @@ void API_FUNC qthread_finalize(void)
 #endif
 # ifdef STEAL_PROFILE
     qthread_steal_stat();
+    qthread_spawn_placement_stat();
 # endif
 # ifdef CAS_STEAL_PROFILE
     qthread_cas_steal_stat();
@@ -1710,12 +1783,10 @@ void API_FUNC qthread_finalize(void)
 #endif /* ifdef QTHREAD_FEB_PROFILING */
 
 #ifdef LOCK_FREE_FEBS
-    extern unsigned int QTHREAD_LOCKING_STRIPES;
     QTHREAD_LOCKING_STRIPES = 1;
 #elif defined(QTHREAD_MUTEX_INCREMENT) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32)
-    extern unsigned int QTHREAD_LOCKING_STRIPES;
     for (i = 0; i < QTHREAD_LOCKING_STRIPES; i++) {
-        QTHREAD_FASTLOCK_DESTROY(qlib->atomic_locks[i]);
+        QTHREAD_FASTLOCK_DESTROY(qlib->atomic_locks[i].lock);
     }
 #endif
 #ifdef QTHREAD_MUTEX_INCREMENT
@@ -1758,7 +1829,7 @@ void API_FUNC qthread_finalize(void)
         FREE(tmp, sizeof(struct qt_cleanup_funcs_s));
     }
 #if defined(QTHREAD_MUTEX_INCREMENT) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32)
-    FREE((void *)qlib->atomic_locks, sizeof(QTHREAD_FASTLOCK_TYPE) * QTHREAD_LOCKING_STRIPES);
+    qthread_internal_aligned_free((void *)qlib->atomic_locks, CACHELINE_WIDTH);
 #endif
 
     for (i = 0; i < qlib->nshepherds; ++i) {
@@ -1775,8 +1846,16 @@ void API_FUNC qthread_finalize(void)
     qthread_debug(CORE_DETAILS, "destroy global memory pools\n");
     qt_mpool_destroy(generic_qthread_pool);
     generic_qthread_pool = NULL;
-    qt_mpool_destroy(generic_big_qthread_pool);
-    generic_big_qthread_pool = NULL;
+    for (i = 0; i < QTHREAD_ARGCOPY_CLASSES; i++) {
+        if (generic_big_qthread_pools[i]) {
+            qt_mpool_destroy(generic_big_qthread_pools[i]);
+            generic_big_qthread_pools[i] = NULL;
+        }
+        if (generic_argcopy_pools[i]) {
+            qt_mpool_destroy(generic_argcopy_pools[i]);
+            generic_argcopy_pools[i] = NULL;
+        }
+    }
     qt_mpool_destroy(generic_stack_pool);
     generic_stack_pool = NULL;
     qt_mpool_destroy(generic_rdata_pool);
@@ -1827,18 +1906,9 @@ void API_FUNC *qthread_get_tasklocal(unsigned int size)
         qthread_debug(THREAD_DETAILS, "tasklocal_size=%u, global tasklocal_size=%u\n", tl_sz, qlib->qthread_tasklocal_size);
         if ((0 == tl_sz) && (size <= qlib->qthread_tasklocal_size)) {
             // Use default space
-            if (f->flags & QTHREAD_BIG_STRUCT) {
-                return &f->data[qlib->qthread_argcopy_size];
-            } else {
-                return &f->data;
-            }
+            return QTHREAD_TASKLOCAL_DATA(f);
         } else {
-            void **data_blob;
-            if (f->flags & QTHREAD_BIG_STRUCT) {
-                data_blob = (void **)&f->data[qlib->qthread_argcopy_size];
-            } else {
-                data_blob = (void **)&f->data[0];
-            }
+            void **data_blob = (void **)QTHREAD_TASKLOCAL_DATA(f);
             if (0 == tl_sz) {
                 qthread_debug(THREAD_DETAILS, "Allocate space and copy old data\n");
                 void *tmp_data = MALLOC(size);
@@ -1903,6 +1973,17 @@ size_t API_FUNC qthread_stackleft(void)
     }
 }                      /*}}} */
 
+/* Gives back to the system the memory that the internal pools (and those
+ * made with qpool_create()) are holding on to without using. */
+size_t API_FUNC qthread_trim_memory(void)
+{                      /*{{{ */
+#ifdef UNPOOLED
+    return 0;
+#else
+    return qt_mpool_trim_all();
+#endif
+}                      /*}}} */
+
 size_t API_FUNC qthread_readstate(const enum introspective_state type)
 {                      /*{{{ */
     switch (type) {
@@ -2028,9 +2109,17 @@ static QINLINE qthread_t *qthread_thread_new(const qthread_f f,
                                              int             team_leader)
 {                      /*{{{ */
     qthread_t *t;
+    uint8_t    argcopy_class = QTHREAD_ARGCOPY_UNPOOLED;
 
-    if ((arg_size > 0) && (arg_size <= qlib->qthread_argcopy_size)) {
-        t = ALLOC_BIG_QTHREAD();
+    if (arg_size > 0) {
+        if (arg_size <= QTHREAD_ARGCOPY_MAX) {
+            argcopy_class = qthread_argcopy_class(arg_size);
+        }
+        if (arg_size <= qlib->qthread_argcopy_size) {
+            t = ALLOC_BIG_QTHREAD(argcopy_class);
+        } else {
+            t = ALLOC_QTHREAD();
+        }
     } else {
         t = ALLOC_QTHREAD();
     }
@@ -2074,10 +2163,14 @@ static QINLINE qthread_t *qthread_thread_new(const qthread_f f,
     t->target_shepherd = NO_SHEPHERD;
 
     // should I use the builtin block for args?
+    t->argcopy_class = argcopy_class;
     if (arg_size > 0) {
         if (arg_size <= qlib->qthread_argcopy_size) {
             t->arg   = (void *)(&t->data);
             t->flags = QTHREAD_BIG_STRUCT;
+        } else if (argcopy_class != QTHREAD_ARGCOPY_UNPOOLED) {
+            t->arg   = ALLOC_ARGCOPY(argcopy_class);
+            t->flags = QTHREAD_HAS_ARGCOPY;
         } else {
             t->arg   = MALLOC(arg_size);
             t->flags = QTHREAD_HAS_ARGCOPY;
@@ -2107,13 +2200,9 @@ void qthread_thread_free(qthread_t *t)
     if (t->rdata != NULL) {
         if (t->rdata->tasklocal_size > 0) {
             qthread_debug(THREAD_DETAILS, "t(%p,%i): destroying %u bytes of task-local storage\n", t, t->thread_id, t->rdata->tasklocal_size);
-            if (t->flags & QTHREAD_BIG_STRUCT) {
-                FREE(*(void **)&t->data[qlib->qthread_argcopy_size], t->rdata->tasklocal_size);
-                *(void **)&t->data[qlib->qthread_argcopy_size] = NULL;
-            } else {
-                FREE(*(void **)&t->data[0], t->rdata->tasklocal_size);
-                *(void **)&t->data[0] = NULL;
-            }
+            void **data_blob = (void **)QTHREAD_TASKLOCAL_DATA(t);
+            FREE(*data_blob, t->rdata->tasklocal_size);
+            *data_blob = NULL;
         }
 #ifdef QTHREAD_USE_VALGRIND
         VALGRIND_STACK_DEREGISTER(t->rdata->valgrind_stack_id);
@@ -2131,7 +2220,11 @@ void qthread_thread_free(qthread_t *t)
     }
     if (t->flags & QTHREAD_HAS_ARGCOPY) {
         assert(&t->data != t->arg);
-        free(t->arg); // I don't record the size of this anywhere, so I can't scribble it
+        if (t->argcopy_class == QTHREAD_ARGCOPY_UNPOOLED) {
+            free(t->arg); // I don't record the size of this anywhere, so I can't scribble it
+        } else {
+            FREE_ARGCOPY(t->arg, t->argcopy_class);
+        }
         t->arg = NULL;
     }
     qthread_debug(THREAD_DETAILS, "t(%p): releasing thread handle %p\n", t, t);
@@ -2234,15 +2327,11 @@ static void qthread_wrapper(void *ptr)
     QTHREAD_FASTLOCK_UNLOCK(&effconcurrentthreads_lock);
 #endif /* ifdef QTHREAD_COUNT_THREADS */
 
-    if ((NULL != t->team) && (t->flags & QTHREAD_TEAM_LEADER)) {
 #ifdef TEAM_PROFILE
+    if ((NULL != t->team) && (t->flags & QTHREAD_TEAM_LEADER)) {
         qthread_incr(&qlib->team_leader_start, 1);
-#endif
-        if (NULL != t->team->parent_eureka) {
-            // This is a subteam's team-leader
-            qt_internal_subteam_leader(t);
-        }
     }
+#endif
 
     assert(t->rdata);
     if(t->flags & QTHREAD_AGGREGATED){
@@ -2415,6 +2504,12 @@ void API_FUNC qthread_yield_(int k)
     assert(qthread_library_initialized);
     qthread_t *t = qthread_internal_self();
 
+    if ((t != NULL) && (t->flags & QTHREAD_SIMPLE)) {
+        /* stackless tasks run to completion; there is nothing to yield to */
+        qthread_debug(THREAD_CALLS,
+                      "tid %u is stackless; not yielding\n", t->thread_id);
+        return;
+    }
     if (t != NULL) {
         qthread_debug(THREAD_CALLS,
                       "tid %u yielding...\n", t->thread_id);
@@ -2470,7 +2565,12 @@ basic_yield:
 void API_FUNC qthread_flushsc(void)
 {   /*{{{*/
 #ifdef QTHREAD_USE_SPAWNCACHE
-    qt_spawncache_flush(qlib->threadqueues[qthread_readstate(CURRENT_UNIQUE_WORKER)]);
+    qthread_shepherd_t *shep = qthread_internal_getshep();
+
+    /* the spawn cache feeds its shepherd's queue */
+    if (shep != NULL) {
+        qt_spawncache_flush(shep->ready);
+    }
 #endif
 } /*}}}*/
 
@@ -2503,6 +2603,60 @@ void API_FUNC qthread_flushsc(void)
  */
 #define QTHREAD_SPAWN_MASK_TEAMS (QTHREAD_SPAWN_NEW_TEAM | QTHREAD_SPAWN_NEW_SUBTEAM)
 
+/* Empties (or flags) a new task's return value location, as described by the
+ * QTHREAD_SPAWN_RET_* bits of feature_flag */
+static int qthread_spawn_prepare_ret(qthread_t   *t,
+                                     void        *ret,
+                                     unsigned int feature_flag)
+{   /*{{{*/
+    int      test     = QTHREAD_SUCCESS;
+    unsigned ret_type = feature_flag & (QTHREAD_SPAWN_RET_SYNCVAR_T |
+                                        QTHREAD_SPAWN_RET_SINC |
+                                        QTHREAD_SPAWN_RET_SINC_VOID);
+
+    switch (ret_type) {
+        case QTHREAD_SPAWN_RET_SYNCVAR_T:
+            t->flags |= QTHREAD_RET_IS_SYNCVAR;
+            if (qthread_syncvar_status((syncvar_t *)ret)) {
+                test = qthread_syncvar_empty((syncvar_t *)ret);
+            } else {
+                test = QTHREAD_SUCCESS;
+            }
+            break;
+        case QTHREAD_SPAWN_RET_SINC:
+            t->flags |= QTHREAD_RET_IS_SINC;
+            break;
+        case QTHREAD_SPAWN_RET_SINC_VOID:
+            t->flags |= QTHREAD_RET_IS_VOID_SINC;
+            break;
+        default:
+            // QTHREAD_SPAWN_RET_ALIGNED
+            qthread_debug(FEB_DETAILS, "emptying new thread %u's retval (%p)\n", t->thread_id, ret);
+            test = qthread_empty(ret);
+            break;
+    }
+    return test;
+} /*}}}*/
+
+#ifdef QTHREAD_COUNT_THREADS
+static void qthread_count_spawned(size_t n)
+{   /*{{{*/
+    QTHREAD_FASTLOCK_LOCK(&concurrentthreads_lock);
+    while (n--) {
+        threadcount++;
+        concurrentthreads++;
+        assert(concurrentthreads <= threadcount);
+        if (concurrentthreads > maxconcurrentthreads) {
+            maxconcurrentthreads = concurrentthreads;
+        }
+        avg_concurrent_threads =
+            (avg_concurrent_threads * (double)(threadcount - 1.0) / threadcount)
+            + ((double)concurrentthreads / threadcount);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&concurrentthreads_lock);
+} /*}}}*/
+#endif  /* ifdef QTHREAD_COUNT_THREADS */
+
 int API_FUNC qthread_spawn(qthread_f             f,
                            const void           *arg,
                            size_t                arg_size,
@@ -2556,7 +2710,7 @@ int API_FUNC qthread_spawn(qthread_f             f,
     if (target_shep != NO_SHEPHERD) {
         dest_shep = target_shep % qlib->nshepherds;
     } else {
-        dest_shep = qt_threadqueue_choose_dest(myshep);
+        dest_shep = qthread_spawn_place(myshep, feature_flag, arg);
 #ifdef QTHREAD_DEBUG
         // debug moved until after destination shepherd is picked for multithreaded shepherds
         // check to make sure destination shepherd is in range (not target_shep which is
@@ -2662,31 +2816,7 @@ int API_FUNC qthread_spawn(qthread_f             f,
 #endif /* ifdef QTHREAD_USE_ROSE_EXTENSIONS */
        /* Step 4: Prepare the return value location (if necessary) */
     if (ret) {
-        int      test     = QTHREAD_SUCCESS;
-        unsigned ret_type = feature_flag & (QTHREAD_SPAWN_RET_SYNCVAR_T |
-                                            QTHREAD_SPAWN_RET_SINC |
-                                            QTHREAD_SPAWN_RET_SINC_VOID);
-        switch (ret_type) {
-            case QTHREAD_SPAWN_RET_SYNCVAR_T:
-                t->flags |= QTHREAD_RET_IS_SYNCVAR;
-                if (qthread_syncvar_status((syncvar_t *)ret)) {
-                    test = qthread_syncvar_empty((syncvar_t *)ret);
-                } else {
-                    test = QTHREAD_SUCCESS;
-                }
-                break;
-            case QTHREAD_SPAWN_RET_SINC:
-                t->flags |= QTHREAD_RET_IS_SINC;
-                break;
-            case QTHREAD_SPAWN_RET_SINC_VOID:
-                t->flags |= QTHREAD_RET_IS_VOID_SINC;
-                break;
-            default:
-                // QTHREAD_SPAWN_RET_ALIGNED
-                qthread_debug(FEB_DETAILS, "tid %i emptying new thread %u's retval (%p)\n", me ? ((int)me->thread_id) : -1, t->thread_id, ret);
-                test = qthread_empty(ret);
-                break;
-        }
+        int test = qthread_spawn_prepare_ret(t, ret, feature_flag);
         if (QTHREAD_UNLIKELY(test != QTHREAD_SUCCESS)) {
             qthread_thread_free(t);
             return test;
@@ -2697,20 +2827,12 @@ int API_FUNC qthread_spawn(qthread_f             f,
     if (QTHREAD_LIKELY(!preconds) || (qthread_check_feb_preconds(t) == 0)) {
         /* Step 6: Set it going */
 #ifdef QTHREAD_COUNT_THREADS
-        QTHREAD_FASTLOCK_LOCK(&concurrentthreads_lock);
-        threadcount++;
-        concurrentthreads++;
-        assert(concurrentthreads <= threadcount);
-        if (concurrentthreads > maxconcurrentthreads) {
-            maxconcurrentthreads = concurrentthreads;
-        }
-        avg_concurrent_threads =
-            (avg_concurrent_threads * (double)(threadcount - 1.0) / threadcount)
-            + ((double)concurrentthreads / threadcount);
-        QTHREAD_FASTLOCK_UNLOCK(&concurrentthreads_lock);
+        qthread_count_spawned(1);
 #endif  /* ifdef QTHREAD_COUNT_THREADS */
 #ifdef QTHREAD_USE_SPAWNCACHE
-        if (target_shep == NO_SHEPHERD) {
+        /* the spawn cache only feeds the spawning shepherd's queue */
+        if ((target_shep == NO_SHEPHERD) &&
+            ((myshep == NULL) || (dest_shep == myshep->shepherd_id))) {
             if (!qt_spawncache_spawn(t, qlib->threadqueues[dest_shep])) {
                 qt_threadqueue_enqueue(qlib->threadqueues[dest_shep], t);
             }
@@ -2729,6 +2851,119 @@ int API_FUNC qthread_spawn(qthread_f             f,
     return QTHREAD_SUCCESS;
 } /*}}}*/
 
+/* Spawns n independent tasks into the caller's team as one batch: the team's
+ * sinc is told to expect all of them at once, and they are handed to a single
+ * shepherd's queue with one enqueue. Task i runs f[i] with args[i] (copied if
+ * arg_size is non-zero) and returns into rets[i]; args and rets may be NULL. */
+int API_FUNC qthread_spawn_many(size_t                n,
+                                const qthread_f      *f,
+                                void *const          *args,
+                                size_t                arg_size,
+                                void *const          *rets,
+                                qthread_shepherd_id_t target_shep,
+                                unsigned int          feature_flag)
+{   /*{{{*/
+    assert(qthread_library_initialized);
+    qthread_t            *me     = qthread_internal_self();
+    qthread_shepherd_t   *myshep = me ? me->rdata->shepherd_ptr : NULL;
+    qt_team_t            *team   = (me && me->team) ? me->team : NULL;
+    qthread_t           **t;
+    qthread_shepherd_id_t dest_shep;
+    size_t                i;
+    int                   rc;
+
+    qthread_debug(THREAD_CALLS, "n(%z), f(%p), args(%p), arg_size(%z), rets(%p), ts(%u)\n",
+                  n, f, args, arg_size, rets, target_shep);
+    qassert_ret(f != NULL, QTHREAD_BADARGS);
+    /* every team-founding task needs a team of its own */
+    qassert_ret(!(feature_flag & QTHREAD_SPAWN_MASK_TEAMS), QTHREAD_BADARGS);
+    if (n == 0) { return QTHREAD_SUCCESS; }
+
+    /* Step 1: Pick a destination for the whole batch */
+    if (target_shep != NO_SHEPHERD) {
+        dest_shep = target_shep % qlib->nshepherds;
+    } else {
+        dest_shep = qthread_spawn_place(myshep, feature_flag, args ? args[0] : NULL);
+    }
+
+    /* Step 2: Allocate & init the structures */
+    t = MALLOC(n * sizeof(qthread_t *));
+    qassert_ret(t, QTHREAD_MALLOC_ERROR);
+    for (i = 0; i < n; i++) {
+        void *ret = rets ? rets[i] : NULL;
+
+        assert(f[i] != NULL);
+        t[i] = qthread_thread_new(f[i], args ? args[i] : NULL, arg_size, ret, team, 0);
+        if (QTHREAD_UNLIKELY(t[i] == NULL)) {
+            rc = QTHREAD_MALLOC_ERROR;
+            break;
+        }
+        if (QTHREAD_UNLIKELY(target_shep != NO_SHEPHERD)) {
+            t[i]->target_shepherd = dest_shep;
+            t[i]->flags          |= QTHREAD_UNSTEALABLE;
+        }
+        t[i]->preconds = NULL;
+        if (feature_flag & QTHREAD_SPAWN_SIMPLE) {
+            t[i]->flags |= QTHREAD_SIMPLE;
+        }
+        if (ret && ((rc = qthread_spawn_prepare_ret(t[i], ret, feature_flag)) != QTHREAD_SUCCESS)) {
+            qthread_thread_free(t[i]);
+            break;
+        }
+    }
+    if (QTHREAD_UNLIKELY(i < n)) {
+        while (i--) {
+            qthread_thread_free(t[i]);
+        }
+        FREE(t, n * sizeof(qthread_t *));
+        return rc;
+    }
+    if (team) {
+        qt_sinc_expect(team->sinc, n);
+    }
+
+    /* Step 3: Set them going */
+#ifdef QTHREAD_COUNT_THREADS
+    qthread_count_spawned(n);
+#endif
+#ifdef QTHREAD_LOCAL_PRIORITY
+    if (feature_flag & QTHREAD_SPAWN_LOCAL_PRIORITY) {
+        qt_threadqueue_enqueue_many(qlib->local_priority_queues[dest_shep], t, n);
+    } else
+#endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+    qt_threadqueue_enqueue_many(qlib->threadqueues[dest_shep], t, n);
+    FREE(t, n * sizeof(qthread_t *));
+    return QTHREAD_SUCCESS;
+} /*}}}*/
+
+#ifdef QTHREAD_USE_EUREKAS
+/* Spawns a task into a team other than the caller's, to deliver a eureka from
+ * the parent team. It counts as a member of that team, but the watcher flag
+ * keeps the team's own eurekas from killing it before it gets to run. */
+int INTERNAL qthread_internal_spawn_watcher(qthread_f  f,
+                                            void      *arg,
+                                            qt_team_t *team)
+{   /*{{{*/
+    qthread_t            *me     = qthread_internal_self();
+    qthread_shepherd_t   *myshep = me ? me->rdata->shepherd_ptr : NULL;
+    qthread_shepherd_id_t dest_shep;
+    qthread_t            *t;
+
+    assert(team);
+    dest_shep = qthread_spawn_place(myshep, 0, arg);
+    t         = qthread_thread_new(f, arg, 0, NULL, team, 0);
+    qassert_ret(t, QTHREAD_MALLOC_ERROR);
+    t->flags   |= QTHREAD_TEAM_WATCHER;
+    t->preconds = NULL;
+    qt_sinc_expect(team->sinc, 1);
+# ifdef QTHREAD_COUNT_THREADS
+    qthread_count_spawned(1);
+# endif
+    qt_threadqueue_enqueue(qlib->threadqueues[dest_shep], t);
+    return QTHREAD_SUCCESS;
+} /*}}}*/
+#endif /* QTHREAD_USE_EUREKAS */
+
 int API_FUNC qthread_fork(qthread_f   f,
                           const void *arg,
                           aligned_t  *ret)
@@ -3015,7 +3250,14 @@ int API_FUNC qthread_fork_syncvar_to(qthread_f             f,
 
 void INTERNAL qthread_back_to_master(qthread_t *t)
 {                      /*{{{ */
-    assert((t->flags & QTHREAD_SIMPLE) == 0);
+    if (QTHREAD_UNLIKELY(t->flags & QTHREAD_SIMPLE)) {
+        /* A stackless task is running on its worker's own stack, so there is
+         * no context to come back to: the promise not to block was broken. */
+        fprintf(stderr,
+                "QTHREADS: task %u was spawned with QTHREAD_SPAWN_SIMPLE but tried to block (state %i); aborting\n",
+                t->thread_id, (int)t->thread_state);
+        abort();
+    }
     RLIMIT_TO_NORMAL(t);
     /* now back to your regularly scheduled master thread */
 #ifdef QTHREAD_USE_VALGRIND
@@ -3056,7 +3298,7 @@ int API_FUNC qthread_migrate_to(const qthread_shepherd_id_t shepherd)
     assert(qthread_library_initialized);
     qthread_t *me = qthread_internal_self();
 
-    if (me->flags & QTHREAD_REAL_MCCOY) {
+    if (me->flags & (QTHREAD_REAL_MCCOY | QTHREAD_SIMPLE)) {
         return QTHREAD_NOT_ALLOWED;
     }
     if (me->rdata->shepherd_ptr->shepherd_id == shepherd) {
@@ -107,6 +107,22 @@ void qtimer_stop(qtimer_t q)
     q->stop = *timer_address;
 }
 
+uint64_t qtimer_ticks(void)
+{
+    if (NULL == timer_address) {
+        if (0 != qtimer_init()) {
+            return 0;
+        }
+    }
+
+    return *timer_address;
+}
+
+double qtimer_ticks_secs(uint64_t ticks)
+{
+    return ((double)ticks) * timer_freq_conv;
+}
+
 double qtimer_secs(qtimer_t q)
 {
     return ((double)(q->stop - q->start)) * timer_freq_conv;
@@ -42,6 +42,16 @@ double qtimer_res(void)
 #endif
 }
 
+uint64_t qtimer_ticks(void)
+{
+    return (uint64_t)gethrtime();
+}
+
+double qtimer_ticks_secs(uint64_t ticks)
+{
+    return ticks * 1e-9;
+}
+
 double qtimer_secs(qtimer_t q)
 {
     return ((double)(q->stop - q->start)) * 1e-9;
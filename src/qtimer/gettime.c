@@ -65,6 +65,19 @@ double qtimer_res(void)
     return s.tv_sec + (s.tv_nsec * 1e-9);
 }
 
+uint64_t qtimer_ticks(void)
+{
+    struct timespec s;
+
+    qassert(clock_gettime(CLOCK_MONOTONIC, &(s)), 0);
+    return (uint64_t)s.tv_sec * 1000000000 + s.tv_nsec;
+}
+
+double qtimer_ticks_secs(uint64_t ticks)
+{
+    return ticks * 1e-9;
+}
+
 double qtimer_secs(qtimer_t q)
 {
     assert(q);
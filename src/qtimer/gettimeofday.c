@@ -59,6 +59,19 @@ void qtimer_stop(qtimer_t q)
     gettimeofday(&(q->stop), NULL);
 }
 
+uint64_t qtimer_ticks(void)
+{
+    struct timeval s;
+
+    gettimeofday(&(s), NULL);
+    return (uint64_t)s.tv_sec * 1000000 + s.tv_usec;
+}
+
+double qtimer_ticks_secs(uint64_t ticks)
+{
+    return ticks * 1e-6;
+}
+
 double qtimer_secs(qtimer_t q)
 {
     return (q->stop.tv_sec + q->stop.tv_usec * 1e-6) - (q->start.tv_sec + q->start.tv_usec * 1e-6);
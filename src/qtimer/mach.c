@@ -21,7 +21,7 @@ struct qtimer_s {
     uint64_t start, stop;
 };
 
-void qtimer_start(qtimer_t q)
+static void qtimer_init(void)
 {
     if (inited == 0) {
         if (qthread_cas(&inited, 0, 1) == 0) {
@@ -38,6 +38,11 @@ void qtimer_start(qtimer_t q)
             while (inited == 1) SPINLOCK_BODY();
         }
     }
+}
+
+void qtimer_start(qtimer_t q)
+{
+    qtimer_init();
     q->start = mach_absolute_time();
 }
 
@@ -65,6 +70,17 @@ double qtimer_res(void)
 #endif
 }
 
+uint64_t qtimer_ticks(void)
+{
+    return mach_absolute_time();
+}
+
+double qtimer_ticks_secs(uint64_t ticks)
+{
+    qtimer_init();
+    return conversion * (double)ticks;
+}
+
 double qtimer_secs(qtimer_t q)
 {
     uint64_t difference = q->stop - q->start;
@@ -0,0 +1,199 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "qthread/qthread.h" /* for aligned_t */
+#include "qt_atomics.h"      /* for SPINLOCK_BODY() */
+#include "qt_expect.h"       /* for QTHREAD_EXPECT() */
+#include "qthread/qtimer.h"
+#include "qt_asserts.h"
+#include "qt_envariables.h"
+
+#include <stdlib.h> /* calloc() & free() */
+#include <time.h>
+
+#include <qthread/qthread-int.h> /* for uint64_t */
+#include <qthread/hash.h>        /* for qt_hash_bytes() */
+
+#include "qt_debug.h" /* for malloc debug wrappers */
+
+/* This timer reads the processor's time-stamp counter directly, which is a
+ * handful of cycles instead of a trip through clock_gettime(). That is only
+ * safe when the counter is invariant (it ticks at a constant rate no matter
+ * the power state, and is synchronized across cores); if it is not, or if it
+ * cannot be calibrated, everything falls back to clock_gettime(), which on
+ * Linux is itself serviced by the vDSO. */
+
+static aligned_t inited        = 0; /* 0: not yet, 1: calibrating, 2: ready */
+static int       use_tsc       = 0;
+static double    secs_per_tick = 1e-9;
+
+#define QTIMER_CALIBRATION_NSECS 2000000 /* 2ms */
+
+struct qtimer_s {
+    uint64_t start, stop;
+};
+
+static QINLINE uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static QINLINE uint64_t gettime_nsecs(void)
+{
+    struct timespec s;
+
+    qassert(clock_gettime(CLOCK_MONOTONIC, &(s)), 0);
+    return (uint64_t)s.tv_sec * 1000000000 + s.tv_nsec;
+}
+
+static void cpuid(const unsigned int op,
+                  unsigned int      *eax_ptr,
+                  unsigned int      *ebx_ptr,
+                  unsigned int      *ecx_ptr,
+                  unsigned int      *edx_ptr)
+{
+#if (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA32) && defined(__PIC__)
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int pic_ebx = 0;
+    __asm__ __volatile__ ("mov %%ebx, %4\n\t"
+                          "cpuid\n\t"
+                          "mov %%ebx, %1\n\t"
+                          "mov %4, %%ebx"
+                          : "=a" (eax), "=m" (ebx), "=c" (ecx), "=d" (edx), "=m" (pic_ebx)
+                          : "a" (op), "m" (pic_ebx));
+    *eax_ptr = eax;
+    *ebx_ptr = ebx;
+    *ecx_ptr = ecx;
+    *edx_ptr = edx;
+#else
+    __asm__ __volatile__ ("cpuid"
+                          : "=a" (*eax_ptr), "=b" (*ebx_ptr), "=c" (*ecx_ptr), "=d" (*edx_ptr)
+                          : "a" (op), "c" (0));
+#endif
+}
+
+static int invariant_tsc(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000007) {
+        return 0;
+    }
+    cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx >> 8) & 1;
+}
+
+static void qtimer_calibrate(void)
+{
+    uint64_t ns_start, ns_stop, tsc_start, tsc_stop;
+
+    if (!qt_internal_get_env_bool("TIMER_TSC", 1) || !invariant_tsc()) {
+        return;
+    }
+    ns_start  = gettime_nsecs();
+    tsc_start = rdtsc();
+    do {
+        ns_stop = gettime_nsecs();
+    } while (ns_stop - ns_start < QTIMER_CALIBRATION_NSECS);
+    tsc_stop = rdtsc();
+    if (tsc_stop > tsc_start) {
+        secs_per_tick = (ns_stop - ns_start) * 1e-9 / (double)(tsc_stop - tsc_start);
+        use_tsc       = 1;
+    }
+}
+
+static void qtimer_init(void)
+{
+    if (qthread_cas(&inited, 0, 1) == 0) {
+        qtimer_calibrate();
+        MACHINE_FENCE;
+        inited = 2;
+    } else {
+        while (inited == 1) SPINLOCK_BODY();
+    }
+}
+
+uint64_t qtimer_ticks(void)
+{
+    if (QTHREAD_EXPECT(inited != 2, 0)) {
+        qtimer_init();
+    }
+    return use_tsc ? rdtsc() : gettime_nsecs();
+}
+
+double qtimer_ticks_secs(uint64_t ticks)
+{
+    if (QTHREAD_EXPECT(inited != 2, 0)) {
+        qtimer_init();
+    }
+    return ticks * secs_per_tick;
+}
+
+void qtimer_start(qtimer_t q)
+{
+    assert(q);
+    q->start = qtimer_ticks();
+}
+
+unsigned long qtimer_fastrand(void)
+{
+    static volatile aligned_t state = GOLDEN_RATIO;
+    volatile aligned_t        tmp; // this volatile is to prevent the compiler from optimizing tmp out of existence
+    uint64_t                  now = qtimer_ticks();
+
+    state = tmp = qt_hash_bytes(&now, sizeof(now), state);
+    return tmp;
+}
+
+void qtimer_stop(qtimer_t q)
+{
+    assert(q);
+    q->stop = qtimer_ticks();
+}
+
+double qtimer_wtime(void)
+{
+    return qtimer_ticks_secs(qtimer_ticks());
+}
+
+double qtimer_res(void)
+{
+    if (QTHREAD_EXPECT(inited != 2, 0)) {
+        qtimer_init();
+    }
+    if (use_tsc) {
+        return secs_per_tick;
+    } else {
+        struct timespec s;
+
+        qassert(clock_getres(CLOCK_MONOTONIC, &s), 0);
+        return s.tv_sec + (s.tv_nsec * 1e-9);
+    }
+}
+
+double qtimer_secs(qtimer_t q)
+{
+    assert(q);
+    return qtimer_ticks_secs(q->stop - q->start);
+}
+
+qtimer_t qtimer_create()
+{
+    qtimer_t ret = calloc(1, sizeof(struct qtimer_s));
+
+    assert(ret);
+    return ret;
+}
+
+void qtimer_destroy(qtimer_t q)
+{
+    assert(q);
+    FREE(q, sizeof(struct qtimer_s));
+}
+
+/* vim:set expandtab: */
@@ -18,165 +18,429 @@
 #include "qt_debug.h"
 #include "qt_int_log.h"
 
+#if defined(__AVX__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
 #ifndef MT_LOOP_CHUNK
 # define MT_LOOP_CHUNK 10000
 #endif
 
 extern int qthread_library_initialized;
 
-#define STRUCT(_structname_, _rtype_)                   struct _structname_ \
-    {                                                                       \
-        const _rtype_       *array;                                         \
-        syncvar_t            ret_sentinel;                                  \
-        _rtype_              ret;                                           \
-        size_t               start, stop;                                   \
-        const _rtype_       *addlast;                                       \
-        syncvar_t           *addlast_sentinel;                              \
-        struct _structname_ *backptr;                                       \
+/* The reductions below are computed as a balanced tree: each task hands the
+ * left half of its range to a child task (which does the same thing) until
+ * what remains fits in one chunk, reduces that chunk with a vectorized
+ * kernel, and then folds in its children's results. Chunks are sized to stay
+ * resident in L2 while they're being reduced. */
+typedef struct qutil_reduce_s qutil_reduce_t;
+typedef void (*qutil_leaf_f)(qutil_reduce_t *r);
+typedef void (*qutil_combine_f)(qutil_reduce_t       *into,
+                                const qutil_reduce_t *from);
+
+struct qutil_reduce_s {
+    const void     *array;
+    size_t          start, stop;
+    size_t          chunk;
+    int             checkfeb;
+    qutil_leaf_f    leaf;
+    qutil_combine_f combine;
+    union {
+        double     d;
+        aligned_t  u;
+        saligned_t i;
+    } val;
+    size_t          idx;               /* for argmax/argmin */
+    aligned_t       done;
+};
+
+static size_t qutil_chunk(size_t elemsize)
+{   /*{{{*/
+    static size_t chunk_bytes = 0;
+    size_t        elems;
+
+    if (chunk_bytes == 0) {
+        long l2 = -1;
+
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        /* leave half of L2 for everything else */
+        chunk_bytes = (l2 > 0) ? (size_t)l2 / 2 : MT_LOOP_CHUNK * sizeof(double);
+    }
+    elems = chunk_bytes / elemsize;
+    return (elems < 1024) ? 1024 : elems;
+} /*}}}*/
+
+static aligned_t qutil_reduce_task(void *arg)
+{   /*{{{*/
+    qutil_reduce_t *r     = (qutil_reduce_t *)arg;
+    qutil_reduce_t *kids  = NULL;
+    size_t          nkids = 0;
+    size_t          len, k;
+
+    for (len = r->stop - r->start; len > r->chunk; len -= len / 2) nkids++;
+    if (nkids > 0) {
+        kids = MALLOC(nkids * sizeof(qutil_reduce_t));
+        assert(kids);
+        for (k = 0; k < nkids; k++) {
+            size_t mid = r->start + (r->stop - r->start) / 2;
+
+            kids[k]      = *r;
+            kids[k].stop = mid;
+            r->start     = mid;
+            qthread_fork(qutil_reduce_task, &kids[k], &kids[k].done);
+        }
     }
-#define INNER_LOOP(_fname_, _structtype_, _opmacro_)    static aligned_t _fname_(struct _structtype_ *args) \
-    {                                                                                                       \
-        size_t i;                                                                                           \
-        args->ret = args->array[args->start];                                                               \
-        for (i = args->start + 1; i < args->stop; i++) {                                                    \
-            _opmacro_(args->ret, args->array[i]);                                                           \
-        }                                                                                                   \
-        if (args->addlast) {                                                                                \
-            qthread_syncvar_readFF(NULL, args->addlast_sentinel);                                           \
-            _opmacro_(args->ret, *(args->addlast));                                                         \
-            FREE(args->backptr, sizeof(struct _structtype_));                                               \
-        }                                                                                                   \
-        qthread_syncvar_fill(&(args->ret_sentinel));                                                        \
-        return 0;                                                                                           \
+    r->leaf(r);
+    /* the last child spawned has the least work, so wait on it first */
+    for (k = nkids; k > 0; k--) {
+        qthread_readFF(NULL, &kids[k - 1].done);
+        r->combine(r, &kids[k - 1]);
     }
-#define INNER_LOOP_FF(_fname_, _structtype_, _opmacro_) static aligned_t _fname_(struct _structtype_ *args) \
-    {                                                                                                       \
-        size_t i;                                                                                           \
-        qthread_readFF(NULL, (aligned_t *)(args->array + args->start));                                     \
-        args->ret = args->array[args->start];                                                               \
-        for (i = args->start + 1; i < args->stop; i++) {                                                    \
-            qthread_readFF(NULL, (aligned_t *)(args->array + i));                                           \
-            _opmacro_(args->ret, args->array[i]);                                                           \
-        }                                                                                                   \
-        if (args->addlast) {                                                                                \
-            qthread_syncvar_readFF(NULL, args->addlast_sentinel);                                           \
-            _opmacro_(args->ret, *(args->addlast));                                                         \
-            FREE(args->backptr, sizeof(struct _structtype_));                                               \
-        }                                                                                                   \
-        qthread_syncvar_fill(&(args->ret_sentinel));                                                        \
-        return 0;                                                                                           \
+    if (kids) {
+        FREE(kids, nkids * sizeof(qutil_reduce_t));
     }
-#define OUTER_LOOP(_fname_, _structtype_, _opmacro_, _rtype_, _innerfunc_, _innerfuncff_) \
-    _rtype_ API_FUNC _fname_(const _rtype_ * array, size_t length, int checkfeb)          \
-    {                                                                                     \
-        size_t               i, start = 0;                                                \
-        syncvar_t           *waitfor_sentinel = NULL;                                     \
-        _rtype_             *waitfor          = NULL, myret;                              \
-        struct _structtype_ *bkptr            = NULL;                                     \
-        /* abort if checkfeb == 1 && aligned_t is too big */                              \
-        assert(checkfeb == 0 || sizeof(aligned_t) == sizeof(_rtype_));                    \
-        while (start + MT_LOOP_CHUNK < length) {                                          \
-            /* spawn off an MT_LOOP_CHUNK-sized segment of the first part of the array */ \
-            struct _structtype_ *left_args =                                              \
-                calloc(1, sizeof(struct _structtype_));                                   \
-                                                                                          \
-            left_args->array            = array;                                          \
-            left_args->start            = start;                                          \
-            left_args->stop             = start + MT_LOOP_CHUNK;                          \
-            start                      += MT_LOOP_CHUNK;                                  \
-            left_args->backptr          = bkptr;                                          \
-            bkptr                       = left_args;                                      \
-            left_args->addlast          = waitfor;                                        \
-            left_args->addlast_sentinel = waitfor_sentinel;                               \
-            waitfor                     = &(left_args->ret);                              \
-            waitfor_sentinel            = &(left_args->ret_sentinel);                     \
-            qthread_syncvar_empty(&(left_args->ret_sentinel));                            \
-            if (checkfeb) {                                                               \
-                qthread_fork((qthread_f)_innerfuncff_, left_args, NULL);                  \
-            } else {                                                                      \
-                qthread_fork((qthread_f)_innerfunc_, left_args, NULL);                    \
-            }                                                                             \
-        }                                                                                 \
-        if (checkfeb) {                                                                   \
-            qthread_readFF(NULL, (aligned_t *)(array + start));                           \
-            myret = array[start];                                                         \
-            for (i = start + 1; i < length; i++) {                                        \
-                qthread_readFF(NULL, (aligned_t *)(array + i));                           \
-                _opmacro_(myret, array[i]);                                               \
-            }                                                                             \
-        } else {                                                                          \
-            myret = array[start];                                                         \
-            for (i = start + 1; i < length; i++) {                                        \
-                _opmacro_(myret, array[i]);                                               \
-            }                                                                             \
-        }                                                                                 \
-        if (waitfor) {                                                                    \
-            qthread_syncvar_readFF(NULL, waitfor_sentinel);                               \
-            _opmacro_(myret, *waitfor);                                                   \
-            FREE(bkptr, sizeof(struct _structtype_));                                     \
-        }                                                                                 \
-        return myret;                                                                     \
+    return 0;
+} /*}}}*/
+
+static void qutil_reduce(qutil_reduce_t *r,
+                         const void     *array,
+                         size_t          length,
+                         size_t          elemsize,
+                         int             checkfeb,
+                         qutil_leaf_f    leaf,
+                         qutil_combine_f combine)
+{   /*{{{*/
+    /* abort if checkfeb == 1 && aligned_t is too big */
+    assert(checkfeb == 0 || sizeof(aligned_t) == elemsize);
+    memset(r, 0, sizeof(qutil_reduce_t));
+    if (length == 0) {
+        return;
     }
+    r->array    = array;
+    r->stop     = length;
+    r->chunk    = qutil_chunk(elemsize);
+    r->checkfeb = checkfeb;
+    r->leaf     = leaf;
+    r->combine  = combine;
+    qutil_reduce_task(r);
+} /*}}}*/
 
 #define SUM_MACRO(sum, add)       sum  += (add)
 #define MULT_MACRO(prod, factor)  prod *= (factor)
 #define MAX_MACRO(max, contender) if (max < (contender)) max = (contender)
 #define MIN_MACRO(max, contender) if (max > (contender)) max = (contender)
+#define ID_MACRO(x)               (x)
+#define SQ_MACRO(x)               ((x) * (x))
+
+/* Kernels reduce a[0..n), n > 0, without FEB checks */
+#if defined(__AVX__)
+# define VD_WIDTH 4
+typedef __m256d vdouble_t;
+# define VD_LOAD(p)        _mm256_loadu_pd(p)
+# define VD_STORE(p, v)    _mm256_storeu_pd((p), (v))
+# define VD_OP(op, a, b)   _mm256_ ## op ## _pd((a), (b))
+#elif defined(__SSE2__)
+# define VD_WIDTH 2
+typedef __m128d vdouble_t;
+# define VD_LOAD(p)        _mm_loadu_pd(p)
+# define VD_STORE(p, v)    _mm_storeu_pd((p), (v))
+# define VD_OP(op, a, b)   _mm_ ## op ## _pd((a), (b))
+#endif
+#define VD_ID(x) (x)
+#define VD_SQ(x) VD_OP(mul, (x), (x))
+
+#ifdef VD_WIDTH
+# define DOUBLE_KERNEL(_fname_, _vop_, _vmap_, _opmacro_, _mapmacro_) \
+    static double _fname_(const double *a, size_t n)                 \
+    {                                                                \
+        size_t i;                                                    \
+        double ret;                                                  \
+        if (n >= 2 * VD_WIDTH) {                                     \
+            vdouble_t acc0 = _vmap_(VD_LOAD(a));                     \
+            vdouble_t acc1 = _vmap_(VD_LOAD(a + VD_WIDTH));          \
+            double    tmp[VD_WIDTH];                                 \
+            size_t    j;                                             \
+            for (i = 2 * VD_WIDTH; i + 2 * VD_WIDTH <= n;            \
+                 i += 2 * VD_WIDTH) {                                \
+                vdouble_t v0 = VD_LOAD(a + i);                       \
+                vdouble_t v1 = VD_LOAD(a + i + VD_WIDTH);            \
+                acc0 = VD_OP(_vop_, acc0, _vmap_(v0));               \
+                acc1 = VD_OP(_vop_, acc1, _vmap_(v1));               \
+            }                                                        \
+            VD_STORE(tmp, VD_OP(_vop_, acc0, acc1));                 \
+            ret = tmp[0];                                            \
+            for (j = 1; j < VD_WIDTH; j++) {                         \
+                _opmacro_(ret, tmp[j]);                              \
+            }                                                        \
+        } else {                                                     \
+            ret = _mapmacro_(a[0]);                                  \
+            i   = 1;                                                 \
+        }                                                            \
+        for (; i < n; i++) {                                         \
+            _opmacro_(ret, _mapmacro_(a[i]));                        \
+        }                                                            \
+        return ret;                                                  \
+    }
+#else
+# define DOUBLE_KERNEL(_fname_, _vop_, _vmap_, _opmacro_, _mapmacro_) \
+    SCALAR_KERNEL(_fname_, double, _opmacro_, _mapmacro_)
+#endif /* ifdef VD_WIDTH */
+
+/* Independent accumulators break the dependency chain, which also lets the
+ * compiler vectorize where the instruction set allows */
+#define SCALAR_KERNEL(_fname_, _rtype_, _opmacro_, _mapmacro_) \
+    static _rtype_ _fname_(const _rtype_ *a, size_t n)         \
+    {                                                          \
+        size_t  i;                                             \
+        _rtype_ ret;                                           \
+        if (n >= 8) {                                          \
+            _rtype_ r0 = _mapmacro_(a[0]);                     \
+            _rtype_ r1 = _mapmacro_(a[1]);                     \
+            _rtype_ r2 = _mapmacro_(a[2]);                     \
+            _rtype_ r3 = _mapmacro_(a[3]);                     \
+            for (i = 4; i + 4 <= n; i += 4) {                  \
+                _opmacro_(r0, _mapmacro_(a[i]));               \
+                _opmacro_(r1, _mapmacro_(a[i + 1]));           \
+                _opmacro_(r2, _mapmacro_(a[i + 2]));           \
+                _opmacro_(r3, _mapmacro_(a[i + 3]));           \
+            }                                                  \
+            _opmacro_(r0, r1);                                 \
+            _opmacro_(r2, r3);                                 \
+            _opmacro_(r0, r2);                                 \
+            ret = r0;                                          \
+        } else {                                               \
+            ret = _mapmacro_(a[0]);                            \
+            i   = 1;                                           \
+        }                                                      \
+        for (; i < n; i++) {                                   \
+            _opmacro_(ret, _mapmacro_(a[i]));                  \
+        }                                                      \
+        return ret;                                            \
+    }
+
+/* integer sums are the same for signed and unsigned */
+#if defined(__AVX2__)
+# define VI_BYTES 32
+typedef __m256i vint_t;
+# define VI_ZERO        _mm256_setzero_si256()
+# define VI_LOAD(p)     _mm256_loadu_si256((const __m256i *)(p))
+# define VI_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+# if QTHREAD_SIZEOF_ALIGNED_T == 4
+#  define VI_ADD(a, b)  _mm256_add_epi32((a), (b))
+# else
+#  define VI_ADD(a, b)  _mm256_add_epi64((a), (b))
+# endif
+#elif defined(__SSE2__)
+# define VI_BYTES 16
+typedef __m128i vint_t;
+# define VI_ZERO        _mm_setzero_si128()
+# define VI_LOAD(p)     _mm_loadu_si128((const __m128i *)(p))
+# define VI_STORE(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+# if QTHREAD_SIZEOF_ALIGNED_T == 4
+#  define VI_ADD(a, b)  _mm_add_epi32((a), (b))
+# else
+#  define VI_ADD(a, b)  _mm_add_epi64((a), (b))
+# endif
+#endif /* if defined(__AVX2__) */
+
+static aligned_t qutil_uint_sum_kernel(const aligned_t *a,
+                                       size_t           n)
+{   /*{{{*/
+    size_t    i   = 0;
+    aligned_t ret = 0;
+
+#ifdef VI_BYTES
+# define VI_WIDTH (VI_BYTES / sizeof(aligned_t))
+    if (n >= 2 * VI_WIDTH) {
+        vint_t    acc0 = VI_ZERO;
+        vint_t    acc1 = VI_ZERO;
+        aligned_t tmp[VI_WIDTH];
+        size_t    j;
+
+        for (; i + 2 * VI_WIDTH <= n; i += 2 * VI_WIDTH) {
+            acc0 = VI_ADD(acc0, VI_LOAD(a + i));
+            acc1 = VI_ADD(acc1, VI_LOAD(a + i + VI_WIDTH));
+        }
+        VI_STORE(tmp, VI_ADD(acc0, acc1));
+        for (j = 0; j < VI_WIDTH; j++) {
+            ret += tmp[j];
+        }
+    }
+# undef VI_WIDTH
+#endif /* ifdef VI_BYTES */
+    for (; i < n; i++) {
+        ret += a[i];
+    }
+    return ret;
+} /*}}}*/
+
+static saligned_t qutil_int_sum_kernel(const saligned_t *a,
+                                       size_t            n)
+{   /*{{{*/
+    return (saligned_t)qutil_uint_sum_kernel((const aligned_t *)a, n);
+} /*}}}*/
+
+DOUBLE_KERNEL(qutil_double_sum_kernel, add, VD_ID, SUM_MACRO, ID_MACRO)
+DOUBLE_KERNEL(qutil_double_mult_kernel, mul, VD_ID, MULT_MACRO, ID_MACRO)
+DOUBLE_KERNEL(qutil_double_max_kernel, max, VD_ID, MAX_MACRO, ID_MACRO)
+DOUBLE_KERNEL(qutil_double_min_kernel, min, VD_ID, MIN_MACRO, ID_MACRO)
+DOUBLE_KERNEL(qutil_double_sumsq_kernel, add, VD_SQ, SUM_MACRO, SQ_MACRO)
+SCALAR_KERNEL(qutil_uint_mult_kernel, aligned_t, MULT_MACRO, ID_MACRO)
+SCALAR_KERNEL(qutil_uint_max_kernel, aligned_t, MAX_MACRO, ID_MACRO)
+SCALAR_KERNEL(qutil_uint_min_kernel, aligned_t, MIN_MACRO, ID_MACRO)
+SCALAR_KERNEL(qutil_uint_sumsq_kernel, aligned_t, SUM_MACRO, SQ_MACRO)
+SCALAR_KERNEL(qutil_int_mult_kernel, saligned_t, MULT_MACRO, ID_MACRO)
+SCALAR_KERNEL(qutil_int_max_kernel, saligned_t, MAX_MACRO, ID_MACRO)
+SCALAR_KERNEL(qutil_int_min_kernel, saligned_t, MIN_MACRO, ID_MACRO)
+SCALAR_KERNEL(qutil_int_sumsq_kernel, saligned_t, SUM_MACRO, SQ_MACRO)
+
+#define LEAF(_fname_, _rtype_, _field_, _kernel_, _opmacro_, _mapmacro_) \
+    static void _fname_(qutil_reduce_t *r)                               \
+    {                                                                    \
+        const _rtype_ *a = (const _rtype_ *)r->array + r->start;         \
+        const size_t   n = r->stop - r->start;                           \
+        if (r->checkfeb) {                                               \
+            size_t i;                                                    \
+            qthread_readFF(NULL, (const aligned_t *)a);                  \
+            r->val._field_ = _mapmacro_(a[0]);                           \
+            for (i = 1; i < n; i++) {                                    \
+                qthread_readFF(NULL, (const aligned_t *)(a + i));        \
+                _opmacro_(r->val._field_, _mapmacro_(a[i]));             \
+            }                                                            \
+        } else {                                                         \
+            r->val._field_ = _kernel_(a, n);                             \
+        }                                                                \
+    }
+#define COMBINE(_fname_, _field_, _opmacro_)                     \
+    static void _fname_(qutil_reduce_t       *into,              \
+                        const qutil_reduce_t *from)              \
+    {                                                            \
+        _opmacro_(into->val._field_, from->val._field_);         \
+    }
+#define REDUCTION(_fname_, _rtype_, _field_, _leaf_, _combine_)                   \
+    _rtype_ API_FUNC _fname_(const _rtype_ * array, size_t length, int checkfeb)  \
+    {                                                                             \
+        qutil_reduce_t r;                                                         \
+        qutil_reduce(&r, array, length, sizeof(_rtype_), checkfeb, _leaf_,        \
+                     _combine_);                                                  \
+        return r.val._field_;                                                     \
+    }
+
+/* argmax/argmin leaves find the extreme value with the kernel, then its first
+ * index; the chunk is still in cache for the second pass. The fallback scan
+ * catches values that never compare equal (NaNs). */
+#define ARG_LEAF(_fname_, _rtype_, _field_, _kernel_, _cmp_)              \
+    static void _fname_(qutil_reduce_t *r)                                \
+    {                                                                     \
+        const _rtype_ *a    = (const _rtype_ *)r->array + r->start;       \
+        const size_t   n    = r->stop - r->start;                         \
+        size_t         i, best = 0;                                       \
+        if (r->checkfeb) {                                                \
+            qthread_readFF(NULL, (const aligned_t *)a);                   \
+            for (i = 1; i < n; i++) {                                     \
+                qthread_readFF(NULL, (const aligned_t *)(a + i));         \
+                if (a[i] _cmp_ a[best]) { best = i; }                     \
+            }                                                             \
+        } else {                                                          \
+            const _rtype_ v = _kernel_(a, n);                             \
+            while (best < n && !(a[best] == v)) best++;                   \
+            if (best == n) {                                              \
+                best = 0;                                                 \
+                for (i = 1; i < n; i++) {                                 \
+                    if (a[i] _cmp_ a[best]) { best = i; }                 \
+                }                                                         \
+            }                                                             \
+        }                                                                 \
+        r->val._field_ = a[best];                                         \
+        r->idx         = r->start + best;                                 \
+    }
+#define ARG_COMBINE(_fname_, _field_, _cmp_)                                    \
+    static void _fname_(qutil_reduce_t       *into,                             \
+                        const qutil_reduce_t *from)                             \
+    {                                                                           \
+        if ((from->val._field_ _cmp_ into->val._field_) ||                      \
+            (!(into->val._field_ _cmp_ from->val._field_) &&                    \
+             (from->idx < into->idx))) {                                        \
+            into->val = from->val;                                              \
+            into->idx = from->idx;                                              \
+        }                                                                       \
+    }
+#define ARG_REDUCTION(_fname_, _rtype_, _leaf_, _combine_)                       \
+    size_t API_FUNC _fname_(const _rtype_ * array, size_t length, int checkfeb)  \
+    {                                                                            \
+        qutil_reduce_t r;                                                        \
+        qutil_reduce(&r, array, length, sizeof(_rtype_), checkfeb, _leaf_,       \
+                     _combine_);                                                 \
+        return r.idx;                                                            \
+    }
 
 /* These are the functions for computing things about doubles */
-STRUCT(qutil_ds_args, double);
-INNER_LOOP(qutil_double_sum_inner, qutil_ds_args, SUM_MACRO)
-INNER_LOOP_FF(qutil_double_FF_sum_inner, qutil_ds_args, SUM_MACRO)
-OUTER_LOOP(qutil_double_sum, qutil_ds_args, SUM_MACRO, double,
-           qutil_double_sum_inner, qutil_double_FF_sum_inner)
-INNER_LOOP(qutil_double_mult_inner, qutil_ds_args, MULT_MACRO)
-INNER_LOOP_FF(qutil_double_FF_mult_inner, qutil_ds_args, MULT_MACRO)
-OUTER_LOOP(qutil_double_mult, qutil_ds_args, MULT_MACRO, double,
-           qutil_double_mult_inner, qutil_double_FF_mult_inner)
-INNER_LOOP(qutil_double_max_inner, qutil_ds_args, MAX_MACRO)
-INNER_LOOP_FF(qutil_double_FF_max_inner, qutil_ds_args, MAX_MACRO)
-OUTER_LOOP(qutil_double_max, qutil_ds_args, MAX_MACRO, double,
-           qutil_double_max_inner, qutil_double_FF_max_inner)
-INNER_LOOP(qutil_double_min_inner, qutil_ds_args, MIN_MACRO)
-INNER_LOOP_FF(qutil_double_FF_min_inner, qutil_ds_args, MIN_MACRO)
-OUTER_LOOP(qutil_double_min, qutil_ds_args, MIN_MACRO, double,
-           qutil_double_min_inner, qutil_double_FF_min_inner)
+LEAF(qutil_double_sum_leaf, double, d, qutil_double_sum_kernel, SUM_MACRO, ID_MACRO)
+LEAF(qutil_double_mult_leaf, double, d, qutil_double_mult_kernel, MULT_MACRO, ID_MACRO)
+LEAF(qutil_double_max_leaf, double, d, qutil_double_max_kernel, MAX_MACRO, ID_MACRO)
+LEAF(qutil_double_min_leaf, double, d, qutil_double_min_kernel, MIN_MACRO, ID_MACRO)
+LEAF(qutil_double_sumsq_leaf, double, d, qutil_double_sumsq_kernel, SUM_MACRO, SQ_MACRO)
+ARG_LEAF(qutil_double_argmax_leaf, double, d, qutil_double_max_kernel, >)
+ARG_LEAF(qutil_double_argmin_leaf, double, d, qutil_double_min_kernel, <)
+COMBINE(qutil_double_sum_combine, d, SUM_MACRO)
+COMBINE(qutil_double_mult_combine, d, MULT_MACRO)
+COMBINE(qutil_double_max_combine, d, MAX_MACRO)
+COMBINE(qutil_double_min_combine, d, MIN_MACRO)
+ARG_COMBINE(qutil_double_argmax_combine, d, >)
+ARG_COMBINE(qutil_double_argmin_combine, d, <)
+REDUCTION(qutil_double_sum, double, d, qutil_double_sum_leaf, qutil_double_sum_combine)
+REDUCTION(qutil_double_mult, double, d, qutil_double_mult_leaf, qutil_double_mult_combine)
+REDUCTION(qutil_double_max, double, d, qutil_double_max_leaf, qutil_double_max_combine)
+REDUCTION(qutil_double_min, double, d, qutil_double_min_leaf, qutil_double_min_combine)
+REDUCTION(qutil_double_sumsq, double, d, qutil_double_sumsq_leaf, qutil_double_sum_combine)
+ARG_REDUCTION(qutil_double_argmax, double, qutil_double_argmax_leaf, qutil_double_argmax_combine)
+ARG_REDUCTION(qutil_double_argmin, double, qutil_double_argmin_leaf, qutil_double_argmin_combine)
 /* These are the functions for computing things about unsigned ints */
-STRUCT(qutil_uis_args, aligned_t);
-INNER_LOOP(qutil_uint_sum_inner, qutil_uis_args, SUM_MACRO)
-INNER_LOOP_FF(qutil_uint_FF_sum_inner, qutil_uis_args, SUM_MACRO)
-OUTER_LOOP(qutil_uint_sum, qutil_uis_args, SUM_MACRO, aligned_t,
-           qutil_uint_sum_inner, qutil_uint_FF_sum_inner)
-INNER_LOOP(qutil_uint_mult_inner, qutil_uis_args, MULT_MACRO)
-INNER_LOOP_FF(qutil_uint_FF_mult_inner, qutil_uis_args, MULT_MACRO)
-OUTER_LOOP(qutil_uint_mult, qutil_uis_args, MULT_MACRO, aligned_t,
-           qutil_uint_mult_inner, qutil_uint_FF_mult_inner)
-INNER_LOOP(qutil_uint_max_inner, qutil_uis_args, MAX_MACRO)
-INNER_LOOP_FF(qutil_uint_FF_max_inner, qutil_uis_args, MAX_MACRO)
-OUTER_LOOP(qutil_uint_max, qutil_uis_args, MAX_MACRO, aligned_t,
-           qutil_uint_max_inner, qutil_uint_FF_max_inner)
-INNER_LOOP(qutil_uint_min_inner, qutil_uis_args, MIN_MACRO)
-INNER_LOOP_FF(qutil_uint_FF_min_inner, qutil_uis_args, MIN_MACRO)
-OUTER_LOOP(qutil_uint_min, qutil_uis_args, MIN_MACRO, aligned_t,
-           qutil_uint_min_inner, qutil_uint_FF_min_inner)
+LEAF(qutil_uint_sum_leaf, aligned_t, u, qutil_uint_sum_kernel, SUM_MACRO, ID_MACRO)
+LEAF(qutil_uint_mult_leaf, aligned_t, u, qutil_uint_mult_kernel, MULT_MACRO, ID_MACRO)
+LEAF(qutil_uint_max_leaf, aligned_t, u, qutil_uint_max_kernel, MAX_MACRO, ID_MACRO)
+LEAF(qutil_uint_min_leaf, aligned_t, u, qutil_uint_min_kernel, MIN_MACRO, ID_MACRO)
+LEAF(qutil_uint_sumsq_leaf, aligned_t, u, qutil_uint_sumsq_kernel, SUM_MACRO, SQ_MACRO)
+ARG_LEAF(qutil_uint_argmax_leaf, aligned_t, u, qutil_uint_max_kernel, >)
+ARG_LEAF(qutil_uint_argmin_leaf, aligned_t, u, qutil_uint_min_kernel, <)
+COMBINE(qutil_uint_sum_combine, u, SUM_MACRO)
+COMBINE(qutil_uint_mult_combine, u, MULT_MACRO)
+COMBINE(qutil_uint_max_combine, u, MAX_MACRO)
+COMBINE(qutil_uint_min_combine, u, MIN_MACRO)
+ARG_COMBINE(qutil_uint_argmax_combine, u, >)
+ARG_COMBINE(qutil_uint_argmin_combine, u, <)
+REDUCTION(qutil_uint_sum, aligned_t, u, qutil_uint_sum_leaf, qutil_uint_sum_combine)
+REDUCTION(qutil_uint_mult, aligned_t, u, qutil_uint_mult_leaf, qutil_uint_mult_combine)
+REDUCTION(qutil_uint_max, aligned_t, u, qutil_uint_max_leaf, qutil_uint_max_combine)
+REDUCTION(qutil_uint_min, aligned_t, u, qutil_uint_min_leaf, qutil_uint_min_combine)
+REDUCTION(qutil_uint_sumsq, aligned_t, u, qutil_uint_sumsq_leaf, qutil_uint_sum_combine)
+ARG_REDUCTION(qutil_uint_argmax, aligned_t, qutil_uint_argmax_leaf, qutil_uint_argmax_combine)
+ARG_REDUCTION(qutil_uint_argmin, aligned_t, qutil_uint_argmin_leaf, qutil_uint_argmin_combine)
 /* These are the functions for computing things about signed ints */
-STRUCT(qutil_is_args, saligned_t);
-INNER_LOOP(qutil_int_sum_inner, qutil_is_args, SUM_MACRO)
-INNER_LOOP_FF(qutil_int_FF_sum_inner, qutil_is_args, SUM_MACRO)
-OUTER_LOOP(qutil_int_sum, qutil_is_args, SUM_MACRO, saligned_t,
-           qutil_int_sum_inner, qutil_int_FF_sum_inner)
-INNER_LOOP(qutil_int_mult_inner, qutil_is_args, MULT_MACRO)
-INNER_LOOP_FF(qutil_int_FF_mult_inner, qutil_is_args, MULT_MACRO)
-OUTER_LOOP(qutil_int_mult, qutil_is_args, MULT_MACRO, saligned_t,
-           qutil_int_mult_inner, qutil_int_FF_mult_inner)
-INNER_LOOP(qutil_int_max_inner, qutil_is_args, MAX_MACRO)
-INNER_LOOP_FF(qutil_int_FF_max_inner, qutil_is_args, MAX_MACRO)
-OUTER_LOOP(qutil_int_max, qutil_is_args, MAX_MACRO, saligned_t,
-           qutil_int_max_inner, qutil_int_FF_max_inner)
-INNER_LOOP(qutil_int_min_inner, qutil_is_args, MIN_MACRO)
-INNER_LOOP_FF(qutil_int_FF_min_inner, qutil_is_args, MIN_MACRO)
-OUTER_LOOP(qutil_int_min, qutil_is_args, MIN_MACRO, saligned_t,
-           qutil_int_min_inner, qutil_int_FF_min_inner)
+LEAF(qutil_int_sum_leaf, saligned_t, i, qutil_int_sum_kernel, SUM_MACRO, ID_MACRO)
+LEAF(qutil_int_mult_leaf, saligned_t, i, qutil_int_mult_kernel, MULT_MACRO, ID_MACRO)
+LEAF(qutil_int_max_leaf, saligned_t, i, qutil_int_max_kernel, MAX_MACRO, ID_MACRO)
+LEAF(qutil_int_min_leaf, saligned_t, i, qutil_int_min_kernel, MIN_MACRO, ID_MACRO)
+LEAF(qutil_int_sumsq_leaf, saligned_t, i, qutil_int_sumsq_kernel, SUM_MACRO, SQ_MACRO)
+ARG_LEAF(qutil_int_argmax_leaf, saligned_t, i, qutil_int_max_kernel, >)
+ARG_LEAF(qutil_int_argmin_leaf, saligned_t, i, qutil_int_min_kernel, <)
+COMBINE(qutil_int_sum_combine, i, SUM_MACRO)
+COMBINE(qutil_int_mult_combine, i, MULT_MACRO)
+COMBINE(qutil_int_max_combine, i, MAX_MACRO)
+COMBINE(qutil_int_min_combine, i, MIN_MACRO)
+ARG_COMBINE(qutil_int_argmax_combine, i, >)
+ARG_COMBINE(qutil_int_argmin_combine, i, <)
+REDUCTION(qutil_int_sum, saligned_t, i, qutil_int_sum_leaf, qutil_int_sum_combine)
+REDUCTION(qutil_int_mult, saligned_t, i, qutil_int_mult_leaf, qutil_int_mult_combine)
+REDUCTION(qutil_int_max, saligned_t, i, qutil_int_max_leaf, qutil_int_max_combine)
+REDUCTION(qutil_int_min, saligned_t, i, qutil_int_min_leaf, qutil_int_min_combine)
+REDUCTION(qutil_int_sumsq, saligned_t, i, qutil_int_sumsq_leaf, qutil_int_sum_combine)
+ARG_REDUCTION(qutil_int_argmax, saligned_t, qutil_int_argmax_leaf, qutil_int_argmax_combine)
+ARG_REDUCTION(qutil_int_argmin, saligned_t, qutil_int_argmin_leaf, qutil_int_argmin_combine)
 
 typedef int (*cmp_f)(const void *a, const void *b);
 
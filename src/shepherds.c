@@ -6,7 +6,10 @@
 #include "qthread/qthread.h"
 
 /* System Headers */
-#include <stdlib.h> /* for random(), according to P2001 */
+#include <stdio.h>
+#include <stdlib.h> /* for exit() */
+#include <string.h>
+#include <strings.h> /* for strncasecmp() */
 
 /* Internal Headers */
 #include "qt_visibility.h"
@@ -18,10 +21,36 @@
 #include "qt_qthread_struct.h"
 #include "qt_qthread_mgmt.h"
 #include "qt_macros.h"
+#include "qt_threadqueues.h"
+#include "qt_threadqueue_scheduler.h"
+#include "qt_envariables.h"
 
 /* Shared Globals */
 TLS_DECL_INIT(qthread_shepherd_t *, shepherd_structs);
 
+/* Where qthread_spawn() puts a task that was not given a shepherd.
+ * LOCAL leaves it to the scheduler (usually the spawning shepherd).
+ * P2C picks two shepherds at random and takes the one with the shorter queue.
+ * DOMAIN deals tasks round-robin across the spawning shepherd's NUMA domain,
+ * i.e. the spawner and the shepherds nearest to it.
+ * OWNER sends the task to the shepherd that owns the page of a hint address
+ * (the spawn's argument pointer), so that tasks on the same data share a
+ * shepherd. */
+enum qt_spawn_placement {
+    SPAWN_PLACEMENT_LOCAL = 0,
+    SPAWN_PLACEMENT_P2C,
+    SPAWN_PLACEMENT_DOMAIN,
+    SPAWN_PLACEMENT_OWNER,
+    SPAWN_PLACEMENT_COUNT
+};
+static const char *const spawn_placement_names[SPAWN_PLACEMENT_COUNT] = {
+    "local", "p2c", "domain", "owner"
+};
+static enum qt_spawn_placement spawn_placement = SPAWN_PLACEMENT_LOCAL;
+
+/* Hint addresses are assigned to shepherds a page at a time */
+#define SPAWN_OWNER_SHIFT 12
+
 int API_FUNC qthread_shep_ok(void)
 {                      /*{{{ */
     assert(qthread_library_initialized);
@@ -223,7 +252,7 @@ qthread_shepherd_t INTERNAL *qthread_find_active_shepherd(qthread_shepherd_id_t
                     target   = i;
                 } else if ((shep_busy_level < busyness) ||
                            ((shep_busy_level == busyness) &&
-                            (random() % 2 == 0))) {
+                            (qthread_random() % 2 == 0))) {
                     qthread_debug(SHEPHERD_FUNCTIONS,
                                   "l(%p): shep %i is the least busy (%i) so far\n",
                                   l, (int)i, shep_busy_level);
@@ -266,7 +295,7 @@ qthread_shepherd_t INTERNAL *qthread_find_active_shepherd(qthread_shepherd_id_t
              alt++) {
             saligned_t shep_busy_level = qt_threadqueue_advisory_queuelen(sheps[l[alt]].ready);
             if ((shep_busy_level < busyness) ||
-                ((shep_busy_level == busyness) && (random() % 2 == 0))) {
+                ((shep_busy_level == busyness) && (qthread_random() % 2 == 0))) {
                 qthread_debug(SHEPHERD_FUNCTIONS,
                               "l(%p): shep %i is the least busy (%i) so far\n",
                               l, l[alt], shep_busy_level);
@@ -280,4 +309,146 @@ qthread_shepherd_t INTERNAL *qthread_find_active_shepherd(qthread_shepherd_id_t
     }
 }                      /*}}} */
 
+void INTERNAL qthread_spawn_placement_init(void)
+{                      /*{{{ */
+    const char                 *policy = qt_internal_get_env_str("SPAWN_PLACEMENT", "local");
+    const qthread_shepherd_id_t nsheps = (qthread_shepherd_id_t)qlib->nshepherds;
+
+    if (policy) {
+        int p;
+        for (p = 0; p < SPAWN_PLACEMENT_COUNT; p++) {
+            if (!strncasecmp(spawn_placement_names[p], policy, strlen(spawn_placement_names[p]))) {
+                spawn_placement = (enum qt_spawn_placement)p;
+                break;
+            }
+        }
+        if (p == SPAWN_PLACEMENT_COUNT) {
+            fprintf(stderr, "unparsable spawn placement (%s)\n", policy);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (qthread_shepherd_id_t i = 0; i < nsheps; i++) {
+        qthread_shepherd_t *shep = &qlib->shepherds[i];
+        size_t              k    = 0;
+
+        if ((nsheps > 1) && shep->sorted_sheplist && shep->shep_dists) {
+            unsigned int const nearest = shep->shep_dists[shep->sorted_sheplist[0]];
+
+            while (k < (size_t)(nsheps - 1) &&
+                   shep->shep_dists[shep->sorted_sheplist[k]] == nearest) {
+                k++;
+            }
+        }
+        shep->spawn_domain = k + 1;
+    }
+    qthread_debug(SHEPHERD_DETAILS, "spawn placement: %s\n",
+                  spawn_placement_names[spawn_placement]);
+}                      /*}}} */
+
+/* Picks the shepherd for a task spawned without one, according to the
+ * placement flags in feature_flag or, failing those, QTHREAD_SPAWN_PLACEMENT.
+ * Shepherds that have been disabled are never chosen. */
+qthread_shepherd_id_t INTERNAL qthread_spawn_place(qthread_shepherd_t *curr_shep,
+                                                   unsigned int        feature_flag,
+                                                   const void         *hint)
+{                      /*{{{ */
+    const qthread_shepherd_id_t nsheps = (qthread_shepherd_id_t)qlib->nshepherds;
+    qthread_shepherd_t *const   sheps  = qlib->shepherds;
+    enum qt_spawn_placement     policy = spawn_placement;
+    qthread_shepherd_id_t       dest;
+
+    if (feature_flag & QTHREAD_SPAWN_PLACE_OWNER) {
+        policy = SPAWN_PLACEMENT_OWNER;
+    } else if (feature_flag & QTHREAD_SPAWN_PLACE_DOMAIN) {
+        policy = SPAWN_PLACEMENT_DOMAIN;
+    } else if (feature_flag & QTHREAD_SPAWN_PLACE_P2C) {
+        policy = SPAWN_PLACEMENT_P2C;
+    }
+    if ((nsheps == 1) || ((policy == SPAWN_PLACEMENT_OWNER) && (hint == NULL))) {
+        policy = SPAWN_PLACEMENT_LOCAL;
+    }
+
+    switch (policy) {
+        default:
+        case SPAWN_PLACEMENT_LOCAL:
+            dest = qt_threadqueue_choose_dest(curr_shep);
+            break;
+        case SPAWN_PLACEMENT_P2C:
+        {
+            qthread_shepherd_id_t a = (qthread_shepherd_id_t)(qthread_random() % nsheps);
+            qthread_shepherd_id_t b = (qthread_shepherd_id_t)(qthread_random() % nsheps);
+
+            if (QTHREAD_CASLOCK_READ_UI(sheps[a].active) == 0) { a = b; }
+            if (QTHREAD_CASLOCK_READ_UI(sheps[b].active) == 0) { b = a; }
+            if (qt_threadqueue_advisory_queuelen(sheps[b].ready) <
+                qt_threadqueue_advisory_queuelen(sheps[a].ready)) {
+                a = b;
+            }
+            dest = a;
+            break;
+        }
+        case SPAWN_PLACEMENT_DOMAIN:
+        {
+            qthread_shepherd_t *home = curr_shep ? curr_shep : &sheps[0];
+            size_t const        i    = (size_t)(qthread_incr(&home->sched_shepherd, 1) % home->spawn_domain);
+
+            dest = i ? home->sorted_sheplist[i - 1] : home->shepherd_id;
+            break;
+        }
+        case SPAWN_PLACEMENT_OWNER:
+            dest = (qthread_shepherd_id_t)
+                   (((((uint64_t)(uintptr_t)hint >> SPAWN_OWNER_SHIFT) * 0x9E3779B97F4A7C15ULL) >> 32) % nsheps);
+            break;
+    }
+    if (QTHREAD_CASLOCK_READ_UI(sheps[dest].active) == 0) {
+        qthread_shepherd_t *alt = qthread_find_active_shepherd(sheps[dest].sorted_sheplist,
+                                                               sheps[dest].shep_dists);
+        dest = alt ? alt->shepherd_id : qt_threadqueue_choose_dest(curr_shep);
+    }
+#ifdef STEAL_PROFILE
+    {
+        size_t const len  = (size_t)qt_threadqueue_advisory_queuelen(sheps[dest].ready);
+        size_t       seen = sheps[dest].spawn_maxqueue;
+
+        qthread_incr(&sheps[dest].spawn_placed, 1);
+        if (curr_shep && (curr_shep != &sheps[dest])) {
+            qthread_incr(&sheps[dest].spawn_remote, 1);
+        }
+        while (seen < len) {
+            size_t const was = qthread_cas(&sheps[dest].spawn_maxqueue, seen, len);
+            if (was == seen) { break; }
+            seen = was;
+        }
+    }
+#endif
+    qthread_debug(SHEPHERD_FUNCTIONS, "placed by %s on shep %i\n",
+                  spawn_placement_names[policy], (int)dest);
+    return dest;
+}                      /*}}} */
+
+#ifdef STEAL_PROFILE
+void INTERNAL qthread_spawn_placement_stat(void)
+{                      /*{{{ */
+    size_t total = 0, most = 0;
+
+    assert(qlib);
+    for (qthread_shepherd_id_t i = 0; i < qlib->nshepherds; i++) {
+        qthread_shepherd_t *shep = &qlib->shepherds[i];
+
+        fprintf(stdout,
+                "QTHREADS: shepherd %d - %s spawns placed:%ld remote:%ld max-queue:%ld\n",
+                shep->shepherd_id,
+                spawn_placement_names[spawn_placement],
+                (long)shep->spawn_placed,
+                (long)shep->spawn_remote,
+                (long)shep->spawn_maxqueue);
+        total += shep->spawn_placed;
+        if (most < shep->spawn_placed) { most = shep->spawn_placed; }
+    }
+    /* 1.0 is perfectly even; nshepherds means everything went to one queue */
+    fprintf(stdout, "QTHREADS: spawn placement imbalance (max/mean): %g\n",
+            total ? ((double)most * qlib->nshepherds / total) : 0.0);
+} /*}}}*/
+#endif /* ifdef STEAL_PROFILE */
+
 /* vim:set expandtab: */
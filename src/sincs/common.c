@@ -0,0 +1,120 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* The API */
+#include "qthread/qthread.h"
+#include "qthread/sinc.h"
+#include "qthread/cacheline.h"
+
+/* Internal Headers */
+#include "qt_sinc_pool.h"
+#include "qt_mpool.h"
+#include "qt_expect.h"
+#include "qt_asserts.h"
+#include "qt_aligned_alloc.h"
+#include "qt_debug.h"
+#include "qt_int_ceil.h"
+#include "qt_subsystems.h"
+
+/* the biggest storage, in cache lines, that gets a pool of its own */
+#define QT_SINC_POOL_LINES 64
+
+static size_t cacheline;
+
+#ifndef UNPOOLED
+static qt_mpool sinc_pool = NULL;
+/* made the first time something of that many lines is asked for: which sizes
+ * get used depends on the value sizes and how many workers there are */
+static qt_mpool storage_pools[QT_SINC_POOL_LINES];
+
+static void qt_sinc_subsystem_teardown(void)
+{   /*{{{*/
+    qt_mpool_destroy(sinc_pool);
+    sinc_pool = NULL;
+    for (size_t i = 0; i < QT_SINC_POOL_LINES; i++) {
+        if (storage_pools[i]) {
+            qt_mpool_destroy(storage_pools[i]);
+            storage_pools[i] = NULL;
+        }
+    }
+} /*}}}*/
+
+static qt_mpool qt_sinc_storage_pool(size_t lines)
+{   /*{{{*/
+    qt_mpool pool = storage_pools[lines - 1];
+
+    if (QTHREAD_EXPECT(pool == NULL, 0)) {
+        qt_mpool const mine = qt_mpool_create_aligned(lines * cacheline, cacheline);
+
+        assert(mine);
+        pool = qthread_cas_ptr((void **)&storage_pools[lines - 1], NULL, mine);
+        if (pool == NULL) {
+            pool = mine;
+        } else {
+            qt_mpool_destroy(mine);
+        }
+    }
+    return pool;
+} /*}}}*/
+#endif /* ifndef UNPOOLED */
+
+void INTERNAL qt_sinc_subsystem_init(void)
+{   /*{{{*/
+    cacheline = qthread_cacheline();
+#ifndef UNPOOLED
+    sinc_pool = qt_mpool_create(sizeof(qt_sinc_t));
+    assert(sinc_pool);
+    for (size_t i = 0; i < QT_SINC_POOL_LINES; i++) {
+        storage_pools[i] = NULL;
+    }
+    qthread_internal_cleanup(qt_sinc_subsystem_teardown);
+#endif
+} /*}}}*/
+
+qt_sinc_t INTERNAL *qt_sinc_internal_alloc(void)
+{   /*{{{*/
+#ifndef UNPOOLED
+    return qt_mpool_alloc(sinc_pool);
+#else
+    return MALLOC(sizeof(qt_sinc_t));
+#endif
+} /*}}}*/
+
+void INTERNAL qt_sinc_internal_free(qt_sinc_t *sinc)
+{   /*{{{*/
+#ifndef UNPOOLED
+    qt_mpool_free(sinc_pool, sinc);
+#else
+    FREE(sinc, sizeof(qt_sinc_t));
+#endif
+} /*}}}*/
+
+void INTERNAL *qt_sinc_internal_storage_alloc(size_t bytes)
+{   /*{{{*/
+    const size_t lines = QT_CEIL_RATIO(bytes, cacheline);
+
+    assert(lines > 0);
+#ifndef UNPOOLED
+    if (lines <= QT_SINC_POOL_LINES) {
+        return qt_mpool_alloc(qt_sinc_storage_pool(lines));
+    }
+#endif
+    return qthread_internal_aligned_alloc(lines * cacheline, cacheline);
+} /*}}}*/
+
+void INTERNAL qt_sinc_internal_storage_free(void  *storage,
+                                            size_t bytes)
+{   /*{{{*/
+    const size_t lines = QT_CEIL_RATIO(bytes, cacheline);
+
+#ifndef UNPOOLED
+    if (lines <= QT_SINC_POOL_LINES) {
+        qt_mpool_free(storage_pools[lines - 1], storage);
+        return;
+    }
+#endif
+    qthread_internal_aligned_free(storage, cacheline);
+} /*}}}*/
+
+/* vim:set expandtab: */
@@ -20,6 +20,7 @@
 #include "qt_aligned_alloc.h"
 #include "qt_debug.h"
 #include "qt_int_ceil.h"
+#include "qt_sinc_pool.h"
 
 typedef aligned_t qt_sinc_count_t;
 
@@ -32,6 +33,7 @@ typedef struct qt_sinc_reduction_ {
     size_t         sizeof_value;
     size_t         sizeof_shep_value_part;
     size_t         sizeof_shep_count_part;
+    size_t         sizeof_storage; // of everything above, allocated as one piece
 } qt_sinc_reduction_t;
 
 typedef struct qt_sinc_s {
@@ -72,20 +74,23 @@ void API_FUNC qt_sinc_init(qt_sinc_t *restrict  sinc_,
         const size_t                        num_lines_per_shep     = QT_CEIL_RATIO(sizeof_shep_values, cacheline);
         const size_t                        num_lines              = num_sheps * num_lines_per_shep;
         const size_t                        sizeof_shep_value_part = num_lines_per_shep * cacheline;
-        qt_sinc_reduction_t *const restrict rdata                  = sinc->rdata = MALLOC(sizeof(qt_sinc_reduction_t));
+        const size_t                        sizeof_rdata           = QT_CEIL_RATIO(sizeof(qt_sinc_reduction_t), cacheline) * cacheline;
+        // The per-worker values (on lines of their own), then the initial value and the result
+        const size_t                        sizeof_storage = sizeof_rdata + num_lines * cacheline + 2 * sizeof_value;
+        uint8_t *const                      storage        = qt_sinc_internal_storage_alloc(sizeof_storage);
+        qt_sinc_reduction_t *const restrict rdata          = sinc->rdata = (qt_sinc_reduction_t *)storage;
         assert(rdata);
-        rdata->op            = op;
-        rdata->sizeof_value  = sizeof_value;
-        rdata->initial_value = MALLOC(2 * sizeof_value);
-        assert(rdata->initial_value);
+        rdata->op             = op;
+        rdata->sizeof_value   = sizeof_value;
+        rdata->sizeof_storage = sizeof_storage;
+        rdata->initial_value  = storage + sizeof_rdata + num_lines * cacheline;
         memcpy(rdata->initial_value, initial_value, sizeof_value);
         rdata->result = ((uint8_t *)rdata->initial_value) + sizeof_value;
         assert(rdata->result);
 
         rdata->sizeof_shep_value_part = sizeof_shep_value_part;
 
-        rdata->values = qthread_internal_aligned_alloc(num_lines * cacheline, cacheline);
-        assert(rdata->values);
+        rdata->values = storage + sizeof_rdata;
         ALLOC_SCRIBBLE(rdata->values, num_lines * cacheline);
 
         // Initialize values
@@ -116,7 +121,7 @@ qt_sinc_t API_FUNC *qt_sinc_create(const size_t sizeof_value,
                                    qt_sinc_op_f op,
                                    const size_t will_spawn)
 {   /*{{{*/
-    qt_sinc_t *const restrict sinc = MALLOC(sizeof(qt_sinc_t));
+    qt_sinc_t *const restrict sinc = qt_sinc_internal_alloc();
 
     assert(sinc);
 
@@ -195,10 +200,8 @@ void API_FUNC qt_sinc_fini(qt_sinc_t *sinc_)
         qt_sinc_reduction_t *const restrict rdata = sinc->rdata;
         assert(rdata->result);
         assert(rdata->initial_value);
-        FREE(rdata->initial_value, 2 * rdata->sizeof_value);
         assert(rdata->values);
-        qthread_internal_aligned_free(rdata->values, cacheline);
-        FREE(rdata, sizeof(qt_sinc_reduction_t));
+        qt_sinc_internal_storage_free(rdata, rdata->sizeof_storage);
         sinc->rdata = NULL;
     }
     qthread_debug(FEB_DETAILS, "tid %u filling sinc ready as part of destruction (%p)\n", qthread_id(), &sinc->ready);
@@ -207,13 +210,8 @@ void API_FUNC qt_sinc_fini(qt_sinc_t *sinc_)
 
 void API_FUNC qt_sinc_destroy(qt_sinc_t *sinc_)
 {   /*{{{*/
-    qt_internal_sinc_t *const restrict sinc = (qt_internal_sinc_t *)sinc_;
-
     qt_sinc_fini(sinc_);
-    if (sinc->rdata) {
-        FREE(sinc->rdata, sizeof(qt_sinc_reduction_t));
-    }
-    FREE(sinc_, sizeof(qt_internal_sinc_t));
+    qt_sinc_internal_free(sinc_);
 } /*}}}*/
 
 /* Adds a new participant to the sinc.
@@ -20,6 +20,7 @@
 #include "qt_aligned_alloc.h"
 #include "qt_debug.h"
 #include "qt_int_ceil.h"
+#include "qt_sinc_pool.h"
 
 typedef aligned_t qt_sinc_count_t;
 
@@ -51,7 +52,7 @@ void qt_sinc_init(qt_sinc_t *restrict  sinc_,
                   qt_sinc_op_f         op,
                   size_t               expect)
 {   /*{{{*/
-    assert(sinc);
+    assert(sinc_);
     assert((0 == sizeof_value && NULL == initial_value) ||
            (0 != sizeof_value && NULL != initial_value));
     qt_internal_sinc_t *const restrict sinc = (struct qt_sinc_s *)sinc_;
@@ -84,7 +85,7 @@ void qt_sinc_init(qt_sinc_t *restrict  sinc_,
 
         rdata->values = qthread_internal_aligned_alloc(num_lines * cacheline, cacheline);
         assert(rdata->values);
-        ALLOC_SCRIBBLE(rdata->values, num_lines * cacheline, cacheline);
+        ALLOC_SCRIBBLE(rdata->values, num_lines * cacheline);
 
         // Initialize values
         for (size_t s = 0; s < num_sheps; s++) {
@@ -110,7 +111,7 @@ qt_sinc_t *qt_sinc_create(const size_t sizeof_value,
                           qt_sinc_op_f op,
                           const size_t will_spawn)
 {   /*{{{*/
-    qt_sinc_t *const restrict sinc = MALLOC(sizeof(qt_sinc_t));
+    qt_sinc_t *const restrict sinc = qt_sinc_internal_alloc();
 
     assert(sinc);
 
@@ -157,16 +158,18 @@ void qt_sinc_fini(qt_sinc_t *sinc_)
         qt_sinc_reduction_t *rdata = sinc->rdata;
         assert(rdata->result);
         assert(rdata->initial_value);
-        FREE(rdata->initial_value, rdata->sizeof_value);
+        FREE(rdata->initial_value, 2 * rdata->sizeof_value);
         assert(rdata->values);
         qthread_internal_aligned_free(rdata->values, cacheline);
+        FREE(rdata, sizeof(qt_sinc_reduction_t));
+        sinc->rdata = NULL;
     }
 } /*}}}*/
 
 void qt_sinc_destroy(qt_sinc_t *sinc_)
 {   /*{{{*/
     qt_sinc_fini(sinc_);
-    FREE(sinc_, sizeof(qt_sinc_t));
+    qt_sinc_internal_free(sinc_);
 } /*}}}*/
 
 /* Adds a new participant to the sinc.
@@ -223,8 +226,8 @@ static void qt_sinc_internal_collate(qt_sinc_t *sinc_)
     qthread_fill(&sinc->ready);
 } /*}}}*/
 
-void qt_sinc_submit(qt_sinc_t *restrict sinc_,
-                    void *restrict      value)
+void qt_sinc_submit(qt_sinc_t *restrict  sinc_,
+                    const void *restrict value)
 {   /*{{{*/
     assert(sinc_);
     qt_internal_sinc_t *const restrict sinc = (qt_internal_sinc_t *)sinc_;
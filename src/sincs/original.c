@@ -20,10 +20,13 @@
 #include "qt_shepherd_innards.h"
 #include "qt_visibility.h"
 #include "qt_int_ceil.h"
+#include "qt_aligned_alloc.h"
+#include "qt_debug.h"
+#include "qt_sinc_pool.h"
 
 typedef saligned_t qt_sinc_count_t;
 
-struct qt_sinc_s {
+typedef struct qt_sinc_orig_s {
     void *restrict            values;
     qt_sinc_count_t *restrict counts;
     qt_sinc_op_f              op;
@@ -44,19 +47,25 @@ struct qt_sinc_s {
     qt_sinc_count_t          *dist_ttl;
     qt_sinc_count_t          *dist_cnt;
 #endif /* defined(SINCS_PROFILE) */
-};
+} qt_sinc_orig_t;
+
+/* this one doesn't fit in a qt_sinc_t */
+typedef struct qt_sinc_s {
+    qt_sinc_orig_t *sinc;
+} qt_internal_sinc_t;
 
 static size_t       num_sheps;
 static size_t       num_workers;
 static size_t       num_wps;
 static unsigned int cacheline;
 
-qt_sinc_t *qt_sinc_create(const size_t sizeof_value,
-                          const void  *initial_value,
-                          qt_sinc_op_f op,
-                          const size_t will_spawn)
+void qt_sinc_init(qt_sinc_t *restrict  sinc_,
+                  size_t               sizeof_value,
+                  const void *restrict initial_value,
+                  qt_sinc_op_f         op,
+                  size_t               will_spawn)
 {
-    qt_sinc_t *sinc = malloc(sizeof(qt_sinc_t));
+    qt_sinc_orig_t *sinc = ((qt_internal_sinc_t *)sinc_)->sinc = MALLOC(sizeof(qt_sinc_orig_t));
 
     assert(sinc);
 
@@ -80,7 +89,7 @@ qt_sinc_t *qt_sinc_create(const size_t sizeof_value,
         const size_t num_lines              = num_sheps * num_lines_per_shep;
         const size_t sizeof_shep_value_part = num_lines_per_shep * cacheline;
 
-        sinc->initial_value = malloc(sizeof_value);
+        sinc->initial_value = MALLOC(sizeof_value);
         assert(sinc->initial_value);
         memcpy(sinc->initial_value, initial_value, sizeof_value);
 
@@ -99,7 +108,7 @@ qt_sinc_t *qt_sinc_create(const size_t sizeof_value,
                        sizeof_value);
             }
         }
-        sinc->result = malloc(sinc->sizeof_value);
+        sinc->result = MALLOC(sinc->sizeof_value);
         assert(sinc->result);
     } else {
         sinc->initial_value          = NULL;
@@ -130,7 +139,7 @@ qt_sinc_t *qt_sinc_create(const size_t sizeof_value,
     sinc->count_decrs = qthread_internal_aligned_alloc(num_count_array_lines * cacheline, cacheline);
     assert(sinc->count_decrs);
     memset(sinc->count_decrs, 0, num_count_array_lines * cacheline);
-    sinc->count_remaining = qthreaad_internal_aligned_alloc(num_count_array_lines * cacheline, cacheline);
+    sinc->count_remaining = qthread_internal_aligned_alloc(num_count_array_lines * cacheline, cacheline);
     assert(sinc->count_remaining);
     memset(sinc->count_remaining, 0, num_count_array_lines * cacheline);
     sinc->count_spawns = qthread_internal_aligned_alloc(num_count_array_lines * cacheline, cacheline);
@@ -183,13 +192,26 @@ qt_sinc_t *qt_sinc_create(const size_t sizeof_value,
         sinc->ready     = SYNCVAR_INITIALIZER;
         sinc->remaining = 0;
     }
+}
+
+qt_sinc_t *qt_sinc_create(const size_t sizeof_value,
+                          const void  *initial_value,
+                          qt_sinc_op_f op,
+                          const size_t will_spawn)
+{
+    qt_sinc_t *sinc = qt_sinc_internal_alloc();
+
+    assert(sinc);
+    qt_sinc_init(sinc, sizeof_value, initial_value, op, will_spawn);
 
     return sinc;
 }
 
-void qt_sinc_reset(qt_sinc_t   *sinc,
+void qt_sinc_reset(qt_sinc_t   *sinc_,
                    const size_t will_spawn)
 {
+    qt_sinc_orig_t *const sinc = ((qt_internal_sinc_t *)sinc_)->sinc;
+
     // Reset values
     if (NULL != sinc->values) {
         const size_t sizeof_shep_value_part = sinc->sizeof_shep_value_part;
@@ -233,8 +255,10 @@ void qt_sinc_reset(qt_sinc_t   *sinc,
     sinc->ready = SYNCVAR_EMPTY_INITIALIZER;
 }
 
-void qt_sinc_destroy(qt_sinc_t *sinc)
+void qt_sinc_fini(qt_sinc_t *sinc_)
 {
+    qt_sinc_orig_t *const sinc = ((qt_internal_sinc_t *)sinc_)->sinc;
+
 #if defined(SINCS_PROFILE)
     const size_t sizeof_shep_count_part = sinc->sizeof_shep_count_part;
     for (size_t s = 0; s < num_sheps; s++) {
@@ -271,20 +295,30 @@ void qt_sinc_destroy(qt_sinc_t *sinc)
     qthread_internal_aligned_free(sinc->counts, cacheline);
     if (sinc->result || sinc->values) {
         assert(sinc->result);
-        free(sinc->result);
+        FREE(sinc->result, sinc->sizeof_value);
+        FREE(sinc->initial_value, sinc->sizeof_value);
         assert(sinc->values);
         qthread_internal_aligned_free(sinc->values, cacheline);
     }
-    free(sinc);
+    FREE(sinc, sizeof(qt_sinc_orig_t));
+    ((qt_internal_sinc_t *)sinc_)->sinc = NULL;
+}
+
+void qt_sinc_destroy(qt_sinc_t *sinc_)
+{
+    qt_sinc_fini(sinc_);
+    qt_sinc_internal_free(sinc_);
 }
 
 /* Adds a new participant to the sinc.
  * Pre:  sinc was created
  * Post: aggregate count is positive
  */
-void qt_sinc_expect(qt_sinc_t *sinc,
+void qt_sinc_expect(qt_sinc_t *sinc_,
                     size_t     count)
 {
+    qt_sinc_orig_t *const sinc = ((qt_internal_sinc_t *)sinc_)->sinc;
+
     assert(sinc);
     if (count > 0) {
         const qthread_worker_id_t worker_id = qthread_readstate(CURRENT_WORKER);
@@ -312,8 +346,10 @@ void qt_sinc_expect(qt_sinc_t *sinc,
     }
 }
 
-void *qt_sinc_tmpdata(qt_sinc_t *sinc)
+void *qt_sinc_tmpdata(qt_sinc_t *sinc_)
 {
+    qt_sinc_orig_t *const sinc = ((qt_internal_sinc_t *)sinc_)->sinc;
+
     if (NULL != sinc->values) {
         const size_t shep_offset   = qthread_shep() * sinc->sizeof_shep_value_part;
         const size_t worker_offset = qthread_readstate(CURRENT_WORKER) * sinc->sizeof_value;
@@ -323,7 +359,7 @@ void *qt_sinc_tmpdata(qt_sinc_t *sinc)
     }
 }
 
-static void qt_sinc_internal_collate(qt_sinc_t *sinc)
+static void qt_sinc_internal_collate(qt_sinc_orig_t *sinc)
 {
     if (sinc->values) {
         // step 1: collate results
@@ -343,9 +379,11 @@ static void qt_sinc_internal_collate(qt_sinc_t *sinc)
     qthread_syncvar_writeF_const(&sinc->ready, 42);
 }
 
-void qt_sinc_submit(qt_sinc_t *restrict sinc,
-                    void *restrict      value)
+void qt_sinc_submit(qt_sinc_t *restrict  sinc_,
+                    const void *restrict value)
 {
+    qt_sinc_orig_t *const sinc = ((qt_internal_sinc_t *)sinc_)->sinc;
+
     assert(NULL != sinc->values || NULL == value);
     assert((sinc->result && sinc->initial_value) || (!sinc->result && !sinc->initial_value));
 
@@ -511,9 +549,11 @@ void qt_sinc_submit(qt_sinc_t *restrict sinc,
     }
 }
 
-void qt_sinc_wait(qt_sinc_t *restrict sinc,
+void qt_sinc_wait(qt_sinc_t *restrict sinc_,
                   void *restrict      target)
 {
+    qt_sinc_orig_t *const sinc = ((qt_internal_sinc_t *)sinc_)->sinc;
+
     qthread_syncvar_readFF(NULL, &sinc->ready);
 
     if (target) {
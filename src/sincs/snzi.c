@@ -19,6 +19,10 @@
 #include "qt_expect.h"
 #include "qt_visibility.h"
 #include "qt_int_ceil.h"
+#include "qt_sinc_pool.h"
+#include "qt_atomics.h"
+#include "qt_debug.h"
+#include "qt_subsystems.h"
 
 typedef aligned_t qt_sinc_count_t;
 
@@ -37,9 +41,12 @@ typedef struct qt_sinc_reduction_ {
     size_t         sizeof_shep_value_part;
 } qt_sinc_reduction_t;
 
+/* One count per node of the SNZI tree (see below): a shepherd's arrivals and
+ * departures land on its own leaf, and only reach a node's parent when that
+ * node goes from zero to non-zero or back. The sinc is done when the root
+ * goes to zero. */
 typedef struct qt_sinc_snzi_ {
     qt_sinc_cache_count_t *restrict counts;
-    aligned_t                       remaining;
 } qt_sinc_snzi_t;
 
 typedef struct qt_sinc_s {
@@ -48,17 +55,206 @@ typedef struct qt_sinc_s {
     qt_sinc_reduction_t *rdata;
 } qt_internal_sinc_t;
 
+/* Everything a sinc points to is allocated as one piece: this, then the
+ * counts (a line per tree node), then, if there is a value, the per-worker
+ * values (on lines of their own), the initial value and the result. */
+typedef struct qt_sinc_storage_s {
+    qt_sinc_snzi_t      snzi;
+    qt_sinc_reduction_t rdata;
+    size_t              sizeof_storage;
+} qt_sinc_storage_t;
+
 static size_t       num_sheps;
 static size_t       num_workers;
 static size_t       num_wps;
 static unsigned int cacheline;
 
+/* The SNZI tree is the same for every sinc, and is shaped by the distances
+ * between shepherds: shepherds that are close together share a parent, and
+ * the groups that are close together share a grandparent, and so on. Nodes
+ * 0 through num_sheps-1 are the shepherds' leaves, a node's parent always
+ * comes after it, and the last node is the root (with one shepherd, the
+ * root is that shepherd's leaf). */
+#define QT_SNZI_FANOUT 8
+#define SNZI_NO_NODE   ((size_t)-1)
+
+static size_t    snzi_nnodes;
+static size_t   *snzi_parent;         /* SNZI_NO_NODE for the root */
+static size_t   *snzi_kids;           /* node n's children are the entries from */
+static size_t   *snzi_first_kid;      /* snzi_first_kid[n] up to snzi_first_kid[n+1] */
+static aligned_t snzi_tree_state = 0; /* 0: not built, 1: being built, 2: built */
+
 #define SNZI_ASSIGN(a, b) do {   \
         if ((b) == 0) { a = 0; } \
         else { a = (b) + 1; }    \
 } while (0)
 
+#define SNZI_HALF 1
+#define SNZI_ONE  2
+
 static void qt_sinc_internal_collate(qt_sinc_t *sinc);
+static int  qt_sinc_snzi_depart(qt_sinc_cache_count_t *restrict counts,
+                                size_t                          node);
+
+static void qt_sinc_snzi_tree_teardown(void)
+{   /*{{{*/
+    FREE(snzi_parent, (2 * num_sheps - 1) * sizeof(size_t));
+    FREE(snzi_kids, (2 * num_sheps - 1) * sizeof(size_t));
+    FREE(snzi_first_kid, 2 * num_sheps * sizeof(size_t));
+    snzi_parent     = snzi_kids = snzi_first_kid = NULL;
+    snzi_nnodes     = 0;
+    num_sheps       = 0;
+    snzi_tree_state = 0;
+} /*}}}*/
+
+static int qt_sinc_snzi_cmp_dist(const void *a,
+                                 const void *b)
+{   /*{{{*/
+    return *(const int *)a - *(const int *)b;
+} /*}}}*/
+
+static void qt_sinc_snzi_tree_build(void)
+{   /*{{{*/
+    num_sheps   = qthread_readstate(TOTAL_SHEPHERDS);
+    num_workers = qthread_readstate(TOTAL_WORKERS);
+    num_wps     = num_workers / num_sheps;
+    cacheline   = qthread_cacheline();
+
+    /* every internal node has at least two children */
+    const size_t max_nodes = 2 * num_sheps - 1;
+    size_t      *groups    = MALLOC(num_sheps * sizeof(size_t)); /* top node of each group */
+    size_t      *reps      = MALLOC(num_sheps * sizeof(size_t)); /* a shepherd in each group */
+    size_t      *cluster   = MALLOC(num_sheps * sizeof(size_t));
+    int         *dists     = MALLOC(num_sheps * num_sheps * sizeof(int));
+    size_t       ngroups   = num_sheps;
+    size_t       ndists    = 0;
+
+    snzi_parent    = MALLOC(max_nodes * sizeof(size_t));
+    snzi_kids      = MALLOC(max_nodes * sizeof(size_t));
+    snzi_first_kid = MALLOC((max_nodes + 1) * sizeof(size_t));
+    assert(groups && reps && cluster && dists && snzi_parent && snzi_kids && snzi_first_kid);
+    snzi_nnodes = num_sheps;
+    for (size_t s = 0; s < num_sheps; s++) {
+        groups[s]      = reps[s] = s;
+        snzi_parent[s] = SNZI_NO_NODE;
+        for (size_t t = 0; t < num_sheps; t++) {
+            dists[ndists++] = qthread_distance(s, t);
+        }
+    }
+    qsort(dists, ndists, sizeof(int), qt_sinc_snzi_cmp_dist);
+    {
+        size_t uniq = 1;
+        for (size_t i = 1; i < ndists; i++) {
+            if (dists[i] != dists[uniq - 1]) { dists[uniq++] = dists[i]; }
+        }
+        ndists = uniq;
+    }
+
+    /* Group together the groups that are within the closest distance of
+     * each other, a few at a time; once nothing is that close, try the next
+     * closest distance. The farthest distance takes in everything. */
+    for (size_t d = 0; ngroups > 1;) {
+        size_t next   = 0;
+        int    merged = 0;
+
+        for (size_t g = 0; g < ngroups; g++) {
+            if (groups[g] == SNZI_NO_NODE) { continue; }
+            size_t n = 0;
+            cluster[n++] = g;
+            for (size_t h = g + 1; h < ngroups && n < QT_SNZI_FANOUT; h++) {
+                if ((groups[h] != SNZI_NO_NODE) &&
+                    (qthread_distance(reps[g], reps[h]) <= dists[d]) &&
+                    (qthread_distance(reps[h], reps[g]) <= dists[d])) {
+                    cluster[n++] = h;
+                }
+            }
+            const size_t rep = reps[g];
+            size_t       top = groups[g];
+            if (n > 1) {
+                top = snzi_nnodes++;
+                snzi_parent[top] = SNZI_NO_NODE;
+                for (size_t i = 0; i < n; i++) {
+                    snzi_parent[groups[cluster[i]]] = top;
+                    groups[cluster[i]]              = SNZI_NO_NODE;
+                }
+                merged = 1;
+            }
+            groups[g]     = SNZI_NO_NODE;
+            groups[next]  = top;
+            reps[next++]  = rep;
+        }
+        ngroups = next;
+        if (!merged && (d < ndists - 1)) { d++; }
+    }
+    assert(snzi_nnodes <= max_nodes);
+
+    /* list each node's children */
+    for (size_t n = 0; n <= snzi_nnodes; n++) {
+        snzi_first_kid[n] = 0;
+    }
+    for (size_t n = 0; n < snzi_nnodes; n++) {
+        if (snzi_parent[n] != SNZI_NO_NODE) { snzi_first_kid[snzi_parent[n] + 1]++; }
+    }
+    for (size_t n = 0; n < snzi_nnodes; n++) {
+        snzi_first_kid[n + 1] += snzi_first_kid[n];
+    }
+    for (size_t n = 0; n < snzi_nnodes; n++) {
+        if (snzi_parent[n] != SNZI_NO_NODE) { snzi_kids[snzi_first_kid[snzi_parent[n]]++] = n; }
+    }
+    for (size_t n = snzi_nnodes; n > 0; n--) {
+        snzi_first_kid[n] = snzi_first_kid[n - 1];
+    }
+    snzi_first_kid[0] = 0;
+
+    FREE(groups, num_sheps * sizeof(size_t));
+    FREE(reps, num_sheps * sizeof(size_t));
+    FREE(cluster, num_sheps * sizeof(size_t));
+    FREE(dists, num_sheps * num_sheps * sizeof(int));
+    qthread_internal_cleanup(qt_sinc_snzi_tree_teardown);
+} /*}}}*/
+
+static void qt_sinc_snzi_tree_init(void)
+{   /*{{{*/
+    if (QTHREAD_EXPECT(snzi_tree_state != 2, 0)) {
+        if (qthread_cas(&snzi_tree_state, 0, 1) == 0) {
+            qt_sinc_snzi_tree_build();
+            MACHINE_FENCE;
+            snzi_tree_state = 2;
+        } else {
+            while (snzi_tree_state != 2) SPINLOCK_BODY();
+        }
+    }
+} /*}}}*/
+
+/* Spreads `expect` over the leaves, and marks each internal node with the
+ * number of its children that start out non-zero. */
+static void qt_sinc_snzi_set_counts(qt_sinc_snzi_t *snzi,
+                                    size_t          expect)
+{   /*{{{*/
+    qt_sinc_cache_count_t *const restrict counts       = snzi->counts;
+    const size_t                          num_per_shep = expect / num_sheps;
+    size_t                                extras       = expect % num_sheps;
+
+    for (size_t s = 0; s < num_sheps; s++) {
+        counts[s].c = num_per_shep;
+        if (extras > 0) {
+            counts[s].c++;
+            extras--;
+        }
+    }
+    for (size_t n = num_sheps; n < snzi_nnodes; n++) {
+        counts[n].c = 0;
+    }
+    /* children come before their parents, so each node is final by the
+     * time it is reached */
+    for (size_t n = 0; n < snzi_nnodes; n++) {
+        const aligned_t c = counts[n].c;
+        if ((c != 0) && (snzi_parent[n] != SNZI_NO_NODE)) {
+            counts[snzi_parent[n]].c++;
+        }
+        SNZI_ASSIGN(counts[n].c, c);
+    }
+} /*}}}*/
 
 void qt_sinc_init(qt_sinc_t *restrict  sinc_,
                   size_t               sizeof_value,
@@ -69,35 +265,40 @@ void qt_sinc_init(qt_sinc_t *restrict  sinc_,
     assert(sinc_);
     qt_internal_sinc_t *sinc = (qt_internal_sinc_t *)sinc_;
 
-    if (QTHREAD_EXPECT((num_sheps == 0), 0)) {
-        num_sheps   = qthread_readstate(TOTAL_SHEPHERDS);
-        num_workers = qthread_readstate(TOTAL_WORKERS);
-        num_wps     = num_workers / num_sheps;
-        cacheline   = qthread_cacheline();
+    qt_sinc_snzi_tree_init();
+
+    const size_t sizeof_header = QT_CEIL_RATIO(sizeof(qt_sinc_storage_t), cacheline) * cacheline;
+    const size_t sizeof_counts = snzi_nnodes * cacheline;
+    size_t       num_lines     = 0;
+
+    if (sizeof_value > 0) {
+        num_lines = num_sheps * QT_CEIL_RATIO(num_wps * sizeof_value, cacheline);
     }
 
+    const size_t sizeof_storage = sizeof_header + sizeof_counts + num_lines * cacheline + 2 * sizeof_value;
+    uint8_t     *storage        = qt_sinc_internal_storage_alloc(sizeof_storage);
+    assert(storage);
+    qt_sinc_storage_t *hdr = (qt_sinc_storage_t *)storage;
+    hdr->sizeof_storage = sizeof_storage;
+
+    assert(sizeof(qt_sinc_cache_count_t) <= cacheline);
+    qt_sinc_snzi_t *snzi = sinc->snzi = &hdr->snzi;
+    snzi->counts = (qt_sinc_cache_count_t *)(storage + sizeof_header);
+
     if (sizeof_value == 0) {
         sinc->rdata = NULL;
     } else {
-        const size_t         sizeof_shep_values     = num_wps * sizeof_value;
-        const size_t         num_lines_per_shep     = QT_CEIL_RATIO(sizeof_shep_values, cacheline);
-        const size_t         num_lines              = num_sheps * num_lines_per_shep;
-        const size_t         sizeof_shep_value_part = num_lines_per_shep * cacheline;
-        qt_sinc_reduction_t *rdata                  = sinc->rdata = malloc(sizeof(qt_sinc_reduction_t));
-        assert(rdata);
+        const size_t         sizeof_shep_value_part = (num_lines / num_sheps) * cacheline;
+        qt_sinc_reduction_t *rdata                  = sinc->rdata = &hdr->rdata;
         rdata->op            = op;
         rdata->sizeof_value  = sizeof_value;
-        rdata->initial_value = malloc(2 * sizeof_value);
-        assert(rdata->initial_value);
+        rdata->values        = storage + sizeof_header + sizeof_counts;
+        rdata->initial_value = (uint8_t *)rdata->values + num_lines * cacheline;
         memcpy(rdata->initial_value, initial_value, sizeof_value);
         rdata->result = ((uint8_t *)rdata->initial_value) + sizeof_value;
-        assert(rdata->result);
 
         rdata->sizeof_shep_value_part = sizeof_shep_value_part;
 
-        rdata->values = qthread_internal_aligned_alloc(num_lines * cacheline, cacheline);
-        assert(rdata->values);
-
         // Initialize values
         for (size_t s = 0; s < num_sheps; s++) {
             const size_t shep_offset = s * sizeof_shep_value_part;
@@ -109,44 +310,11 @@ void qt_sinc_init(qt_sinc_t *restrict  sinc_,
             }
         }
     }
-    qt_sinc_snzi_t *snzi = sinc->snzi = malloc(sizeof(qt_sinc_snzi_t));
-    assert(snzi);
 
-    assert(sizeof(qt_sinc_cache_count_t) <= cacheline);
-    snzi_counts = qthread_internal_aligned_alloc(num_sheps * cacheline, cacheline);
-    assert(snzi->counts);
-    // memset(sinc->counts, 0, num_sheps * cacheline);
-    // memset(sinc->counts, 0, QTHREAD_SIZEOF_ALIGNED_T * num_sheps);
-
-    // Initialize counts array
+    qt_sinc_snzi_set_counts(snzi, expect);
     if (expect > 0) {
-        const size_t num_per_shep = expect / num_sheps;
-        size_t       extras       = expect % num_sheps;
-
-        // Set remaining count
-        if (num_per_shep > 0) {
-            snzi->remaining = num_sheps;
-        } else {
-            snzi->remaining = extras;
-        }
-
-        for (size_t s = 0; s < num_sheps; s++) {
-#if defined(SINCS_PROFILE)
-            snzi->count_spawns[s] = num_per_shep;
-            if (extras > 0) {
-                snzi->count_spawns[s]++;
-            }
-#endif      /* defined(SINCS_PROFILE) */
-            if (extras > 0) {
-                SNZI_ASSIGN(snzi->counts[s].c, num_per_shep + 1);
-                extras--;
-            } else {
-                SNZI_ASSIGN(snzi->counts[s].c, num_per_shep);
-            }
-        }
         qthread_empty(&sinc->ready);
     } else {
-        snzi->remaining = 0;
         qthread_fill(&sinc->ready);
     }
 }
@@ -156,7 +324,7 @@ qt_sinc_t *qt_sinc_create(const size_t sizeof_value,
                           qt_sinc_op_f op,
                           const size_t expect)
 {
-    qt_sinc_t *sinc = malloc(sizeof(qt_sinc_t));
+    qt_sinc_t *sinc = qt_sinc_internal_alloc();
 
     assert(sinc);
     qt_sinc_init(sinc, sizeof_value, initial_value, op, expect);
@@ -186,24 +354,7 @@ void qt_sinc_reset(qt_sinc_t   *sinc_,
     }
 
     // Reset counts
-    const size_t                   num_per_worker = will_spawn / num_sheps;
-    size_t                         extras         = will_spawn % num_sheps;
-    qt_sinc_snzi_t *const restrict snzi           = sinc->snzi;
-
-    if (num_per_worker > 0) {
-        snzi->remaining = num_sheps;
-    } else {
-        snzi->remaining = extras;
-    }
-
-    for (size_t s = 0; s < num_sheps; s++) {
-        if (extras > 0) {
-            extras--;
-            SNZI_ASSIGN(snzi->counts[s].c, num_per_worker + 1);
-        } else {
-            SNZI_ASSIGN(snzi->counts[s].c, num_per_worker);
-        }
-    }
+    qt_sinc_snzi_set_counts(sinc->snzi, will_spawn);
 
     // Reset ready flag
     if (will_spawn != 0) {
@@ -250,25 +401,118 @@ void qt_sinc_fini(qt_sinc_t *sinc_)
     qt_sinc_snzi_t *const restrict snzi = sinc->snzi;
     assert(snzi);
     assert(snzi->counts);
-    qthread_internal_aligned_free(snzi->counts, cacheline);
-    if (sinc->rdata) {
-        qt_sinc_reduction_t *rdata = sinc->rdata;
-        assert(rdata->result);
-        assert(rdata->initial_value);
-        free(rdata->initial_value);
-        assert(rdata->values);
-        qthread_internal_aligned_free(rdata->values, cacheline);
-    }
+    qt_sinc_internal_storage_free(snzi, ((qt_sinc_storage_t *)snzi)->sizeof_storage);
+    sinc->snzi  = NULL;
+    sinc->rdata = NULL;
 }
 
 void qt_sinc_destroy(qt_sinc_t *sinc_)
 {
     qt_sinc_fini(sinc_);
-    free(sinc_);
+    qt_sinc_internal_free(sinc_);
 }
 
-#define SNZI_HALF 1
-#define SNZI_ONE  2
+/* Arrives at a node, and, if that takes it from zero to non-zero, at its
+ * parent first; so a node is never non-zero while its parent is zero.
+ * Returns 1 if this arrival took the root from zero to non-zero. */
+static int qt_sinc_snzi_arrive(qt_sinc_cache_count_t *restrict counts,
+                               size_t                          node,
+                               aligned_t                       count)
+{   /*{{{*/
+    aligned_t *C       = &counts[node].c;
+    size_t     parent  = snzi_parent[node];
+    int        succ    = 0;
+    int        raised  = 0;
+    size_t     undoArr = 0;
+
+    do {
+        aligned_t c = *C;
+        if ((c >= SNZI_ONE) && (qthread_cas(C, c, c + count) == c)) {
+            succ = 1;
+        }
+        if ((c == 0) && (qthread_cas(C, 0, SNZI_HALF) == 0)) {
+            c = SNZI_HALF;
+        }
+        if (c == SNZI_HALF) {
+            if (parent != SNZI_NO_NODE) {
+                raised |= qt_sinc_snzi_arrive(counts, parent, 1);
+            }
+            if (qthread_cas(C, SNZI_HALF, count + 1) != SNZI_HALF) {
+                undoArr++;
+            } else {
+                succ = 1;
+                if (parent == SNZI_NO_NODE) {
+                    raised = 1;
+                }
+            }
+        }
+        COMPILER_FENCE;
+    } while (!succ);
+    /* someone else got this node from half to one, and told the parent
+     * about it too; our own count is in now, so this can't empty anything */
+    while (undoArr > 0 && parent != SNZI_NO_NODE) {
+        (void)qt_sinc_snzi_depart(counts, parent);
+        undoArr--;
+    }
+    return raised;
+} /*}}}*/
+
+/* Departs from a node that is known to be non-zero, and from its parent if
+ * that takes it to zero; returns 1 if that emptied the root. */
+static int qt_sinc_snzi_depart(qt_sinc_cache_count_t *restrict counts,
+                               size_t                          node)
+{   /*{{{*/
+    do {
+        aligned_t *C = &counts[node].c;
+        aligned_t  x = *C;
+
+        assert(x >= SNZI_ONE);
+        if (qthread_cas(C, x, (x == SNZI_ONE) ? 0 : x - 1) == x) {
+            if (x != SNZI_ONE) {
+                return 0;
+            }
+            node = snzi_parent[node];
+            if (node == SNZI_NO_NODE) {
+                return 1;
+            }
+        }
+    } while (1);
+} /*}}}*/
+
+/* Finds a leaf with something left to depart from, looking first at the
+ * given one, then at the rest of its parent's subtree, and so on up: so the
+ * nearest shepherds are tried first, and empty subtrees are skipped whole. */
+static size_t qt_sinc_snzi_find_leaf(qt_sinc_cache_count_t *restrict counts,
+                                     size_t                          leaf)
+{   /*{{{*/
+    size_t node = leaf;
+    size_t from = SNZI_NO_NODE;
+
+    do {
+        if (counts[node].c >= SNZI_ONE) {
+            size_t n    = node;
+            size_t skip = from;
+            while (n >= num_sheps) {
+                size_t next = SNZI_NO_NODE;
+                for (size_t k = snzi_first_kid[n]; k < snzi_first_kid[n + 1]; k++) {
+                    if ((snzi_kids[k] != skip) && (counts[snzi_kids[k]].c >= SNZI_ONE)) {
+                        next = snzi_kids[k];
+                        break;
+                    }
+                }
+                if (next == SNZI_NO_NODE) { break; }
+                n    = next;
+                skip = SNZI_NO_NODE;
+            }
+            if ((n < num_sheps) && (counts[n].c >= SNZI_ONE)) {
+                return n;
+            }
+        }
+        from = node;
+        node = snzi_parent[node];
+    } while (node != SNZI_NO_NODE);
+    return SNZI_NO_NODE;
+} /*}}}*/
 
 /* Adds a new participant to the sinc.
  * Pre:  sinc was created
@@ -281,33 +525,12 @@ void qt_sinc_expect(qt_sinc_t *sinc_,
     qt_internal_sinc_t *const restrict sinc = (qt_internal_sinc_t *)sinc_;
     qt_sinc_snzi_t *const restrict     snzi = sinc->snzi;
     if (count > 0) {
-        const size_t shep_id = qthread_shep();
-        aligned_t   *C       = &snzi->counts[shep_id].c;
-        int          succ    = 0;
-        int          undoArr = 0;
-
-        // Increment count
-        do {
-            aligned_t c = *C;
-            if ((c >= SNZI_ONE) && (qthread_cas(C, c, c + count) == c)) {
-                succ = 1;
-            }
-            if ((c == 0) && (qthread_cas(C, 0, SNZI_HALF) == 0)) {
-                succ = 1;
-                c    = SNZI_HALF;
-            }
-            if (c == SNZI_HALF) {
-                qthread_incr(&snzi->remaining, 1);
-                if (qthread_cas(C, SNZI_HALF, count + 1) != SNZI_HALF) {
-                    undoArr--;
-                } else {
-                    succ = 1;
-                }
-            }
-            COMPILER_FENCE;
-        } while (!succ);
-        if (undoArr != 0) {
-            qthread_incr(&snzi->remaining, undoArr);
+        size_t shep_id = qthread_shep();
+
+        if (shep_id >= num_sheps) { shep_id = 0; }
+        if (qt_sinc_snzi_arrive(snzi->counts, shep_id, count)) {
+            // the sinc had been satisfied; waiters must block again
+            qthread_empty(&sinc->ready);
         }
     }
 }
@@ -349,8 +572,8 @@ static void qt_sinc_internal_collate(qt_sinc_t *sinc_)
     qthread_fill(&sinc->ready);
 }
 
-void qt_sinc_submit(qt_sinc_t *restrict sinc_,
-                    void *restrict      value)
+void qt_sinc_submit(qt_sinc_t *restrict  sinc_,
+                    const void *restrict value)
 {
     assert(sinc_);
     qt_internal_sinc_t *const restrict sinc    = (qt_internal_sinc_t *)sinc_;
@@ -379,36 +602,24 @@ void qt_sinc_submit(qt_sinc_t *restrict sinc_,
     qt_sinc_snzi_t *const restrict snzi = sinc->snzi;
     assert(snzi->counts);
 
+    if (shep_id >= num_sheps) { shep_id = 0; }
     do {
-        aligned_t x = snzi->counts[shep_id].c;
-        aligned_t y;
-        while (snzi->counts[shep_id].c == 0) {
-            shep_id++;
-            shep_id *= (shep_id < num_sheps);
-        }
-        if (x > SNZI_ONE) {
-            y = x - 1;
-        } else if (x == SNZI_ONE) {
-            y = 0;
-        } else {
-            // shep_id has insufficient counts
-            continue;
-        }
-        // printf("depart c=%i (%i)\n", (int)x, (int)(count_offset));
-        assert(x >= SNZI_ONE);  // search for a good shep_id?
-        if (qthread_cas(&snzi->counts[shep_id].c, x, y) == x) {
-            if (x == SNZI_ONE) {
-                x = snzi->remaining;
-                // printf("snzi_depart x = %i (%p)\n", (int)x, snzi);
-                assert(x >= 1);
-                if (qthread_incr(&snzi->remaining, -1) == 1) {
+        const size_t leaf = qt_sinc_snzi_find_leaf(snzi->counts, shep_id);
+
+        if (leaf != SNZI_NO_NODE) {
+            aligned_t *C = &snzi->counts[leaf].c;
+            aligned_t  x = *C;
+
+            if ((x >= SNZI_ONE) && (qthread_cas(C, x, x - 1 - (x == SNZI_ONE)) == x)) {
+                if ((x == SNZI_ONE) && ((snzi_parent[leaf] == SNZI_NO_NODE) ||
+                                        qt_sinc_snzi_depart(snzi->counts, snzi_parent[leaf]))) {
                     qt_sinc_internal_collate(sinc_);
-                    return;
                 }
-                // printf("            x = %i (%p)\n", (int)x, snzi);
+                return;
             }
-            // qthread_cas(&snzi->remaining, x, x-1);
-            return;
+        } else {
+            // the counts are on their way up from a concurrent expect
+            SPINLOCK_BODY();
         }
     } while (1);
 }
@@ -77,11 +77,9 @@ extern aligned_t *febs_stripes;
 extern QTHREAD_FASTLOCK_TYPE *febs_stripes_locks;
 # endif
 #endif
-extern unsigned int QTHREAD_LOCKING_STRIPES;
 
 /* Internal Macros */
 #define BUILD_UNLOCKED_SYNCVAR(data, state) (((data) << 4) | ((state) << 1))
-#define QTHREAD_CHOOSE_STRIPE(addr)         (((size_t)addr >> 4) & (QTHREAD_LOCKING_STRIPES - 1))
 
 #if (QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64)
 # define UNLOCK_THIS_UNMODIFIED_SYNCVAR(addr, unlocked) do { \
@@ -1541,17 +1539,9 @@ static filter_code qt_syncvar_tf_call_cb(const qt_key_t            addr,
     void                 *tls;
 
     if (waiter->rdata->tasklocal_size <= qlib->qthread_tasklocal_size) {
-        if (waiter->flags & QTHREAD_BIG_STRUCT) {
-            tls = &waiter->data[qlib->qthread_argcopy_size];
-        } else {
-            tls = waiter->data;
-        }
+        tls = QTHREAD_TASKLOCAL_DATA(waiter);
     } else {
-        if (waiter->flags & QTHREAD_BIG_STRUCT) {
-            tls = *(void **)&waiter->data[qlib->qthread_argcopy_size];
-        } else {
-            tls = *(void **)&waiter->data[0];
-        }
+        tls = *(void **)QTHREAD_TASKLOCAL_DATA(waiter);
     }
     f((void *)addr, waiter->f, waiter->arg, waiter->ret, waiter->thread_id, tls, f_arg);
     return IGNORE_AND_CONTINUE;
@@ -4,6 +4,7 @@
 
 /* System Headers */
 #include <qthread/qthread-int.h> /* for uint64_t */
+#include <errno.h>
 
 #ifdef HAVE_SYS_SYSCALL_H
 # include <unistd.h>
@@ -41,6 +42,7 @@ int qt_poll(struct pollfd fds[],
     me->thread_state        = QTHREAD_STATE_SYSCALL;
     qthread_back_to_master(me);
     ret = job->ret;
+    if (ret < 0) { errno = job->err; }
     FREE_SYSCALLJOB(job);
     return ret;
 }
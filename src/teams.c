@@ -21,6 +21,9 @@
 #include "qt_asserts.h"
 #include "qt_subsystems.h"
 #include "qt_debug.h"
+#ifdef QTHREAD_USE_EUREKAS
+# include "qt_eurekas.h"
+#endif
 
 /* Memory management macros */
 #if defined(UNPOOLED)
@@ -182,7 +185,7 @@ static void qt_team_profile(void)
             (unsigned long)(qlib->team_leader_start -
                             qlib->team_leader_stop));
 
-    fprintf(stderr, "\nWatchers:\n");
+    fprintf(stderr, "\nWatchers (eureka deliveries):\n");
     fprintf(stderr, "%8lu watcher_start\n",
             (unsigned long)qlib->team_watcher_start);
     fprintf(stderr, "%8lu watcher_stop\n",
@@ -198,6 +201,109 @@ static void qt_team_profile(void)
 
 #endif /* ifdef TEAM_PROFILE */
 
+#ifdef QTHREAD_USE_EUREKAS
+static void qt_team_lock_subteams(qt_team_t *team)
+{   /*{{{*/
+    do {
+        while (team->subteams_lock != 0) SPINLOCK_BODY();
+    } while (qthread_cas(&team->subteams_lock, 0, 1) != 0);
+} /*}}}*/
+
+static void qt_team_unlock_subteams(qt_team_t *team)
+{   /*{{{*/
+    MACHINE_FENCE;
+    team->subteams_lock = 0;
+} /*}}}*/
+
+static void qt_team_link(qt_team_t *team,
+                         qt_team_t *parent)
+{   /*{{{*/
+    team->parent       = parent;
+    team->prev_subteam = NULL;
+    qt_eureka_disable();
+    qt_team_lock_subteams(parent);
+    team->next_subteam = parent->subteams;
+    if (parent->subteams) {
+        parent->subteams->prev_subteam = team;
+    }
+    parent->subteams = team;
+    qt_team_unlock_subteams(parent);
+    qt_eureka_check(0);
+} /*}}}*/
+
+static void qt_team_unlink(qt_team_t *team)
+{   /*{{{*/
+    qt_team_t *parent = team->parent;
+
+    assert(parent);
+    qt_eureka_disable();
+    qt_team_lock_subteams(parent);
+    if (team->prev_subteam) {
+        team->prev_subteam->next_subteam = team->next_subteam;
+    } else {
+        parent->subteams = team->next_subteam;
+    }
+    if (team->next_subteam) {
+        team->next_subteam->prev_subteam = team->prev_subteam;
+    }
+    qt_team_unlock_subteams(parent);
+    qt_eureka_check(0);
+    team->parent = NULL;
+} /*}}}*/
+
+/* Runs inside a subteam to carry a eureka down from the parent team: it
+ * repeats the eureka there, which makes it the subteam's leader. */
+static aligned_t qt_team_eureka_delivery(void *arg)
+{   /*{{{*/
+    qt_team_t *team = (qt_team_t *)arg;
+    qthread_t *self = qthread_internal_self();
+
+    assert(self->team == team);
+#ifdef TEAM_PROFILE
+    qthread_incr(&qlib->team_watcher_start, 1);
+#endif
+    qthread_debug(TEAM_DETAILS, "tid %u delivering a eureka from team %u to team %u\n", qthread_id(), team->parent_id, team->team_id);
+    qt_team_eureka();
+
+    // From here on this is an ordinary leader, which the next eureka from
+    // the parent (if any) will replace
+    self->flags       &= ~QTHREAD_TEAM_WATCHER;
+    MACHINE_FENCE;
+    team->eureka_state = QT_TEAM_OPEN;
+#ifdef TEAM_PROFILE
+    qthread_incr(&qlib->team_watcher_stop, 1);
+#endif
+    return 0;
+} /*}}}*/
+
+/* Called by the winner of a eureka in team. Every open subteam gets a task
+ * that carries the eureka into it (and from there, further down). Subteams
+ * that are already closing take no new tasks, but their own subteams may still
+ * be running, so those are visited directly. The caller must keep eurekas
+ * from interrupting this, as it holds the subteam locks. */
+void INTERNAL qt_internal_team_eureka_subteams(qt_team_t *team)
+{   /*{{{*/
+    qt_team_t *sub;
+
+    qt_team_lock_subteams(team);
+    for (sub = team->subteams; sub != NULL; sub = sub->next_subteam) {
+        switch (qthread_cas(&sub->eureka_state, QT_TEAM_OPEN, QT_TEAM_EUREKA)) {
+            case QT_TEAM_OPEN:
+                qassert(qthread_internal_spawn_watcher(qt_team_eureka_delivery, sub, sub), QTHREAD_SUCCESS);
+                break;
+            case QT_TEAM_CLOSING:
+                qt_internal_team_eureka_subteams(sub);
+                break;
+            default:
+                // someone is already on the way
+                break;
+        }
+    }
+    qt_team_unlock_subteams(team);
+} /*}}}*/
+
+#endif /* QTHREAD_USE_EUREKAS */
+
 // This is called in `qthread_wrapper()` immediately after each team task
 // returns.
 void INTERNAL qt_internal_teamfinish(qt_team_t   *team,
@@ -213,7 +319,6 @@ void INTERNAL qt_internal_teamfinish(qt_team_t   *team,
             assert(team->sinc);
             assert(team->subteams_sinc);
             assert(NULL == team->parent_subteams_sinc);
-            assert(NULL == team->parent_eureka);
 
             // Wait for all participants on team sinc after submitting to
             // team sinc for the leader
@@ -229,8 +334,6 @@ void INTERNAL qt_internal_teamfinish(qt_team_t   *team,
             team->sinc = NULL;
             qt_sinc_destroy(team->subteams_sinc);
             team->subteams_sinc = NULL;
-            qthread_debug(FEB_DETAILS, "tid %u killing team %u, filling my own eureka (%p)\n", qthread_id(), team->team_id, &team->eureka);
-            qthread_fill(&team->eureka);
 
             FREE_TEAM(team);
 
@@ -246,11 +349,10 @@ void INTERNAL qt_internal_teamfinish(qt_team_t   *team,
 
             if (QTHREAD_DEFAULT_TEAM_ID == team->parent_id) {
                 // 1.2.1. This is a subteam of the default team
-                assert(NULL == team->parent_eureka);
                 assert(NULL == team->parent_subteams_sinc);
 
                 // Wait for all participants on team sinc after subtmitting
-                // to team sinc - there is no watcher
+                // to team sinc for the leader
                 qt_sinc_submit(team->sinc, NULL);
                 qt_sinc_wait(team->sinc, NULL);
 
@@ -265,28 +367,30 @@ void INTERNAL qt_internal_teamfinish(qt_team_t   *team,
                 team->subteams_sinc = NULL;
             } else {
                 // 1.2.2. This is a subteam of a non-default team
-                assert(team->parent_eureka);
                 assert(team->parent_subteams_sinc);
 
                 // Wait for all participants on team sinc after subtmitting
-                // to team sinc for leader and watcher; reset team sinc
-                // for watcher
-                qt_sinc_submit(team->sinc, NULL);
+                // to team sinc for the leader
                 qt_sinc_submit(team->sinc, NULL);
                 qt_sinc_wait(team->sinc, NULL);
 
+#ifdef QTHREAD_USE_EUREKAS
+                // Shut out the parent's eurekas. If one got in first, the
+                // task delivering it will take over as leader and kill me.
+                if (qthread_cas(&team->eureka_state, QT_TEAM_OPEN,
+                                QT_TEAM_CLOSING) != QT_TEAM_OPEN) {
+                    qthread_debug(TEAM_DETAILS, "tid %u in team %u waiting on a eureka from team %u\n", qthread_id(), team->team_id, team->parent_id);
+                    while (1) qthread_yield();
+                }
+#endif /* QTHREAD_USE_EUREKAS */
+
                 // Wait for all participants on team subteams sinc
                 qt_sinc_submit(team->subteams_sinc, NULL);
                 qt_sinc_wait(team->subteams_sinc, NULL);
 
-                if (team->watcher_started == 0) {
-                    // Signal watcher to exit and wait for it
-                    qt_sinc_reset(team->sinc, 1);
-                    qthread_debug(FEB_DETAILS, "tid %u killing team %u signalling team %u's watcher (%p)\n", qthread_id(), team->team_id, team->parent_id, team->parent_eureka);
-                    qthread_writeEF_const(team->parent_eureka,
-                            TEAM_SIGNAL_EXIT(team->team_id));
-                    qt_sinc_wait(team->sinc, NULL);
-                }
+#ifdef QTHREAD_USE_EUREKAS
+                qt_team_unlink(team);
+#endif /* QTHREAD_USE_EUREKAS */
 
                 // Submit to parent team subteams sinc
                 qt_sinc_submit(team->parent_subteams_sinc, NULL);
@@ -297,13 +401,9 @@ void INTERNAL qt_internal_teamfinish(qt_team_t   *team,
                 qt_sinc_destroy(team->subteams_sinc);
                 team->subteams_sinc = NULL;
 
-                team->parent_eureka        = NULL;
                 team->parent_subteams_sinc = NULL;
             }
 
-            qthread_debug(FEB_DETAILS, "tid %u killing team %u, filling my own eureka (%p)\n", qthread_id(), team->team_id, &team->eureka);
-            qthread_fill(&team->eureka);
-
             FREE_TEAM(team);
 
             qthread_internal_incr(&(qlib->team_count), &qlib->team_count_lock, -1);
@@ -319,7 +419,7 @@ void INTERNAL qt_internal_teamfinish(qt_team_t   *team,
         qthread_incr(&qlib->team_leader_stop, 1);
 #endif
     } else {
-        // 2. This task is not a sub/team leader: a watcher or participant
+        // 2. This task is not a sub/team leader: a participant
         assert(team);
 
         // Submit to the team sinc
@@ -327,88 +427,30 @@ void INTERNAL qt_internal_teamfinish(qt_team_t   *team,
     }
 } /*}}}*/
 
-static aligned_t qt_team_watcher(void *args_)
-{   /*{{{*/
-    aligned_t    code   = 0;
-    unsigned int myteam = qt_team_id();
-
-    qt_team_t *team = (qt_team_t *)args_;
-
-    assert(team);
-    assert(myteam == team->team_id);
-
-    aligned_t *parent_eureka = team->parent_eureka;
-    assert(parent_eureka);
-
-    qthread_debug(FEB_DETAILS, "watcher (tid %u) of team %u filling watcher_started (%p)\n", qthread_id(), myteam, &team->watcher_started);
-    qthread_fill(&team->watcher_started);
-#ifdef TEAM_PROFILE
-    qthread_incr(&qlib->team_watcher_start, 1);
-#endif
-
-    do {
-        qthread_debug(FEB_DETAILS, "team %u's watcher (tid %u) waiting for a eureka or a team exit (%p)\n", myteam, qthread_id(), parent_eureka);
-        qthread_readFF(&code, parent_eureka);
-
-        if (TEAM_SIGNAL_ISEXIT(code)) {
-            if (myteam == TEAM_SIGNAL_SENDERID(code)) {
-                // Reset the FEB and exit
-                qthread_debug(FEB_DETAILS, "team %u's watcher (tid %u) preparing to exit, emptying parent's eureka (%p)\n", myteam, qthread_id(), parent_eureka);
-                qthread_empty(parent_eureka);
-                break;
-            } else {
-                // Yield control of the resource while waiting for FEB to be reset
-                qthread_yield();
-            }
-        } else if (TEAM_SIGNAL_ISEUREKA(code)) {
-            if (myteam == TEAM_SIGNAL_SENDERID(code)) {
-                // I must survive this eureka: I am the waiter, the Beholder!
-                assert("Error: why was the eureka propogated UPWARD?!?" && 0);
-            } else {
-                // I must propogate this eureka: I am the end of all things, and like a Shoggoth, I will sweep my team evilly free of litter
-                qthread_debug(FEB_DETAILS, "team %u's watcher (tid %u) preparing to destroy its team\n", myteam, qthread_id());
-#ifdef QTHREAD_USE_EUREKAS
-                qt_team_eureka();
-#endif /* QTHREAD_USE_EUREKAS */
-                team->watcher_started = 1; // signal that the watcher doesn't need to be killed
-                qthread_empty(parent_eureka);
-                break;
-            }
-        } else {
-            assert("Error: watcher received code 0 or 1" && 0); // not sure what this means
-        }
-    } while (1);
-
-#ifdef TEAM_PROFILE
-    qthread_incr(&qlib->team_watcher_stop, 1);
-#endif
-
-    return 0;
-} /*}}}*/
-
 qt_team_t INTERNAL *qt_internal_team_new(void *restrict      ret,
                                          unsigned int        feature_flag,
                                          qt_team_t *restrict curr_team,
                                          unsigned int        parent_id)
 {   /*{{{*/
-    DEBUG_ONLY(qthread_t * me = qthread_internal_self());
-
     // Allocate new team structure
     qt_team_t *new_team = ALLOC_TEAM();
     assert(new_team);
 
     // Initialize new team values
     new_team->team_id         = qthread_internal_incr(&(qlib->max_team_id), &qlib->max_team_id_lock, 1);
-    new_team->eureka          = QTHREAD_NON_TASK_ID;
-    new_team->eureka_lock     = 0;
-    new_team->watcher_started = 0;
-    new_team->sinc            = qt_sinc_create(0, NULL, NULL, 1);
+    new_team->eureka_lock = 0;
+    new_team->sinc        = qt_sinc_create(0, NULL, NULL, 1);
     assert(new_team->sinc);
     new_team->subteams_sinc = qt_sinc_create(0, NULL, NULL, 1);
     assert(new_team->subteams_sinc);
     new_team->parent_id            = parent_id;
-    new_team->parent_eureka        = NULL;
     new_team->parent_subteams_sinc = NULL;
+#ifdef QTHREAD_USE_EUREKAS
+    new_team->parent        = NULL;
+    new_team->subteams      = NULL;
+    new_team->subteams_lock = 0;
+    new_team->eureka_state  = QT_TEAM_OPEN;
+#endif
     new_team->return_loc           = ret;
     new_team->flags                = feature_flag & QTHREAD_RET_MASK;
 
@@ -416,19 +458,16 @@ qt_team_t INTERNAL *qt_internal_team_new(void *restrict      ret,
         new_team->team_id = qthread_internal_incr(&(qlib->max_team_id), &qlib->max_team_id_lock, 3);
     }
 
-    // Empty new team FEBs
-    qthread_debug(FEB_DETAILS, "tid %i emptying NEW team %u's eureka (%p)\n", me ? ((int)me->thread_id) : -1, new_team->team_id, &new_team->eureka);
-    qthread_empty(&new_team->eureka);
-
     if (curr_team) {
-        new_team->parent_id     = curr_team->team_id;
-        new_team->parent_eureka = &curr_team->eureka;
-        assert(new_team->parent_eureka);
+        new_team->parent_id            = curr_team->team_id;
         new_team->parent_subteams_sinc = curr_team->subteams_sinc;
         assert(new_team->parent_subteams_sinc);
 
         // Notify the parent of the new subteam
         qt_sinc_expect(new_team->parent_subteams_sinc, 1);
+#ifdef QTHREAD_USE_EUREKAS
+        qt_team_link(new_team, curr_team);
+#endif
     }
 
 #ifdef TEAM_PROFILE
@@ -439,12 +478,4 @@ qt_team_t INTERNAL *qt_internal_team_new(void *restrict      ret,
     return new_team;
 } /*}}}*/
 
-void INTERNAL qt_internal_subteam_leader(qthread_t *t)
-{   /*{{{*/
-    qthread_debug(FEB_DETAILS, "tid %u emptying team %u's watcher_started (%p)\n", t->thread_id, t->team->team_id, &t->team->watcher_started);
-    qthread_empty(&t->team->watcher_started);
-    qthread_fork(qt_team_watcher, t->team, NULL);
-    qthread_readFF(NULL, &t->team->watcher_started);
-} /*}}}*/
-
 /* vim:set expandtab: */
@@ -0,0 +1,892 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h> /* for INT_MAX */
+#if defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_SYS_SYSCALL_H) && defined(HAVE_SYSCALL)
+# define QT_PARK_FUTEX 1
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+/* Public Headers */
+#include "qthread/qthread.h"
+#include "qthread/cacheline.h"
+
+/* Internal Headers */
+#include "qt_visibility.h"
+#include "qthread_innards.h"           /* for qlib */
+#include "qt_shepherd_innards.h"
+#include "qt_qthread_struct.h"
+#include "qt_qthread_mgmt.h"
+#include "qt_aligned_alloc.h"
+#include "qt_asserts.h"
+#include "qt_atomics.h"
+#include "qt_threadqueues.h"
+#include "qt_threadqueue_scheduler.h"
+#include "qt_envariables.h"
+#include "qt_debug.h"
+#ifdef QTHREAD_USE_EUREKAS
+#include "qt_eurekas.h" /* for qt_eureka_check() */
+#endif /* QTHREAD_USE_EUREKAS */
+#include "qt_expect.h"
+#include "qt_subsystems.h"
+
+/* This scheduler gives every worker its own Chase-Lev work-stealing deque
+ * (see "Dynamic Circular Work-Stealing Deque", Chase & Lev, SPAA'05, and
+ * "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al.,
+ * PPoPP'13). The owning worker pushes and pops at the bottom without any
+ * atomic read-modify-write (except when taking the very last task); every
+ * other worker, on this shepherd or elsewhere, steals from the top with a
+ * single CAS.
+ *
+ * A shepherd's qt_threadqueue_t is the set of its workers' deques plus an
+ * "inbox": a lock-free stack that receives tasks enqueued by anything that
+ * does not own one of the deques (other shepherds, I/O proxies, external
+ * pthreads, yields). Workers drain their own shepherd's inbox into their
+ * deque once it runs dry. Tasks marked QTHREAD_UNSTEALABLE are tagged in the
+ * deque slot so that thieves from other shepherds leave them alone.
+ *
+ * Idle workers park on their shepherd's queue exactly as in Sherwood: after
+ * QT_SPINCOUNT fruitless polls they sleep on an eventcount, and every enqueue
+ * wakes one of them.
+ */
+
+/* Data Structures */
+struct _qt_threadqueue_node {
+    struct _qt_threadqueue_node *next;
+    qthread_t                   *value;
+} /* qt_threadqueue_node_t */;
+
+typedef struct _qt_cl_array {
+    struct _qt_cl_array *retired;   /* the array this one replaced */
+    long                 mask;      /* size - 1; size is a power of two */
+    uintptr_t            slots[];   /* tagged qthread_t pointers */
+} qt_cl_array_t;
+
+typedef struct {
+    volatile long           top;
+    uint8_t                 pad1[CACHELINE_WIDTH - sizeof(long)];
+    volatile long           bottom;
+    qt_cl_array_t *volatile array;
+    uint8_t                 pad2[CACHELINE_WIDTH - sizeof(long) - sizeof(void *)];
+} qt_cl_deque_t;
+
+struct _qt_threadqueue {
+    qt_cl_deque_t                  *deques;   /* one per worker of the owning shepherd */
+    qt_threadqueue_node_t *volatile inbox;
+    qthread_t *volatile             mccoy;    /* only ever set on shepherd 0 */
+    saligned_t                      inbox_len;
+    /* Idle workers park here once they exhaust their spin budget */
+    aligned_t                       parked;     /* number of workers asleep on this queue */
+    uint32_t                        park_epoch; /* eventcount; bumped on every wakeup */
+#ifndef QT_PARK_FUTEX
+    QTHREAD_COND_DECL(park_trigger);
+#endif
+#ifdef STEAL_PROFILE
+    aligned_t steal_amount_stolen;
+#endif
+} /* qt_threadqueue_t */;
+
+#define CL_INITIAL_SIZE 256
+#define CL_UNSTEALABLE  ((uintptr_t)1)
+#define CL_EMPTY        ((qthread_t *)NULL)
+#define CL_ABORT        ((qthread_t *)1)
+
+/* Owner-side publication (push) and thief-side reads only need to be ordered
+ * by the compiler on TSO machines; elsewhere they need a real fence. The
+ * store->load ordering in pop and steal always needs a real fence. */
+#if ((QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) || \
+    (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA32))
+# define CL_RELEASE_FENCE COMPILER_FENCE
+# define CL_ACQUIRE_FENCE COMPILER_FENCE
+#else
+# define CL_RELEASE_FENCE MACHINE_FENCE
+# define CL_ACQUIRE_FENCE MACHINE_FENCE
+#endif
+
+static aligned_t     steal_disable  = 0;
+static unsigned long spin_count     = 0; /* spins before parking; 0 means never park */
+static aligned_t     parked_workers = 0; /* total across all queues */
+
+#ifdef STEAL_PROFILE
+# define STEAL_CALLED(shep)     qthread_incr( & ((shep)->steal_called), 1)
+# define STEAL_ATTEMPTED(shep)  qthread_incr( & ((shep)->steal_attempted), 1)
+# define STEAL_FAILED(shep)     qthread_incr( & ((shep)->steal_failed), 1)
+# define STEAL_AMOUNT(q, ct)    qthread_incr( & ((q)->steal_amount_stolen), ct)
+# define PARK_COUNT(shep)       qthread_incr( & ((shep)->park_count), 1)
+#else
+# define STEAL_CALLED(shep)     do {} while(0)
+# define STEAL_ATTEMPTED(shep)  do {} while(0)
+# define STEAL_FAILED(shep)     do {} while(0)
+# define STEAL_AMOUNT(q, ct)    do {} while(0)
+# define PARK_COUNT(shep)       do {} while(0)
+#endif /* ifdef STEAL_PROFILE */
+
+static void qt_threadqueue_read_env(void)
+{   /*{{{*/
+    spin_count = qt_internal_get_env_num("SPINCOUNT", 300000, 0);
+} /*}}}*/
+
+/* Memory Management */
+#if defined(UNPOOLED_QUEUES) || defined(UNPOOLED)
+# define ALLOC_THREADQUEUE() (qt_threadqueue_t *)MALLOC(sizeof(qt_threadqueue_t))
+# define FREE_THREADQUEUE(t) FREE(t, sizeof(qt_threadqueue_t))
+# define ALLOC_TQNODE()      (qt_threadqueue_node_t *)MALLOC(sizeof(qt_threadqueue_node_t))
+# define FREE_TQNODE(t)      FREE(t, sizeof(qt_threadqueue_node_t))
+void INTERNAL qt_threadqueue_subsystem_init(void)
+{   /*{{{*/
+    qt_threadqueue_read_env();
+} /*}}}*/
+#else /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
+qt_threadqueue_pools_t generic_threadqueue_pools = { NULL, NULL };
+# define ALLOC_THREADQUEUE() (qt_threadqueue_t *)qt_mpool_alloc(generic_threadqueue_pools.queues)
+# define FREE_THREADQUEUE(t) qt_mpool_free(generic_threadqueue_pools.queues, t)
+# define ALLOC_TQNODE()      (qt_threadqueue_node_t *)qt_mpool_alloc(generic_threadqueue_pools.nodes)
+# define FREE_TQNODE(t)      qt_mpool_free(generic_threadqueue_pools.nodes, t)
+
+static void qt_threadqueue_subsystem_shutdown(void)
+{   /*{{{*/
+    qt_mpool_destroy(generic_threadqueue_pools.queues);
+    qt_mpool_destroy(generic_threadqueue_pools.nodes);
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_subsystem_init(void)
+{   /*{{{*/
+    generic_threadqueue_pools.queues = qt_mpool_create(sizeof(qt_threadqueue_t));
+    generic_threadqueue_pools.nodes  = qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t), sizeof(void *));
+    qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
+    qt_threadqueue_read_env();
+} /*}}}*/
+#endif /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
+
+/*****************************************/
+/* the Chase-Lev deque itself            */
+/*****************************************/
+
+static qt_cl_array_t *qt_cl_array_new(long size)
+{   /*{{{*/
+    qt_cl_array_t *a = MALLOC(sizeof(qt_cl_array_t) + size * sizeof(uintptr_t));
+
+    assert(a);
+    assert((size & (size - 1)) == 0);
+    a->retired = NULL;
+    a->mask    = size - 1;
+    return a;
+} /*}}}*/
+
+static QINLINE uintptr_t qt_cl_tag(qthread_t *t)
+{   /*{{{*/
+    assert(((uintptr_t)t & CL_UNSTEALABLE) == 0);
+    return (uintptr_t)t |
+           ((t->flags & (QTHREAD_UNSTEALABLE | QTHREAD_REAL_MCCOY)) ? CL_UNSTEALABLE : 0);
+} /*}}}*/
+
+static QINLINE qthread_t *qt_cl_untag(uintptr_t slot)
+{   /*{{{*/
+    return (qthread_t *)(slot & ~CL_UNSTEALABLE);
+} /*}}}*/
+
+/* Only the owner may grow the array. Thieves may still be reading the old
+ * one, so it is kept (chained off the new one) until the queue is freed. */
+static qt_cl_array_t *qt_cl_grow(qt_cl_deque_t *d,
+                                 qt_cl_array_t *a,
+                                 long           b,
+                                 long           t)
+{   /*{{{*/
+    qt_cl_array_t *n = qt_cl_array_new((a->mask + 1) * 2);
+    long           i;
+
+    for (i = t; i < b; i++) {
+        n->slots[i & n->mask] = a->slots[i & a->mask];
+    }
+    n->retired = a;
+    CL_RELEASE_FENCE;
+    d->array = n;
+    return n;
+} /*}}}*/
+
+static QINLINE void qt_cl_push(qt_cl_deque_t *d,
+                               qthread_t     *x)
+{   /*{{{*/
+    long const     b = d->bottom;
+    long const     t = d->top;
+    qt_cl_array_t *a = d->array;
+
+    if (QTHREAD_UNLIKELY(b - t > a->mask)) {
+        a = qt_cl_grow(d, a, b, t);
+    }
+    a->slots[b & a->mask] = qt_cl_tag(x);
+    CL_RELEASE_FENCE;
+    d->bottom = b + 1;
+} /*}}}*/
+
+static QINLINE void qt_cl_push_many(qt_cl_deque_t    *d,
+                                    qthread_t *const *x,
+                                    size_t            n)
+{   /*{{{*/
+    long const     b = d->bottom;
+    long const     t = d->top;
+    qt_cl_array_t *a = d->array;
+
+    while (QTHREAD_UNLIKELY(b - t + (long)n > a->mask + 1)) {
+        a = qt_cl_grow(d, a, b, t);
+    }
+    for (size_t i = 0; i < n; i++) {
+        a->slots[(b + (long)i) & a->mask] = qt_cl_tag(x[i]);
+    }
+    CL_RELEASE_FENCE;
+    d->bottom = b + (long)n;
+} /*}}}*/
+
+static QINLINE qthread_t *qt_cl_pop(qt_cl_deque_t *d)
+{   /*{{{*/
+    long const     b = d->bottom - 1;
+    qt_cl_array_t *a = d->array;
+    long           t;
+    qthread_t     *x = CL_EMPTY;
+
+    d->bottom = b;
+    MACHINE_FENCE;
+    t = d->top;
+    if (t <= b) {
+        x = qt_cl_untag(a->slots[b & a->mask]);
+        if (t == b) {
+            /* last one: race the thieves for it */
+            if (qthread_cas(&d->top, t, t + 1) != t) {
+                x = CL_EMPTY;
+            }
+            d->bottom = b + 1;
+        }
+    } else {
+        d->bottom = b + 1;
+    }
+    return x;
+} /*}}}*/
+
+/* Returns CL_EMPTY if there was nothing to take (or only an unstealable task
+ * and the thief is foreign), and CL_ABORT if it lost a race. */
+static QINLINE qthread_t *qt_cl_steal(qt_cl_deque_t *d,
+                                      int            foreign)
+{   /*{{{*/
+    long const t = d->top;
+    long       b;
+
+    MACHINE_FENCE;
+    b = d->bottom;
+    if (t < b) {
+        qt_cl_array_t *a;
+        uintptr_t      slot;
+
+        CL_ACQUIRE_FENCE;
+        a    = d->array;
+        slot = a->slots[t & a->mask];
+        if (foreign && (slot & CL_UNSTEALABLE)) {
+            return CL_EMPTY;
+        }
+        if (qthread_cas(&d->top, t, t + 1) != t) {
+            return CL_ABORT;
+        }
+        return qt_cl_untag(slot);
+    }
+    return CL_EMPTY;
+} /*}}}*/
+
+static QINLINE long qt_cl_size(qt_cl_deque_t *d)
+{   /*{{{*/
+    long const s = d->bottom - d->top;
+
+    return (s > 0) ? s : 0;
+} /*}}}*/
+
+/*****************************************/
+/* functions to manage the thread queues */
+/*****************************************/
+
+/* The deque the calling worker owns in q, or NULL if it owns none. */
+static QINLINE qt_cl_deque_t *qt_threadqueue_mydeque(qt_threadqueue_t *q)
+{   /*{{{*/
+    qthread_worker_t *w = qthread_internal_getworker();
+
+    if ((w != NULL) && (w->shepherd->ready == q)) {
+        return &q->deques[w->worker_id];
+    }
+    return NULL;
+} /*}}}*/
+
+static QINLINE void qt_threadqueue_inbox_push(qt_threadqueue_t *q,
+                                              qthread_t        *t)
+{   /*{{{*/
+    qt_threadqueue_node_t *node = ALLOC_TQNODE();
+    qt_threadqueue_node_t *old;
+
+    assert(node != NULL);
+    node->value = t;
+    old         = q->inbox;
+    do {
+        qt_threadqueue_node_t *seen;
+        node->next = old;
+        seen       = qthread_cas_ptr(&q->inbox, old, node);
+        if (seen == old) { break; }
+        old = seen;
+    } while (1);
+    (void)qthread_incr(&q->inbox_len, 1);
+} /*}}}*/
+
+/* Takes the whole inbox (newest first); no ABA since nobody pops singly. */
+static QINLINE qt_threadqueue_node_t *qt_threadqueue_inbox_take(qt_threadqueue_t *q)
+{   /*{{{*/
+    qt_threadqueue_node_t *list = q->inbox;
+
+    if (list == NULL) { return NULL; }
+    do {
+        qt_threadqueue_node_t *seen = qthread_cas_ptr(&q->inbox, list, NULL);
+        if (seen == list) { break; }
+        list = seen;
+    } while (list != NULL);
+    return list;
+} /*}}}*/
+
+/* Moves the inbox into d and returns its oldest task, which is the next one
+ * that should run. */
+static qthread_t *qt_threadqueue_inbox_drain(qt_threadqueue_t *q,
+                                             qt_cl_deque_t    *d)
+{   /*{{{*/
+    qt_threadqueue_node_t *node = qt_threadqueue_inbox_take(q);
+    qthread_t             *t    = NULL;
+    saligned_t             ct   = 0;
+
+    while (node) {
+        qt_threadqueue_node_t *next = node->next;
+        if (next == NULL) {
+            t = node->value;
+        } else {
+            qt_cl_push(d, node->value);
+        }
+        FREE_TQNODE(node);
+        node = next;
+        ct++;
+    }
+    if (ct) {
+        (void)qthread_incr(&q->inbox_len, -ct);
+    }
+    return t;
+} /*}}}*/
+
+/* Pull every task out of q (including unstealable ones) into a private list,
+ * oldest first. Tasks popped concurrently by their owners are simply not
+ * seen, exactly as if they had been dequeued a moment earlier. */
+static qt_threadqueue_node_t *qt_threadqueue_take_all(qt_threadqueue_t *q)
+{   /*{{{*/
+    qt_threadqueue_node_t  *list = NULL;
+    qt_threadqueue_node_t **tail = &list;
+    qt_threadqueue_node_t  *inbox;
+    qthread_worker_id_t     i;
+
+    for (i = 0; i < qlib->nworkerspershep; i++) {
+        qt_cl_deque_t *d  = &q->deques[i];
+        long           ct = qt_cl_size(d);
+        while (ct > 0) {
+            qthread_t *t = qt_cl_steal(d, 0);
+            if (t == CL_ABORT) { continue; }
+            if (t == CL_EMPTY) { break; }
+            *tail          = ALLOC_TQNODE();
+            (*tail)->value = t;
+            tail           = &(*tail)->next;
+            ct--;
+        }
+    }
+    *tail = NULL;
+    /* the inbox is newest-first; reverse it onto the end */
+    inbox = qt_threadqueue_inbox_take(q);
+    if (inbox) {
+        qt_threadqueue_node_t *rev = NULL;
+        saligned_t             ct  = 0;
+        while (inbox) {
+            qt_threadqueue_node_t *next = inbox->next;
+            inbox->next = rev;
+            rev         = inbox;
+            inbox       = next;
+            ct++;
+        }
+        *tail = rev;
+        (void)qthread_incr(&q->inbox_len, -ct);
+    }
+    return list;
+} /*}}}*/
+
+ssize_t INTERNAL qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q)
+{   /*{{{*/
+    ssize_t             len = q->inbox_len;
+    qthread_worker_id_t i;
+
+    for (i = 0; i < qlib->nworkerspershep; i++) {
+        len += qt_cl_size(&q->deques[i]);
+    }
+    return (len > 0) ? len : 0;
+} /*}}}*/
+
+/*****************************************/
+/* idle worker parking                   */
+/*****************************************/
+
+#define QT_PARK_DUE(spins) (spin_count && ((spins) >= spin_count))
+
+static QINLINE void qt_threadqueue_signal(qt_threadqueue_t *q,
+                                          int               nwaiters)
+{   /*{{{*/
+    (void)qthread_incr(&q->park_epoch, 1);
+#ifdef QT_PARK_FUTEX
+    syscall(SYS_futex, &q->park_epoch, FUTEX_WAKE_PRIVATE, nwaiters, NULL, NULL, 0);
+#else
+    QTHREAD_COND_LOCK(q->park_trigger);
+    if (nwaiters == 1) {
+        QTHREAD_COND_SIGNAL(q->park_trigger);
+    } else {
+        QTHREAD_COND_BCAST(q->park_trigger);
+    }
+    QTHREAD_COND_UNLOCK(q->park_trigger);
+#endif /* ifdef QT_PARK_FUTEX */
+} /*}}}*/
+
+/* Called after work has been made visible on q. Wakes one parked worker: one
+ * sleeping on q itself if possible, otherwise, if the work went into a deque
+ * where other shepherds can steal it, the nearest parked worker elsewhere. */
+static QINLINE void qt_threadqueue_wake_one(qt_threadqueue_t *q,
+                                            int               stealable)
+{   /*{{{*/
+    if (spin_count == 0) { return; }
+    /* pairs with the increments in qt_threadqueue_park() */
+    MACHINE_FENCE;
+    if (QTHREAD_LIKELY(parked_workers == 0)) { return; }
+
+    if (q->parked) {
+        qt_threadqueue_signal(q, 1);
+    } else if (stealable && !steal_disable && (qlib->nshepherds > 1)) {
+        qthread_shepherd_t *const          owner  = qthread_internal_getshep();
+        qthread_shepherd_id_t const *const sorted = owner ? owner->sorted_sheplist : NULL;
+        qthread_shepherd_id_t const        limit  = sorted ? (qlib->nshepherds - 1) : qlib->nshepherds;
+        qthread_shepherd_id_t              i;
+
+        for (i = 0; i < limit; i++) {
+            qt_threadqueue_t *v = qlib->shepherds[sorted ? sorted[i] : i].ready;
+            if (v->parked) {
+                qt_threadqueue_signal(v, 1);
+                return;
+            }
+        }
+    }
+} /*}}}*/
+
+static QINLINE int qt_threadqueue_work_available(qthread_worker_t *me,
+                                                 uint_fast8_t      active)
+{   /*{{{*/
+    qt_threadqueue_t *const q = me->shepherd->ready;
+
+    if ((me->packed_worker_id == 0) && q->mccoy) { return 1; }
+    if (q->inbox != NULL) { return 1; }
+    if (qt_threadqueue_advisory_queuelen(q) > 0) { return 1; }
+    if (active && !steal_disable && (qlib->nshepherds > 1)) {
+        qthread_shepherd_id_t i;
+        for (i = 0; i < qlib->nshepherds; i++) {
+            qt_threadqueue_t *v = qlib->shepherds[i].ready;
+            if (qt_threadqueue_advisory_queuelen(v) - v->inbox_len > 0) { return 1; }
+        }
+    }
+    return 0;
+} /*}}}*/
+
+/* Block the calling worker on its shepherd's queue until an enqueue wakes it
+ * (or until it notices work while registering itself as parked). */
+static void qt_threadqueue_park(qthread_worker_t *me,
+                                uint_fast8_t      active)
+{   /*{{{*/
+    qt_threadqueue_t *q = me->shepherd->ready;
+    uint32_t          key;
+
+    key = q->park_epoch;
+    (void)qthread_incr(&q->parked, 1);
+    (void)qthread_incr(&parked_workers, 1);
+    if (!qt_threadqueue_work_available(me, active)) {
+        PARK_COUNT(me->shepherd);
+        qthread_debug(THREADQUEUE_DETAILS, "shep(%u): parking on q(%p)\n", me->shepherd->shepherd_id, q);
+#ifdef QT_PARK_FUTEX
+        syscall(SYS_futex, &q->park_epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+#else
+        QTHREAD_COND_LOCK(q->park_trigger);
+        if (q->park_epoch == key) {
+            QTHREAD_COND_WAIT(q->park_trigger);
+        }
+        QTHREAD_COND_UNLOCK(q->park_trigger);
+#endif /* ifdef QT_PARK_FUTEX */
+    }
+    (void)qthread_incr(&parked_workers, -1);
+    (void)qthread_incr(&q->parked, -1);
+} /*}}}*/
+
+qt_threadqueue_t INTERNAL *qt_threadqueue_new(void)
+{   /*{{{*/
+    qt_threadqueue_t *q = ALLOC_THREADQUEUE();
+
+    qassert_ret(q != NULL, NULL);
+
+    q->deques = qthread_internal_aligned_alloc(qlib->nworkerspershep * sizeof(qt_cl_deque_t),
+                                               CACHELINE_WIDTH);
+    qassert_ret(q->deques != NULL, NULL);
+    for (qthread_worker_id_t i = 0; i < qlib->nworkerspershep; i++) {
+        q->deques[i].top    = 0;
+        q->deques[i].bottom = 0;
+        q->deques[i].array  = qt_cl_array_new(CL_INITIAL_SIZE);
+    }
+    q->inbox     = NULL;
+    q->mccoy     = NULL;
+    q->inbox_len = 0;
+    q->parked     = 0;
+    q->park_epoch = 0;
+#ifndef QT_PARK_FUTEX
+    QTHREAD_COND_INIT(q->park_trigger);
+#endif
+#ifdef STEAL_PROFILE
+    q->steal_amount_stolen = 0;
+#endif
+
+    return q;
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_free(qt_threadqueue_t *q)
+{   /*{{{*/
+    qt_threadqueue_node_t *node = qt_threadqueue_take_all(q);
+    qthread_worker_id_t    i;
+
+    while (node) {
+        qt_threadqueue_node_t *next = node->next;
+        qthread_thread_free(node->value);
+        FREE_TQNODE(node);
+        node = next;
+    }
+    for (i = 0; i < qlib->nworkerspershep; i++) {
+        qt_cl_array_t *a = q->deques[i].array;
+        while (a) {
+            qt_cl_array_t *r = a->retired;
+            FREE(a, sizeof(qt_cl_array_t) + (a->mask + 1) * sizeof(uintptr_t));
+            a = r;
+        }
+    }
+    qthread_internal_aligned_free(q->deques, CACHELINE_WIDTH);
+    assert(q->parked == 0);
+#ifndef QT_PARK_FUTEX
+    QTHREAD_COND_DESTROY(q->park_trigger);
+#endif
+    FREE_THREADQUEUE(q);
+} /*}}}*/
+
+#ifdef QTHREAD_USE_SPAWNCACHE
+/* The owner's deque already is an uncontended private queue, so the spawn
+ * cache is not used. */
+qthread_t INTERNAL *qt_threadqueue_private_dequeue(qt_threadqueue_private_t *c)
+{   /*{{{*/
+    return NULL;
+} /*}}}*/
+
+int INTERNAL qt_threadqueue_private_enqueue(qt_threadqueue_private_t *restrict pq,
+                                            qt_threadqueue_t *restrict         q,
+                                            qthread_t *restrict                t)
+{   /*{{{*/
+    return 0;
+} /*}}}*/
+
+int INTERNAL qt_threadqueue_private_enqueue_yielded(qt_threadqueue_private_t *restrict q,
+                                                    qthread_t *restrict                t)
+{   /*{{{*/
+    return 0;
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_enqueue_cache(qt_threadqueue_t         *q,
+                                           qt_threadqueue_private_t *cache)
+{}
+
+void INTERNAL qt_threadqueue_private_filter(qt_threadqueue_private_t *restrict c,
+                                            qt_threadqueue_filter_f            f)
+{}
+#endif /* ifdef QTHREAD_USE_SPAWNCACHE */
+
+void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
+                                     qthread_t *restrict        t)
+{   /*{{{*/
+    qt_cl_deque_t *d;
+
+    assert(q != NULL);
+    assert(t != NULL);
+
+    qthread_debug(THREADQUEUE_CALLS, "q(%p), t(%p->%u)\n", q, t, t->thread_id);
+    if (QTHREAD_UNLIKELY(t->flags & QTHREAD_REAL_MCCOY)) {
+        /* McCoy thread can only run on worker 0 of shepherd 0 */
+        assert(qlib->shepherds[0].ready->mccoy == NULL);
+        qlib->shepherds[0].ready->mccoy = t;
+        MACHINE_FENCE;
+        if (qlib->shepherds[0].ready->parked) {
+            /* worker 0 may be asleep; make sure it gets it */
+            qt_threadqueue_signal(qlib->shepherds[0].ready, INT_MAX);
+        }
+        return;
+    }
+    d = qt_threadqueue_mydeque(q);
+    if (d) {
+        qt_cl_push(d, t);
+        qt_threadqueue_wake_one(q, !(t->flags & QTHREAD_UNSTEALABLE));
+    } else {
+        qt_threadqueue_inbox_push(q, t);
+        qt_threadqueue_wake_one(q, 0);
+    }
+} /*}}}*/
+
+/* The owner can write a whole batch into its deque and publish it to thieves
+ * with one store to bottom; anyone else goes through the inbox. */
+void INTERNAL qt_threadqueue_enqueue_many(qt_threadqueue_t *restrict q,
+                                          qthread_t *const          *t,
+                                          size_t                     n)
+{   /*{{{*/
+    qt_cl_deque_t *d         = qt_threadqueue_mydeque(q);
+    int            stealable = 0;
+
+    assert(q != NULL);
+    if (n == 0) { return; }
+    if (d == NULL) {
+        qt_threadqueue_enqueue_each(q, t, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        assert(t[i] != NULL);
+        assert(!(t[i]->flags & QTHREAD_REAL_MCCOY));
+        stealable |= !(t[i]->flags & QTHREAD_UNSTEALABLE);
+    }
+    qt_cl_push_many(d, t, n);
+    qt_threadqueue_wake_one(q, stealable);
+} /*}}}*/
+
+/* yielded threads go to the inbox, which is only consulted once the worker's
+ * own deque is empty; this includes the McCoy thread, which would otherwise
+ * starve everything else on worker 0 while it yields in a loop */
+void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
+                                             qthread_t *restrict        t)
+{   /*{{{*/
+    assert(q != NULL);
+    assert(t != NULL);
+
+    qt_threadqueue_inbox_push(q, t);
+    qt_threadqueue_wake_one(q, 0);
+} /*}}}*/
+
+/* Try to steal one task from each of shep's deques in turn, starting after
+ * `start` so that siblings spread out over each other's deques. */
+static QINLINE qthread_t *qt_threadqueue_steal_from(qthread_shepherd_t *victim,
+                                                    qthread_worker_id_t start,
+                                                    int                 foreign)
+{   /*{{{*/
+    qt_threadqueue_t *const   vq = victim->ready;
+    qthread_worker_id_t const n  = qlib->nworkerspershep;
+    qthread_worker_id_t       i;
+
+    for (i = 1; i <= n; i++) {
+        qt_cl_deque_t *d = &vq->deques[(start + i) % n];
+        qthread_t     *t;
+        do {
+            t = qt_cl_steal(d, foreign);
+        } while (t == CL_ABORT);
+        if (t != CL_EMPTY) {
+            return t;
+        }
+    }
+    return NULL;
+} /*}}}*/
+
+static qthread_t *qthread_steal(qthread_shepherd_t *thief_shepherd,
+                                qthread_worker_id_t thief_worker)
+{   /*{{{*/
+    qthread_shepherd_id_t *const sorted_sheplist = thief_shepherd->sorted_sheplist;
+    qthread_shepherd_id_t        i;
+
+    assert(sorted_sheplist);
+    STEAL_CALLED(thief_shepherd);
+    for (i = 0; i < qlib->nshepherds - 1; i++) {
+        qthread_shepherd_t *victim = &qlib->shepherds[sorted_sheplist[i]];
+        if (qt_threadqueue_advisory_queuelen(victim->ready) - victim->ready->inbox_len > 0) {
+            qthread_t *t;
+            STEAL_ATTEMPTED(thief_shepherd);
+            t = qt_threadqueue_steal_from(victim, thief_worker, 1);
+            if (t) {
+                STEAL_AMOUNT(victim->ready, 1);
+                return t;
+            }
+            STEAL_FAILED(thief_shepherd);
+        }
+    }
+    return NULL;
+} /*}}}*/
+
+qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
+#ifdef QTHREAD_LOCAL_PRIORITY
+                                            qt_threadqueue_t         *QUNUSED(lpq),
+#endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+                                            qt_threadqueue_private_t *QUNUSED(qc),
+                                            uint_fast8_t              active)
+{   /*{{{*/
+    qthread_worker_t *const   me         = qthread_internal_getworker();
+    qthread_shepherd_t *const my_shep    = me->shepherd;
+    qt_cl_deque_t *const      d          = &q->deques[me->worker_id];
+    int const                 mccoy_home = (me->packed_worker_id == 0);
+    unsigned long             spins      = 0;
+    qthread_t                *t;
+
+    assert(my_shep->ready == q);
+#ifdef QTHREAD_USE_EUREKAS
+    qt_eureka_disable();
+#endif /* QTHREAD_USE_EUREKAS */
+    while (1) {
+        if (mccoy_home && q->mccoy) {
+            t = qt_internal_atomic_swap_ptr((void **)&q->mccoy, NULL);
+            if (t) { return t; }
+        }
+        if (((t = qt_cl_pop(d)) != CL_EMPTY) ||
+            (q->inbox && ((t = qt_threadqueue_inbox_drain(q, d)) != NULL)) ||
+            ((qlib->nworkerspershep > 1) &&
+             ((t = qt_threadqueue_steal_from(my_shep, me->worker_id, 0)) != NULL)) ||
+            (active && (qlib->nshepherds > 1) && !steal_disable &&
+             ((t = qthread_steal(my_shep, me->worker_id)) != NULL))) {
+            if (QTHREAD_UNLIKELY((t->flags & QTHREAD_REAL_MCCOY) && !mccoy_home)) {
+                /* McCoy thread can only run on worker 0 of shepherd 0 */
+                qt_threadqueue_enqueue(q, t);
+                continue;
+            }
+            return t;
+        }
+#ifdef QTHREAD_USE_EUREKAS
+        qt_eureka_check(1);
+#endif /* QTHREAD_USE_EUREKAS */
+        if (QT_PARK_DUE(++spins)) {
+            qt_threadqueue_park(me, active);
+            spins = 0;
+        } else {
+            SPINLOCK_BODY();
+        }
+    }
+} /*}}}*/
+
+/* walk queue removing all tasks matching this description */
+void INTERNAL qt_threadqueue_filter(qt_threadqueue_t       *q,
+                                    qt_threadqueue_filter_f f)
+{   /*{{{*/
+    qt_threadqueue_node_t *node = qt_threadqueue_take_all(q);
+    int                    stop = 0;
+
+    while (node) {
+        qt_threadqueue_node_t *next = node->next;
+        qthread_t             *t    = node->value;
+        FREE_TQNODE(node);
+        if (stop) {
+            qt_threadqueue_inbox_push(q, t);
+        } else {
+            switch (f(t)) {
+                case IGNORE_AND_STOP:
+                    stop = 1;
+                    /* fallthrough */
+                case IGNORE_AND_CONTINUE:
+                    qt_threadqueue_inbox_push(q, t);
+                    break;
+                case REMOVE_AND_STOP:
+                    stop = 1;
+                    /* fallthrough */
+                case REMOVE_AND_CONTINUE:
+#ifdef QTHREAD_USE_EUREKAS
+                    qthread_internal_assassinate(t);
+#endif /* QTHREAD_USE_EUREKAS */
+                    break;
+            }
+        }
+        node = next;
+    }
+} /*}}}*/
+
+/* walk queue looking for a specific value -- if found, make it the next task
+ * the caller will run and return it -- if not return NULL
+ */
+qthread_t INTERNAL *qt_threadqueue_dequeue_specific(qt_threadqueue_t *q,
+                                                    void             *value)
+{   /*{{{*/
+    qt_threadqueue_node_t *node  = qt_threadqueue_take_all(q);
+    qthread_t             *found = NULL;
+    qt_cl_deque_t         *d     = qt_threadqueue_mydeque(q);
+
+    while (node) {
+        qt_threadqueue_node_t *next = node->next;
+        qthread_t             *t    = node->value;
+        FREE_TQNODE(node);
+        if ((found == NULL) && (t->ret == value)) {
+            found = t;
+        } else {
+            qt_threadqueue_inbox_push(q, t);
+        }
+        node = next;
+    }
+    if (found) {
+        if (d) {
+            qt_cl_push(d, found);
+        } else {
+            qt_threadqueue_inbox_push(q, found);
+        }
+    }
+    return found;
+} /*}}}*/
+
+#ifdef STEAL_PROFILE                   // should give mechanism to make steal profiling optional
+void INTERNAL qthread_steal_stat(void)
+{   /*{{{*/
+    int i;
+
+    assert(qlib);
+    for (i = 0; i < qlib->nshepherds; i++) {
+        fprintf(stdout,
+                "QTHREADS: shepherd %d - steals called:%ld attempted:%ld(failed:%ld successful:%ld) tasks-stolen:%ld\n",
+                qlib->shepherds[i].shepherd_id,
+                qlib->shepherds[i].steal_called,
+                qlib->shepherds[i].steal_attempted,
+                qlib->shepherds[i].steal_failed,
+                qlib->shepherds[i].steal_attempted - qlib->shepherds[i].steal_failed,
+                qlib->shepherds[i].ready->steal_amount_stolen);
+    }
+} /*}}}*/
+#endif  /* ifdef STEAL_PROFILE */
+
+void INTERNAL qthread_steal_enable(void)
+{   /*{{{*/
+    steal_disable = 0;
+} /*}}}*/
+
+void INTERNAL qthread_steal_disable(void)
+{   /*{{{*/
+    steal_disable = 1;
+} /*}}}*/
+
+qthread_shepherd_id_t INTERNAL qt_threadqueue_choose_dest(qthread_shepherd_t *curr_shep)
+{   /*{{{*/
+    if (curr_shep) {
+        return curr_shep->shepherd_id;
+    } else {
+        return (qthread_shepherd_id_t)0;
+    }
+} /*}}}*/
+
+size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
+{   /*{{{*/
+    switch (policy) {
+        default:
+            return THREADQUEUE_POLICY_UNSUPPORTED;
+    }
+} /*}}}*/
+
+/* vim:set expandtab: */
@@ -196,6 +196,13 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
 #endif
 } /*}}}*/
 
+void INTERNAL qt_threadqueue_enqueue_many(qt_threadqueue_t *restrict q,
+                                          qthread_t *const          *t,
+                                          size_t                     n)
+{   /*{{{*/
+    qt_threadqueue_enqueue_each(q, t, n);
+} /*}}}*/
+
 void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                              qthread_t *restrict        t)
 {   /*{{{*/
@@ -202,6 +202,13 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
     q->empty = 0;
 } /*}}}*/
 
+void INTERNAL qt_threadqueue_enqueue_many(qt_threadqueue_t *restrict q,
+                                          qthread_t *const          *t,
+                                          size_t                     n)
+{   /*{{{*/
+    qt_threadqueue_enqueue_each(q, t, n);
+} /*}}}*/
+
 /* enqueue multiple (from steal) */
 void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t   *q,
                                               int                 stealcount,
@@ -6,6 +6,15 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h> /* for INT_MAX */
+#include <string.h>
+#include <strings.h> /* for strncasecmp() */
+#if defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_SYS_SYSCALL_H) && defined(HAVE_SYSCALL)
+# define QT_PARK_FUTEX 1
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
 
 /* Public Headers */
 #include "qthread/qthread.h"
@@ -27,6 +36,7 @@
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_expect.h"
 #include "qt_subsystems.h"
+#include "qthread/qtimer.h" /* for qtimer_wtime() */
 
 /* Data Structures */
 struct _qt_threadqueue_node {
@@ -43,30 +53,81 @@ struct _qt_threadqueue {
     long                   qlength_stealable;                   /* number of stealable tasks on queue - stop steal attempts
                                                                  * that will fail because tasks cannot be moved - 4/1/11 AKP
                                                                  */
+    long                   steal_success;                       /* recent success rate of this queue's thief,
+                                                                 * in 1/STEAL_SUCCESS_ONE units (adaptive batching) */
 #ifdef STEAL_PROFILE
     aligned_t steal_amount_stolen;
+    double    wake_stamp;                /* when the last parked worker was signalled */
 #endif
 
     QTHREAD_TRYLOCK_TYPE qlock;
+
+    /* Idle workers park here once they exhaust their spin budget */
+    qthread_shepherd_t *owner;           /* set by the first worker to park */
+    aligned_t           parked;          /* number of workers asleep on this queue */
+    uint32_t            park_epoch;      /* eventcount; bumped on every wakeup */
+#ifndef QT_PARK_FUTEX
+    QTHREAD_COND_DECL(park_trigger);
+#endif
 } /* qt_threadqueue_t */;
 
-static aligned_t steal_disable   = 0;
-static long      steal_chunksize = 0;
+static aligned_t     steal_disable   = 0;
+static long          steal_chunksize = 0;
+static int           steal_adaptive  = 0; /* size steal batches from recent success rate */
+static unsigned long spin_count      = 0; /* spins before parking; 0 means never park */
+static aligned_t     parked_workers  = 0; /* total across all queues */
+
+/* How a thief picks the order in which it visits other shepherds.
+ * SORTED walks sorted_sheplist from the nearest shepherd outward every time.
+ * RANDOM picks each victim at random, three times in four from the nearest
+ * tier (the shepherds sharing the smallest shep_dists value).
+ * LAST tries whichever shepherd it last stole from successfully, then falls
+ * back to SORTED.
+ * HIERARCHICAL sweeps one distance tier at a time, nearest first, starting at
+ * a random member of each tier so that thieves do not pile onto one victim. */
+enum qt_steal_policy {
+    STEAL_POLICY_SORTED = 0,
+    STEAL_POLICY_RANDOM,
+    STEAL_POLICY_LAST,
+    STEAL_POLICY_HIERARCHICAL,
+    STEAL_POLICY_COUNT
+};
+static const char *const steal_policy_names[STEAL_POLICY_COUNT] = {
+    "sorted", "random", "last", "hierarchical"
+};
+static enum qt_steal_policy steal_policy = STEAL_POLICY_SORTED;
+
+/* The thief's success rate is an exponentially-weighted moving average over
+ * its victim probes, kept in fixed point. */
+#define STEAL_SUCCESS_ONE   256
+#define STEAL_SUCCESS_DECAY 3       /* each probe counts for 1/8 */
+
+typedef struct {
+    size_t tier_lo, tier_hi;            /* the tier being swept: [lo, hi) */
+    size_t offset;                      /* rotation within that tier */
+} qt_steal_order_t;
 
 #ifdef STEAL_PROFILE
 # define STEAL_CALLED(shep)     qthread_incr( & ((shep)->steal_called), 1)
 # define STEAL_ELECTED(shep)    qthread_incr( & ((shep)->steal_elected), 1)
 # define STEAL_ATTEMPTED(shep)  qthread_incr( & ((shep)->steal_attempted), 1)
-# define STEAL_SUCCESSFUL(shep) do {} while (0)
+# define STEAL_SUCCESSFUL(shep, idx)                                        \
+    do {                                                                   \
+        if ((idx) >= qt_steal_tier_end(shep, 0)) {                         \
+            qthread_incr( & ((shep)->steal_remote), 1);                    \
+        }                                                                  \
+    } while (0)
 # define STEAL_FAILED(shep)     qthread_incr( & ((shep)->steal_failed), 1)
 # define STEAL_AMOUNT(q, ct)    qthread_incr( & ((q)->steal_amount_stolen), ct)
+# define PARK_COUNT(shep)       qthread_incr( & ((shep)->park_count), 1)
 #else
 # define STEAL_CALLED(shep)     do {} while(0)
 # define STEAL_ELECTED(shep)    do {} while(0)
 # define STEAL_ATTEMPTED(shep)  do {} while(0)
-# define STEAL_SUCCESSFUL(shep) do {} while(0)
+# define STEAL_SUCCESSFUL(shep, idx) do {} while(0)
 # define STEAL_FAILED(shep)     do {} while(0)
 # define STEAL_AMOUNT(q, ct)    do {} while(0)
+# define PARK_COUNT(shep)       do {} while(0)
 #endif /* ifdef STEAL_PROFILE */
 
 // Forward declarations
@@ -161,6 +222,38 @@ static inline void sanity_check_queue(qt_threadqueue_t *q)
 # define PARANOIA_ONLY(x)
 #endif /* ifndef QTHREAD_NO_ASSERTS */
 
+static void qt_threadqueue_read_env(void)
+{   /*{{{*/
+    const char *policy = qt_internal_get_env_str("STEAL_POLICY", "sorted");
+    const char *batch  = qt_internal_get_env_str("STEAL_BATCH", "static");
+
+    steal_chunksize = qt_internal_get_env_num("STEAL_CHUNK", 0, 0);
+    spin_count      = qt_internal_get_env_num("SPINCOUNT", 300000, 0);
+    if (policy) {
+        int p;
+        for (p = 0; p < STEAL_POLICY_COUNT; p++) {
+            if (!strncasecmp(steal_policy_names[p], policy, strlen(steal_policy_names[p]))) {
+                steal_policy = (enum qt_steal_policy)p;
+                break;
+            }
+        }
+        if (p == STEAL_POLICY_COUNT) {
+            fprintf(stderr, "unparsable steal policy (%s)\n", policy);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (batch) {
+        if (!strncasecmp("adaptive", batch, 8)) {
+            steal_adaptive = 1;
+        } else if (strncasecmp("static", batch, 6)) {
+            fprintf(stderr, "unparsable steal batch mode (%s)\n", batch);
+            exit(EXIT_FAILURE);
+        }
+    }
+    qthread_debug(THREADQUEUE_DETAILS, "steal policy: %s, %s batches\n",
+                  steal_policy_names[steal_policy], steal_adaptive ? "adaptive" : "static");
+} /*}}}*/
+
 /* Memory Management */
 #if defined(UNPOOLED_QUEUES) || defined(UNPOOLED)
 # define ALLOC_THREADQUEUE() (qt_threadqueue_t *)MALLOC(sizeof(qt_threadqueue_t))
@@ -175,7 +268,7 @@ static void qt_threadqueue_subsystem_shutdown(void)
 void INTERNAL qt_threadqueue_subsystem_init(void)
 {
     init_agged_tasks();
-    steal_chunksize = qt_internal_get_env_num("STEAL_CHUNK", 0, 0);
+    qt_threadqueue_read_env();
     qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 }
 
@@ -205,7 +298,7 @@ void INTERNAL qt_threadqueue_subsystem_init(void)
                                                                qthread_cacheline());
     generic_threadqueue_pools.nodes = qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t),
                                                               qthread_cacheline());
-    steal_chunksize = qt_internal_get_env_num("STEAL_CHUNK", 0, 0);
+    qt_threadqueue_read_env();
     qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 } /*}}}*/
 #endif /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
@@ -233,7 +326,8 @@ ssize_t INTERNAL qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q)
 /* functions to manage the thread queues */
 /*****************************************/
 
-static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_shepherd);
+static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_shepherd,
+                                                    unsigned long      *spins);
 
 qt_threadqueue_t INTERNAL *qt_threadqueue_new(void)
 {   /*{{{*/
@@ -244,7 +338,14 @@ qt_threadqueue_t INTERNAL *qt_threadqueue_new(void)
         q->tail              = NULL;
         q->qlength           = 0;
         q->qlength_stealable = 0;
+        q->steal_success     = 0;
         QTHREAD_TRYLOCK_INIT(q->qlock);
+        q->owner      = NULL;
+        q->parked     = 0;
+        q->park_epoch = 0;
+#ifndef QT_PARK_FUTEX
+        QTHREAD_COND_INIT(q->park_trigger);
+#endif
     }
 
     return q;
@@ -286,7 +387,11 @@ void INTERNAL qt_threadqueue_free(qt_threadqueue_t *q)
         QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
     }
     assert(q->head == q->tail);
+    assert(q->parked == 0);
     QTHREAD_TRYLOCK_DESTROY(q->qlock);
+#ifndef QT_PARK_FUTEX
+    QTHREAD_COND_DESTROY(q->park_trigger);
+#endif
     FREE_THREADQUEUE(q);
 } /*}}}*/
 
@@ -295,6 +400,130 @@ static QINLINE int qt_threadqueue_isstealable(qthread_t *t)
     return ((t->flags & QTHREAD_UNSTEALABLE) == 0) ? 1 : 0;
 } /*}}}*/
 
+/*****************************************/
+/* idle worker parking                   */
+/*****************************************/
+
+#define QT_PARK_DUE(spins) (spin_count && ((spins) >= spin_count))
+
+static QINLINE void qt_threadqueue_signal(qt_threadqueue_t *q,
+                                          int               nwaiters)
+{   /*{{{*/
+#ifdef STEAL_PROFILE
+    q->wake_stamp = qtimer_wtime();
+#endif
+    (void)qthread_incr(&q->park_epoch, 1);
+#ifdef QT_PARK_FUTEX
+    syscall(SYS_futex, &q->park_epoch, FUTEX_WAKE_PRIVATE, nwaiters, NULL, NULL, 0);
+#else
+    QTHREAD_COND_LOCK(q->park_trigger);
+    if (nwaiters == 1) {
+        QTHREAD_COND_SIGNAL(q->park_trigger);
+    } else {
+        QTHREAD_COND_BCAST(q->park_trigger);
+    }
+    QTHREAD_COND_UNLOCK(q->park_trigger);
+#endif /* ifdef QT_PARK_FUTEX */
+} /*}}}*/
+
+/* Called after work has been made visible on q. Wakes exactly one parked
+ * worker: one sleeping on q itself if possible, otherwise the one closest to
+ * q's shepherd, so that it can steal the new work. */
+static QINLINE void qt_threadqueue_wake_one(qt_threadqueue_t *q)
+{   /*{{{*/
+    if (spin_count == 0) { return; }
+    /* pairs with the increments in qt_threadqueue_park() */
+    MACHINE_FENCE;
+    if (QTHREAD_LIKELY(parked_workers == 0)) { return; }
+
+    if ((q->owner != NULL) && (q->owner->ready != q)) {
+        /* a local priority queue; only its own shepherd can service it */
+        q = q->owner->ready;
+    }
+    if (q->parked) {
+        qt_threadqueue_signal(q, 1);
+    } else if (!steal_disable && (qlib->nshepherds > 1)) {
+        qthread_shepherd_id_t const *const sorted = q->owner ? q->owner->sorted_sheplist : NULL;
+        qthread_shepherd_id_t const        limit  = sorted ? (qlib->nshepherds - 1) : qlib->nshepherds;
+        qthread_shepherd_id_t              i;
+
+        for (i = 0; i < limit; i++) {
+            qt_threadqueue_t *v = qlib->shepherds[sorted ? sorted[i] : i].ready;
+            if (v->parked) {
+                qt_threadqueue_signal(v, 1);
+                return;
+            }
+        }
+    }
+} /*}}}*/
+
+static QINLINE int qt_threadqueue_work_available(qthread_shepherd_t *me)
+{   /*{{{*/
+    if (me->ready->head != NULL) { return 1; }
+#ifdef QTHREAD_LOCAL_PRIORITY
+    if (me->local_priority_queue->head != NULL) { return 1; }
+#endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+    if (!steal_disable && (qlib->nshepherds > 1)) {
+        qthread_shepherd_id_t i;
+        for (i = 0; i < qlib->nshepherds; i++) {
+            if (qlib->shepherds[i].ready->qlength_stealable) { return 1; }
+        }
+    }
+    return 0;
+} /*}}}*/
+
+/* Block the calling worker on its shepherd's queue until an enqueue wakes it
+ * (or until it notices work while registering itself as parked). */
+static void qt_threadqueue_park(qthread_shepherd_t *me)
+{   /*{{{*/
+    qt_threadqueue_t *q = me->ready;
+    uint32_t          key;
+
+    q->owner = me;
+#ifdef QTHREAD_LOCAL_PRIORITY
+    me->local_priority_queue->owner = me;
+#endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+    key = q->park_epoch;
+    (void)qthread_incr(&q->parked, 1);
+    (void)qthread_incr(&parked_workers, 1);
+    if (!qt_threadqueue_work_available(me)) {
+        PARK_COUNT(me);
+        qthread_debug(THREADQUEUE_DETAILS, "shep(%u): parking on q(%p)\n", me->shepherd_id, q);
+#ifdef QT_PARK_FUTEX
+        syscall(SYS_futex, &q->park_epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+#else
+        QTHREAD_COND_LOCK(q->park_trigger);
+        if (q->park_epoch == key) {
+            QTHREAD_COND_WAIT(q->park_trigger);
+        }
+        QTHREAD_COND_UNLOCK(q->park_trigger);
+#endif /* ifdef QT_PARK_FUTEX */
+#ifdef STEAL_PROFILE
+        if (q->park_epoch != key) {
+            double latency = qtimer_wtime() - q->wake_stamp;
+            union {
+                double   d;
+                uint64_t u;
+            } seen, mine;
+
+            qthread_incr(&me->wake_count, 1);
+            qthread_dincr(&me->wake_latency, latency);
+            /* every worker of the shepherd shares the max, so swap it in */
+            mine.d = latency;
+            seen.d = me->wake_maxlatency;
+            while (seen.d < latency) {
+                uint64_t const was = qthread_cas64((uint64_t *)&me->wake_maxlatency,
+                                                   seen.u, mine.u);
+                if (was == seen.u) { break; }
+                seen.u = was;
+            }
+        }
+#endif  /* ifdef STEAL_PROFILE */
+    }
+    (void)qthread_incr(&parked_workers, -1);
+    (void)qthread_incr(&q->parked, -1);
+} /*}}}*/
+
 /* enqueue at tail */
 void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
                                      qthread_t *restrict        t)
@@ -323,6 +552,7 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
     q->qlength++;
     q->qlength_stealable += node->stealable;
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    qt_threadqueue_wake_one(q);
 } /*}}}*/
 
 #ifdef QTHREAD_USE_SPAWNCACHE
@@ -462,6 +692,7 @@ void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
     q->qlength++;
     if (node->stealable) { q->qlength_stealable++; }
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    qt_threadqueue_wake_one(q);
 } /*}}}*/
 
 #define QTHREAD_TASK_IS_AGGREGABLE(f) (0 &&                                                \
@@ -707,6 +938,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
     qthread_shepherd_t *my_shepherd = qthread_internal_getshep();
     qthread_t          *t;
     qthread_worker_id_t worker_id = NO_WORKER;
+    unsigned long       spins     = 0;
     int                 curr_cost, max_t, ret_agg_task;
 
     assert(q != NULL);
@@ -841,6 +1073,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
                 assert(q->tail->next == NULL);
                 assert(q->head->prev == NULL);
                 QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+                qt_threadqueue_wake_one(q);
                 qc->head    = qc->tail = NULL;
                 qc->qlength = qc->qlength_stealable = 0;
 #endif          /* if 0 */
@@ -893,9 +1126,19 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
                 worker_id = qthread_worker(NULL);
             }
             if ((my_shepherd->shepherd_id == 0) && (worker_id == 0)) {
-                while (my_shepherd->stealing == 1) SPINLOCK_BODY();  // no sense contending for the lock
+                while (my_shepherd->stealing == 1 && !QT_PARK_DUE(spins)) {  // no sense contending for the lock
+                    SPINLOCK_BODY();
+                    spins++;
+                }
             } else {
-                while (my_shepherd->stealing) SPINLOCK_BODY();  // no sense contending for the lock
+                while (my_shepherd->stealing && !QT_PARK_DUE(spins)) {  // no sense contending for the lock
+                    SPINLOCK_BODY();
+                    spins++;
+                }
+            }
+            if (QT_PARK_DUE(spins)) {
+                qt_threadqueue_park(my_shepherd);
+                spins = 0;
             }
             continue;
         }
@@ -903,10 +1146,12 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
         if ((node == NULL) && (active)) {
             if (qlib->nshepherds > 1) {
                 if (!steal_disable) {
-                    node = qthread_steal(my_shepherd); // TODO: same agg behavior when stealing
+                    node = qthread_steal(my_shepherd, &spins); // TODO: same agg behavior when stealing
                 } else {
-                    while (NULL == q->head) SPINLOCK_BODY();
-                    continue;
+                    while (NULL == q->head && !QT_PARK_DUE(spins)) {
+                        SPINLOCK_BODY();
+                        spins++;
+                    }
                 }
             }
         }
@@ -934,6 +1179,10 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
                         my_shepherd->stealing = 2; // no stealing
                         MACHINE_FENCE;
                         qt_threadqueue_enqueue_yielded(q, t);
+                        if (q->parked) {
+                            /* worker 0 may be asleep; make sure it gets it */
+                            qt_threadqueue_signal(q, INT_MAX);
+                        }
 #ifdef QTHREAD_TASK_AGGREGATION
                         t = qt_init_agg_task();
 #endif
@@ -942,6 +1191,9 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
             } else {
                 break;
             }
+        } else if (QT_PARK_DUE(++spins)) {
+            qt_threadqueue_park(my_shepherd);
+            spins = 0;
         }
     }
     return (t);
@@ -976,6 +1228,51 @@ void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
     q->qlength           += addCnt;
     q->qlength_stealable += addCnt;
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    qt_threadqueue_wake_one(q);
+} /*}}}*/
+
+/* enqueue a batch of new tasks at the tail, taking the queue lock once */
+void INTERNAL qt_threadqueue_enqueue_many(qt_threadqueue_t *restrict q,
+                                          qthread_t *const          *t,
+                                          size_t                     n)
+{   /*{{{*/
+    qt_threadqueue_node_t *first = NULL, *last = NULL;
+    long                   stealable = 0;
+
+    assert(q != NULL);
+    if (n == 0) { return; }
+
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_node_t *node = ALLOC_TQNODE();
+
+        assert(node != NULL);
+        assert(t[i] != NULL);
+        node->value     = t[i];
+        node->stealable = qt_threadqueue_isstealable(t[i]);
+        node->next      = NULL;
+        node->prev      = last;
+        if (last) {
+            last->next = node;
+        } else {
+            first = node;
+        }
+        last       = node;
+        stealable += node->stealable;
+    }
+
+    QTHREAD_TRYLOCK_LOCK(&q->qlock);
+    PARANOIA_ONLY(sanity_check_queue(q));
+    first->prev = q->tail;
+    q->tail     = last;
+    if (q->head == NULL) {
+        q->head = first;
+    } else {
+        first->prev->next = first;
+    }
+    q->qlength           += n;
+    q->qlength_stealable += stealable;
+    QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    qt_threadqueue_wake_one(q);
 } /*}}}*/
 
 #ifdef QTHREAD_USE_SPAWNCACHE
@@ -1015,11 +1312,45 @@ void INTERNAL qt_threadqueue_enqueue_cache(qt_threadqueue_t         *q,
     q->qlength           += cache->qlength;
     q->qlength_stealable += cache->qlength_stealable;
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    qt_threadqueue_wake_one(q);
     cache->qlength           = 0;
     cache->qlength_stealable = 0;
 } /*}}}*/
 #endif /* ifdef QTHREAD_USE_SPAWNCACHE */
 
+/* Only the elected thief of h's shepherd updates this, so no atomics */
+static QINLINE void qt_threadqueue_steal_outcome(qt_threadqueue_t *h,
+                                                 int               success)
+{   /*{{{*/
+    h->steal_success += ((success ? STEAL_SUCCESS_ONE : 0) - h->steal_success) >> STEAL_SUCCESS_DECAY;
+} /*}}}*/
+
+/* How many of the victim's stealable tasks to take. In static mode this is
+ * QT_STEAL_CHUNK, or half when that is zero. In adaptive mode it starts at
+ * half and shrinks toward an eighth as the thief's probes succeed more often:
+ * frequent success means work is plentiful, and taking big batches just
+ * moves it back and forth; frequent failure means work is scarce, and each
+ * successful probe should bring home as much as possible. QT_STEAL_CHUNK,
+ * if set, caps the adaptive batch. */
+static QINLINE long qt_threadqueue_steal_batch(qt_threadqueue_t *h,
+                                               long              stealable)
+{   /*{{{*/
+    long desired;
+
+    if (steal_adaptive) {
+        desired = (stealable * STEAL_SUCCESS_ONE) /
+                  (2 * STEAL_SUCCESS_ONE + 6 * h->steal_success);
+        if ((steal_chunksize != 0) && (desired > steal_chunksize)) {
+            desired = steal_chunksize;
+        }
+    } else if (steal_chunksize == 0) {
+        desired = stealable / 2;
+    } else {
+        desired = steal_chunksize;
+    }
+    return (desired > 0) ? desired : 1;
+} /*}}}*/
+
 /* dequeue stolen threads at head, skip yielded threads */
 qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h,
                                                              qt_threadqueue_t *v)
@@ -1030,20 +1361,13 @@ qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h
     long                   amtStolen = 0;
     long                   desired_stolen;
 
-    if (steal_chunksize == 0) {
-        desired_stolen = v->qlength_stealable / 2;
-    } else {
-        desired_stolen = steal_chunksize;
-    }
-
     assert(h != NULL);
     assert(v != NULL);
 
-    if (desired_stolen == 0) { desired_stolen = 1; }
-
     if (!QTHREAD_TRYLOCK_TRY(&v->qlock)) {
         return NULL;
     }
+    desired_stolen = qt_threadqueue_steal_batch(h, v->qlength_stealable);
     PARANOIA_ONLY(sanity_check_queue(v));
     while (v->qlength_stealable > 0 && amtStolen < desired_stolen) {
         node = (qt_threadqueue_node_t *)v->head;
@@ -1120,10 +1444,63 @@ qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h
     return (first);
 }                                      /*}}} */
 
+/* One past the last index of the distance tier of sorted_sheplist that starts
+ * at index lo. */
+static QINLINE size_t qt_steal_tier_end(const qthread_shepherd_t *thief,
+                                        size_t                    lo)
+{   /*{{{*/
+    const qthread_shepherd_id_t *const sorted = thief->sorted_sheplist;
+    const unsigned int *const          dists  = thief->shep_dists;
+    size_t const                       n      = qlib->nshepherds - 1;
+    size_t                             hi     = lo + 1;
+
+    while (hi < n && dists[sorted[hi]] == dists[sorted[lo]]) {
+        hi++;
+    }
+    return hi;
+} /*}}}*/
+
+/* The index into thief->sorted_sheplist of the i'th victim to try in the
+ * current sweep, according to steal_policy. */
+static QINLINE size_t qt_steal_victim(qthread_shepherd_t *thief,
+                                      size_t              i,
+                                      qt_steal_order_t   *o)
+{   /*{{{*/
+    size_t const n = qlib->nshepherds - 1;
+
+    switch (steal_policy) {
+        default:
+        case STEAL_POLICY_SORTED:
+            return i;
+        case STEAL_POLICY_RANDOM:
+        {
+            unsigned long const r = qthread_random();
+            if (o->tier_hi == 0) {
+                o->tier_hi = qt_steal_tier_end(thief, 0);
+            }
+            return (r & 3) ? ((r >> 2) % o->tier_hi) : ((r >> 2) % n);
+        }
+        case STEAL_POLICY_LAST:
+        {
+            size_t const last = thief->steal_last_victim;
+            if (i == 0) { return last; }
+            return (i <= last) ? (i - 1) : i;
+        }
+        case STEAL_POLICY_HIERARCHICAL:
+            if ((i == 0) || (i >= o->tier_hi)) {
+                o->tier_lo = i;
+                o->tier_hi = qt_steal_tier_end(thief, i);
+                o->offset  = qthread_random() % (o->tier_hi - o->tier_lo);
+            }
+            return o->tier_lo + (i - o->tier_lo + o->offset) % (o->tier_hi - o->tier_lo);
+    }
+} /*}}}*/
+
 /*  Steal work from another shepherd's queue
- *  Returns the work stolen
+ *  Returns the work stolen, or NULL once the caller's spin budget runs out
  */
-static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_shepherd)
+static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_shepherd,
+                                                    unsigned long      *spins)
 {   /*{{{*/
     qt_threadqueue_node_t *stolen = NULL;
 
@@ -1150,10 +1527,12 @@ static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_sh
     }
     STEAL_ELECTED(thief_shepherd);
 
-    qthread_shepherd_id_t        i               = 0;
+    size_t                       i               = 0;
     qthread_shepherd_t *const    shepherds       = qlib->shepherds;
     qthread_shepherd_id_t *const sorted_sheplist = thief_shepherd->sorted_sheplist;
+    qt_steal_order_t             order           = { 0, 0, 0 };
     assert(sorted_sheplist);
+    assert(thief_shepherd->shep_dists);
 
     qt_threadqueue_t *myqueue = thief_shepherd->ready;
 
@@ -1161,10 +1540,12 @@ static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_sh
     qt_threadqueue_t *mypriorityqueue = thief_shepherd->local_priority_queue;
 #endif /* ifdef QTHREAD_LOCAL_PRIORITY */
     while (stolen == NULL) {
-        qt_threadqueue_t *victim_queue = shepherds[sorted_sheplist[i]].ready;
+        size_t const      victim       = qt_steal_victim(thief_shepherd, i, &order);
+        qt_threadqueue_t *victim_queue = shepherds[sorted_sheplist[victim]].ready;
         if (0 != victim_queue->qlength_stealable) {
             STEAL_ATTEMPTED(thief_shepherd);
             stolen = qt_threadqueue_dequeue_steal(myqueue, victim_queue);
+            qt_threadqueue_steal_outcome(myqueue, stolen != NULL);
             if (stolen) {
                 qt_threadqueue_node_t *surplus = stolen->next;
                 if (surplus) {
@@ -1172,11 +1553,14 @@ static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_sh
                     surplus->prev = NULL;
                     qt_threadqueue_enqueue_multiple(myqueue, surplus);
                 }
-                STEAL_SUCCESSFUL(thief_shepherd);
+                STEAL_SUCCESSFUL(thief_shepherd, victim);
+                thief_shepherd->steal_last_victim = victim;
                 break;
             } else {
                 STEAL_FAILED(thief_shepherd);
             }
+        } else {
+            qt_threadqueue_steal_outcome(myqueue, 0);
         }
 #ifdef QTHREAD_LOCAL_PRIORITY
         if ((0 < mypriorityqueue->qlength)){
@@ -1200,6 +1584,9 @@ static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_sh
             sched_yield();
 #endif
         }
+        if (QT_PARK_DUE(++(*spins))) {
+            break;
+        }
         SPINLOCK_BODY();
     }
     thief_shepherd->stealing = 0;
@@ -1214,14 +1601,24 @@ void INTERNAL qthread_steal_stat(void)
     assert(qlib);
     for (i = 0; i < qlib->nshepherds; i++) {
         fprintf(stdout,
-                "QTHREADS: shepherd %d - steals called:%ld elected:%ld attempted:%ld(failed:%ld successful:%ld) tasks-stolen:%ld\n",
+                "QTHREADS: shepherd %d - %s steals called:%ld elected:%ld attempted:%ld(failed:%ld successful:%ld remote:%ld) tasks-stolen:%ld\n",
                 qlib->shepherds[i].shepherd_id,
+                steal_policy_names[steal_policy],
                 qlib->shepherds[i].steal_called,
                 qlib->shepherds[i].steal_elected,
                 qlib->shepherds[i].steal_attempted,
                 qlib->shepherds[i].steal_failed,
                 qlib->shepherds[i].steal_attempted - qlib->shepherds[i].steal_failed,
+                qlib->shepherds[i].steal_remote,
                 qlib->shepherds[i].ready->steal_amount_stolen);
+        fprintf(stdout,
+                "QTHREADS: shepherd %d - parked:%ld woken:%ld wake-latency avg:%gus max:%gus\n",
+                qlib->shepherds[i].shepherd_id,
+                qlib->shepherds[i].park_count,
+                qlib->shepherds[i].wake_count,
+                qlib->shepherds[i].wake_count ?
+                (qlib->shepherds[i].wake_latency * 1e6 / qlib->shepherds[i].wake_count) : 0.0,
+                qlib->shepherds[i].wake_maxlatency * 1e6);
     }
 } /*}}}*/
 #endif  /* ifdef STEAL_PROFILE */
@@ -6,14 +6,18 @@
 #include "qthread/qthread.h"
 
 /* System Headers */
+#include <stdint.h> /* for uintptr_t */
 
 /* Internal Headers */
 #include "qt_visibility.h"
 #include "qt_debug.h"
 #include "qt_asserts.h"
+#include "qt_expect.h"
 #include "qthread_innards.h" /* for qlib */
 #include "qt_initialized.h"  // for qthread_library_initialized
 #include "qt_shepherd_innards.h"
+#include "qthread/qtimer.h" /* for qtimer_ticks() */
+#include "qthread/hash.h"   /* for GOLDEN_RATIO */
 // #include "qt_qthread_struct.h"
 
 #ifdef QTHREAD_USE_ROSE_EXTENSIONS
@@ -137,4 +141,50 @@ qthread_worker_id_t API_FUNC qthread_num_workers_local(qthread_shepherd_id_t she
 #endif
 }
 
+/* splitmix64's finalizer: spreads nearby inputs (timestamps, ids, counters)
+ * over the whole word */
+static QINLINE uint64_t qt_random_mix(uint64_t x)
+{   /*{{{*/
+    x += 0x9e3779b97f4a7c15ULL;
+    x  = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x  = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+} /*}}}*/
+
+void INTERNAL qthread_internal_worker_seed(qthread_worker_t *w)
+{   /*{{{*/
+    uint64_t seed = qt_random_mix(qtimer_ticks() ^
+                                  ((uint64_t)w->unique_id << 32) ^
+                                  (uint64_t)(uintptr_t)w);
+
+    /* xorshift never leaves zero */
+    w->rand_state = seed ? seed : (uint64_t)GOLDEN_RATIO;
+} /*}}}*/
+
+/* A xorshift64* generator per worker: each worker only ever touches its own
+ * state, so there is no shared cache line bouncing between the stealing,
+ * queueing, and pattern code that all want a cheap random number. Callers
+ * without a worker (before init, or from foreign pthreads) share a counter
+ * run through the mixer instead. */
+unsigned long API_FUNC qthread_random(void)
+{   /*{{{*/
+    qthread_worker_t *w = qthread_internal_getworker();
+    uint64_t          x;
+
+    if (QTHREAD_EXPECT(w == NULL, 0)) {
+        static aligned_t counter = 0;
+
+        x = qt_random_mix(qthread_incr(&counter, 1));
+    } else {
+        x             = w->rand_state;
+        x            ^= x >> 12;
+        x            ^= x << 25;
+        x            ^= x >> 27;
+        w->rand_state = x;
+        x            *= 0x2545f4914f6cdd1dULL;
+    }
+    /* the high bits are the good ones */
+    return (unsigned long)(x >> (64 - 8 * sizeof(unsigned long)));
+} /*}}}*/
+
 /* vim:set expandtab: */
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Copied arguments of every size class, inline and out of line, must arrive
+ * intact and must not overlap the task-local data that follows them. */
+
+static const size_t sizes[] = {
+    1, 8, 31, 32, 33, 100, 255, 256, 1000, 1024, 1025, 2000, 4096, 8191,
+    8192, 8193, 20000
+};
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static unsigned char *buf;
+
+static aligned_t checker(void *arg)
+{
+    const unsigned char *copy = arg;
+    size_t const         size = ((const size_t *)arg)[0];
+    aligned_t           *tl   = qthread_get_tasklocal(sizeof(aligned_t));
+
+    *tl = 0xdeadbeef;
+    for (size_t i = sizeof(size_t); i < size; i++) {
+        assert(copy[i] == (unsigned char)(i * 7));
+    }
+    assert(*tl == 0xdeadbeef);
+    return (aligned_t)size;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t rets[NUM_SIZES];
+    int       rounds = 10;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(rounds, "TEST_ROUNDS");
+
+    buf = malloc(sizes[NUM_SIZES - 1]);
+    assert(buf);
+    for (size_t i = 0; i < sizes[NUM_SIZES - 1]; i++) {
+        buf[i] = (unsigned char)(i * 7);
+    }
+
+    for (int r = 0; r < rounds; r++) {
+        for (size_t s = 0; s < NUM_SIZES; s++) {
+            size_t const size = (sizes[s] < sizeof(size_t)) ? sizeof(size_t) : sizes[s];
+
+            memcpy(buf, &size, sizeof(size_t));
+            assert(qthread_spawn(checker, buf, size, &rets[s], 0, NULL,
+                                 NO_SHEPHERD, 0) == QTHREAD_SUCCESS);
+            /* the argument was copied, so it can be changed right away */
+            memset(buf, 0, sizeof(size_t));
+        }
+        for (size_t s = 0; s < NUM_SIZES; s++) {
+            size_t const size = (sizes[s] < sizeof(size_t)) ? sizeof(size_t) : sizes[s];
+
+            qthread_readFF(NULL, &rets[s]);
+            assert(rets[s] == (aligned_t)size);
+        }
+    }
+    iprintf("%i rounds of %i argument sizes ok\n", rounds, (int)NUM_SIZES);
+
+    free(buf);
+    return 0;
+}
+
+/* vim:set expandtab */
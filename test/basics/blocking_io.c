@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <poll.h>
+#include <qthread/qthread.h>
+#include <qthread/qt_syscalls.h>
+#include "argparsing.h"
+
+static int (*pipes)[2];
+
+static aligned_t reader(void *arg)
+{
+    int       p = (int)(uintptr_t)arg;
+    aligned_t v = 0;
+
+    assert(qt_read(pipes[p][0], &v, sizeof(aligned_t)) == sizeof(aligned_t));
+    return v;
+}
+
+static aligned_t writer(void *arg)
+{
+    int       p = (int)(uintptr_t)arg;
+    aligned_t v = p + 1;
+
+    assert(qt_write(pipes[p][1], &v, sizeof(aligned_t)) == sizeof(aligned_t));
+    return 0;
+}
+
+/* default stacks are small, so stdio stays out of here */
+static aligned_t misc(void *arg)
+{
+    int           fd = (int)(uintptr_t)arg;
+    int           p[2];
+    struct pollfd pfd;
+    char          c = 'x';
+    char          buf[16];
+
+    /* poll timeout on an empty pipe */
+    assert(pipe(p) == 0);
+    pfd.fd      = p[0];
+    pfd.events  = POLLIN;
+    pfd.revents = POLLERR;
+    assert(qt_poll(&pfd, 1, 10) == 0);
+    assert(pfd.revents == 0);
+
+    /* ...and once there is something to read */
+    assert(qt_write(p[1], &c, 1) == 1);
+    assert(qt_poll(&pfd, 1, -1) == 1);
+    assert(pfd.revents & POLLIN);
+    assert(qt_read(p[0], buf, sizeof(buf)) == 1);
+    assert(buf[0] == 'x');
+    close(p[0]);
+    close(p[1]);
+
+    /* positioned I/O */
+    assert(qt_pwrite(fd, "qthreads", 8, 4096) == 8);
+    assert(qt_pread(fd, buf, 8, 4096) == 8);
+    assert(memcmp(buf, "qthreads", 8) == 0);
+    assert(qt_pread(fd, buf, 8, 8192) == 0);
+
+    /* errors come back as -1 (errno is not checked here, since this task
+     * may have resumed on a different worker) */
+    assert(qt_read(-1, buf, 1) == -1);
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    size_t     npipes = 8;
+    aligned_t *rets;
+    aligned_t  m;
+    FILE      *f;
+    size_t     i;
+
+    CHECK_VERBOSE();
+    NUMARG(npipes, "NUM_PIPES");
+    assert(qthread_initialize() == 0);
+
+    pipes = malloc(npipes * sizeof(int[2]));
+    rets  = malloc(npipes * sizeof(aligned_t));
+    assert(pipes && rets);
+    for (i = 0; i < npipes; i++) {
+        assert(pipe(pipes[i]) == 0);
+    }
+
+    /* the readers block until the writers run */
+    for (i = 0; i < npipes; i++) {
+        assert(qthread_fork(reader, (void *)(uintptr_t)i, &rets[i]) == 0);
+    }
+    for (i = 0; i < npipes; i++) {
+        assert(qthread_fork(writer, (void *)(uintptr_t)i, NULL) == 0);
+    }
+    for (i = 0; i < npipes; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(rets[i] == i + 1);
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    iprintf("%lu reader/writer pairs ok\n", (unsigned long)npipes);
+
+    f = tmpfile();
+    assert(f);
+    assert(qthread_fork(misc, (void *)(uintptr_t)fileno(f), &m) == 0);
+    qthread_readFF(NULL, &m);
+    fclose(f);
+    iprintf("poll, pread/pwrite and errno ok\n");
+
+    free(pipes);
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,113 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Uncontended FEB transitions bypass the FEB hash table; this makes sure the
+ * state stays consistent when they mix with waiting operations and when words
+ * that are empty at the same time collide in the fast path's slot table (a
+ * few thousand words are plenty to make that happen often). */
+
+static size_t     NUM_WORDS = 4096;
+static aligned_t *words;
+
+static aligned_t filler(void *arg)
+{
+    aligned_t i = (aligned_t)(uintptr_t)arg;
+
+    qthread_writeEF(&words[i], &i);
+    return 0;
+}
+
+static aligned_t waiter(void *arg)
+{
+    aligned_t i = (aligned_t)(uintptr_t)arg;
+    aligned_t v;
+
+    qthread_readFE(&v, &words[i]);
+    assert(v == i);
+    qthread_writeEF_const(&words[i], v + 1);
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t *rets;
+    aligned_t  v;
+    size_t     i;
+
+    CHECK_VERBOSE();
+    NUMARG(NUM_WORDS, "NUM_WORDS");
+    assert(qthread_initialize() == 0);
+
+    words = calloc(NUM_WORDS, sizeof(aligned_t));
+    rets  = malloc(NUM_WORDS * sizeof(aligned_t));
+    assert(words && rets);
+
+    /* simple transitions */
+    v = 1;
+    assert(qthread_feb_status(&words[0]) == 1);
+    assert(qthread_readFE(&v, &words[0]) == QTHREAD_SUCCESS);
+    assert(v == 0);
+    assert(qthread_feb_status(&words[0]) == 0);
+    assert(qthread_writeEF_const(&words[0], 5) == QTHREAD_SUCCESS);
+    assert(qthread_feb_status(&words[0]) == 1);
+    assert(qthread_readFF(&v, &words[0]) == QTHREAD_SUCCESS);
+    assert(v == 5);
+    assert(qthread_empty(&words[0]) == QTHREAD_SUCCESS);
+    assert(qthread_empty(&words[0]) == QTHREAD_SUCCESS);
+    assert(qthread_feb_status(&words[0]) == 0);
+    assert(qthread_writeF_const(&words[0], 0) == QTHREAD_SUCCESS);
+    assert(qthread_feb_status(&words[0]) == 1);
+    assert(qthread_fill(&words[0]) == QTHREAD_SUCCESS);
+    assert(qthread_feb_status(&words[0]) == 1);
+    iprintf("simple transitions ok\n");
+
+    /* many words empty at once */
+    for (i = 0; i < NUM_WORDS; i++) {
+        assert(qthread_empty(&words[i]) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i < NUM_WORDS; i++) {
+        assert(qthread_feb_status(&words[i]) == 0);
+    }
+    for (i = 0; i < NUM_WORDS; i += 2) {
+        assert(qthread_fill(&words[i]) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i < NUM_WORDS; i++) {
+        assert(qthread_feb_status(&words[i]) == ((i & 1) == 0));
+    }
+    for (i = 1; i < NUM_WORDS; i += 2) {
+        words[i] = i;
+        assert(qthread_fill(&words[i]) == QTHREAD_SUCCESS);
+    }
+    iprintf("%lu words emptied and filled ok\n", (unsigned long)NUM_WORDS);
+
+    /* waiters: each word is emptied, waited on, and refilled */
+    for (i = 0; i < NUM_WORDS; i++) {
+        assert(qthread_empty(&words[i]) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i < NUM_WORDS; i++) {
+        assert(qthread_fork(waiter, (void *)(uintptr_t)i, &rets[i]) == 0);
+    }
+    for (i = 0; i < NUM_WORDS; i++) {
+        assert(qthread_fork(filler, (void *)(uintptr_t)i, NULL) == 0);
+    }
+    for (i = 0; i < NUM_WORDS; i++) {
+        assert(qthread_readFF(NULL, &rets[i]) == QTHREAD_SUCCESS);
+        assert(qthread_readFF(&v, &words[i]) == QTHREAD_SUCCESS);
+        assert(v == i + 1);
+    }
+    iprintf("waiters ok\n");
+
+    free(rets);
+    free(words);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,123 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/sinc.h>
+#include "argparsing.h"
+
+static aligned_t ran = 0;
+static size_t    count = 1000;
+
+static aligned_t double_it(void *arg)
+{
+    qthread_incr(&ran, 1);
+    return 2 * *(aligned_t *)arg;
+}
+
+static aligned_t just_count(void *arg)
+{
+    qthread_incr(&ran, 1);
+    return 1;
+}
+
+/* a team member that fans out; the team must wait for the whole batch */
+static aligned_t fan_out(void *arg)
+{
+    qthread_f *funcs = arg;
+
+    assert(qthread_spawn_many(count, funcs, NULL, 0, NULL, NO_SHEPHERD, 0) == QTHREAD_SUCCESS);
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    qthread_f *funcs;
+    void     **args, **rets;
+    aligned_t *vals, *alrets, team_ret;
+    syncvar_t *svrets;
+    qt_sinc_t  sinc;
+    uint64_t   sv;
+    size_t     i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(count, "TEST_COUNT");
+
+    funcs  = malloc(count * sizeof(qthread_f));
+    args   = malloc(count * sizeof(void *));
+    rets   = malloc(count * sizeof(void *));
+    vals   = malloc(count * sizeof(aligned_t));
+    alrets = malloc(count * sizeof(aligned_t));
+    svrets = malloc(count * sizeof(syncvar_t));
+    assert(funcs && args && rets && vals && alrets && svrets);
+
+    /* aligned_t returns, arguments by reference */
+    for (i = 0; i < count; i++) {
+        vals[i] = i;
+        args[i] = &vals[i];
+        rets[i] = &alrets[i];
+        funcs[i] = double_it;
+    }
+    assert(qthread_spawn_many(count, funcs, args, 0, rets, NO_SHEPHERD, 0) == QTHREAD_SUCCESS);
+    for (i = 0; i < count; i++) {
+        qthread_readFF(NULL, &alrets[i]);
+        assert(alrets[i] == 2 * i);
+    }
+    iprintf("%lu aligned_t returns ok\n", (unsigned long)count);
+
+    /* syncvar_t returns, copied arguments, simple tasks */
+    for (i = 0; i < count; i++) {
+        svrets[i] = SYNCVAR_EMPTY_INITIALIZER;
+        rets[i]   = &svrets[i];
+    }
+    assert(qthread_spawn_many(count, funcs, args, sizeof(aligned_t), rets, NO_SHEPHERD,
+                              QTHREAD_SPAWN_RET_SYNCVAR_T | QTHREAD_SPAWN_SIMPLE) == QTHREAD_SUCCESS);
+    for (i = 0; i < count; i++) {
+        vals[i] = 0;           /* the tasks have their own copies */
+    }
+    for (i = 0; i < count; i++) {
+        qthread_syncvar_readFF(&sv, &svrets[i]);
+        assert(sv == 2 * i);
+    }
+    iprintf("%lu syncvar_t returns ok\n", (unsigned long)count);
+
+    /* everything submits to one sinc, and can be pinned */
+    qt_sinc_init(&sinc, 0, NULL, NULL, count);
+    for (i = 0; i < count; i++) {
+        funcs[i] = just_count;
+        rets[i]  = &sinc;
+    }
+    assert(qthread_spawn_many(count, funcs, NULL, 0, rets, qthread_num_shepherds() - 1,
+                              QTHREAD_SPAWN_RET_SINC_VOID) == QTHREAD_SUCCESS);
+    qt_sinc_wait(&sinc, NULL);
+    qt_sinc_fini(&sinc);
+    iprintf("%lu sinc submissions ok\n", (unsigned long)count);
+
+    /* batches join the spawner's team */
+    ran = 0;
+    assert(qthread_fork_new_team(fan_out, funcs, &team_ret) == QTHREAD_SUCCESS);
+    qthread_readFF(NULL, &team_ret);
+    assert(ran == count);
+    iprintf("team waited for a batch of %lu\n", (unsigned long)count);
+
+    /* teams cannot be founded in bulk */
+    assert(qthread_spawn_many(count, funcs, NULL, 0, NULL, NO_SHEPHERD,
+                              QTHREAD_SPAWN_NEW_TEAM) == QTHREAD_BADARGS);
+    assert(qthread_spawn_many(0, funcs, NULL, 0, NULL, NO_SHEPHERD, 0) == QTHREAD_SUCCESS);
+
+    free(svrets);
+    free(alrets);
+    free(vals);
+    free(rets);
+    free(args);
+    free(funcs);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,159 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef STEAL_PROFILE
+/* these come first: the library's own assert() may be compiled out, and the
+ * test's must not be */
+# include "qthread_innards.h"
+# include "qt_shepherd_innards.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+static aligned_t  ran = 0;
+static aligned_t *ran_on;
+static char      *data;
+static int        count = 1000;
+
+static aligned_t task(void *arg)
+{
+    qthread_incr(&ran_on[qthread_shep()], 1);
+    qthread_incr(&ran, 1);
+    return 0;
+}
+
+/* with QTHREAD_SPAWN_PLACE_OWNER, the argument is the hint; a stride of 0
+ * puts every task's argument in the same page */
+static void spawn_strided(unsigned int flags,
+                          size_t       stride)
+{
+    aligned_t *rets = malloc(count * sizeof(aligned_t));
+
+    assert(rets);
+    for (int i = 0; i < count; i++) {
+        assert(qthread_spawn(task, data + (size_t)i * stride, 0, &rets[i],
+                             0, NULL, NO_SHEPHERD, flags) == QTHREAD_SUCCESS);
+    }
+    for (int i = 0; i < count; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    free(rets);
+}
+
+static void spawn_all(unsigned int flags)
+{
+    spawn_strided(flags, 512);
+}
+
+#ifdef STEAL_PROFILE
+/* Where tasks were placed, as opposed to where they ran: an idle shepherd
+ * may steal a task before its own shepherd gets to it. */
+static size_t placed_on(qthread_shepherd_id_t s)
+{
+    return qlib->shepherds[s].spawn_placed;
+}
+#endif
+
+/* placement from inside a task, where there is a spawning shepherd */
+static aligned_t spawner(void *arg)
+{
+    spawn_all((unsigned int)(uintptr_t)arg);
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    static const unsigned int flags[] = {
+        0,
+        QTHREAD_SPAWN_PLACE_P2C,
+        QTHREAD_SPAWN_PLACE_DOMAIN,
+        QTHREAD_SPAWN_PLACE_OWNER,
+        QTHREAD_SPAWN_PLACE_OWNER | QTHREAD_SPAWN_PLACE_P2C,
+        QTHREAD_SPAWN_PLACE_DOMAIN | QTHREAD_SPAWN_SIMPLE
+    };
+    const size_t nflags = sizeof(flags) / sizeof(flags[0]);
+    aligned_t    expected = 0;
+    aligned_t    r;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(count, "TEST_COUNT");
+    iprintf("%i shepherds...\n", qthread_num_shepherds());
+    iprintf("  %i threads total\n", qthread_num_workers());
+
+    ran_on = calloc(qthread_num_shepherds(), sizeof(aligned_t));
+    data   = malloc((size_t)count * 512);
+    assert(ran_on && data);
+
+    for (size_t f = 0; f < nflags; f++) {
+        spawn_all(flags[f]);
+        assert(qthread_fork(spawner, (void *)(uintptr_t)flags[f], &r) == QTHREAD_SUCCESS);
+        qthread_readFF(NULL, &r);
+        expected += 2 * count;
+        assert(ran == expected);
+        iprintf("flags %#x: %i tasks placed from outside and inside a task\n",
+                flags[f], count);
+    }
+
+#ifdef STEAL_PROFILE
+    /* tasks whose arguments share a page are all placed on one shepherd */
+    {
+        qthread_shepherd_id_t const nsheps = qthread_num_shepherds();
+        size_t                     *before = malloc(nsheps * sizeof(size_t));
+        int                         owners = 0;
+
+        assert(before);
+        for (qthread_shepherd_id_t s = 0; s < nsheps; s++) {
+            before[s] = placed_on(s);
+        }
+        spawn_strided(QTHREAD_SPAWN_PLACE_OWNER, 0);
+        expected += count;
+        assert(ran == expected);
+        for (qthread_shepherd_id_t s = 0; s < nsheps; s++) {
+            if (placed_on(s) != before[s]) {
+                assert(placed_on(s) - before[s] == (size_t)count);
+                owners++;
+            }
+        }
+        assert(owners == 1);
+        free(before);
+        iprintf("same-page tasks share a shepherd\n");
+    }
+#endif /* ifdef STEAL_PROFILE */
+
+    /* disabled shepherds are never chosen, and so run nothing */
+    if (qthread_num_shepherds() > 1) {
+        aligned_t const ran_on_one = ran_on[1];
+#ifdef STEAL_PROFILE
+        size_t const placed_one = placed_on(1);
+#endif
+
+        assert(qthread_disable_shepherd(1) == QTHREAD_SUCCESS);
+        for (size_t f = 1; f < nflags; f++) {
+            spawn_all(flags[f]);
+            expected += count;
+        }
+        assert(ran == expected);
+        assert(ran_on[1] == ran_on_one);
+#ifdef STEAL_PROFILE
+        assert(placed_on(1) == placed_one);
+#endif
+        qthread_enable_shepherd(1);
+        iprintf("placement around a disabled shepherd ok\n");
+    }
+
+    for (int i = 0; i < qthread_num_shepherds(); i++) {
+        iprintf("shepherd %i ran %lu tasks\n", i, (unsigned long)ran_on[i]);
+    }
+    free(data);
+    free(ran_on);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+static aligned_t ran   = 0;
+static aligned_t ready = 1;
+
+/* Stackless tasks may call anything that does not actually block. */
+static aligned_t stackless(void *arg)
+{
+    aligned_t tmp;
+
+    qthread_yield();         /* ignored, since there is nothing to yield to */
+    assert(qthread_migrate_to(0) == QTHREAD_NOT_ALLOWED);
+    qthread_readFF(&tmp, &ready); /* already full, so this does not block */
+    assert(tmp == 1);
+    qthread_incr(&ran, 1);
+
+    return (aligned_t)(uintptr_t)arg;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    int        count = 1000;
+    aligned_t *rets;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(count, "TEST_COUNT");
+    iprintf("%i shepherds...\n", qthread_num_shepherds());
+    iprintf("  %i threads total\n", qthread_num_workers());
+
+    qthread_fill(&ready);
+    rets = malloc(count * sizeof(aligned_t));
+    assert(rets);
+    for (int i = 0; i < count; i++) {
+        qthread_empty(&rets[i]);
+        assert(qthread_spawn(stackless, (void *)(uintptr_t)i, 0, &rets[i],
+                             0, NULL, NO_SHEPHERD, QTHREAD_SPAWN_SIMPLE) == QTHREAD_SUCCESS);
+    }
+    for (int i = 0; i < count; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(rets[i] == (aligned_t)i);
+    }
+    assert(ran == (aligned_t)count);
+    free(rets);
+
+    iprintf("%i stackless tasks ran to completion\n", count);
+    return 0;
+}
+
+/* vim:set expandtab */
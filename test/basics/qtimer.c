@@ -310,6 +310,15 @@ static void autocorrelation(void)
     }
 } /*}}}*/
 
+static aligned_t draw(void *arg)
+{
+    unsigned long *out = (unsigned long *)arg;
+
+    out[0] = qthread_random();
+    out[1] = qthread_random();
+    return 0;
+}
+
 int main(int   argc,
          char *argv[])
 {
@@ -342,6 +351,46 @@ int main(int   argc,
 
     qtimer_destroy(t);
 
+    // Timers on the stack need no setup, and must agree with qtimer_wtime()
+    {
+        qtimer_local_t local;
+        double         start, stop, secs;
+
+        start = qtimer_wtime();
+        qtimer_local_start(&local);
+        do {
+            stop = qtimer_wtime();
+        } while (stop - start < 0.01);
+        qtimer_local_stop(&local);
+        secs = qtimer_local_secs(&local);
+        iprintf("local timer: %g secs over a %g sec wait\n", secs, stop - start);
+        assert(local.stop >= local.start);
+        assert(secs >= 0.005 && secs <= 1.0);
+        assert(qtimer_ticks_secs(0) == 0.0);
+    }
+
+    // Every worker has its own qthread_random() stream
+    {
+        qthread_shepherd_id_t nsheps = qthread_num_shepherds();
+        unsigned long        *draws  = malloc(sizeof(unsigned long) * 2 * nsheps);
+        aligned_t            *rets   = malloc(sizeof(aligned_t) * nsheps);
+
+        assert(draws && rets);
+        for (qthread_shepherd_id_t i = 0; i < nsheps; i++) {
+            qthread_fork_to(draw, draws + 2 * i, rets + i, i);
+        }
+        for (qthread_shepherd_id_t i = 0; i < nsheps; i++) {
+            qthread_readFF(NULL, rets + i);
+            iprintf("shepherd %u drew %lu, %lu\n", (unsigned)i, draws[2 * i], draws[2 * i + 1]);
+            assert(draws[2 * i] != draws[2 * i + 1]);
+            if (i > 0) {
+                assert(draws[2 * i] != draws[0]);
+            }
+        }
+        free(rets);
+        free(draws);
+    }
+
     // Now to test fastrand
     ks_test();
     runs();
@@ -122,6 +122,24 @@ int main(int   argc,
 
     qt_sinc_fini(&sinc);
 
+    // Sincs made over and over get their storage back from a pool; each
+    // must still start out from its own initial value
+    for (int i = 0; i < 64; i++) {
+        qt_sinc_t *s   = qt_sinc_create(sizeof(my_value_t), &initial_value, my_incr, 1);
+        qt_sinc_t *n   = qt_sinc_create(0, NULL, NULL, 1);
+        my_value_t one = 1;
+
+        x = 0;
+        qt_sinc_submit(s, &one);
+        qt_sinc_submit(n, NULL);
+        qt_sinc_wait(s, &x);
+        qt_sinc_wait(n, NULL);
+        assert(x == 1);
+        qt_sinc_destroy(s);
+        qt_sinc_destroy(n);
+    }
+    iprintf("Reused sincs start out empty\n");
+
     if (total == (1UL << (depth+1))) {
         iprintf("SUCCEEDED with total = 2*(2^%lu) = %lu\n", 
             (unsigned long)depth,
@@ -0,0 +1,174 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"                   /* for _GNU_SOURCE */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/qloop.h>
+#include <qthread/qtimer.h>
+#include <qthread/dictionary.h>
+#include "argparsing.h"
+
+/* Mixed workload on a qt_dictionary: the table is prefilled with NUM_KEYS
+ * keys, then NUM_OPS operations are spread across the workers. Of every
+ * hundred operations, PUT_PCT are put_if_absent and DEL_PCT are deletes of
+ * random keys drawn from twice the prefilled range; the rest are lookups.
+ * The same lookups are then timed on their own, one at a time and in
+ * batches of BATCH keys with qt_dictionary_get_many. */
+
+static size_t    num_keys = 100000;
+static size_t    num_ops  = 1000000;
+static size_t    numiters = 10;
+static size_t    put_pct  = 10;
+static size_t    del_pct  = 10;
+static size_t    batch    = 256;
+static aligned_t hits     = 0;
+
+static qt_dictionary *dict;
+static uintptr_t     *keys;
+static void         **lookups; /* the keys looked up, in workload order */
+
+static int key_equals(void *a,
+                      void *b)
+{
+    return a == b;
+}
+
+static int key_hash(void *a)
+{
+    return (int)(uintptr_t)a;
+}
+
+static void prefill(const size_t startat,
+                    const size_t stopat,
+                    void        *arg)
+{
+    for (size_t i = startat; i < stopat; ++i) {
+        qt_dictionary_put(dict, (void *)keys[i], (void *)keys[i]);
+    }
+}
+
+static void mixed(const size_t startat,
+                  const size_t stopat,
+                  void        *arg)
+{
+    aligned_t found = 0;
+
+    for (size_t i = startat; i < stopat; ++i) {
+        uint64_t  r   = (uint64_t)i * 0x9E3779B97F4A7C15ULL;
+        uintptr_t k   = keys[(r >> 33) % (2 * num_keys)];
+        size_t    pct = (r >> 13) % 100;
+
+        if (pct < put_pct) {
+            qt_dictionary_put_if_absent(dict, (void *)k, (void *)k);
+        } else if (pct < put_pct + del_pct) {
+            qt_dictionary_delete(dict, (void *)k);
+        } else if (qt_dictionary_get(dict, (void *)k) != NULL) {
+            found++;
+        }
+    }
+    qthread_incr(&hits, found);
+}
+
+static void gets(const size_t startat,
+                 const size_t stopat,
+                 void        *arg)
+{
+    aligned_t found = 0;
+
+    for (size_t i = startat; i < stopat; ++i) {
+        if (qt_dictionary_get(dict, lookups[i]) != NULL) {
+            found++;
+        }
+    }
+    qthread_incr(&hits, found);
+}
+
+static void get_many(const size_t startat,
+                     const size_t stopat,
+                     void        *arg)
+{
+    void    **values = malloc(batch * sizeof(void *));
+    aligned_t found  = 0;
+
+    assert(values);
+    for (size_t i = startat; i < stopat; i += batch) {
+        size_t const n = (stopat - i < batch) ? (stopat - i) : batch;
+
+        found += qt_dictionary_get_many(dict, n, lookups + i, values);
+    }
+    qthread_incr(&hits, found);
+    free(values);
+}
+
+static double time_loop(qt_loop_f f,
+                        qtimer_t  timer)
+{
+    hits = 0;
+    qtimer_start(timer);
+    qt_loop_balance(0, num_ops, f, NULL);
+    qtimer_stop(timer);
+    return qtimer_secs(timer);
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t  timer = qtimer_create();
+    double    total = 0, total_get = 0, total_many = 0;
+    aligned_t mixed_hits = 0, get_hits;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+    NUMARG(num_keys, "NUM_KEYS");
+    NUMARG(num_ops, "NUM_OPS");
+    NUMARG(numiters, "NUM_ITERS");
+    NUMARG(put_pct, "PUT_PCT");
+    NUMARG(del_pct, "DEL_PCT");
+    NUMARG(batch, "BATCH");
+    assert(batch > 0);
+    assert(put_pct + del_pct <= 100);
+
+    keys = malloc(2 * num_keys * sizeof(uintptr_t));
+    assert(keys);
+    for (size_t i = 0; i < 2 * num_keys; ++i) {
+        keys[i] = i + 1;
+    }
+    lookups = malloc(num_ops * sizeof(void *));
+    assert(lookups);
+    for (size_t i = 0; i < num_ops; ++i) {
+        lookups[i] = (void *)keys[(((uint64_t)i * 0x9E3779B97F4A7C15ULL) >> 33) % (2 * num_keys)];
+    }
+
+    for (size_t it = 0; it < numiters; ++it) {
+        dict = qt_dictionary_create(key_equals, key_hash, NULL);
+        assert(dict);
+        qt_loop_balance(0, num_keys, prefill, NULL);
+        total      += time_loop(mixed, timer);
+        mixed_hits  = hits;
+        total_get  += time_loop(gets, timer);
+        get_hits    = hits;
+        total_many += time_loop(get_many, timer);
+        assert(hits == get_hits);
+        qt_dictionary_destroy(dict);
+    }
+
+    printf("%5i %7i %9lu %9lu %3lu/%3lu/%3lu %f Mops/s (%lu hits)\n",
+           (int)qthread_num_shepherds(), (int)qthread_num_workers(),
+           (unsigned long)num_keys, (unsigned long)num_ops,
+           (unsigned long)(100 - put_pct - del_pct), (unsigned long)put_pct,
+           (unsigned long)del_pct, (num_ops * numiters) / total / 1e6,
+           (unsigned long)mixed_hits);
+    printf("lookups: %f Mops/s one at a time, %f Mops/s in batches of %lu\n",
+           (num_ops * numiters) / total_get / 1e6,
+           (num_ops * numiters) / total_many / 1e6, (unsigned long)batch);
+
+    free(lookups);
+    free(keys);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -36,7 +36,7 @@ static aligned_t int_fetch_inc(
 
     for (offset = 0, node = 0, depth = 0; depth < PTREE_DEPTH; ++depth) {
         unsigned int pindex =
-            qtimer_fastrand() % (ROOT_PRISM_SIZE >> depth) + 1;
+            qthread_random() % (ROOT_PRISM_SIZE >> depth) + 1;
         aligned_t try1 = qthread_incr(&prism[node][pindex], 1);
         if (try1 & 0x1) {              // try is odd
             node = 2 * node + 2;       // go right
@@ -28,7 +28,7 @@ static void sumrand(const size_t startat,
         tmp = randlen[i];
         tmp2 = tmp;
         while (tmp2 > 0) {
-            tmp += qtimer_fastrand();
+            tmp += qthread_random();
             tmp2--;
         }
     }
@@ -100,7 +100,7 @@ int main(int   argc,
 
     randlen = malloc(sizeof(size_t) * numincrs);
     for (int i = 0; i < numincrs; ++i) {
-        randlen[i] = qtimer_fastrand() % 10;
+        randlen[i] = qthread_random() % 10;
     }
 
     if (print_headers) {
@@ -0,0 +1,160 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"                   /* for QTHREAD_SINC_STYLE */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/sinc.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* The sinc implementation is picked at configure time (--with-sinc), so
+ * comparing them means building once per implementation and running this
+ * against each build. Within a run, the work is spread over more and more
+ * shepherds to show how each one holds up as more of them share a sinc. */
+#ifndef QTHREAD_SINC_STYLE
+# define QTHREAD_SINC_STYLE "unknown"
+#endif
+
+static aligned_t             numtasks     = 16384;
+static aligned_t             depth        = 12;
+static size_t                numiters     = 10;
+static qthread_shepherd_id_t active_sheps = 1;
+static qtimer_t              timer;
+
+static int num_sheps   = 0;
+static int num_workers = 0;
+
+static void sum(void       *tgt,
+                const void *src)
+{
+    *(aligned_t *)tgt += *(const aligned_t *)src;
+}
+
+/* one sinc, counted up front, and a task per count */
+static aligned_t flat_task(void *arg)
+{
+    aligned_t one = 1;
+
+    qt_sinc_submit((qt_sinc_t *)arg, &one);
+    return 0;
+}
+
+/* every task expects its children before submitting itself, so the counts
+ * go up and down all over the place */
+typedef struct tree_args_s {
+    qt_sinc_t *sinc;
+    aligned_t  depth;
+    aligned_t  id;
+} tree_args_t;
+
+static aligned_t tree_task(void *arg_)
+{
+    tree_args_t *arg = (tree_args_t *)arg_;
+
+    if (arg->depth > 0) {
+        tree_args_t kids[2] = {
+            { arg->sinc, arg->depth - 1, arg->id * 2 + 1 },
+            { arg->sinc, arg->depth - 1, arg->id * 2 + 2 }
+        };
+
+        qt_sinc_expect(arg->sinc, 2);
+        for (int i = 0; i < 2; i++) {
+            qthread_fork_copyargs_to(tree_task, &kids[i], sizeof(tree_args_t), NULL,
+                                     kids[i].id % active_sheps);
+        }
+        qt_sinc_submit(arg->sinc, NULL);
+    } else {
+        aligned_t one = 1;
+        qt_sinc_submit(arg->sinc, &one);
+    }
+    return 0;
+}
+
+static double run_flat(void)
+{
+    double    total = 0;
+    aligned_t zero  = 0;
+
+    for (size_t i = 0; i < numiters; i++) {
+        aligned_t  result;
+        qt_sinc_t *sinc;
+
+        qtimer_start(timer);
+        sinc = qt_sinc_create(sizeof(aligned_t), &zero, sum, numtasks);
+        for (aligned_t t = 0; t < numtasks; t++) {
+            qthread_fork_to(flat_task, sinc, NULL, t % active_sheps);
+        }
+        qt_sinc_wait(sinc, &result);
+        qtimer_stop(timer);
+        assert(result == numtasks);
+        qt_sinc_destroy(sinc);
+        total += qtimer_secs(timer);
+    }
+    return total / numiters;
+}
+
+static double run_tree(void)
+{
+    double    total = 0;
+    aligned_t zero  = 0;
+
+    for (size_t i = 0; i < numiters; i++) {
+        aligned_t   result;
+        tree_args_t root;
+
+        qtimer_start(timer);
+        root.sinc  = qt_sinc_create(sizeof(aligned_t), &zero, sum, 1);
+        root.depth = depth;
+        root.id    = 0;
+        qthread_fork_copyargs_to(tree_task, &root, sizeof(tree_args_t), NULL, 0);
+        qt_sinc_wait(root.sinc, &result);
+        qtimer_stop(timer);
+        assert(result == ((aligned_t)1 << depth));
+        qt_sinc_destroy(root.sinc);
+        total += qtimer_secs(timer);
+    }
+    return total / numiters;
+}
+
+static void run_all(void)
+{
+    printf("%-13s %5i %7i %-5s %8lu %f\n", QTHREAD_SINC_STYLE, (int)active_sheps, num_workers,
+           "flat", (unsigned long)numtasks, run_flat());
+    printf("%-13s %5i %7i %-5s %8lu %f\n", QTHREAD_SINC_STYLE, (int)active_sheps, num_workers,
+           "tree", (unsigned long)((aligned_t)2 << depth) - 1, run_tree());
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    int print_headers = 1;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    num_sheps   = qthread_num_shepherds();
+    num_workers = qthread_num_workers();
+
+    CHECK_VERBOSE();
+    NUMARG(numtasks, "NUM_TASKS");
+    NUMARG(depth, "TREE_DEPTH");
+    NUMARG(numiters, "NUM_ITERS");
+    NUMARG(print_headers, "PRINT_HEADERS");
+    if (print_headers) {
+        printf("%i shepherds\n", num_sheps);
+        printf("%i threads\n", num_workers);
+        printf("%-13s %5s %7s %-5s %8s time\n", "sinc", "sheps", "workers", "shape", "tasks");
+    }
+    timer = qtimer_create();
+
+    for (active_sheps = 1; active_sheps < num_sheps; active_sheps *= 2) {
+        run_all();
+    }
+    active_sheps = num_sheps;
+    run_all();
+
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -55,8 +55,8 @@ static inline void perform_local_work(void)
     qtimer_start(work_timer);
 # endif // TIME_WORKLOAD
     volatile unsigned long work = workload;
-    long rand_per = (long)qtimer_fastrand();
-    long rand_var = (long)qtimer_fastrand();
+    long rand_per = (long)qthread_random();
+    long rand_var = (long)qthread_random();
 
     rand_per = (rand_per<0) ? (-rand_per)%100 : rand_per%100;
     if (rand_per < workload_per) {
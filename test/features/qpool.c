@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <qthread/qthread.h>
 #include <qthread/qpool.h>
@@ -31,13 +32,78 @@ static aligned_t allocator(void *arg)
     return 0;
 }
 
+/* comfortably more than one batch of aligned_t-sized items */
+#define REMOTE_COUNT 10000
+static aligned_t **allthat;
+
+static aligned_t alloc_all(void *arg)
+{
+    for (size_t i = 0; i < REMOTE_COUNT; i++) {
+        allthat[i] = (aligned_t *)qpool_alloc(qp);
+        assert(allthat[i] != NULL);
+    }
+    return 0;
+}
+
+static aligned_t free_all(void *arg)
+{
+    for (size_t i = 0; i < REMOTE_COUNT; i++) {
+        qpool_free(qp, allthat[i]);
+    }
+    return 0;
+}
+
+/* pages, in many blocks of many items */
+#define BIG_ITEM  4096
+#define BIG_COUNT 4096
+
+static size_t trimmed(qpool *p,
+                      size_t *bytes)
+{
+    qpool_stats_t stats;
+    size_t        n = 0;
+
+    *bytes = 0;
+    for (size_t i = 0; i < qpool_num_nodes(p); i++) {
+        assert(qpool_stats(p, i, &stats) == QTHREAD_SUCCESS);
+        n      += stats.trimmed;
+        *bytes += stats.bytes;
+    }
+    return n;
+}
+
+static void churn(qpool *p)
+{
+    void **items = malloc(sizeof(void *) * BIG_COUNT);
+
+    assert(items != NULL);
+    for (size_t i = 0; i < BIG_COUNT; i++) {
+        items[i] = qpool_alloc(p);
+        assert(items[i] != NULL);
+        memset(items[i], 0x5a, BIG_ITEM);
+    }
+    for (size_t i = 0; i < BIG_COUNT; i++) {
+        qpool_free(p, items[i]);
+    }
+    free(items);
+}
+
+#ifdef __INTEL_COMPILER
+int setenv(const char *name,
+           const char *value,
+           int overwrite);
+#endif
+
 int main(int argc,
          char *argv[])
 {
     size_t i;
     aligned_t *rets;
-    aligned_t **allthat;
+    qpool_stats_t stats;
+    size_t nodes, hits = 0, bytes = 0;
 
+    /* so that the pool is split in two when there are two shepherds */
+    setenv("QT_MPOOL_NODES", "2", 0);
     assert(qthread_initialize() == QTHREAD_SUCCESS);
     CHECK_VERBOSE();
     NUMARG(ELEMENT_COUNT, "ELEMENT_COUNT");
@@ -85,8 +151,70 @@ int main(int argc,
     }
     free(rets);
 
+    /* items allocated on one shepherd and freed on another */
+    allthat = (aligned_t **)malloc(sizeof(aligned_t *) * REMOTE_COUNT);
+    assert(allthat != NULL);
+    rets = (aligned_t *)malloc(sizeof(aligned_t));
+    assert(rets != NULL);
+    assert(qthread_fork_to(alloc_all, NULL, rets, 0) == QTHREAD_SUCCESS);
+    assert(qthread_readFF(NULL, rets) == QTHREAD_SUCCESS);
+    assert(qthread_fork_to(free_all, NULL, rets, qthread_num_shepherds() > 1) == QTHREAD_SUCCESS);
+    assert(qthread_readFF(NULL, rets) == QTHREAD_SUCCESS);
+    free(rets);
+    free(allthat);
+
+    nodes = qpool_num_nodes(qp);
+    assert(nodes >= 1);
+    for (i = 0; i < nodes; i++) {
+        assert(qpool_stats(qp, i, &stats) == QTHREAD_SUCCESS);
+        iprintf("node %lu: %lu hits, %lu refills, %lu spills, %lu remote frees, %lu blocks (%lu bytes)\n",
+                (unsigned long)i, (unsigned long)stats.hits,
+                (unsigned long)stats.refills, (unsigned long)stats.spills,
+                (unsigned long)stats.remote_frees, (unsigned long)stats.blocks,
+                (unsigned long)stats.bytes);
+        hits  += stats.hits;
+        bytes += stats.bytes;
+        if ((nodes > 1) && (i == 0)) {
+            /* shepherds 0 and 1 are in different domains */
+            assert(stats.remote_frees > 0);
+        }
+    }
+    assert(hits > 0);
+    assert(bytes >= REMOTE_COUNT * sizeof(aligned_t));
+    assert(qpool_stats(qp, nodes, &stats) == QTHREAD_BADARGS);
+
     qpool_destroy(qp);
 
+    /* once it is all freed, most of the pool is given back */
+    {
+        qpool *big = qpool_create(BIG_ITEM);
+        size_t before, after, released, n;
+
+        assert(big != NULL);
+        churn(big);
+        assert(trimmed(big, &before) == 0);
+        released = qpool_trim(big);
+        n        = trimmed(big, &after);
+        iprintf("trimmed %lu blocks: %lu of %lu bytes\n", (unsigned long)n,
+                (unsigned long)released, (unsigned long)before);
+        assert(n > 0);
+        assert(released > 0);
+        assert(after == before - released);
+        assert(qpool_trim(big) == 0);
+
+        /* and a soft cap does it as the items are freed */
+        qpool_set_soft_cap(big, 1);
+        for (i = 0; i < 4; i++) {
+            churn(big);
+        }
+        assert(trimmed(big, &after) > n);
+        iprintf("with a soft cap: %lu blocks trimmed, %lu bytes held\n",
+                (unsigned long)trimmed(big, &after), (unsigned long)after);
+        qpool_destroy(big);
+    }
+    iprintf("qthread_trim_memory() released %lu bytes\n",
+            (unsigned long)qthread_trim_memory());
+
     iprintf("success!\n");
     return 0;
 }
@@ -1,9 +1,11 @@
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "argparsing.h"
 
 #include <qthread/qthread.h>
+#include <qthread/qloop.h>
 #include <qthread/dictionary.h>
 #include <qthread/hash.h>
 
@@ -30,6 +32,85 @@ void my_destructor(void *key, void *val)
     iprintf("\tdeleting value key=%p (%s), val=%p (%s)\n", key, key, val, val);
 }
 
+/* enough concurrently inserted keys to make a growing table resize a few
+ * times while it is in use */
+static qt_dictionary *big;
+static size_t         NUM_KEYS = 20000;
+
+static int int_key_equals(void *first,
+                          void *second)
+{
+    return first == second;
+}
+
+/* deliberately weak, like many user hash functions */
+static int int_hashcode(void *key)
+{
+    return (int)(uintptr_t)key;
+}
+
+static void insert_keys(size_t startat,
+                        size_t stopat,
+                        void  *arg)
+{
+    for (size_t i = startat; i < stopat; i++) {
+        void *k = (void *)(uintptr_t)(i + 1);
+
+        assert(qt_dictionary_put_if_absent(big, k, k) == k);
+    }
+}
+
+/* keeps the odd keys */
+static void check_keys(size_t startat,
+                       size_t stopat,
+                       void  *arg)
+{
+    for (size_t i = startat; i < stopat; i++) {
+        void *k = (void *)(uintptr_t)(i + 1);
+
+        assert(qt_dictionary_get(big, k) == k);
+        if (i & 1) {
+            assert(qt_dictionary_delete(big, k) == k);
+            assert(qt_dictionary_get(big, k) == NULL);
+        }
+    }
+}
+
+/* spreads the key across all 64 bits */
+static uint64_t int_hashcode64(void *key)
+{
+    return (uint64_t)(uintptr_t)key * UINT64_C(0xD6E8FEB86659FD93);
+}
+
+static void **batch_keys;
+
+static void put_batches(size_t startat,
+                        size_t stopat,
+                        void  *arg)
+{
+    void **results = malloc((stopat - startat) * sizeof(void *));
+
+    assert(results);
+    assert(qt_dictionary_put_many(big, stopat - startat, batch_keys + startat,
+                                  batch_keys + startat, results) == stopat - startat);
+    for (size_t i = startat; i < stopat; i++) {
+        assert(results[i - startat] == batch_keys[i]);
+    }
+    free(results);
+}
+
+static aligned_t visited = 0, visited_sum = 0;
+
+static void visit(void *key,
+                  void *value,
+                  void *arg)
+{
+    assert(key == value);
+    assert(arg == &visited);
+    qthread_incr(&visited, 1);
+    qthread_incr(&visited_sum, (aligned_t)(uintptr_t)key);
+}
+
 int main(int    argc,
          char **argv)
 {
@@ -158,6 +239,86 @@ int main(int    argc,
     qt_dictionary_iterator_destroy(it2);
     qt_dictionary_destroy(dict);
 
+    // concurrent use of a dictionary that has to grow
+    NUMARG(NUM_KEYS, "NUM_KEYS");
+    big = qt_dictionary_create(int_key_equals, int_hashcode, NULL);
+    qt_loop(0, NUM_KEYS, insert_keys, NULL);
+    qt_loop(0, NUM_KEYS, check_keys, NULL);
+    no_entries = 0;
+    it         = qt_dictionary_iterator_create(big);
+    while(NULL != qt_dictionary_iterator_next(it)) {
+        list_entry *le = qt_dictionary_iterator_get(it);
+        no_entries++;
+        assert(le->key == le->value);
+        assert((uintptr_t)le->key & 1);
+    }
+    qt_dictionary_iterator_destroy(it);
+    iprintf("21. Found %d of %lu keys after concurrent inserts and deletes\n",
+            no_entries, (unsigned long)NUM_KEYS);
+    assert(no_entries == (NUM_KEYS + 1) / 2);
+    qt_dictionary_destroy(big);
+
+    // batched operations and parallel traversal, with a 64-bit hash
+    big        = qt_dictionary_create64(int_key_equals, int_hashcode64, NULL);
+    batch_keys = malloc(2 * NUM_KEYS * sizeof(void *));
+    assert(batch_keys);
+    for (size_t i = 0; i < 2 * NUM_KEYS; i++) {
+        batch_keys[i] = (void *)(uintptr_t)(i + 1);
+    }
+    qt_loop_balance(0, NUM_KEYS, put_batches, NULL);
+    {
+        // the second half of the keys were never inserted
+        void **values = malloc(2 * NUM_KEYS * sizeof(void *));
+
+        assert(values);
+        assert(qt_dictionary_get_many(big, 2 * NUM_KEYS, batch_keys, values) == NUM_KEYS);
+        for (size_t i = 0; i < 2 * NUM_KEYS; i++) {
+            assert(values[i] == ((i < NUM_KEYS) ? batch_keys[i] : NULL));
+        }
+        free(values);
+    }
+    qt_dictionary_for_each(big, visit, &visited);
+    iprintf("22. Visited %lu of %lu batch-inserted keys\n",
+            (unsigned long)visited, (unsigned long)NUM_KEYS);
+    assert(visited == NUM_KEYS);
+    assert(visited_sum == (aligned_t)NUM_KEYS * (NUM_KEYS + 1) / 2);
+    qt_dictionary_destroy(big);
+    free(batch_keys);
+
+    // inserting while an iterator is live must not make it return an entry
+    // twice, even though the inserts would otherwise grow the table
+    big = qt_dictionary_create(int_key_equals, int_hashcode, NULL);
+    qt_loop(0, NUM_KEYS, insert_keys, NULL);
+    {
+        char     *seen     = calloc(2 * NUM_KEYS + 1, 1);
+        uintptr_t next_key = NUM_KEYS + 1;
+        size_t    i;
+
+        assert(seen);
+        no_entries = 0;
+        it         = qt_dictionary_iterator_create(big);
+        while(NULL != qt_dictionary_iterator_next(it)) {
+            uintptr_t const k = (uintptr_t)qt_dictionary_iterator_get(it)->key;
+
+            assert(k >= 1 && k <= 2 * NUM_KEYS);
+            assert(!seen[k]);
+            seen[k] = 1;
+            no_entries++;
+            if (next_key <= 2 * NUM_KEYS) {
+                void *nk = (void *)next_key++;
+                assert(qt_dictionary_put_if_absent(big, nk, nk) == nk);
+            }
+        }
+        qt_dictionary_iterator_destroy(it);
+        for (i = 1; i <= NUM_KEYS; i++) {
+            assert(seen[i]);
+        }
+        iprintf("23. Iterated over %d entries while inserting %lu more\n",
+                no_entries, (unsigned long)(next_key - NUM_KEYS - 1));
+        free(seen);
+    }
+    qt_dictionary_destroy(big);
+
     return 0;
 }
 
@@ -34,6 +34,15 @@ int main(int   argc,
     }
     assert(threads == numincrs);
 
+    /* each iteration returns into its own syncvar_t / aligned_t */
+    threads = 0;
+    qt_loop_sv(0, numincrs, sum, NULL);
+    assert(threads == numincrs);
+    threads = 0;
+    qt_loop_aligned(0, numincrs, sum, NULL);
+    assert(threads == numincrs);
+    iprintf("qt_loop_sv and qt_loop_aligned ok\n");
+
     return 0;
 }
 
@@ -0,0 +1,102 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"                   /* for _GNU_SOURCE */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qloop.h>
+#include "argparsing.h"
+
+static aligned_t iterations = 0;
+static aligned_t numiters   = 100000;
+
+/* every 64th iteration is a lot more work than the rest */
+static aligned_t spin(size_t i)
+{
+    aligned_t x = i;
+
+    for (size_t j = ((i % 64) == 0) ? 10000 : 10; j > 0; j--) {
+        x = x * 1103515245 + 12345;
+    }
+    return x;
+}
+
+static void count(const size_t startat,
+                  const size_t stopat,
+                  void        *arg_)
+{
+    aligned_t junk = 0;
+
+    for (size_t i = startat; i < stopat; i++) {
+        junk += spin(i);
+    }
+    qthread_incr(&iterations, (stopat - startat) + (junk & 0));
+}
+
+static void sum(const size_t startat,
+                const size_t stopat,
+                void        *arg_,
+                void        *ret)
+{
+    aligned_t total = 0;
+
+    for (size_t i = startat; i < stopat; i++) {
+        total += i;
+    }
+    *(aligned_t *)ret = total;
+}
+
+/* the range each call covered; combining two only works if they are
+ * adjacent, in order */
+typedef struct {
+    size_t first, last;
+} span_t;
+
+static void span(const size_t startat,
+                 const size_t stopat,
+                 void        *arg_,
+                 void        *ret)
+{
+    ((span_t *)ret)->first = startat;
+    ((span_t *)ret)->last  = stopat;
+}
+
+static void span_acc(void *restrict       a,
+                     const void *restrict b)
+{
+    assert(((span_t *)a)->last == ((const span_t *)b)->first);
+    ((span_t *)a)->last = ((const span_t *)b)->last;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t total = 0;
+    span_t    s     = { 0, 0 };
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+    NUMARG(numiters, "NUM_ITERS");
+    iprintf("%i shepherds\n", qthread_num_shepherds());
+    iprintf("%i threads\n", qthread_num_workers());
+
+    qt_loop_lbs(0, numiters, count, NULL);
+    iprintf("%lu iterations\n", (unsigned long)iterations);
+    assert(iterations == numiters);
+
+    qt_loopaccum_lbs(0, numiters, sizeof(aligned_t), &total, sum, NULL, qt_uint_add_acc);
+    iprintf("sum %lu\n", (unsigned long)total);
+    assert(total == numiters * (numiters - 1) / 2);
+
+    qt_loopaccum_lbs(3, numiters, sizeof(span_t), &s, span, NULL, span_acc);
+    iprintf("span [%lu, %lu)\n", (unsigned long)s.first, (unsigned long)s.last);
+    assert(s.first == 3 && s.last == numiters);
+
+    /* nothing to do */
+    qt_loop_lbs(5, 5, count, NULL);
+    assert(iterations == numiters);
+
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,156 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"                   /* for _GNU_SOURCE */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <qthread/qloop.h>
+#include "argparsing.h"
+
+#define NKEYS 17
+
+static aligned_t numiters = 100000;
+
+/* a range of indices; combining two only works if they are in order */
+typedef struct {
+    size_t first, last;
+} span_t;
+
+static const span_t no_span = { SIZE_MAX, 0 };
+
+static void span_acc(void *restrict       a,
+                     const void *restrict b)
+{
+    span_t *const       x = (span_t *)a;
+    const span_t *const y = (const span_t *)b;
+
+    if (x->first == SIZE_MAX) {
+        *x = *y;
+    } else if (y->first != SIZE_MAX) {
+        assert(x->last < y->first);
+        x->last = y->last;
+    }
+}
+
+static int multiple_of_three(const void *elem,
+                             void       *arg)
+{
+    return (*(const aligned_t *)elem % 3) == 0;
+}
+
+static int odd_span(const void *elem,
+                    void       *arg)
+{
+    return ((const span_t *)elem)->first & 1;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t *in, *out;
+    double    *din, *dout;
+    span_t    *sin, *sout;
+    size_t    *keys;
+    aligned_t  sums[NKEYS], counts[NKEYS];
+    span_t     spans[NKEYS];
+    size_t     kept;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+    NUMARG(numiters, "NUM_ITERS");
+    iprintf("%i shepherds\n", qthread_num_shepherds());
+    iprintf("%i threads\n", qthread_num_workers());
+
+    in   = malloc(numiters * sizeof(aligned_t));
+    out  = malloc(numiters * sizeof(aligned_t));
+    din  = malloc(numiters * sizeof(double));
+    dout = malloc(numiters * sizeof(double));
+    sin  = malloc(numiters * sizeof(span_t));
+    sout = malloc(numiters * sizeof(span_t));
+    keys = malloc(numiters * sizeof(size_t));
+    assert(in && out && din && dout && sin && sout && keys);
+    for (size_t i = 0; i < numiters; i++) {
+        in[i]        = i;
+        din[i]       = (double)(i & 7);
+        sin[i].first = sin[i].last = i;
+        keys[i]      = i % NKEYS;
+    }
+
+    qt_uint_prefix_sum(in, out, numiters, QT_SCAN_INCLUSIVE);
+    for (size_t i = 0; i < numiters; i++) {
+        assert(out[i] == i * (i + 1) / 2);
+    }
+    qt_uint_prefix_sum(in, out, numiters, QT_SCAN_EXCLUSIVE);
+    for (size_t i = 0; i < numiters; i++) {
+        assert(out[i] == i * (i - 1) / 2);
+    }
+    iprintf("uint prefix sums ok\n");
+
+    qt_double_prefix_sum(din, dout, numiters, QT_SCAN_INCLUSIVE);
+    {
+        double run = 0;
+        for (size_t i = 0; i < numiters; i++) {
+            run += din[i];
+            assert(dout[i] == run);
+        }
+    }
+    /* in place */
+    qt_double_prefix_sum(din, din, numiters, QT_SCAN_EXCLUSIVE);
+    assert(din[0] == 0 && (numiters < 2 || din[numiters - 1] == dout[numiters - 2]));
+    iprintf("double prefix sums ok\n");
+
+    qt_loop_scan(sin, sout, numiters, sizeof(span_t), span_acc, NULL, QT_SCAN_INCLUSIVE);
+    for (size_t i = 0; i < numiters; i++) {
+        assert(sout[i].first == 0 && sout[i].last == i);
+    }
+    qt_loop_scan(sin, sout, numiters, sizeof(span_t), span_acc, &no_span, QT_SCAN_EXCLUSIVE);
+    assert(sout[0].first == SIZE_MAX);
+    for (size_t i = 1; i < numiters; i++) {
+        assert(sout[i].first == 0 && sout[i].last == i - 1);
+    }
+    iprintf("generic scans ok\n");
+
+    qt_uint_sum_by_key(keys, in, numiters, sums, NKEYS);
+    qt_uint_sum_by_key(keys, NULL, numiters, counts, NKEYS);
+    qt_loop_reduce_by_key(keys, sin, numiters, sizeof(span_t), spans, NKEYS, span_acc, &no_span);
+    for (size_t k = 0; k < NKEYS; k++) {
+        aligned_t sum = 0, n = 0;
+
+        for (size_t i = k; i < numiters; i += NKEYS) {
+            sum += i;
+            n++;
+        }
+        iprintf("key %lu: %lu items, sum %lu\n", (unsigned long)k, (unsigned long)n, (unsigned long)sum);
+        assert(sums[k] == sum && counts[k] == n);
+        assert(n == 0 || (spans[k].first == k && spans[k].last == k + (n - 1) * NKEYS));
+    }
+    iprintf("reductions by key ok\n");
+
+    kept = qt_loop_filter(in, out, numiters, sizeof(aligned_t), multiple_of_three, NULL);
+    assert(kept == (numiters + 2) / 3);
+    for (size_t i = 0; i < kept; i++) {
+        assert(out[i] == i * 3);
+    }
+    kept = qt_loop_filter(sin, sout, numiters, sizeof(span_t), odd_span, NULL);
+    assert(kept == numiters / 2);
+    for (size_t i = 0; i < kept; i++) {
+        assert(sout[i].first == i * 2 + 1);
+    }
+    iprintf("filters ok\n");
+
+    /* nothing to do */
+    assert(qt_loop_filter(in, out, 0, sizeof(aligned_t), multiple_of_three, NULL) == 0);
+    qt_uint_prefix_sum(in, out, 0, QT_SCAN_INCLUSIVE);
+
+    free(in);
+    free(out);
+    free(din);
+    free(dout);
+    free(sin);
+    free(sout);
+    free(keys);
+    return 0;
+}
+
+/* vim:set expandtab */
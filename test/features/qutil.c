@@ -29,15 +29,21 @@ static Q_UNUSED int dcmp(const void *a,
 
 aligned_t *ui_array;
 aligned_t  ui_out, ui_sum_authoritative = 0, ui_mult_authoritative =
-    1, ui_max_authoritative = 0, ui_min_authoritative = UINT_MAX;
+    1, ui_max_authoritative = 0, ui_min_authoritative = UINT_MAX,
+    ui_sumsq_authoritative = 0;
+size_t      ui_argmax_authoritative = 0, ui_argmin_authoritative = 0;
 size_t      ui_len          = 1000000;
 saligned_t *i_array;
 saligned_t  i_out, i_sum_authoritative = 0, i_mult_authoritative =
-    1, i_max_authoritative = INT_MIN, i_min_authoritative = INT_MAX;
+    1, i_max_authoritative = INT_MIN, i_min_authoritative = INT_MAX,
+    i_sumsq_authoritative = 0;
+size_t  i_argmax_authoritative = 0, i_argmin_authoritative = 0;
 size_t  i_len              = 1000000;
 double *d_array;
 double  d_out, d_sum_authoritative = 0.0, d_mult_authoritative =
-    1.0, d_max_authoritative = DBL_MIN, d_min_authoritative = DBL_MAX;
+    1.0, d_max_authoritative = DBL_MIN, d_min_authoritative = DBL_MAX,
+    d_sumsq_authoritative = 0.0;
+size_t         d_argmax_authoritative = 0, d_argmin_authoritative = 0;
 size_t         d_len         = 1000000;
 struct timeval start, stop;
 
@@ -51,11 +57,14 @@ static aligned_t qmain(void *junk)
         ui_array[i]            = random();
         ui_sum_authoritative  += ui_array[i];
         ui_mult_authoritative *= ui_array[i];
+        ui_sumsq_authoritative += ui_array[i] * ui_array[i];
         if (ui_max_authoritative < ui_array[i]) {
-            ui_max_authoritative = ui_array[i];
+            ui_max_authoritative    = ui_array[i];
+            ui_argmax_authoritative = i;
         }
         if (ui_min_authoritative > ui_array[i]) {
-            ui_min_authoritative = ui_array[i];
+            ui_min_authoritative    = ui_array[i];
+            ui_argmin_authoritative = i;
         }
     }
     iprintf("ui_array generated, calculating sum in parallel..\n");
@@ -71,6 +80,13 @@ static aligned_t qmain(void *junk)
     ui_out = qutil_uint_min(ui_array, ui_len, 0);
     assert(ui_out == ui_min_authoritative);
     iprintf(" - qutil_uint_min is correct\n");
+    ui_out = qutil_uint_sumsq(ui_array, ui_len, 0);
+    assert(ui_out == ui_sumsq_authoritative);
+    iprintf(" - qutil_uint_sumsq is correct\n");
+    assert(qutil_uint_argmax(ui_array, ui_len, 0) == ui_argmax_authoritative);
+    iprintf(" - qutil_uint_argmax is correct\n");
+    assert(qutil_uint_argmin(ui_array, ui_len, 0) == ui_argmin_authoritative);
+    iprintf(" - qutil_uint_argmin is correct\n");
     gettimeofday(&start, NULL);
     qutil_aligned_qsort(ui_array, ui_len);
     gettimeofday(&stop, NULL);
@@ -105,11 +121,14 @@ static aligned_t qmain(void *junk)
         i_array[i]            = random();
         i_sum_authoritative  += i_array[i];
         i_mult_authoritative *= i_array[i];
+        i_sumsq_authoritative += i_array[i] * i_array[i];
         if (i_max_authoritative < i_array[i]) {
-            i_max_authoritative = i_array[i];
+            i_max_authoritative    = i_array[i];
+            i_argmax_authoritative = i;
         }
         if (i_min_authoritative > i_array[i]) {
-            i_min_authoritative = i_array[i];
+            i_min_authoritative    = i_array[i];
+            i_argmin_authoritative = i;
         }
     }
     iprintf("i_array generated...\n");
@@ -124,8 +143,12 @@ static aligned_t qmain(void *junk)
     iprintf(" - qutil_int_max is correct\n");
     i_out = qutil_int_min(i_array, i_len, 0);
     assert(i_out == i_min_authoritative);
+    i_out = qutil_int_sumsq(i_array, i_len, 0);
+    assert(i_out == i_sumsq_authoritative);
+    assert(qutil_int_argmax(i_array, i_len, 0) == i_argmax_authoritative);
+    assert(qutil_int_argmin(i_array, i_len, 0) == i_argmin_authoritative);
     free(i_array);
-    iprintf(" - qutil_int_min is correct\n");
+    iprintf(" - qutil_int_min, sumsq, argmax and argmin are correct\n");
 
     d_array = (double *)calloc(d_len, sizeof(double));
     assert(d_array != NULL);
@@ -134,11 +157,14 @@ static aligned_t qmain(void *junk)
 
         d_sum_authoritative  += d_array[i];
         d_mult_authoritative *= d_array[i];
+        d_sumsq_authoritative += d_array[i] * d_array[i];
         if (d_max_authoritative < d_array[i]) {
-            d_max_authoritative = d_array[i];
+            d_max_authoritative    = d_array[i];
+            d_argmax_authoritative = i;
         }
         if (d_min_authoritative > d_array[i]) {
-            d_min_authoritative = d_array[i];
+            d_min_authoritative    = d_array[i];
+            d_argmin_authoritative = i;
         }
     }
     iprintf("d_array generated...\n");
@@ -168,6 +194,18 @@ static aligned_t qmain(void *junk)
     d_out = qutil_double_min(d_array, d_len, 0);
     assert(d_out == d_min_authoritative);
     iprintf(" - qutil_double_min is correct\n");
+    d_out = qutil_double_sumsq(d_array, d_len, 0);
+    if (fabs(d_out - d_sumsq_authoritative) >
+        (fabs(d_out + d_sumsq_authoritative) * FLT_EPSILON)) {
+        printf("unexpectedly large sumsq delta: %g (EPSILON = %g)\n",
+               fabs(d_out - d_sumsq_authoritative),
+               (fabs(d_out + d_sumsq_authoritative) * FLT_EPSILON));
+    }
+    iprintf(" - qutil_double_sumsq is correct\n");
+    assert(qutil_double_argmax(d_array, d_len, 0) == d_argmax_authoritative);
+    iprintf(" - qutil_double_argmax is correct\n");
+    assert(qutil_double_argmin(d_array, d_len, 0) == d_argmin_authoritative);
+    iprintf(" - qutil_double_argmin is correct\n");
     /*qutil_mergesort(d_array, d_len, 0);
      * for (i = 0; i < d_len-1; i++) {
      * if (d_array[i] > d_array[i+1]) {